@@ -42,6 +42,13 @@
 #include "meta_data_lists/dl_intercept_lists.h"
 #include "wrapper_utils.h"
 #include "overflow_error.h"
+#include "launch_worker.h"
+#include "deferred_check.h"
+#include "overhead_governor.h"
+#include "canary_budget.h"
+#include "canary_policy.h"
+#include "checker_scratch.h"
+#include "checker_registry.h"
 
 #include "dl_interceptor_internal.h"
 #include "cl_interceptor_internal.h"
@@ -91,6 +98,12 @@ uint64_t current_overhead_mem = 0;
 
 CL_INTERCEPTOR_FUNCTION(GetDeviceInfo);
 
+/* Context APIs */
+CL_INTERCEPTOR_FUNCTION(CreateContext);
+CL_INTERCEPTOR_FUNCTION(CreateContextFromType);
+CL_INTERCEPTOR_FUNCTION(RetainContext);
+CL_INTERCEPTOR_FUNCTION(ReleaseContext);
+
 /* Command Queue APIs */
 CL_INTERCEPTOR_FUNCTION(CreateCommandQueue);
 #ifdef CL_VERSION_2_0
@@ -112,6 +125,7 @@ CL_INTERCEPTOR_FUNCTION(CreateImage3D);
 CL_INTERCEPTOR_FUNCTION(RetainMemObject);
 CL_INTERCEPTOR_FUNCTION(ReleaseMemObject);
 CL_INTERCEPTOR_FUNCTION(EnqueueMapBuffer);
+CL_INTERCEPTOR_FUNCTION(EnqueueMapImage);
 CL_INTERCEPTOR_FUNCTION(EnqueueUnmapMemObject);
 
 /* SVM APIs */
@@ -126,6 +140,9 @@ CL_INTERCEPTOR_FUNCTION(EnqueueSVMUnmap);
 #endif
 
 /* Kernel APIs */
+#ifdef CL_VERSION_2_1
+CL_INTERCEPTOR_FUNCTION(CloneKernel);
+#endif
 CL_INTERCEPTOR_FUNCTION(RetainKernel);
 CL_INTERCEPTOR_FUNCTION(ReleaseKernel);
 CL_INTERCEPTOR_FUNCTION(EnqueueNDRangeKernel);
@@ -136,13 +153,18 @@ CL_INTERCEPTOR_FUNCTION(EnqueueNativeKernel);
 CL_INTERCEPTOR_FUNCTION(SetKernelArg);
 #ifdef CL_VERSION_2_0
 CL_INTERCEPTOR_FUNCTION(SetKernelArgSVMPointer);
+CL_INTERCEPTOR_FUNCTION(SetKernelExecInfo);
 #endif
 
 /* Event APIs */
+CL_INTERCEPTOR_FUNCTION(WaitForEvents);
 CL_INTERCEPTOR_FUNCTION(GetEventProfilingInfo);
 CL_INTERCEPTOR_FUNCTION(RetainEvent);
 CL_INTERCEPTOR_FUNCTION(ReleaseEvent);
 
+/* Flush and Finish APIs */
+CL_INTERCEPTOR_FUNCTION(Finish);
+
 /* Enqueued Commands APIs */
 CL_INTERCEPTOR_FUNCTION(EnqueueReadBuffer);
 CL_INTERCEPTOR_FUNCTION(EnqueueReadBufferRect);
@@ -177,6 +199,10 @@ static int cl_function_addresses( void* oclDllHandle )
 #pragma GCC diagnostic ignored "-Wpedantic"
 #endif
     CL_INTERCEPTOR_FUNCTION_ADDRESS( GetDeviceInfo );
+    CL_INTERCEPTOR_FUNCTION_ADDRESS( CreateContext );
+    CL_INTERCEPTOR_FUNCTION_ADDRESS( CreateContextFromType );
+    CL_INTERCEPTOR_FUNCTION_ADDRESS( RetainContext );
+    CL_INTERCEPTOR_FUNCTION_ADDRESS( ReleaseContext );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( CreateCommandQueue );
 #ifdef CL_VERSION_2_0
     CL_INTERCEPTOR_FUNCTION_ADDRESS( CreateCommandQueueWithProperties );
@@ -197,6 +223,7 @@ static int cl_function_addresses( void* oclDllHandle )
     CL_INTERCEPTOR_FUNCTION_ADDRESS( RetainMemObject );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( ReleaseMemObject );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( EnqueueMapBuffer );
+    CL_INTERCEPTOR_FUNCTION_ADDRESS( EnqueueMapImage );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( EnqueueUnmapMemObject );
 
 #ifdef CL_VERSION_2_0
@@ -210,6 +237,9 @@ static int cl_function_addresses( void* oclDllHandle )
 #endif
 
     /* Kernel Object APIs */
+#ifdef CL_VERSION_2_1
+    CL_INTERCEPTOR_FUNCTION_ADDRESS( CloneKernel );
+#endif
     CL_INTERCEPTOR_FUNCTION_ADDRESS( RetainKernel );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( ReleaseKernel );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( EnqueueNDRangeKernel );
@@ -219,12 +249,17 @@ static int cl_function_addresses( void* oclDllHandle )
     CL_INTERCEPTOR_FUNCTION_ADDRESS( SetKernelArg);
 #ifdef CL_VERSION_2_0
     CL_INTERCEPTOR_FUNCTION_ADDRESS( SetKernelArgSVMPointer );
+    CL_INTERCEPTOR_FUNCTION_ADDRESS( SetKernelExecInfo );
 #endif
     /* Event APIs */
+    CL_INTERCEPTOR_FUNCTION_ADDRESS( WaitForEvents );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( GetEventProfilingInfo );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( RetainEvent );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( ReleaseEvent );
 
+    /* Flush and Finish APIs */
+    CL_INTERCEPTOR_FUNCTION_ADDRESS( Finish );
+
     /* Enqueued Commands APIs */
     CL_INTERCEPTOR_FUNCTION_ADDRESS( EnqueueReadBuffer );
     CL_INTERCEPTOR_FUNCTION_ADDRESS( EnqueueReadBufferRect );
@@ -262,6 +297,36 @@ void init_perf_outfile(void)
     {
         fprintf(perf_out_f, "total_user_mem_B, total_overhead_mem_B, high_user_mem_B, high_overhead_mem_B\n");
     }
+    else if(global_tool_stats_flags & STATS_KERNEL_POOL)
+    {
+        fprintf(perf_out_f, "pool_hits, pool_misses, idle_kernels, high_in_use_kernels\n");
+    }
+    else if(global_tool_stats_flags & STATS_SVM_POOL)
+    {
+        fprintf(perf_out_f, "svm_pool_hits, svm_pool_misses, svm_pool_trimmed, pooled_B, high_pooled_B\n");
+    }
+    fclose(perf_out_f);
+}
+
+void write_out_kernel_pool_stats(void)
+{
+    FILE *perf_out_f;
+    kernel_pool_stats stats;
+    kpool_get_stats(&stats);
+    perf_out_f = fopen(global_tool_stats_outfile, "w");
+    fprintf(perf_out_f, "pool_hits, pool_misses, idle_kernels, high_in_use_kernels\n");
+    fprintf(perf_out_f, "%lu, %lu, %lu, %lu\n", stats.hits, stats.misses, stats.idle, stats.high_in_use);
+    fclose(perf_out_f);
+}
+
+void write_out_svm_pool_stats(void)
+{
+    FILE *perf_out_f;
+    svm_pool_stats stats;
+    svm_pool_get_stats(&stats);
+    perf_out_f = fopen(global_tool_stats_outfile, "w");
+    fprintf(perf_out_f, "svm_pool_hits, svm_pool_misses, svm_pool_trimmed, pooled_B, high_pooled_B\n");
+    fprintf(perf_out_f, "%lu, %lu, %lu, %lu, %lu\n", stats.hits, stats.misses, stats.trimmed, stats.pooled_bytes, stats.high_pooled_bytes);
     fclose(perf_out_f);
 }
 
@@ -375,6 +440,32 @@ clGetDeviceInfo(cl_device_id device,
     return(ret);
 }
 
+/*
+ * run the deferred canary checks that an application synchronization point
+ * depends on
+ * checks the windows of command_queue if it is set, else those that used
+ * handle if it is set, else all of them
+ * calls made by the detector itself are not synchronization points
+ */
+static void runDeferredChecks(cl_command_queue command_queue, void *handle)
+{
+    if(internal_create || !get_deferred_check_envvar())
+        return;
+
+    internal_create = 1;
+    allowCanaryAccess();
+
+    if(command_queue)
+        check_window_flush(command_queue);
+    else if(handle)
+        check_window_flush_object(handle);
+    else
+        check_window_flush_all();
+
+    disallowCanaryAccess();
+    internal_create = 0;
+}
+
 __attribute__((constructor)) static void wrapper_constructor ( void )
 {
     cl_wrapper_init();
@@ -382,13 +473,234 @@ __attribute__((constructor)) static void wrapper_constructor ( void )
 
 __attribute__((destructor)) static void cl__destructor ( void )
 {
+    // Report anything still being checked in the background.
+    launch_worker_drain_all();
+    runDeferredChecks(NULL, NULL);
+
     if(global_tool_stats_flags & STATS_MEM_OVERHEAD)
         write_out_mem_perf_stats();
+    else if(global_tool_stats_flags & STATS_KERNEL_POOL)
+        write_out_kernel_pool_stats();
+    else if(global_tool_stats_flags & STATS_SVM_POOL)
+        write_out_svm_pool_stats();
 
     finalize_detector();
 }
 
 
+/* Context APIs */
+
+/*
+ * the slab that small buffers of a context are currently packed into
+ * slabs that are full are only kept alive by their buffers' sub-buffers
+ */
+typedef struct buffer_slab_
+{
+    cl_context context;
+    cl_mem slab;
+    size_t used;
+    // length of the back canary at the end of the slab
+    size_t tail;
+    // completes once that back canary has been filled
+    cl_event tail_filled;
+    struct buffer_slab_ *next;
+} buffer_slab;
+
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static buffer_slab *open_slabs = NULL;
+
+static void retireContextSlab(cl_context context)
+{
+    pthread_mutex_lock(&slab_lock);
+    buffer_slab **s = &open_slabs;
+    while(*s != NULL && (*s)->context != context)
+        s = &(*s)->next;
+    if(*s != NULL)
+    {
+        buffer_slab *done = *s;
+        *s = done->next;
+        if(done->slab != NULL)
+            ReleaseMemObject(done->slab);
+        if(done->tail_filled != NULL)
+            ReleaseEvent(done->tail_filled);
+        free(done);
+    }
+    pthread_mutex_unlock(&slab_lock);
+}
+
+// The detector's own objects (slabs, scratch memory, checker programs and
+// the cached command queue) retain the context, so CL_CONTEXT_REFERENCE_COUNT
+// never drops to 1 while they exist. Count the application's references
+// instead so we know which clReleaseContext is its last.
+typedef struct context_refs_ {
+    cl_context context;
+    cl_uint app_refs;
+    struct context_refs_ *next;
+} context_refs;
+
+static pthread_mutex_t context_refs_lock = PTHREAD_MUTEX_INITIALIZER;
+static context_refs *app_contexts = NULL;
+
+static void addAppContextRef(cl_context context)
+{
+    pthread_mutex_lock(&context_refs_lock);
+    context_refs *c = app_contexts;
+    while(c != NULL && c->context != context)
+        c = c->next;
+    if(c == NULL)
+    {
+        c = calloc(1, sizeof(context_refs));
+        if(c == NULL)
+        {
+            det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        c->context = context;
+        c->next = app_contexts;
+        app_contexts = c;
+    }
+    c->app_refs++;
+    pthread_mutex_unlock(&context_refs_lock);
+}
+
+// Returns 1 if this drops the application's last reference to the context.
+static int dropAppContextRef(cl_context context)
+{
+    int last = 0;
+    pthread_mutex_lock(&context_refs_lock);
+    context_refs **c = &app_contexts;
+    while(*c != NULL && (*c)->context != context)
+        c = &(*c)->next;
+    if(*c != NULL)
+    {
+        if(--(*c)->app_refs == 0)
+        {
+            context_refs *done = *c;
+            *c = done->next;
+            free(done);
+            last = 1;
+        }
+    }
+    else
+    {
+        // A context we did not see being created. Fall back to the
+        // runtime's count, which is exact when we hold nothing on it.
+        cl_uint refs = 0;
+        cl_int cl_err = clGetContextInfo(context, CL_CONTEXT_REFERENCE_COUNT,
+                sizeof(cl_uint), &refs, NULL);
+        last = (cl_err == CL_SUCCESS && refs == 1);
+    }
+    pthread_mutex_unlock(&context_refs_lock);
+    return last;
+}
+
+    CL_API_ENTRY cl_context CL_API_CALL
+clCreateContext(const cl_context_properties *properties,
+        cl_uint num_devices,
+        const cl_device_id *devices,
+        void (CL_CALLBACK *pfn_notify)(const char *errinfo,
+            const void *private_info, size_t cb, void *user_data),
+        void *user_data,
+        cl_int *errcode_ret)
+{
+    cl_context ret = NULL;
+    if ( CreateContext )
+    {
+        ret = CreateContext(properties, num_devices, devices, pfn_notify,
+                user_data, errcode_ret);
+        if(ret != NULL)
+            addAppContextRef(ret);
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return ret;
+}
+
+    CL_API_ENTRY cl_context CL_API_CALL
+clCreateContextFromType(const cl_context_properties *properties,
+        cl_device_type device_type,
+        void (CL_CALLBACK *pfn_notify)(const char *errinfo,
+            const void *private_info, size_t cb, void *user_data),
+        void *user_data,
+        cl_int *errcode_ret)
+{
+    cl_context ret = NULL;
+    if ( CreateContextFromType )
+    {
+        ret = CreateContextFromType(properties, device_type, pfn_notify,
+                user_data, errcode_ret);
+        if(ret != NULL)
+            addAppContextRef(ret);
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return ret;
+}
+
+    CL_API_ENTRY cl_int CL_API_CALL
+clRetainContext(cl_context context)
+{
+    cl_int ret = CL_INVALID_CONTEXT;
+    if ( RetainContext )
+    {
+        ret = RetainContext(context);
+        if(ret == CL_SUCCESS)
+            addAppContextRef(context);
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return ret;
+}
+
+    CL_API_ENTRY cl_int CL_API_CALL
+clReleaseContext(cl_context context)
+{
+    cl_int ret = CL_INVALID_CONTEXT;
+    if ( ReleaseContext )
+    {
+        initialize_logging();
+
+        // Only tear down what we keep for the context on the application's
+        // last release; earlier releases leave it alive for further use.
+        int last_ref = dropAppContextRef(context);
+
+        // The open slab holds a reference to the context.
+        if(last_ref)
+            retireContextSlab(context);
+
+        // So do idle checker scratch memory and built checker kernels.
+        if(last_ref)
+        {
+            scratch_release_context(context);
+            checker_registry_release_context(context);
+        }
+
+#ifdef CL_VERSION_2_0
+        // Pooled SVM must be freed while its context is still around.
+        if (last_ref)
+        {
+            void *pooled;
+            while ((pooled = svm_pool_trim(context, 1)) != NULL)
+                SVMFree(context, pooled);
+        }
+#endif
+
+        ret = ReleaseContext(context);
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return ret;
+}
+
+
 /* Command Queue APIs */
     CL_API_ENTRY cl_command_queue CL_API_CALL
 clCreateCommandQueue(cl_context                     context ,
@@ -400,7 +712,7 @@ clCreateCommandQueue(cl_context                     context ,
     if ( CreateCommandQueue )
     {
         cl_command_queue_properties local_prop = properties;
-        if(global_tool_stats_flags & STATS_CHECKER_TIME)
+        if((global_tool_stats_flags & STATS_CHECKER_TIME) || governor_enabled())
         {
             local_prop |= CL_QUEUE_PROFILING_ENABLE;
         }
@@ -448,7 +760,7 @@ clCreateCommandQueueWithProperties(
     {
         const cl_queue_properties* updated_prop = properties;
         cl_queue_properties* temp_prop = 0;
-        if(global_tool_stats_flags & STATS_CHECKER_TIME)
+        if((global_tool_stats_flags & STATS_CHECKER_TIME) || governor_enabled())
         {
             temp_prop = add_profiling(properties);
             if (temp_prop != NULL)
@@ -481,7 +793,7 @@ clCreateCommandQueueWithProperties(
                 *errcode_ret = CL_INVALID_COMMAND_QUEUE;
         }
 
-        if(global_tool_stats_flags & STATS_CHECKER_TIME)
+        if((global_tool_stats_flags & STATS_CHECKER_TIME) || governor_enabled())
         {
             free(temp_prop);
         }
@@ -545,6 +857,8 @@ clReleaseCommandQueue(cl_command_queue command_queue )
     {
         if (command_queue)
         {
+            runDeferredChecks(command_queue, NULL);
+
             // Purposefully leak command queues in detector. We currently do this
             // because the AMD APP SDK OpenCL runtime has a memory corruption
             // error that happens somewhere inside clReleaseCommandQueue(). We
@@ -640,17 +954,428 @@ clGetMemObjectInfo(cl_mem memobj,
                 }
                 else
                 {
-                    *p_val = m1->size;
+                    *p_val = m1->size;
+                }
+            }
+        }
+
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return(ret);
+}
+
+/*
+ * Vendor specific handling of the allocations that padded buffers live in.
+ */
+typedef struct alloc_backend_
+{
+    /*
+     * Make a new allocation resident as one piece, so that overflows of the
+     * sub-buffers in it spill into canaries in the same memory. Commands the
+     * detector enqueues on the allocation itself already do this, so it is
+     * only needed when just its sub-buffers are used. NULL if the vendor
+     * places sub-buffers with their parent anyway.
+     * evt is the event of the command that places the allocation.
+     */
+    void (*place)(cl_command_queue queue, cl_mem parent, cl_event *evt);
+} alloc_backend;
+
+/*
+ * free host memory that a command used, once the command has completed
+ */
+static void freeCommandScratch(cl_event event, cl_int status, void *scratch)
+{
+    (void)event;
+    (void)status;
+    free(scratch);
+}
+
+/*
+ * NVIDIA allocates all of a buffer the first time a command uses it, so one
+ * word of it is read into a scratch word that is freed once the read is done.
+ */
+static void placeNvidia(cl_command_queue queue, cl_mem parent, cl_event *evt)
+{
+    cl_int cl_err;
+    uint32_t *scratch = malloc(sizeof(uint32_t));
+    if(scratch == NULL)
+    {
+        det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = EnqueueReadBuffer(queue, parent, CL_NON_BLOCKING, 0,
+            sizeof(uint32_t), scratch, 0, NULL, evt);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetEventCallback(*evt, CL_COMPLETE, freeCommandScratch,
+            scratch);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+}
+
+static const alloc_backend default_backend = { NULL };
+static const alloc_backend nvidia_backend = { placeNvidia };
+
+// backend of the context that was last looked up
+static pthread_mutex_t backend_lock = PTHREAD_MUTEX_INITIALIZER;
+static cl_context backend_context = NULL;
+static const alloc_backend *backend_cached = NULL;
+
+static const alloc_backend* getAllocBackend(cl_context context)
+{
+    const alloc_backend *ret;
+
+    pthread_mutex_lock(&backend_lock);
+    if(context == backend_context)
+    {
+        ret = backend_cached;
+        pthread_mutex_unlock(&backend_lock);
+        return ret;
+    }
+    pthread_mutex_unlock(&backend_lock);
+
+    ret = is_nvidia_platform(context) ? &nvidia_backend : &default_backend;
+
+    pthread_mutex_lock(&backend_lock);
+    backend_context = context;
+    backend_cached = ret;
+    pthread_mutex_unlock(&backend_lock);
+    return ret;
+}
+
+/*
+ * fill the canaries of a new padded buffer and upload the user's data into
+ * the region between them, without staging the whole buffer on the host
+ * the data starts at offset, fill gives the canary bytes to poison on each
+ * side of it
+ * new_parent is the allocation main_buff was just made in, if main_buff is
+ * a sub-buffer of one, and is placed first
+ * returns once the commands are enqueued, or once host_ptr is uploaded if
+ * there is one, since the application may reuse it right away
+ * ready is the event of the last command. The context's internal queue runs
+ * them in order, so the buffer is initialized once ready completes.
+ */
+static void initPaddedBuffer(cl_context context, cl_mem new_parent,
+        cl_mem main_buff, size_t offset, size_t size,
+        const canary_geometry *fill, const void *host_ptr, cl_event *ready)
+{
+    cl_int cl_err;
+    cl_command_queue command_queue;
+    cl_event place_event = NULL;
+
+    if(getCommandQueueForContext(context, &command_queue))
+        clRetainCommandQueue(command_queue);
+
+    const alloc_backend *backend = getAllocBackend(context);
+    if(new_parent != NULL && backend->place != NULL)
+        backend->place(command_queue, new_parent, &place_event);
+
+#ifndef CL_VERSION_1_2
+    uint32_t poison_len = (fill->front > fill->back) ? fill->front : fill->back;
+    char *poison_data = malloc(poison_len);
+    if(poison_data == NULL)
+    {
+        det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    memset(poison_data, POISON_FILL, poison_len);
+#endif
+
+    if(fill->front > 0)
+    {
+#ifdef CL_VERSION_1_2
+        cl_err = EnqueueFillBuffer(command_queue, main_buff, &poisonFill_8b,
+                sizeof(uint8_t), offset - fill->front, fill->front, 0, NULL,
+                NULL);
+#else
+        cl_err = EnqueueWriteBuffer(command_queue, main_buff, CL_NON_BLOCKING,
+                offset - fill->front, fill->front, poison_data, 0, NULL,
+                NULL);
+#endif
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+
+    if(host_ptr)
+    {
+        cl_err = EnqueueWriteBuffer(command_queue, main_buff, CL_BLOCKING,
+                offset, size, host_ptr, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+    offset += size;
+
+#ifdef CL_VERSION_1_2
+    cl_err = EnqueueFillBuffer(command_queue, main_buff, &poisonFill_8b,
+            sizeof(uint8_t), offset, fill->back, 0, NULL, ready);
+#else
+    cl_err = EnqueueWriteBuffer(command_queue, main_buff, CL_NON_BLOCKING,
+            offset, fill->back, poison_data, 0, NULL, ready);
+#endif
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+#ifndef CL_VERSION_1_2
+    cl_err = clSetEventCallback(*ready, CL_COMPLETE, freeCommandScratch,
+            poison_data);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+#endif
+    if(place_event != NULL)
+        ReleaseEvent(place_event);
+
+    // Commands on the application's queues will wait for ready.
+    clFlush(command_queue);
+    clReleaseCommandQueue(command_queue);
+}
+
+/*
+ * device memory spent on the canaries of a buffer
+ * buffers in a slab share their front canary with the buffer before them
+ */
+static size_t canaryOverhead(cl_mem slab, const canary_geometry *geom)
+{
+    if(slab != NULL)
+        return geom->back;
+    return geom->front + geom->back;
+}
+
+static size_t roundUpTo(size_t len, size_t align)
+{
+    return ((len + align - 1) / align) * align;
+}
+
+/*
+ * Pack a small buffer into its context's open slab, between the canary left
+ * by the previous buffer and a new one, which the next buffer will use as
+ * its front canary. A new slab is opened when the buffer does not fit.
+ * Returns the buffer the application sees, or NULL to pad it alone.
+ *
+ * geom is given the lengths of the buffer's canaries, and window is the
+ * sub-buffer holding them and the buffer. Both origins respect the
+ * sub-buffer alignment of the context's devices. ready completes once the
+ * buffer is initialized, see initPaddedBuffer().
+ */
+static cl_mem createSlabBuffer(cl_context context, cl_mem_flags sub_flags,
+        size_t size, const void *upload_ptr, canary_geometry *geom,
+        cl_mem *window, cl_mem *slab, size_t *slab_offset, cl_event *ready)
+{
+    cl_int cl_err;
+    size_t align = getSubBufferAlignment(context);
+    if(align < sizeof(uint32_t))
+        align = sizeof(uint32_t);
+
+#ifdef UNDERFLOW_CHECK
+    size_t front = roundUpTo(geom->front, align);
+#else
+    size_t front = 0;
+#endif
+    size_t back = roundUpTo(geom->back, align);
+    size_t data_len = roundUpTo(size, align);
+    if(front + data_len + back > SLAB_SIZE)
+        return NULL;
+
+    pthread_mutex_lock(&slab_lock);
+
+    buffer_slab *s = open_slabs;
+    while(s != NULL && s->context != context)
+        s = s->next;
+    if(s == NULL)
+    {
+        s = calloc(sizeof(buffer_slab), 1);
+        if(s == NULL)
+        {
+            det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        s->context = context;
+        s->next = open_slabs;
+        open_slabs = s;
+    }
+
+    // Only the part of the front canary that the previous buffer did not
+    // leave behind needs to be poisoned.
+    size_t fresh = (s->slab != NULL && front > s->tail) ? front - s->tail : 0;
+    size_t data = s->used + fresh;
+    cl_mem new_slab = NULL;
+    if(s->slab != NULL && data + data_len + back > SLAB_SIZE)
+    {
+        // Buffers in the old slab keep it alive.
+        ReleaseMemObject(s->slab);
+        s->slab = NULL;
+    }
+    if(s->slab == NULL)
+    {
+        s->slab = CreateBuffer(context, CL_MEM_READ_WRITE, SLAB_SIZE, NULL,
+                &cl_err);
+        if(s->slab == NULL)
+        {
+            pthread_mutex_unlock(&slab_lock);
+            return NULL;
+        }
+        new_slab = s->slab;
+        s->used = 0;
+        s->tail = 0;
+        fresh = front;
+        data = front;
+    }
+    size_t end = data + data_len + back;
+
+    // The fill happens after the lock is dropped. A buffer that reuses the
+    // previous one's back canary as its front canary enqueues its own fills
+    // only after that canary's fill, so that its ready event covers both.
+    cl_event prev_filled = (new_slab == NULL) ? s->tail_filled : NULL;
+    if(new_slab != NULL && s->tail_filled != NULL)
+        ReleaseEvent(s->tail_filled);
+    s->tail_filled = clCreateUserEvent(context, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_event tail_filled = s->tail_filled;
+    RetainEvent(tail_filled);
+
+    cl_buffer_region region;
+    region.origin = data - front;
+    region.size = end - region.origin;
+    *window = CreateSubBuffer(s->slab, CL_MEM_READ_WRITE,
+            CL_BUFFER_CREATE_TYPE_REGION, (void*)&region, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    region.origin = data;
+    region.size = size;
+    cl_mem ret = CreateSubBuffer(s->slab, sub_flags,
+            CL_BUFFER_CREATE_TYPE_REGION, (void*)&region, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    s->used = end;
+    s->tail = back;
+    *slab = s->slab;
+    *slab_offset = data - front;
+
+    pthread_mutex_unlock(&slab_lock);
+
+    // tail_filled is set by the host once the fills are enqueued, so this
+    // only waits for another thread, never for the device.
+    if(prev_filled != NULL)
+    {
+        cl_err = WaitForEvents(1, &prev_filled);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        ReleaseEvent(prev_filled);
+    }
+
+    canary_geometry fill;
+    fill.front = fresh;
+    fill.back = end - data - size;
+    initPaddedBuffer(context, new_slab, *window, front, size, &fill,
+            upload_ptr, ready);
+
+    cl_err = clSetUserEventStatus(tail_filled, CL_COMPLETE);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    ReleaseEvent(tail_filled);
+
+    // The checkers compare whole words, the last few bytes of the padding
+    // are still checked as the next buffer's front canary.
+    geom->front = front;
+    geom->back = fill.back & ~(sizeof(uint32_t) - 1);
+    return ret;
+}
+
+#ifdef CL_VERSION_2_0
+typedef struct svm_backing_
+{
+    cl_context context;
+    void *base;
+} svm_backing;
+
+/*
+ * free the SVM a buffer was created over once the runtime destroys it
+ */
+static void CL_CALLBACK releaseSVMBacking(cl_mem memobj, void *user_data)
+{
+    svm_backing *backing = (svm_backing*)user_data;
+    (void)memobj;
+    SVMFree(backing->context, backing->base);
+    free(backing);
+}
+
+/*
+ * whether every device of a context can use coarse-grained SVM
+ */
+static int contextHasCoarseSVM(cl_context context)
+{
+    cl_int cl_err;
+    cl_uint num_dev, i;
+    cl_device_id *devices;
+    int ret = 1;
+
+    cl_err = clGetContextInfo(context, CL_CONTEXT_NUM_DEVICES, sizeof(cl_uint),
+            &num_dev, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    devices = malloc(sizeof(cl_device_id) * num_dev);
+    if(devices == NULL)
+    {
+        det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clGetContextInfo(context, CL_CONTEXT_DEVICES,
+            sizeof(cl_device_id) * num_dev, devices, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    for(i = 0; i < num_dev; i++)
+    {
+        cl_device_svm_capabilities caps = 0;
+        // Devices from before OpenCL 2.0 do not know the query.
+        if(clGetDeviceInfo(devices[i], CL_DEVICE_SVM_CAPABILITIES,
+                    sizeof(caps), &caps, NULL) != CL_SUCCESS ||
+                !(caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER))
+        {
+            ret = 0;
+            break;
+        }
+    }
+    free(devices);
+    return ret;
+}
+#endif
+
+/*
+ * Create the padded allocation of a buffer. With CLARMOR_SVM_BACKED it is
+ * created over coarse-grained SVM where the context allows it, and the SVM
+ * base is returned in backing. Otherwise backing is NULL.
+ */
+static cl_mem createPaddedBuffer(cl_context context, cl_mem_flags flags,
+        size_t size, void *host_ptr, void **backing, cl_int *errcode_ret)
+{
+    *backing = NULL;
+#ifdef CL_VERSION_2_0
+    if(get_svm_backed_envvar() && !internal_create && SVMAlloc && SVMFree &&
+            !(flags & (CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR)) &&
+            contextHasCoarseSVM(context))
+    {
+        void *base = SVMAlloc(context, CL_MEM_READ_WRITE, size, 0);
+        if(base != NULL)
+        {
+            cl_mem ret = CreateBuffer(context, flags | CL_MEM_USE_HOST_PTR,
+                    size, base, errcode_ret);
+            if(ret != NULL)
+            {
+                svm_backing *temp = calloc(sizeof(svm_backing), 1);
+                if(temp == NULL)
+                {
+                    det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__,
+                            __LINE__);
+                    exit(-1);
                 }
+                temp->context = context;
+                temp->base = base;
+                cl_int cl_err = clSetMemObjectDestructorCallback(ret,
+                        releaseSVMBacking, temp);
+                check_cl_error(__FILE__, __LINE__, cl_err);
+                *backing = base;
+                return ret;
             }
+            SVMFree(context, base);
         }
-
-    }
-    else
-    {
-        CL_MSG("NOT FOUND!");
+        // Device memory still works, its canaries are just copied out to be
+        // checked.
     }
-    return(ret);
+#endif
+    return CreateBuffer(context, flags, size, host_ptr, errcode_ret);
 }
 
 CL_API_ENTRY cl_mem CL_API_CALL
@@ -671,7 +1396,7 @@ clCreateBuffer(cl_context   context,
             return NULL;
         }
 
-        char *fill_ptr = 0;
+        void *create_ptr = NULL;
         size_t size_aug = size;
 
         if(global_tool_stats_flags & STATS_MEM_OVERHEAD)
@@ -690,121 +1415,139 @@ clCreateBuffer(cl_context   context,
             pthread_mutex_unlock(&memory_overhead_lock);
         }
 
-        flags &= ~CL_MEM_WRITE_ONLY;
-        flags &= ~CL_MEM_READ_ONLY;
-        flags |= CL_MEM_READ_WRITE;
-#ifdef CL_VERSION_1_2
-        flags &= ~CL_MEM_HOST_WRITE_ONLY;
-        flags &= ~CL_MEM_HOST_READ_ONLY;
-        flags &= ~CL_MEM_HOST_NO_ACCESS;
-#endif
+        // The detector writes canaries into, and reads them back from, every
+        // padded allocation, so it must allow any access. With
+        // CLARMOR_PRESERVE_FLAGS the sub-buffer the application uses keeps
+        // its own flags, as do USE_HOST_PTR buffers, which are not padded.
+        cl_mem_flags user_flags = flags;
+        int preserve_flags = get_preserve_flags_envvar();
+        if(!preserve_flags || !(flags & CL_MEM_USE_HOST_PTR))
+        {
+            flags &= ~(MEM_DEVICE_ACCESS_FLAGS | MEM_HOST_ACCESS_FLAGS);
+            flags |= CL_MEM_READ_WRITE;
+        }
 
+        const void *upload_ptr = NULL;
+        canary_geometry geom = {0, 0};
+        uintptr_t site = (uintptr_t)__builtin_return_address(0);
+        cl_mem_flags passDownFlags = 0;
         if(flags & CL_MEM_USE_HOST_PTR)
         {
-            fill_ptr = host_ptr;
+            create_ptr = host_ptr;
         }
         else
         {
-            fill_ptr = (char*)calloc(sizeof(char), size + POISON_REGIONS*POISON_FILL_LENGTH);
-
-            if(fill_ptr)
-            {
-                uint32_t offset = 0;
-#ifdef UNDERFLOW_CHECK
-                memset(fill_ptr, POISON_FILL, POISON_FILL_LENGTH);
-                offset = POISON_FILL_LENGTH;
-#endif
-                if(flags & CL_MEM_COPY_HOST_PTR)
-                    memcpy(fill_ptr + offset, host_ptr, size);
+            // The padded buffer is created empty. Its canaries and the
+            // user's data are written on the device once it exists.
+            if(flags & CL_MEM_COPY_HOST_PTR)
+                upload_ptr = host_ptr;
+            flags &= ~CL_MEM_COPY_HOST_PTR;
 
-                offset += size;
-                memset(fill_ptr + offset, POISON_FILL, POISON_FILL_LENGTH);
-                flags |= CL_MEM_COPY_HOST_PTR;
+            getCanaryGeometry(context, size, site, &geom);
+            size_aug += geom.front + geom.back;
 
-                if(global_tool_stats_flags & STATS_MEM_OVERHEAD)
-                {
-                    pthread_mutex_lock(&memory_overhead_lock);
-                    total_overhead_mem += POISON_REGIONS*POISON_FILL_LENGTH;
-                    current_overhead_mem += POISON_REGIONS*POISON_FILL_LENGTH;
-                    pthread_mutex_unlock(&memory_overhead_lock);
-                }
-                size_aug += POISON_REGIONS*POISON_FILL_LENGTH;
-            }
+            cl_mem_flags ptrFlags;
+            ptrFlags = CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR;
+            if(preserve_flags)
+                passDownFlags = user_flags & (MEM_DEVICE_ACCESS_FLAGS | MEM_HOST_ACCESS_FLAGS);
+            else
+                passDownFlags = flags & ~ptrFlags;
         }
 
-        if(global_tool_stats_flags & STATS_MEM_OVERHEAD)
+        cl_int internal_err = CL_SUCCESS;
+        cl_mem main_buff = 0;
+        cl_mem slab = NULL;
+        size_t slab_offset = 0;
+        void *svm_base = NULL;
+        cl_event init_event = NULL;
+        if(!(flags & (CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR)) &&
+                size <= SLAB_MAX_BUFFER && get_slab_alloc_envvar())
         {
-            pthread_mutex_lock(&memory_overhead_lock);
-            high_user_mem = (high_user_mem > current_user_mem) ? high_user_mem : current_user_mem;
-            high_overhead_mem = (high_overhead_mem > current_overhead_mem) ? high_overhead_mem : current_overhead_mem;
-            pthread_mutex_unlock(&memory_overhead_lock);
+            ret = createSlabBuffer(context, passDownFlags, size, upload_ptr,
+                    &geom, &main_buff, &slab, &slab_offset, &init_event);
         }
 
-        cl_int internal_err;
-        cl_mem main_buff = 0;
-        main_buff =
-            CreateBuffer( context ,
-                    flags ,
-                    size_aug ,
-                    fill_ptr ,
-                    &internal_err );
-
-        if(main_buff && !(flags & CL_MEM_USE_HOST_PTR))
+        if(ret == NULL)
         {
-            cl_buffer_region sub_region;
-#ifdef UNDERFLOW_CHECK
-            sub_region.origin = POISON_FILL_LENGTH;
-#else
-            sub_region.origin = 0;
-#endif
-            sub_region.size = size;
-            cl_mem_flags passDownFlags, ptrFlags;
-            ptrFlags = CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR;
-            passDownFlags = flags & ~ptrFlags;
-
-            ret =
-                CreateSubBuffer( main_buff,
-                        passDownFlags,
-                        CL_BUFFER_CREATE_TYPE_REGION,
-                        (void*)&sub_region,
+            main_buff =
+                createPaddedBuffer( context ,
+                        flags ,
+                        size_aug ,
+                        create_ptr ,
+                        &svm_base ,
                         &internal_err );
-            check_cl_error(__FILE__, __LINE__, internal_err);
 
-            if(is_nvidia_platform(context))
+            // Less canary may fit where this did not. The canaries are only
+            // to blame if the buffer fits without them, otherwise the
+            // application gets the error it would have had anyway.
+            while(main_buff == NULL && !(flags & CL_MEM_USE_HOST_PTR) &&
+                    budgetMayDegrade(internal_err))
             {
-                // Force the buffer allocation to contiguous gpu memory space.
-                // This will ensure that the whole buffer is in the same memory.
-                // Later when we act on the sub-buffer, any overflows will spill
-                //   into the main buffer.
-                cl_command_queue command_queue;
-                int weCreated = !getCommandQueueForContext(context, &command_queue);
-                if(!weCreated)
-                    clRetainCommandQueue(command_queue);
-
-                void *read_ptr = malloc(size_aug);
-                EnqueueReadBuffer(command_queue, main_buff, CL_TRUE, 0, size_aug, read_ptr,
-                                    0, NULL, NULL);
-                free(read_ptr);
+                cl_mem unpadded = CreateBuffer(context, flags, size, NULL,
+                        &internal_err);
+                if(unpadded == NULL)
+                    break;
+                ReleaseMemObject(unpadded);
+                budgetAllocFailed();
+
+                getCanaryGeometry(context, size, site, &geom);
+                size_aug = size + geom.front + geom.back;
+                main_buff =
+                    createPaddedBuffer( context ,
+                            flags ,
+                            size_aug ,
+                            create_ptr ,
+                            &svm_base ,
+                            &internal_err );
+            }
 
-                clReleaseCommandQueue(command_queue);
+            if(main_buff && !(flags & CL_MEM_USE_HOST_PTR))
+            {
+                // The canaries are written into main_buff itself, which is
+                // enough to place it.
+                initPaddedBuffer(context, NULL, main_buff, geom.front, size,
+                        &geom, upload_ptr, &init_event);
+
+                cl_buffer_region sub_region;
+                sub_region.origin = geom.front;
+                sub_region.size = size;
+
+                ret =
+                    CreateSubBuffer( main_buff,
+                            passDownFlags,
+                            CL_BUFFER_CREATE_TYPE_REGION,
+                            (void*)&sub_region,
+                            &internal_err );
+                check_cl_error(__FILE__, __LINE__, internal_err);
+            }
+            else
+            {
+                ret = main_buff;
             }
         }
-        else
+
+        if(global_tool_stats_flags & STATS_MEM_OVERHEAD)
         {
-            ret = main_buff;
+            pthread_mutex_lock(&memory_overhead_lock);
+            if(ret && !(flags & CL_MEM_USE_HOST_PTR))
+            {
+                total_overhead_mem += canaryOverhead(slab, &geom);
+                current_overhead_mem += canaryOverhead(slab, &geom);
+            }
+            high_user_mem = (high_user_mem > current_user_mem) ? high_user_mem : current_user_mem;
+            high_overhead_mem = (high_overhead_mem > current_overhead_mem) ? high_overhead_mem : current_overhead_mem;
+            pthread_mutex_unlock(&memory_overhead_lock);
         }
 
-        if(fill_ptr && fill_ptr != host_ptr)
-            free(fill_ptr);
-
         if(ret)
         {
             cl_memobj *temp = (cl_memobj*)calloc(sizeof(cl_memobj), 1);
             temp->handle = ret;
             temp->is_image = 0;
             temp->context = context;
-            temp->flags = flags;
+            temp->flags = preserve_flags ? (user_flags & ~CL_MEM_COPY_HOST_PTR) : flags;
             temp->size = size;
+            temp->alloc_site = site;
             if(flags & CL_MEM_USE_HOST_PTR)
                 temp->host_ptr = host_ptr;
             else
@@ -812,6 +1555,13 @@ clCreateBuffer(cl_context   context,
                 temp->main_buff = main_buff;
                 temp->host_ptr = NULL;
                 temp->has_canary = 1;
+                temp->canary = geom;
+                temp->slab = slab;
+                temp->slab_offset = slab_offset;
+                temp->svm_backing = svm_base;
+                temp->init_event = init_event;
+                temp->canary_bytes = canaryOverhead(slab, &geom);
+                budgetAddCanaries(context, temp->canary_bytes);
             }
             temp->ref_count = 1;
 
@@ -845,10 +1595,24 @@ CL_API_ENTRY cl_mem CL_API_CALL
         cl_buffer_region buffer_region_info = *(cl_buffer_region*)buffer_create_info;
         if(superBuff->has_canary == 1)
         {
-            buffer = superBuff->main_buff;
-#ifdef UNDERFLOW_CHECK
-            buffer_region_info.origin += POISON_FILL_LENGTH;
-#endif
+            // Sub-buffers cannot be made from the window of a slab buffer.
+            if(superBuff->slab)
+            {
+                buffer = superBuff->slab;
+                buffer_region_info.origin += superBuff->slab_offset;
+            }
+            else
+                buffer = superBuff->main_buff;
+            buffer_region_info.origin += superBuff->canary.front;
+            // Access flags a sub-buffer leaves out are inherited from the
+            // buffer the application made it from, not from the padded one.
+            if(get_preserve_flags_envvar())
+            {
+                if(!(flags & MEM_DEVICE_ACCESS_FLAGS))
+                    flags |= superBuff->flags & MEM_DEVICE_ACCESS_FLAGS;
+                if(!(flags & MEM_HOST_ACCESS_FLAGS))
+                    flags |= superBuff->flags & MEM_HOST_ACCESS_FLAGS;
+            }
         }
 
         ret =
@@ -868,6 +1632,9 @@ CL_API_ENTRY cl_mem CL_API_CALL
             temp->flags = flags;
             temp->size = buffer_region_info.size;
             temp->origin = buffer_region_info.origin;
+            temp->parent = superBuff->handle;
+            // The sub-buffer may outlive its parent's cl_memobj.
+            temp->init_event = getBufferInitEvent(superBuff);
             if(superBuff->host_ptr)
                 temp->host_ptr = (char*)superBuff->host_ptr + temp->origin;
             else
@@ -911,7 +1678,7 @@ clGetImageInfo(cl_mem image,
         if(dim_req && *p_val != 0)
         {
             cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), image);
-            if(m1 && m1->is_image)
+            if(m1 && m1->is_image && m1->has_canary)
             {
                 uint64_t w, h, d, a;
                 w = m1->image_desc.image_width;
@@ -953,6 +1720,30 @@ clGetImageInfo(cl_mem image,
     return(ret);
 }
 
+/*
+ * take back the memory stats of a padded image that could not be created
+ */
+static void uncountImage(uint64_t img_size, uint64_t padded_size)
+{
+    if(!(global_tool_stats_flags & STATS_MEM_OVERHEAD))
+        return;
+
+    pthread_mutex_lock(&memory_overhead_lock);
+    if(internal_create)
+    {
+        total_overhead_mem -= padded_size;
+        current_overhead_mem -= padded_size;
+    }
+    else
+    {
+        total_user_mem -= img_size;
+        current_user_mem -= img_size;
+        total_overhead_mem -= padded_size - img_size;
+        current_overhead_mem -= padded_size - img_size;
+    }
+    pthread_mutex_unlock(&memory_overhead_lock);
+}
+
 #ifdef CL_VERSION_1_2
     CL_API_ENTRY cl_mem CL_API_CALL
 clCreateImage(cl_context              context ,
@@ -1050,6 +1841,11 @@ clCreateImage(cl_context              context ,
             {
                 fill_ptr = host_ptr;
             }
+            else if(budgetDropsImageCanaries())
+            {
+                fill_ptr = host_ptr;
+                temp->canary_dropped = 1;
+            }
             else
             {
                 expandLastDimForFill(&temp->image_desc);
@@ -1080,23 +1876,24 @@ clCreateImage(cl_context              context ,
                 pthread_mutex_unlock(&memory_overhead_lock);
             }
 
+            cl_int internal_err = CL_SUCCESS;
             if (temp->flags & CL_MEM_COPY_HOST_PTR)
             {
                 // Bug workaround.
                 // On the AMD ROCm software stack, CL_MEM_COPY_HOST_PTR causes
                 // memory corruption on the CPU side. As such, we replace the
                 // implicit copy with an explicit copy to make things work.
-                cl_int internal_err = CL_SUCCESS;
+                // Images without canaries are written straight from the
+                // application's data, with its pitches.
+                size_t row_pitch = temp->image_desc.image_row_pitch;
+                size_t slice_pitch = temp->image_desc.image_slice_pitch;
+                temp->image_desc.image_row_pitch = 0;
+                temp->image_desc.image_slice_pitch = 0;
                 temp->flags &= ~CL_MEM_COPY_HOST_PTR;
                 ret = CreateImage(context, temp->flags, image_format,
-                        &temp->image_desc, NULL, errcode_ret);
+                        &temp->image_desc, NULL, &internal_err);
 
-                if (errcode_ret != NULL)
-                    *errcode_ret = internal_err;
-                temp->handle = ret;
-
-                if(internal_err != CL_IMAGE_FORMAT_NOT_SUPPORTED &&
-                        internal_err != CL_INVALID_IMAGE_FORMAT_DESCRIPTOR)
+                if(ret != NULL)
                 {
                     const size_t zero_origin[3] = {0,0,0};
                     const size_t region[3] = {temp->image_desc.image_width,
@@ -1106,19 +1903,51 @@ clCreateImage(cl_context              context ,
                     cl_command_queue command_queue;
                     getCommandQueueForContext(context, &command_queue);
                     internal_err = EnqueueWriteImage(command_queue, ret, CL_BLOCKING,
-                            zero_origin, region, 0, 0, fill_ptr, 0, NULL, NULL);
+                            zero_origin, region, row_pitch, slice_pitch,
+                            fill_ptr, 0, NULL, NULL);
                     check_cl_error(__FILE__, __LINE__, internal_err);
                 }
             }
             else
             {
                 ret = CreateImage(context, temp->flags, image_format,
-                        &temp->image_desc, fill_ptr, errcode_ret);
+                        &temp->image_desc, fill_ptr, &internal_err);
             }
 
             if(fill_ptr && fill_ptr != host_ptr)
                 free(fill_ptr);
 
+            if(ret == NULL && temp->has_canary && budgetMayDegrade(internal_err))
+            {
+                // The canaries are only to blame if the image fits without
+                // them, otherwise the application gets this error anyway.
+                cl_image_desc unpadded_desc = *image_desc;
+                unpadded_desc.image_row_pitch = 0;
+                unpadded_desc.image_slice_pitch = 0;
+                cl_mem unpadded = CreateImage(context,
+                        flags & ~(CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR),
+                        image_format, &unpadded_desc, NULL, &internal_err);
+                if(unpadded != NULL)
+                {
+                    ReleaseMemObject(unpadded);
+                    budgetAllocFailed();
+
+                    // Try again with less canary, or none.
+                    uncountImage(img_size, temp->size);
+                    free(temp);
+                    return clCreateImage(context, flags, image_format,
+                            image_desc, host_ptr, errcode_ret);
+                }
+            }
+            if(errcode_ret != NULL)
+                *errcode_ret = internal_err;
+            temp->handle = ret;
+            if(temp->has_canary)
+            {
+                temp->canary_bytes = temp->size - img_size;
+                budgetAddCanaries(context, temp->canary_bytes);
+            }
+
             temp->host_ptr = NULL;
             if(flags & CL_MEM_USE_HOST_PTR)
                 temp->host_ptr = host_ptr;
@@ -1200,6 +2029,11 @@ clCreateImage2D(cl_context              context ,
             {
                 fill_ptr = host_ptr;
             }
+            else if(budgetDropsImageCanaries())
+            {
+                fill_ptr = host_ptr;
+                temp->canary_dropped = 1;
+            }
             else
             {
                 expandLastDimForFill(&temp->image_desc);
@@ -1226,25 +2060,23 @@ clCreateImage2D(cl_context              context ,
                 pthread_mutex_unlock(&memory_overhead_lock);
             }
 
+            cl_int internal_err = CL_SUCCESS;
             if (temp->flags & CL_MEM_COPY_HOST_PTR)
             {
                 // Bug workaround.
                 // On the AMD ROCm software stack, CL_MEM_COPY_HOST_PTR causes
                 // memory corruption on the CPU side. As such, we replace the
                 // implicit copy with an explicit copy to make things work.
-                cl_int internal_err = CL_SUCCESS;
+                // Images without canaries are written straight from the
+                // application's data, with its pitch.
+                size_t row_pitch = temp->canary_dropped ? image_row_pitch : 0;
                 temp->flags &= ~CL_MEM_COPY_HOST_PTR;
                 ret = CreateImage2D(context, temp->flags, image_format,
                         temp->image_desc.image_width,
                         temp->image_desc.image_height,
                         0, NULL, &internal_err);
 
-                if (errcode_ret != NULL)
-                    *errcode_ret = internal_err;
-                temp->handle = ret;
-
-                if(internal_err != CL_IMAGE_FORMAT_NOT_SUPPORTED &&
-                        internal_err != CL_INVALID_IMAGE_FORMAT_DESCRIPTOR)
+                if(ret != NULL)
                 {
                     const size_t zero_origin[3] = {0,0,0};
                     const size_t region[3] = {temp->image_desc.image_width,
@@ -1253,8 +2085,8 @@ clCreateImage2D(cl_context              context ,
                     cl_command_queue command_queue;
                     getCommandQueueForContext(context, &command_queue);
                     internal_err = EnqueueWriteImage(command_queue, ret,
-                            CL_BLOCKING, zero_origin, region, 0, 0, fill_ptr, 0,
-                            NULL, NULL);
+                            CL_BLOCKING, zero_origin, region, row_pitch, 0,
+                            fill_ptr, 0, NULL, NULL);
                     check_cl_error(__FILE__, __LINE__, internal_err);
                 }
             }
@@ -1263,12 +2095,43 @@ clCreateImage2D(cl_context              context ,
                 ret = CreateImage2D(context, temp->flags, image_format,
                         temp->image_desc.image_width,
                         temp->image_desc.image_height,
-                        0, fill_ptr, errcode_ret);
+                        (fill_ptr == host_ptr) ? image_row_pitch : 0,
+                        fill_ptr, &internal_err);
             }
 
             if(fill_ptr && fill_ptr != host_ptr)
                 free(fill_ptr);
 
+            if(ret == NULL && temp->has_canary && budgetMayDegrade(internal_err))
+            {
+                // The canaries are only to blame if the image fits without
+                // them, otherwise the application gets this error anyway.
+                cl_mem unpadded = CreateImage2D(context,
+                        flags & ~(CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR),
+                        image_format, image_width, image_height, 0, NULL,
+                        &internal_err);
+                if(unpadded != NULL)
+                {
+                    ReleaseMemObject(unpadded);
+                    budgetAllocFailed();
+
+                    // Try again with less canary, or none.
+                    uncountImage(img_size, temp->size);
+                    free(temp);
+                    return clCreateImage2D(context, flags, image_format,
+                            image_width, image_height, image_row_pitch,
+                            host_ptr, errcode_ret);
+                }
+            }
+            if(errcode_ret != NULL)
+                *errcode_ret = internal_err;
+            temp->handle = ret;
+            if(temp->has_canary)
+            {
+                temp->canary_bytes = temp->size - img_size;
+                budgetAddCanaries(context, temp->canary_bytes);
+            }
+
             temp->host_ptr = NULL;
             if(flags & CL_MEM_USE_HOST_PTR)
                 temp->host_ptr = host_ptr;
@@ -1351,6 +2214,11 @@ clCreateImage3D(cl_context              context ,
             {
                 fill_ptr = host_ptr;
             }
+            else if(budgetDropsImageCanaries())
+            {
+                fill_ptr = host_ptr;
+                temp->canary_dropped = 1;
+            }
             else
             {
                 expandLastDimForFill(&temp->image_desc);
@@ -1377,13 +2245,17 @@ clCreateImage3D(cl_context              context ,
                 pthread_mutex_unlock(&memory_overhead_lock);
             }
 
+            cl_int internal_err = CL_SUCCESS;
             if (temp->flags & CL_MEM_COPY_HOST_PTR)
             {
                 // Bug workaround.
                 // On the AMD ROCm software stack, CL_MEM_COPY_HOST_PTR causes
                 // memory corruption on the CPU side. As such, we replace the
                 // implicit copy with an explicit copy to make things work.
-                cl_int internal_err = CL_SUCCESS;
+                // Images without canaries are written straight from the
+                // application's data, with its pitches.
+                size_t row_pitch = temp->canary_dropped ? image_row_pitch : 0;
+                size_t slice_pitch = temp->canary_dropped ? image_slice_pitch : 0;
                 temp->flags &= ~CL_MEM_COPY_HOST_PTR;
                 ret = CreateImage3D(context, temp->flags, image_format,
                         temp->image_desc.image_width,
@@ -1391,12 +2263,7 @@ clCreateImage3D(cl_context              context ,
                         temp->image_desc.image_depth,
                         0, 0, NULL, &internal_err);
 
-                if (errcode_ret != NULL)
-                    *errcode_ret = internal_err;
-                temp->handle = ret;
-
-                if(internal_err != CL_IMAGE_FORMAT_NOT_SUPPORTED &&
-                        internal_err != CL_INVALID_IMAGE_FORMAT_DESCRIPTOR)
+                if(ret != NULL)
                 {
                     const size_t zero_origin[3] = {0,0,0};
                     const size_t region[3] = {temp->image_desc.image_width,
@@ -1405,7 +2272,8 @@ clCreateImage3D(cl_context              context ,
                     cl_command_queue command_queue;
                     getCommandQueueForContext(context, &command_queue);
                     internal_err = EnqueueWriteImage(command_queue, ret, CL_BLOCKING,
-                            zero_origin, region, 0, 0, fill_ptr, 0, NULL, NULL);
+                            zero_origin, region, row_pitch, slice_pitch,
+                            fill_ptr, 0, NULL, NULL);
                     check_cl_error(__FILE__, __LINE__, internal_err);
                 }
             }
@@ -1415,12 +2283,45 @@ clCreateImage3D(cl_context              context ,
                         temp->image_desc.image_width,
                         temp->image_desc.image_height,
                         temp->image_desc.image_depth,
-                        0, 0, fill_ptr, errcode_ret);
+                        (fill_ptr == host_ptr) ? image_row_pitch : 0,
+                        (fill_ptr == host_ptr) ? image_slice_pitch : 0,
+                        fill_ptr, &internal_err);
             }
 
             if(fill_ptr && fill_ptr != host_ptr)
                 free(fill_ptr);
 
+            if(ret == NULL && temp->has_canary && budgetMayDegrade(internal_err))
+            {
+                // The canaries are only to blame if the image fits without
+                // them, otherwise the application gets this error anyway.
+                cl_mem unpadded = CreateImage3D(context,
+                        flags & ~(CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR),
+                        image_format, image_width, image_height, image_depth,
+                        0, 0, NULL, &internal_err);
+                if(unpadded != NULL)
+                {
+                    ReleaseMemObject(unpadded);
+                    budgetAllocFailed();
+
+                    // Try again with less canary, or none.
+                    uncountImage(img_size, temp->size);
+                    free(temp);
+                    return clCreateImage3D(context, flags, image_format,
+                            image_width, image_height, image_depth,
+                            image_row_pitch, image_slice_pitch, host_ptr,
+                            errcode_ret);
+                }
+            }
+            if(errcode_ret != NULL)
+                *errcode_ret = internal_err;
+            temp->handle = ret;
+            if(temp->has_canary)
+            {
+                temp->canary_bytes = temp->size - img_size;
+                budgetAddCanaries(context, temp->canary_bytes);
+            }
+
             temp->host_ptr = NULL;
             if(flags & CL_MEM_USE_HOST_PTR)
                 temp->host_ptr = host_ptr;
@@ -1484,12 +2385,21 @@ clReleaseMemObject(cl_mem memobj )
         cl_mem main_buff = 0;
         if (findme != NULL)
         {
+            // Launches that have not been checked yet may have overflowed
+            // this object, so check them while its canaries still exist.
+            if(findme->ref_count == 1 && !findme->detector_internal_buffer)
+                runDeferredChecks(NULL, memobj);
+
             if(findme->main_buff)
                 main_buff = findme->main_buff;
 
             findme->ref_count--;
             if (findme->ref_count == 0)
             {
+                releaseMirror(findme);
+                if(findme->init_event != NULL)
+                    ReleaseEvent(findme->init_event);
+
                 if(global_tool_stats_flags & STATS_MEM_OVERHEAD)
                 {
                     pthread_mutex_lock(&memory_overhead_lock);
@@ -1497,7 +2407,7 @@ clReleaseMemObject(cl_mem memobj )
                     {
                         current_overhead_mem -= findme->size;
                         if(!findme->is_image)
-                            current_overhead_mem -= POISON_REGIONS*POISON_FILL_LENGTH;
+                            current_overhead_mem -= canaryOverhead(findme->slab, &findme->canary);
                     }
                     else if( !findme->has_canary )
                         current_user_mem -= findme->size;
@@ -1531,11 +2441,13 @@ clReleaseMemObject(cl_mem memobj )
                     else
                     {
                         current_user_mem -= findme->size;
-                        current_overhead_mem -= POISON_REGIONS*POISON_FILL_LENGTH;
+                        current_overhead_mem -= canaryOverhead(findme->slab, &findme->canary);
                     }
                     pthread_mutex_unlock(&memory_overhead_lock);
                 }
 
+                budgetRemoveCanaries(findme->canary_bytes);
+
                 cl_memobj *temp;
                 temp = cl_mem_remove(get_cl_mem_alloc(), memobj);
                 if(temp != NULL)
@@ -1576,11 +2488,13 @@ clEnqueueMapBuffer(cl_command_queue command_queue,
         if(m1 && m1->main_buff)
         {
             main_buffer = m1->main_buff;
-#ifdef UNDERFLOW_CHECK
-            offset_aug += POISON_FILL_LENGTH;
-#endif
+            offset_aug += m1->canary.front;
         }
 
+        syncMirrorBeforeAccess(command_queue, buffer, num_events_in_wait_list, event_wait_list);
+        if(blocking_map)
+            runDeferredChecks(command_queue, NULL);
+
         ret = EnqueueMapBuffer(command_queue, main_buffer, blocking_map, map_flags, offset_aug, size, num_events_in_wait_list, event_wait_list, event, errcode_ret);
     }
     else
@@ -1591,6 +2505,37 @@ clEnqueueMapBuffer(cl_command_queue command_queue,
     return ret;
 }
 
+CL_API_ENTRY void* CL_API_CALL
+clEnqueueMapImage(cl_command_queue command_queue,
+            cl_mem image,
+            cl_bool blocking_map,
+            cl_map_flags map_flags,
+            const size_t *origin,
+            const size_t *region,
+            size_t *image_row_pitch,
+            size_t *image_slice_pitch,
+            cl_uint num_events_in_wait_list,
+            const cl_event *event_wait_list,
+            cl_event *event,
+            cl_int *errcode_ret)
+{
+    void *ret = NULL;
+    if(EnqueueMapImage)
+    {
+        syncMirrorBeforeAccess(command_queue, image, num_events_in_wait_list, event_wait_list);
+        if(blocking_map)
+            runDeferredChecks(command_queue, NULL);
+
+        ret = EnqueueMapImage(command_queue, image, blocking_map, map_flags, origin, region, image_row_pitch, image_slice_pitch, num_events_in_wait_list, event_wait_list, event, errcode_ret);
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+
+    return ret;
+}
+
 CL_API_ENTRY cl_int CL_API_CALL
 clEnqueueUnmapMemObject(cl_command_queue command_queue,
             cl_mem memobj,
@@ -1610,6 +2555,10 @@ clEnqueueUnmapMemObject(cl_command_queue command_queue,
         }
 
         err = EnqueueUnmapMemObject(command_queue, main_buffer, mapped_ptr, num_events_in_wait_list, event_wait_list, event);
+
+        // We cannot tell whether the mapping was written through, so assume
+        // that it was.
+        invalidateMirrors(memobj);
     }
     else
     {
@@ -1620,6 +2569,93 @@ clEnqueueUnmapMemObject(cl_command_queue command_queue,
 }
 
 
+/*
+ * Create the detector's record of a kernel the first time we see it.
+ * The argument table is sized from the kernel's real argument count.
+ */
+static kernel_info* createKernelInfo(cl_kernel kernel, uint32_t ref_count)
+{
+    cl_uint nargs = 0;
+    cl_int cl_err = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(nargs),
+            &nargs, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    kernel_info *kern_temp = kinfo_create(kernel, nargs);
+    if (kern_temp == NULL)
+    {
+        char * err_text = strerror(errno);
+        det_fprintf(stderr, "Failed to allocate kern_temp near %s:%d\n",
+            __FILE__, __LINE__);
+        det_fprintf(stderr, "Error reason: %s\n", err_text);
+        exit(-1);
+    }
+    kern_temp->ref_count = ref_count;
+
+#ifdef CL_VERSION_1_2
+    // Learn which arguments the kernel can only read from. Argument info is
+    // not available for every program (e.g. binaries built without
+    // -cl-kernel-arg-info), in which case we assume every argument is written.
+    cl_uint i;
+    for (i = 0; i < nargs; i++)
+    {
+        cl_kernel_arg_address_qualifier addr_qual;
+        cl_kernel_arg_access_qualifier access_qual;
+        cl_kernel_arg_type_qualifier type_qual;
+        if (clGetKernelArgInfo(kernel, i, CL_KERNEL_ARG_ADDRESS_QUALIFIER,
+                    sizeof(addr_qual), &addr_qual, NULL) != CL_SUCCESS ||
+                clGetKernelArgInfo(kernel, i, CL_KERNEL_ARG_ACCESS_QUALIFIER,
+                    sizeof(access_qual), &access_qual, NULL) != CL_SUCCESS ||
+                clGetKernelArgInfo(kernel, i, CL_KERNEL_ARG_TYPE_QUALIFIER,
+                    sizeof(type_qual), &type_qual, NULL) != CL_SUCCESS)
+            break;
+        kern_temp->args[i].read_only =
+            (addr_qual == CL_KERNEL_ARG_ADDRESS_CONSTANT ||
+             access_qual == CL_KERNEL_ARG_ACCESS_READ_ONLY ||
+             (type_qual & CL_KERNEL_ARG_TYPE_CONST));
+    }
+#endif
+
+    kinfo_insert(get_kern_list(), kern_temp);
+    return kern_temp;
+}
+
+#ifdef CL_VERSION_2_1
+CL_API_ENTRY cl_kernel CL_API_CALL
+clCloneKernel(cl_kernel     source_kernel ,
+        cl_int *      errcode_ret )
+{
+    cl_kernel ret = NULL;
+    if ( CloneKernel )
+    {
+        initialize_logging();
+        ret = CloneKernel(source_kernel, errcode_ret);
+
+        // The runtime copies the source kernel's arguments into the clone,
+        // so the clone starts out with the same buffers to check. The
+        // detector's own clones are set up by createPoisonedKernel.
+        kernel_info *source = kinfo_find(get_kern_list(), source_kernel);
+        if (ret != NULL && source != NULL && !internal_create)
+        {
+            kernel_info *kern_temp = kinfo_clone(source, ret);
+            if (kern_temp == NULL)
+            {
+                det_fprintf(stderr, "Failed to allocate kern_temp near %s:%d\n",
+                    __FILE__, __LINE__);
+                exit(-1);
+            }
+            if (kern_temp->name != NULL)
+                kpool_add_user(kern_temp->program, kern_temp->name);
+            kinfo_insert(get_kern_list(), kern_temp);
+        }
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return(ret);
+}
+#endif
+
 CL_API_ENTRY cl_int CL_API_CALL
 clRetainKernel(cl_kernel     kernel )
 {
@@ -1627,20 +2663,19 @@ clRetainKernel(cl_kernel     kernel )
     if ( RetainKernel )
     {
         initialize_logging();
-        kernel_info *temp;
-        temp = kinfo_find(get_kern_list(), kernel);
-        if (temp != NULL)
-            temp->ref_count++;
-        else
+        err = RetainKernel(kernel);
+        if (err == CL_SUCCESS)
         {
-            kernel_info *kern_temp = (kernel_info*)calloc(sizeof(kernel_info), 1);
-            kern_temp->handle = kernel;
-            kern_temp->arg_list = NULL;
-            // Insert at ref_count 2 because this is the Retain function
-            kern_temp->ref_count = 2;
-            kinfo_insert(get_kern_list(), kern_temp);
+            kernel_info *temp;
+            temp = kinfo_find(get_kern_list(), kernel);
+            if (temp != NULL)
+                temp->ref_count++;
+            else
+            {
+                // Insert at ref_count 2 because this is the Retain function
+                createKernelInfo(kernel, 2);
+            }
         }
-        err = RetainKernel(kernel);
     }
     else
     {
@@ -1664,6 +2699,15 @@ clReleaseKernel(cl_kernel    kernel )
             if (temp->ref_count == 0)
             {
                 temp = kinfo_remove(get_kern_list(), kernel);
+                // Clones of a function are only kept while the application
+                // still has a kernel of it.
+                if (temp != NULL && !temp->pool_clone &&
+                        kpool_remove_user(temp->program, temp->name))
+                {
+                    cl_kernel clone;
+                    while ((clone = kpool_drain(temp->program, temp->name)) != NULL)
+                        clReleaseKernel(clone);
+                }
                 kinfo_delete(temp);
             }
         }
@@ -1701,52 +2745,24 @@ clSetKernelArg(cl_kernel     kernel ,
         if(err == CL_SUCCESS)
         {
             kernel_info *kern_temp;
-            kernel_arg *arg_temp;
             kern_temp = kinfo_find(get_kern_list(), kernel);
 
             if(kern_temp == NULL)
-            {
-                kern_temp = (kernel_info*)calloc(sizeof(kernel_info), 1);
-                kern_temp->handle = kernel;
-                kern_temp->arg_list = NULL;
-                kern_temp->ref_count = 1;
-                kinfo_insert(get_kern_list(), kern_temp);
-            }
+                kern_temp = createKernelInfo(kernel, 1);
 
-            arg_temp = karg_remove(&(kern_temp->arg_list), arg_index);
-            if(arg_temp != NULL)
-            {
-                if (arg_temp->value != NULL)
-                    free(arg_temp->value);
-                arg_temp->value = NULL;
-                //free(arg_temp);
-                //arg_temp = NULL;
-            }
-            else
+            cl_memobj *m1 = NULL;
+            if(arg_size == sizeof(cl_mem) && arg_value != NULL)
             {
-                arg_temp = calloc(sizeof(kernel_arg), 1);
-                arg_temp->handle = arg_index;
+                m1 = cl_mem_find(get_cl_mem_alloc(), *(cl_mem*)arg_value);
+                //m1 is 0 if not present
             }
 
-            arg_temp->size = arg_size;
-            if(arg_value != NULL)
-            {
-                arg_temp->value = calloc(arg_size, 1);
-                memcpy(arg_temp->value, arg_value, arg_size);
-            }
-            else
+            if (karg_set(kern_temp, arg_index, arg_size, arg_value, m1, NULL))
             {
-                arg_temp->value = NULL;
-            }
-            arg_temp->buffer = NULL;
-            arg_temp->svm_buffer = NULL;
-            if(arg_size == sizeof(cl_mem) && arg_value != NULL)
-            {
-                cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), *(cl_mem*)arg_value);
-                arg_temp->buffer = m1; //m1 is 0 if not present
+                det_fprintf(stderr, "Failed to record kernel argument near "
+                        "%s:%d\n", __FILE__, __LINE__);
+                exit(-1);
             }
-
-            karg_insert(&(kern_temp->arg_list), arg_temp);
         }
     }
     else
@@ -1789,64 +2805,17 @@ clSetKernelArgSVMPointer(
             // track of this argument's information in a list of kernel args.
             // This is later used to detect duplicate kernel arguments.
             kernel_info *kern_temp;
-            kernel_arg *arg_temp;
 
             kern_temp = kinfo_find(get_kern_list(), kernel);
             if(kern_temp == NULL)
             {
                 // This is the first time we've called a function on this
                 // kernel. Create the structure that will hold its information.
-                kern_temp = (kernel_info*)calloc(sizeof(kernel_info), 1);
-                if (kern_temp != NULL)
-                {
-                    kern_temp->handle = kernel;
-                    kern_temp->arg_list = NULL;
-                    kern_temp->ref_count = 1;
-                    kinfo_insert(get_kern_list(), kern_temp);
-                }
-                else
-                {
-                    char * err_text = strerror(errno);
-                    det_fprintf(stderr, "Failed to allocate kern_temp near %s:%d\n",
-                        __FILE__, __LINE__);
-                    det_fprintf(stderr, "Error reason: %s\n", err_text);
-                    exit(-1);
-                }
-            }
-
-            // If we have previously set the kernel argument for this kernel at
-            // this index, we are now over-writing it. Remove the old value.
-            // If no old value existed, this is the first time we are setting
-            // the arg at this index for this kernel. Create it.
-            arg_temp = karg_remove(&(kern_temp->arg_list), arg_index);
-            if(arg_temp != NULL)
-            {
-                if (arg_temp->value != NULL)
-                    free(arg_temp->value);
-                arg_temp->value = NULL;
-                free(arg_temp);
-                arg_temp = NULL;
-            }
-            arg_temp = calloc(sizeof(kernel_arg), 1);
-            if (arg_temp == NULL)
-            {
-                char * err_text = strerror(errno);
-                det_fprintf(stderr, "Failed to allocate arg_temp near %s:%d\n",
-                        __FILE__, __LINE__);
-                det_fprintf(stderr, "Error reason: %s\n", err_text);
-                exit(-1);
+                kern_temp = createKernelInfo(kernel, 1);
             }
-            arg_temp->handle = arg_index;
-            // Doing this weird memory copy because arg_value comes in as a const.
-            // We want to put it into a non-const value.
-            // As such, we will just copy the pointer by value using memcpy.
-            void **value_ptr = calloc(sizeof(void*), 1);
-            memcpy(value_ptr, &arg_value, sizeof(void*));
-            arg_temp->value = (void*)value_ptr;
 
             // The regular non-SVM buffer should always be NULL, since we are
             // setting this kernel argument with the SetSVMPointer function.
-            arg_temp->buffer = NULL;
             cl_svm_memobj *m1 = cl_svm_mem_find(get_cl_svm_mem_alloc(), arg_value);
             if (m1 == NULL && !canaryAccessAllowed())
             {
@@ -1854,17 +2823,131 @@ clSetKernelArgSVMPointer(
                         "clSetKernelArgSVMPointer() that was not allocated "
                         "with clSVMAlloc().\n");
             }
-            arg_temp->svm_buffer = m1;
-            karg_insert(&(kern_temp->arg_list), arg_temp);
+
+            // The argument's value is the pointer itself. This replaces any
+            // value previously set for this kernel at this index.
+            if (karg_set(kern_temp, arg_index, sizeof(void*), &arg_value,
+                        NULL, m1))
+            {
+                det_fprintf(stderr, "Failed to record kernel argument near "
+                        "%s:%d\n", __FILE__, __LINE__);
+                exit(-1);
+            }
+        }
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return(err);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clSetKernelExecInfo(cl_kernel kernel,
+        cl_kernel_exec_info param_name,
+        size_t param_value_size,
+        const void *param_value)
+{
+    cl_int err = INT_MIN;
+    if (SetKernelExecInfo)
+    {
+        initialize_logging();
+        err = SetKernelExecInfo(kernel, param_name, param_value_size,
+                param_value);
+
+        // The SVM a kernel reaches beyond its arguments is declared here, so
+        // only those allocations need their canaries checked.
+        if (err == CL_SUCCESS)
+        {
+            kernel_info *kern_temp = kinfo_find(get_kern_list(), kernel);
+            if (kern_temp == NULL)
+                kern_temp = createKernelInfo(kernel, 1);
+
+            if (param_name == CL_KERNEL_EXEC_INFO_SVM_PTRS)
+            {
+                if (kinfo_set_exec_svm_ptrs(kern_temp,
+                            param_value_size / sizeof(void*),
+                            (void * const *)param_value))
+                {
+                    det_fprintf(stderr, "Failed to record kernel exec info "
+                            "near %s:%d\n", __FILE__, __LINE__);
+                    exit(-1);
+                }
+            }
+            else if (param_name == CL_KERNEL_EXEC_INFO_SVM_FINE_GRAIN_SYSTEM)
+            {
+                kinfo_set_svm_fine_grain_system(kern_temp,
+                        (*(const cl_bool*)param_value == CL_TRUE));
+            }
         }
     }
-    else
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return(err);
+}
+#endif
+
+/*
+ * a wait list made of the user's events followed by extra ones
+ * the caller frees it
+ */
+static cl_event *joinWaitLists(cl_uint num_user, const cl_event *user_list,
+        cl_uint num_extra, const cl_event *extra)
+{
+    cl_event *joined = malloc(sizeof(cl_event) * (num_user + num_extra));
+    if(joined == NULL)
+    {
+        det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    if(num_user > 0)
+        memcpy(joined, user_list, sizeof(cl_event) * num_user);
+    if(num_extra > 0)
+        memcpy(joined + num_user, extra, sizeof(cl_event) * num_extra);
+    return joined;
+}
+
+/*
+ * release and free the events returned by getSVMInitEvents() and
+ * appendArgInitEvents()
+ */
+static void releaseInitEvents(cl_uint num_events, cl_event *events)
+{
+    cl_uint i;
+    for(i = 0; i < num_events; i++)
+        ReleaseEvent(events[i]);
+    free(events);
+}
+
+/*
+ * add the canary fills that may still be pending for the buffer arguments of
+ * a kernel to a malloc'd array of retained events, which is returned
+ */
+static cl_event *appendArgInitEvents(const kernel_info *kinfo,
+        const kernel_launch_plan *plan, cl_event *events, cl_uint *num_events)
+{
+    uint32_t i;
+    for(i = 0; i < plan->nargs; i++)
     {
-        CL_MSG("NOT FOUND!");
+        cl_event init, *grown;
+        if(plan->dupe[i] != i || plan->arg_kind[i] != KARG_BUFFER)
+            continue;
+        init = getBufferInitEvent(kinfo->args[i].buffer);
+        if(init == NULL)
+            continue;
+        grown = realloc(events, sizeof(cl_event) * (*num_events + 1));
+        if(grown == NULL)
+        {
+            det_fprintf(stderr, "Realloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        events = grown;
+        events[(*num_events)++] = init;
     }
-    return(err);
+    return events;
 }
-#endif
 
 #ifdef CL_VERSION_2_0
 void *internalSVMAlloc(cl_context     context,
@@ -1885,27 +2968,131 @@ void *internalSVMAlloc(cl_context     context,
 
     // Workaround for the fact that fine-grained buffers are not properly
     // freed in Linux. If we keep allocating them, we will quickly run
-    // out of resources. As such, we aggressively buffer them and find any
-    // of the proper size with the right flags and context.
-    if (flags & CL_MEM_SVM_FINE_GRAIN_BUFFER)
-    {
-        // Always set read-write so that all FG SVM buffers can be
-        // used by everyone who wants one.
-        flags = CL_MEM_READ_WRITE | CL_MEM_SVM_FINE_GRAIN_BUFFER;
-        ret = find_free_svm(context, size, alignment);
-    }
+    // out of resources. As such, we pool freed SVM and look for a region
+    // of about the right size with the right flags and context.
+    // Always set read-write so that all pooled regions can be used by
+    // everyone who wants one.
+    flags = CL_MEM_READ_WRITE | (flags & CL_MEM_SVM_FINE_GRAIN_BUFFER);
+    ret = svm_pool_get(context, flags, size, alignment);
 
     if (ret == NULL)
     {
         ret = SVMAlloc(context, flags, size, alignment);
-        if (ret != NULL && (flags & CL_MEM_SVM_FINE_GRAIN_BUFFER))
-            cl_svm_fg_alloc(context, ret, flags, size, alignment);
+        if (ret != NULL)
+            svm_pool_track(context, ret, flags, size);
     }
 
     return ret;
 }
 
 /* Shared Virtual Memory Object APIs */
+
+// guards the canary fills kept on each cl_svm_memobj
+static pthread_mutex_t svm_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * forget the canary fills of an SVM allocation that have finished
+ * must hold svm_init_lock
+ */
+static void pruneSVMInit(cl_svm_memobj *m)
+{
+    uint32_t i, kept = 0;
+    for(i = 0; i < m->num_init_events; i++)
+    {
+        cl_int status = CL_QUEUED;
+        cl_int cl_err = clGetEventInfo(m->init_events[i],
+                CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status,
+                NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        // Failed commands have a negative status, and are done as well.
+        if(status <= CL_COMPLETE)
+            ReleaseEvent(m->init_events[i]);
+        else
+            m->init_events[kept++] = m->init_events[i];
+    }
+    m->num_init_events = kept;
+}
+
+/*
+ * add the canary fills of an SVM allocation to a growing event array
+ * must hold svm_init_lock
+ */
+static void appendSVMInit(cl_svm_memobj *m, cl_event **events,
+        cl_uint *num_events, cl_uint *cap)
+{
+    uint32_t i;
+    pruneSVMInit(m);
+    for(i = 0; i < m->num_init_events; i++)
+    {
+        if(*num_events == *cap)
+        {
+            *cap = (*cap == 0) ? 16 : 2 * *cap;
+            cl_event *grown = realloc(*events, sizeof(cl_event) * *cap);
+            if(grown == NULL)
+            {
+                det_fprintf(stderr, "Realloc failed at %s:%d\n", __FILE__, __LINE__);
+                exit(-1);
+            }
+            *events = grown;
+        }
+        RetainEvent(m->init_events[i]);
+        (*events)[(*num_events)++] = m->init_events[i];
+    }
+}
+
+cl_event *getSVMInitEvents(cl_uint num_ptrs, void * const *svm_ptrs,
+        cl_uint *num_events)
+{
+    cl_event *events = NULL;
+    cl_uint cap = 0;
+    cl_svm_memobj *m;
+
+    *num_events = 0;
+    pthread_mutex_lock(&svm_init_lock);
+    if(svm_ptrs == NULL)
+    {
+        m = cl_svm_mem_next(get_cl_svm_mem_alloc(), 0);
+        while(m != NULL)
+        {
+            appendSVMInit(m, &events, num_events, &cap);
+            m = cl_svm_mem_next(get_cl_svm_mem_alloc(), m->handle);
+        }
+    }
+    else
+    {
+        cl_uint i;
+        for(i = 0; i < num_ptrs; i++)
+        {
+            m = cl_svm_mem_find(get_cl_svm_mem_alloc(), svm_ptrs[i]);
+            if(m != NULL)
+                appendSVMInit(m, &events, num_events, &cap);
+        }
+    }
+    pthread_mutex_unlock(&svm_init_lock);
+    return events;
+}
+
+/*
+ * forget the canary fills of an SVM allocation being freed
+ * if wait is set, the fills of this allocation alone are waited for first
+ */
+static void finishSVMInit(cl_svm_memobj *m, int wait)
+{
+    uint32_t i;
+    cl_int cl_err;
+    pthread_mutex_lock(&svm_init_lock);
+    pruneSVMInit(m);
+    if(wait && m->num_init_events > 0)
+    {
+        cl_err = WaitForEvents(m->num_init_events, m->init_events);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+    for(i = 0; i < m->num_init_events; i++)
+        ReleaseEvent(m->init_events[i]);
+    m->num_init_events = 0;
+    pthread_mutex_unlock(&svm_init_lock);
+}
+
 CL_API_ENTRY void* CL_API_CALL
 clSVMAlloc(cl_context           context,
             cl_svm_mem_flags    flags,
@@ -1916,58 +3103,74 @@ clSVMAlloc(cl_context           context,
     if ( SVMAlloc )
     {
         size_t size_aug = size;
+        canary_geometry geom;
 
         initialize_logging();
 
+        getSVMCanaryGeometry(context, size, alignment,
+                (uintptr_t)__builtin_return_address(0), &geom);
+        size_aug += geom.front + geom.back;
+
+        ret = internalSVMAlloc(context, flags, size_aug, alignment);
+
+        if (ret == NULL)
+            return NULL;
+
         if(global_tool_stats_flags & STATS_MEM_OVERHEAD)
         {
             pthread_mutex_lock(&memory_overhead_lock);
             if(internal_create)
             {
-                total_overhead_mem += size + POISON_REGIONS*POISON_FILL_LENGTH;
-                current_overhead_mem += size + POISON_REGIONS*POISON_FILL_LENGTH;
+                total_overhead_mem += size + geom.front + geom.back;
+                current_overhead_mem += size + geom.front + geom.back;
             }
             else
             {
                 total_user_mem += size;
                 current_user_mem += size;
-                total_overhead_mem += POISON_REGIONS*POISON_FILL_LENGTH;
-                current_overhead_mem += POISON_REGIONS*POISON_FILL_LENGTH;
+                total_overhead_mem += geom.front + geom.back;
+                current_overhead_mem += geom.front + geom.back;
             }
 
             high_user_mem = (high_user_mem > current_user_mem) ? high_user_mem : current_user_mem;
             high_overhead_mem = (high_overhead_mem > current_overhead_mem) ? high_overhead_mem : current_overhead_mem;
             pthread_mutex_unlock(&memory_overhead_lock);
         }
-        size_aug += POISON_REGIONS*POISON_FILL_LENGTH;
-
-        ret = internalSVMAlloc(context, flags, size_aug, alignment);
-
-        if (ret == NULL)
-            return NULL;
+        budgetAddCanaries(context, geom.front + geom.back);
 
         void * user_ptr;
-        user_ptr = ret;
-#ifdef UNDERFLOW_CHECK
-        user_ptr = (char*)user_ptr + POISON_FILL_LENGTH;
-#endif
+        user_ptr = (char*)ret + geom.front;
 
-        cl_int cl_err;
-        cl_command_queue cmdQueue;
-        int weCreated = !getCommandQueueForContext(context, &cmdQueue);
-        if(!weCreated)
-            clRetainCommandQueue(cmdQueue);
-
-        uint32_t offset = size;
+        size_t offset = geom.front + size;
         cl_event finish[2];
-#ifdef UNDERFLOW_CHECK
-        cl_err = clEnqueueSVMMemFill(cmdQueue, (char*)ret, &poisonFill_8b, sizeof(uint8_t), POISON_FILL_LENGTH, 0, 0, &finish[1]);
-        check_cl_error(__FILE__, __LINE__, cl_err);
+        uint32_t num_finish = 0;
+        if(flags & CL_MEM_SVM_FINE_GRAIN_BUFFER)
+        {
+            // The host can write fine-grained SVM without a trip through
+            // the device.
+            if(geom.front > 0)
+                memset(ret, POISON_FILL, geom.front);
+            memset((char*)ret + offset, POISON_FILL, geom.back);
+        }
+        else
+        {
+            cl_int cl_err;
+            cl_command_queue cmdQueue;
+            int weCreated = !getCommandQueueForContext(context, &cmdQueue);
+            if(!weCreated)
+                clRetainCommandQueue(cmdQueue);
 
-        offset += POISON_FILL_LENGTH;
-#endif
-        cl_err = clEnqueueSVMMemFill(cmdQueue, (char*)ret + offset, &poisonFill_8b, sizeof(uint8_t), POISON_FILL_LENGTH, 0, 0, &finish[0]);
-        check_cl_error(__FILE__, __LINE__, cl_err);
+            if(geom.front > 0)
+            {
+                cl_err = clEnqueueSVMMemFill(cmdQueue, (char*)ret, &poisonFill_8b, sizeof(uint8_t), geom.front, 0, 0, &finish[num_finish++]);
+                check_cl_error(__FILE__, __LINE__, cl_err);
+            }
+            cl_err = clEnqueueSVMMemFill(cmdQueue, (char*)ret + offset, &poisonFill_8b, sizeof(uint8_t), geom.back, 0, 0, &finish[num_finish++]);
+            check_cl_error(__FILE__, __LINE__, cl_err);
+            cl_err = clFlush(cmdQueue);
+            check_cl_error(__FILE__, __LINE__, cl_err);
+            clReleaseCommandQueue(cmdQueue);
+        }
 
         cl_svm_memobj *temp = (cl_svm_memobj*)calloc(sizeof(cl_svm_memobj), 1);
         temp->handle = user_ptr;
@@ -1976,13 +3179,15 @@ clSVMAlloc(cl_context           context,
         temp->flags = flags;
         temp->size = size;
         temp->alignment = alignment;
+        temp->canary = geom;
+        temp->alloc_site = (uintptr_t)__builtin_return_address(0);
         temp->detector_internal_buffer = 0; // will set this outside if need be.
+        // Coarse-grained SVM can only be used through the API, and the
+        // commands that use it wait for these fills first.
+        temp->num_init_events = num_finish;
+        memcpy(temp->init_events, finish, sizeof(cl_event) * num_finish);
         cl_svm_mem_insert(get_cl_svm_mem_alloc(), temp);
 
-        clWaitForEvents(POISON_REGIONS, finish);
-
-        clReleaseCommandQueue(cmdQueue);
-
         ret = user_ptr;
     }
     else
@@ -2001,6 +3206,7 @@ clSVMFree(cl_context    context,
         initialize_logging();
         if (svm_pointer == NULL)
             return;
+        runDeferredChecks(NULL, svm_pointer);
         cl_svm_memobj *temp;
         temp = cl_svm_mem_remove(get_cl_svm_mem_alloc(), svm_pointer);
         void *main_svm = 0;
@@ -2011,11 +3217,11 @@ clSVMFree(cl_context    context,
             if(temp != NULL)
             {
                 if(internal_create)
-                    current_overhead_mem -= temp->size + POISON_REGIONS*POISON_FILL_LENGTH;
+                    current_overhead_mem -= temp->size + temp->canary.front + temp->canary.back;
                 else
                 {
                     current_user_mem -= temp->size;
-                    current_overhead_mem -= POISON_REGIONS*POISON_FILL_LENGTH;
+                    current_overhead_mem -= temp->canary.front + temp->canary.back;
                 }
             }
             pthread_mutex_unlock(&memory_overhead_lock);
@@ -2023,21 +3229,26 @@ clSVMFree(cl_context    context,
 
         if(temp != NULL)
         {
+            // clSVMFree() has no queue to chain to, so only the canary
+            // fills of this allocation are waited for, which have most
+            // likely finished long ago.
+            finishSVMInit(temp, 1);
+            budgetRemoveCanaries(temp->canary.front + temp->canary.back);
             main_svm = temp->main_buff;
             cl_svm_mem_delete(temp);
         }
 
         /*
-         * If this was a previously-allocated fine-grained buffer, don't free
-         * it. The OpenCL runtime does not properly free these buffers,
-         * and further allocations will eventually fill up our limited SVM
-         * space, causing out-of-resource errors. Instead, we cache them and
-         * try to reuse them for the next-requested alloc. Don't call
-         * real SVMFree on this, just in case the runtime eventually decides
-         * to do the free and we end up with use-after-free errors.
-         * Coarse-grained buffers call SVMFree like normal.
+         * Don't free buffers that we allocated. The OpenCL runtime does not
+         * properly free fine-grained buffers, and further allocations will
+         * eventually fill up our limited SVM space, causing out-of-resource
+         * errors. Instead, we pool them and try to reuse them for the
+         * next-requested alloc. Only regions the pool trims are really
+         * freed.
          */
-        if (main_svm && cl_svm_fg_free(context, main_svm))
+        if (main_svm && svm_pool_put(context, main_svm))
+            SVMFree(context, main_svm);
+        while ((main_svm = svm_pool_trim(context, 0)) != NULL)
             SVMFree(context, main_svm);
     }
     else
@@ -2069,20 +3280,83 @@ clEnqueueSVMFree(cl_command_queue command_queue,
         // try to remove detector-internal stuff that is then later used
         // by a kernel or transfer that is queued but not yet running.
         clFinish(command_queue);
+        for (cl_uint i = 0; i < num_svm_pointers; i++)
+            runDeferredChecks(NULL, svm_pointers[i]);
+
+        // The free waits for any canary fills still writing the regions.
+        cl_uint num_init = 0;
+        cl_event *init = getSVMInitEvents(num_svm_pointers, svm_pointers,
+                &num_init);
+        cl_event *joined = NULL;
+        const cl_event *wait_list = event_list;
+        if (num_init > 0)
+        {
+            joined = joinWaitLists(num_events, event_list, num_init, init);
+            wait_list = joined;
+        }
+        cl_uint num_wait = num_events + num_init;
+
+        // A user free function is handed the user's pointers and frees
+        // them with clSVMFree(), which does the bookkeeping below.
+        if (pfn_free_func != NULL)
+        {
+            err = EnqueueSVMFree(command_queue, num_svm_pointers,
+                    svm_pointers, pfn_free_func, user_data, num_wait,
+                    wait_list, event);
+            free(joined);
+            releaseInitEvents(num_init, init);
+            return err;
+        }
+
         // Delete from the detector-internal lists before we actually call the
         // real SVM free function to prevent any weird use-after-free stuff.
         cl_context context;
         cl_int cl_err = clGetCommandQueueInfo(command_queue, CL_QUEUE_CONTEXT, sizeof(cl_context), &context, NULL);
         check_cl_error(__FILE__, __LINE__, cl_err);
+        void **to_free = calloc(num_svm_pointers + 1, sizeof(void*));
+        if (to_free == NULL)
+        {
+            det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        cl_uint num_to_free = 0;
         for (cl_uint i = 0; i < num_svm_pointers; i++)
         {
+            void *main_svm = svm_pointers[i];
             cl_svm_memobj *temp = cl_svm_mem_remove(get_cl_svm_mem_alloc(), svm_pointers[i]);
-            cl_svm_mem_delete(temp);
-            cl_svm_fg_free(context, svm_pointers[i]);
+            if (temp != NULL)
+            {
+                budgetRemoveCanaries(temp->canary.front + temp->canary.back);
+                main_svm = temp->main_buff;
+            }
+            // Pooled regions are not really freed, see clSVMFree(). They
+            // can be handed out again right away, so unlike the regions
+            // freed below they cannot wait for their fills on the queue.
+            int pooled = 1;
+            if (main_svm && svm_pool_put(context, main_svm))
+            {
+                to_free[num_to_free++] = main_svm;
+                pooled = 0;
+            }
+            if (temp != NULL)
+            {
+                finishSVMInit(temp, pooled);
+                cl_svm_mem_delete(temp);
+            }
         }
+        void *trimmed;
+        while ((trimmed = svm_pool_trim(context, 0)) != NULL)
+            SVMFree(context, trimmed);
 
-        err = EnqueueSVMFree(command_queue, num_svm_pointers, svm_pointers,
-                    pfn_free_func, user_data, num_events, event_list, event);
+        if (num_to_free > 0)
+            err = EnqueueSVMFree(command_queue, num_to_free, to_free,
+                    NULL, NULL, num_wait, wait_list, event);
+        else
+            err = clEnqueueMarkerWithWaitList(command_queue, num_wait,
+                    wait_list, event);
+        free(to_free);
+        free(joined);
+        releaseInitEvents(num_init, init);
     }
     else
     {
@@ -2113,16 +3387,32 @@ clEnqueueSVMMap(cl_command_queue command_queue,
         if(m1)
         {
             main_svm = m1->main_buff;
-#ifdef UNDERFLOW_CHECK
-            size_aug += POISON_FILL_LENGTH;
-#endif
+            size_aug += m1->canary.front;
         }
 
-        err = EnqueueSVMMap(command_queue, blocking_map, flags, main_svm, size_aug, num_events_in_wait_list, event_wait_list, event);
-#ifdef UNDERFLOW_CHECK
-        if(map_flags & CL_MAP_WRITE_INVALIDATE_REGION)
-            memset(main_svm, POISON_FILL, POISON_FILL_LENGTH);
-#endif
+        if(blocking_map)
+            runDeferredChecks(command_queue, NULL);
+
+        // The map waits for the canary fills of the region, which it reads
+        // and may write back.
+        cl_uint num_init = 0;
+        cl_event *init = NULL;
+        cl_event *joined = NULL;
+        const cl_event *wait_list = event_wait_list;
+        if(m1)
+            init = getSVMInitEvents(1, &svm_ptr, &num_init);
+        if(num_init > 0)
+        {
+            joined = joinWaitLists(num_events_in_wait_list, event_wait_list,
+                    num_init, init);
+            wait_list = joined;
+        }
+
+        err = EnqueueSVMMap(command_queue, blocking_map, flags, main_svm, size_aug, num_events_in_wait_list + num_init, wait_list, event);
+        free(joined);
+        releaseInitEvents(num_init, init);
+        if(m1 && m1->canary.front > 0 && (map_flags & CL_MAP_WRITE_INVALIDATE_REGION))
+            memset(main_svm, POISON_FILL, m1->canary.front);
     }
     else
     {
@@ -2179,6 +3469,143 @@ cl_int runNDRangeKernel(launchOclKernelStruct *ocl_args)
     return 0;
 }
 
+/*
+ * With CLARMOR_ASYNC_CHECK set, the application thread only enqueues a kernel
+ * launch, and the launch worker of its command queue does the canary check.
+ * A barrier enqueued right behind the launch waits for check_done, so
+ * anything the user enqueues later still runs after the launch was checked,
+ * as it would if the check had been enqueued on the user's queue. check_done
+ * is completed from a callback on the check, the worker never waits for it.
+ */
+typedef struct launch_check_job_
+{
+    cl_command_queue command_queue;
+    /// kernel that was actually launched, may be a clone from the kernel pool
+    cl_kernel kernel;
+    uint8_t is_clone;
+    /// snapshot of the launched kernel's arguments and its plan, taken at
+    /// launch because the arguments may change again before the job runs
+    kernel_info *kinfo;
+    kernel_launch_plan *plan;
+    cl_event launch_event;
+    cl_event check_done;
+} launch_check_job;
+
+// A launch and the barrier behind it are enqueued together with the job that
+// releases that barrier. Otherwise a kernel from another thread could end up
+// behind a barrier whose job is queued after that kernel's own job.
+static pthread_mutex_t launch_check_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * called once the check of a launch has finished on the device, to release
+ * the barrier behind the launch and free the job
+ */
+static void finishLaunchCheck(cl_event event, cl_int status, void *arg)
+{
+    cl_int cl_err;
+    launch_check_job *job = (launch_check_job*)arg;
+    cl_command_queue command_queue = job->command_queue;
+    (void)event;
+    (void)status;
+
+    cl_err = clSetUserEventStatus(job->check_done, CL_COMPLETE);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    ReleaseEvent(job->check_done);
+    kinfo_snapshot_release(job->kinfo);
+    free(job);
+    launch_worker_release(command_queue);
+}
+
+static void launchCheckJob(void *arg)
+{
+    cl_int cl_err;
+    launch_check_job *job = (launch_check_job*)arg;
+    cl_command_queue check_queue = launch_worker_check_queue(job->command_queue);
+    cl_event check_event = NULL;
+
+    internal_create = 1;
+    allowCanaryAccess();
+
+    verifyPlanInBounds(check_queue, job->kinfo, job->plan, &job->launch_event,
+            &check_event);
+
+    disallowCanaryAccess();
+    internal_create = 0;
+
+    // drop the reference taken at launch before the clone goes back to the pool
+    clReleaseKernel(job->kernel);
+    if(job->is_clone)
+        delPoisonKernel(job->kernel, job->launch_event);
+
+    // Nothing else moves the launch along if the application is not
+    // flushing its queue.
+    clFlush(job->command_queue);
+    clFlush(check_queue);
+
+    // The worker goes on to the next job right away. The checker may still
+    // use the snapshot, so the callback frees it along with the job.
+    cl_event launch_event = job->launch_event;
+    launch_worker_hold(job->command_queue);
+    cl_err = clSetEventCallback((check_event != NULL) ? check_event :
+            launch_event, CL_COMPLETE, finishLaunchCheck, job);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    if(check_event != NULL)
+        ReleaseEvent(check_event);
+    ReleaseEvent(launch_event);
+}
+
+/*
+ * hand the check of a launch to the launch worker of its command queue
+ * must be called with launch_check_lock held, right after the launch
+ *
+ * external_event, if not NULL, gets the barrier that waits for the check
+ */
+static void submitLaunchCheck(cl_command_queue command_queue, cl_kernel kernel,
+        cl_kernel org_kernel, cl_event launch_event, cl_event *external_event)
+{
+    cl_int cl_err;
+    cl_context ctx;
+    launch_check_job *job = calloc(sizeof(launch_check_job), 1);
+    if(job == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    job->command_queue = command_queue;
+    job->kernel = kernel;
+    job->is_clone = (kernel != org_kernel);
+    job->kinfo = kinfo_clone(kinfo_find(get_kern_list(), kernel), kernel);
+    if(job->kinfo == NULL)
+    {
+        det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    job->kinfo->snapshot = 1;
+    job->plan = getKernelLaunchPlan(job->kinfo);
+    job->launch_event = launch_event;
+
+    cl_err = clGetCommandQueueInfo(command_queue, CL_QUEUE_CONTEXT, sizeof(cl_context), &ctx, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    job->check_done = clCreateUserEvent(ctx, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+#ifdef CL_VERSION_1_2
+    cl_err = clEnqueueBarrierWithWaitList(command_queue, 1, &job->check_done,
+            external_event);
+#else
+    cl_err = clEnqueueWaitForEvents(command_queue, 1, &job->check_done);
+    if(cl_err == CL_SUCCESS && external_event != NULL)
+        cl_err = clEnqueueMarker(command_queue, external_event);
+#endif
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    // the job keeps the kernel's arguments and kernel_info alive
+    clRetainKernel(kernel);
+    launch_worker_submit(command_queue, launchCheckJob, job);
+}
+
 /********** call from interseptor  *****************************/
 static cl_int kernelLaunchFunc(void * thread_args_)
 {
@@ -2200,12 +3627,11 @@ static cl_int kernelLaunchFunc(void * thread_args_)
     //----------------------------------END-SETUP-------------------------------
 
     //----------------------------------COPY-ARGS-------------------------------
-    uint32_t *dupe = NULL;
     cl_kernel org_kernel = 0;
     cl_kernel temp_kernel = 0;
 
-    uint32_t nargs;
     kernel_info *kinfo;
+    kernel_launch_plan *plan;
 
     //getting the information grabbed about this kernel
     kinfo = kinfo_find(get_kern_list(), ocl_args->kernel);
@@ -2215,23 +3641,62 @@ static cl_int kernelLaunchFunc(void * thread_args_)
         exit(-1);
     }
 
-    cl_err = clGetKernelInfo(ocl_args->kernel, CL_KERNEL_NUM_ARGS, sizeof(nargs), &nargs, 0);
-    check_cl_error(__FILE__, __LINE__, cl_err);
-
     org_kernel = ocl_args->kernel;
 
-    cl_context ctx;
-    clGetCommandQueueInfo(ocl_args->command_queue, CL_QUEUE_CONTEXT, sizeof(cl_context), &ctx, 0);
+    //duplicate arguments and buffers to check, reused until an arg changes
+    plan = getKernelLaunchPlan(kinfo);
 
-    findDuplicates(nargs, kinfo->arg_list, &dupe); //duplicate arguments list
+    // The launch waits on the user's events, the canary fills of any SVM it
+    // can reach, plus the canary fills of its arguments and any copies
+    // enqueued to bring argument mirrors up to date.
+    const cl_event *user_wait_list = ocl_args->event_wait_list;
+    cl_uint num_user_events = ocl_args->num_events_in_wait_list;
+    cl_uint num_svm_init = 0;
+    cl_event *svm_init = NULL;
+#ifdef CL_VERSION_2_0
+    if (plan->svm_sweep)
+        svm_init = getSVMInitEvents(0, NULL, &num_svm_init);
+    else if (plan->num_svm > 0)
+        svm_init = getSVMInitEvents(plan->num_svm, plan->svm_ptrs,
+                &num_svm_init);
+#endif
+    cl_uint num_launch_events = num_user_events + num_svm_init;
+    cl_event *launch_events = calloc(sizeof(cl_event), num_launch_events + 4 * plan->nargs + 1);
+    if (launch_events == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    if (num_user_events > 0)
+        memcpy(launch_events, user_wait_list, sizeof(cl_event) * num_user_events);
+    if (num_svm_init > 0)
+        memcpy(launch_events + num_user_events, svm_init, sizeof(cl_event) * num_svm_init);
+    free(svm_init);
+
+    // Mirrors for buffers without canaries are detector overhead, and stay
+    // around for as long as the buffer they mirror.
+    internal_create = 1;
+    temp_kernel = createPoisonedKernel(ocl_args->command_queue, ocl_args->kernel,
+            plan, &num_launch_events, launch_events);
+    internal_create = 0;
 
-    temp_kernel = createPoisonedKernel(ocl_args->command_queue, ocl_args->kernel, dupe);
+    if (num_launch_events > 0)
+    {
+        ocl_args->num_events_in_wait_list = num_launch_events;
+        ocl_args->event_wait_list = launch_events;
+    }
 
     //--------------------------------END-COPY-ARGS-----------------------------
 
     //------------------------------------RUN-----------------------------------
     ocl_args->kernel = temp_kernel;
 
+    // Deferred checks already run off the launch path, and take precedence.
+    uint8_t defer_check = (get_deferred_check_envvar() != 0);
+    uint8_t async_check = !defer_check && (get_async_check_envvar() != 0);
+    if(async_check)
+        pthread_mutex_lock(&launch_check_lock);
+
     if(global_tool_stats_flags & STATS_KERN_ENQ_TIME)
     {
         gettimeofday(&enq_start, NULL);
@@ -2243,6 +3708,22 @@ static cl_int kernelLaunchFunc(void * thread_args_)
     }
     check_cl_error(__FILE__, __LINE__, cl_err);
 
+    ocl_args->num_events_in_wait_list = num_user_events;
+    ocl_args->event_wait_list = user_wait_list;
+    for (cl_uint i = num_user_events; i < num_launch_events; i++)
+        clReleaseEvent(launch_events[i]);
+    free(launch_events);
+
+    if(async_check)
+    {
+        // The job gets its own reference to the launch event, since this
+        // thread still needs it for the mirrors below.
+        RetainEvent(internal_event);
+        submitLaunchCheck(ocl_args->command_queue, temp_kernel, org_kernel,
+                internal_event, external_event);
+        pthread_mutex_unlock(&launch_check_lock);
+    }
+
     // internal_event is used as the output event for runNDRangeKernel. Because
     // we want the verifyBufferInBounds work to run after the kernel is
     // finished, we use that as an input event for the verify function.
@@ -2252,14 +3733,73 @@ static cl_int kernelLaunchFunc(void * thread_args_)
     // may fail (since it would try to profile our internal detector kernels).
     // As such, we have a list that maps our "internal" events to the real
     // user events.
-    internal_create = 1;
-    allowCanaryAccess();
+    if(defer_check)
+    {
+        // Check the buffers of the kernel that was launched, but blame the
+        // user's kernel for any overflow in them.
+        kernel_info *launched = kinfo_find(get_kern_list(), temp_kernel);
+        int window_full = check_window_add_launch(ocl_args->command_queue,
+                org_kernel, plan, getKernelLaunchPlan(launched));
+
+        if (external_event != NULL)
+        {
+#ifdef CL_VERSION_1_2
+            cl_err = clEnqueueMarkerWithWaitList(ocl_args->command_queue, 1,
+                    &internal_event, external_event);
+#else
+            cl_err = clEnqueueMarker(ocl_args->command_queue, external_event);
+#endif
+            check_cl_error(__FILE__, __LINE__, cl_err);
+        }
+
+        if(window_full)
+            runDeferredChecks(ocl_args->command_queue, NULL);
+    }
+    else if(!async_check)
+    {
+        // With an overhead target, only some launches are checked and the
+        // governor measures what those checks cost.
+        uint8_t governed = governor_enabled();
+        uint8_t check_launch = !governed || governor_should_check(kinfo);
+        cl_event check_event = NULL;
+        cl_event *check_ret = governed ? &check_event : external_event;
+        struct timeval check_start, check_stop;
+        uint64_t check_us = 0;
+
+        if(check_launch)
+        {
+            gettimeofday(&check_start, NULL);
+            internal_create = 1;
+            allowCanaryAccess();
 
-    verifyBufferInBounds(ocl_args->command_queue, ocl_args->kernel, dupe,
-            &internal_event, external_event);
+            verifyBufferInBounds(ocl_args->command_queue, ocl_args->kernel,
+                    &internal_event, check_ret);
 
-    disallowCanaryAccess();
-    internal_create = 0;
+            disallowCanaryAccess();
+            internal_create = 0;
+            gettimeofday(&check_stop, NULL);
+            check_us = timeval_diff_us(&check_stop, &check_start);
+        }
+
+        if(governed)
+        {
+            // The user's event still completes after the checks, if any.
+            if (external_event != NULL)
+            {
+                cl_event *last = check_launch ? &check_event : &internal_event;
+#ifdef CL_VERSION_1_2
+                cl_err = clEnqueueMarkerWithWaitList(ocl_args->command_queue,
+                        1, last, external_event);
+#else
+                (void)last;
+                cl_err = clEnqueueMarker(ocl_args->command_queue, external_event);
+#endif
+                check_cl_error(__FILE__, __LINE__, cl_err);
+            }
+            RetainEvent(internal_event);
+            governor_add_sample(internal_event, check_event, check_us);
+        }
+    }
 
     // Later, if the user wants to profile the output event of this enqueue,
     // we will check the list to see what real NDRangeKernelEnqueue event
@@ -2283,20 +3823,19 @@ static cl_int kernelLaunchFunc(void * thread_args_)
 
     // -----------------Deleting Host Pointers and Cleaning Up------------------
 
-    if(temp_kernel != org_kernel)
-    {
-        copyKernelBuffers(org_kernel, ocl_args->kernel, dupe, ocl_args->command_queue);
-
-        delPoisonKernel(temp_kernel, dupe);
-    }
+    commitKernelMirrors(org_kernel, plan, ocl_args->command_queue, &internal_event);
 
-    if (dupe != NULL)
-        free(dupe);
-    dupe = NULL;
+    // the launch worker returns the clone once it has been checked
+    if(temp_kernel != org_kernel && !async_check)
+        delPoisonKernel(temp_kernel, internal_event);
 
     // -----------------Deleting Host Pointers and Cleaning Up----------------
     ocl_args->kernel = org_kernel;
 
+    // Only the event list keeps the launch event for the user's event.
+    if((async_check || defer_check) && external_event == NULL)
+        ReleaseEvent(internal_event);
+
 
     //------------------------------------TEARDOWN------------------------------
     ocl_args->event = external_event;
@@ -2425,8 +3964,34 @@ clEnqueueTask(cl_command_queue   command_queue ,
     if ( EnqueueTask )
     {
         initialize_logging();
-        err = EnqueueTask(command_queue, kernel, num_events, event_list,
-                    event);
+        cl_uint num_init = 0;
+        cl_event *init = NULL;
+        cl_event *joined = NULL;
+        const cl_event *wait_list = event_list;
+        // The task waits for the canary fills of its buffers and of the SVM
+        // it can reach.
+        kernel_info *kinfo = kinfo_find(get_kern_list(), kernel);
+        if (kinfo != NULL)
+        {
+            kernel_launch_plan *plan = getKernelLaunchPlan(kinfo);
+#ifdef CL_VERSION_2_0
+            if (plan->svm_sweep)
+                init = getSVMInitEvents(0, NULL, &num_init);
+            else if (plan->num_svm > 0)
+                init = getSVMInitEvents(plan->num_svm, plan->svm_ptrs,
+                        &num_init);
+#endif
+            init = appendArgInitEvents(kinfo, plan, init, &num_init);
+        }
+        if (num_init > 0)
+        {
+            joined = joinWaitLists(num_events, event_list, num_init, init);
+            wait_list = joined;
+        }
+        err = EnqueueTask(command_queue, kernel, num_events + num_init,
+                wait_list, event);
+        free(joined);
+        releaseInitEvents(num_init, init);
     }
     else
     {
@@ -2462,6 +4027,33 @@ clEnqueueNativeKernel(cl_command_queue   command_queue,
     return(err);
 }
 
+CL_API_ENTRY cl_int CL_API_CALL
+clWaitForEvents(cl_uint num_events, const cl_event *event_list)
+{
+    cl_int err = INT_MIN;
+    if (WaitForEvents)
+    {
+        initialize_logging();
+        // Waiting for a command is a synchronization point for the queue
+        // it was enqueued on. User events do not have one.
+        for (cl_uint i = 0; event_list != NULL && i < num_events; i++)
+        {
+            cl_command_queue queue = NULL;
+            cl_int temp_err = clGetEventInfo(event_list[i],
+                    CL_EVENT_COMMAND_QUEUE, sizeof(cl_command_queue), &queue,
+                    NULL);
+            if (temp_err == CL_SUCCESS && queue != NULL)
+                runDeferredChecks(queue, NULL);
+        }
+        err = WaitForEvents(num_events, event_list);
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return(err);
+}
+
 CL_API_ENTRY cl_int CL_API_CALL
 clGetEventProfilingInfo(cl_event event,
         cl_profiling_info param_name, size_t param_value_size,
@@ -2556,6 +4148,24 @@ clReleaseEvent(cl_event event)
     return(err);
 }
 
+/* Flush and Finish APIs */
+CL_API_ENTRY cl_int CL_API_CALL
+clFinish(cl_command_queue command_queue)
+{
+    cl_int err = INT_MIN;
+    if (Finish)
+    {
+        initialize_logging();
+        runDeferredChecks(command_queue, NULL);
+        err = Finish(command_queue);
+    }
+    else
+    {
+        CL_MSG("NOT FOUND!");
+    }
+    return(err);
+}
+
 /* Enqueued Commands APIs */
     CL_API_ENTRY cl_int CL_API_CALL
 clEnqueueReadBuffer(cl_command_queue     command_queue ,
@@ -2575,6 +4185,9 @@ clEnqueueReadBuffer(cl_command_queue     command_queue ,
     {
         if( !apiBufferOverflowCheck("clEnqueueReadBuffer", buffer, offset, size) )
         {
+            syncMirrorBeforeAccess(command_queue, buffer, num_events, event_list);
+            if(blocking_read)
+                runDeferredChecks(command_queue, NULL);
             err =
                 EnqueueReadBuffer(command_queue ,
                         buffer ,
@@ -2616,6 +4229,9 @@ clEnqueueReadBufferRect(cl_command_queue     command_queue ,
     {
         if( !apiBufferRectOverflowCheck("clEnqueueReadBufferRect", buffer, buffer_offset, region, buffer_row_pitch, buffer_slice_pitch) )
         {
+            syncMirrorBeforeAccess(command_queue, buffer, num_events, event_list);
+            if(blocking_read)
+                runDeferredChecks(command_queue, NULL);
             err =
                 EnqueueReadBufferRect(command_queue ,
                         buffer ,
@@ -2656,6 +4272,7 @@ clEnqueueWriteBuffer(cl_command_queue    command_queue ,
     {
         if( !apiBufferOverflowCheck("clEnqueueWriteBuffer", buffer, offset, size) )
         {
+            syncMirrorBeforeAccess(command_queue, buffer, num_events, event_list);
             err =
                 EnqueueWriteBuffer(command_queue ,
                         buffer ,
@@ -2666,6 +4283,7 @@ clEnqueueWriteBuffer(cl_command_queue    command_queue ,
                         num_events ,
                         event_list ,
                         event );
+            invalidateMirrors(buffer);
         }
     }
     else
@@ -2697,6 +4315,7 @@ clEnqueueWriteBufferRect(cl_command_queue     command_queue ,
     {
         if( !apiBufferRectOverflowCheck("clEnqueueWriteBufferRect", buffer, buffer_offset, region, buffer_row_pitch, buffer_slice_pitch) )
         {
+            syncMirrorBeforeAccess(command_queue, buffer, num_events, event_list);
             err =
                 EnqueueWriteBufferRect(command_queue ,
                         buffer ,
@@ -2712,6 +4331,7 @@ clEnqueueWriteBufferRect(cl_command_queue     command_queue ,
                         num_events ,
                         event_list ,
                         event );
+            invalidateMirrors(buffer);
         }
     }
     else
@@ -2738,6 +4358,7 @@ clEnqueueFillBuffer(cl_command_queue    command_queue ,
     {
         if( !apiBufferOverflowCheck("clEnqueueFillBuffer", buffer, offset, size) )
         {
+            syncMirrorBeforeAccess(command_queue, buffer, num_events, event_list);
             err =
                 EnqueueFillBuffer(command_queue ,
                         buffer ,
@@ -2748,6 +4369,7 @@ clEnqueueFillBuffer(cl_command_queue    command_queue ,
                         num_events ,
                         event_list ,
                         event );
+            invalidateMirrors(buffer);
         }
     }
     else
@@ -2774,6 +4396,8 @@ clEnqueueCopyBuffer(cl_command_queue     command_queue ,
         if( !apiBufferOverflowCheck("clEnqueueCopyBuffer", src_buffer, src_offset, size)
             && !apiBufferOverflowCheck("clEnqueueCopyBuffer", dst_buffer, dst_offset, size) )
         {
+            syncMirrorBeforeAccess(command_queue, src_buffer, num_events, event_list);
+            syncMirrorBeforeAccess(command_queue, dst_buffer, num_events, event_list);
             err =
                 EnqueueCopyBuffer(command_queue ,
                         src_buffer ,
@@ -2784,6 +4408,7 @@ clEnqueueCopyBuffer(cl_command_queue     command_queue ,
                         num_events ,
                         event_list ,
                         event );
+            invalidateMirrors(dst_buffer);
         }
     }
     else
@@ -2815,6 +4440,8 @@ clEnqueueCopyBufferRect(cl_command_queue     command_queue ,
         if( !apiBufferRectOverflowCheck("clEnqueueCopyBufferRect", src_buffer, src_origin, region, src_row_pitch, src_slice_pitch)
             && !apiBufferRectOverflowCheck("clEnqueueCopyBufferRect", dst_buffer, dst_origin, region, dst_row_pitch, dst_slice_pitch) )
         {
+            syncMirrorBeforeAccess(command_queue, src_buffer, num_events, event_list);
+            syncMirrorBeforeAccess(command_queue, dst_buffer, num_events, event_list);
             err =
                 EnqueueCopyBufferRect(command_queue ,
                         src_buffer ,
@@ -2829,6 +4456,7 @@ clEnqueueCopyBufferRect(cl_command_queue     command_queue ,
                         num_events ,
                         event_list ,
                         event );
+            invalidateMirrors(dst_buffer);
         }
     }
     else
@@ -2874,6 +4502,9 @@ clEnqueueReadImage(cl_command_queue      command_queue ,
             return CL_INVALID_OPERATION;
         if( !apiImageOverflowCheck("clEnqueueReadImage", image, origin, region) )
         {
+            syncMirrorBeforeAccess(command_queue, image, num_events, event_list);
+            if(blocking_read)
+                runDeferredChecks(command_queue, NULL);
             err = EnqueueReadImage(command_queue, image, blocking_read,
                     origin, region, row_pitch, slice_pitch, ptr,
                     num_events, event_list, event);
@@ -2924,6 +4555,7 @@ clEnqueueWriteImage(cl_command_queue     command_queue ,
 
         if( !apiImageOverflowCheck("clEnqueueWriteImage", image, origin, region) )
         {
+            syncMirrorBeforeAccess(command_queue, image, num_events, event_list);
             err =
                 EnqueueWriteImage(command_queue ,
                         image ,
@@ -2936,6 +4568,7 @@ clEnqueueWriteImage(cl_command_queue     command_queue ,
                         num_events ,
                         event_list ,
                         event );
+            invalidateMirrors(image);
         }
     }
     else
@@ -2980,6 +4613,7 @@ clEnqueueFillImage(cl_command_queue    command_queue ,
 
         if( !apiImageOverflowCheck("clEnqueueFillImage", image, origin, region) )
         {
+            syncMirrorBeforeAccess(command_queue, image, num_events, event_list);
             err =
                 EnqueueFillImage( command_queue ,
                         image ,
@@ -2989,6 +4623,7 @@ clEnqueueFillImage(cl_command_queue    command_queue ,
                         num_events ,
                         event_list ,
                         event );
+            invalidateMirrors(image);
         }
     }
     else
@@ -3035,6 +4670,8 @@ clEnqueueCopyImage(cl_command_queue      command_queue ,
         if( !apiImageOverflowCheck("clEnqueueCopyImage", src_image, src_origin, region)
             && !apiImageOverflowCheck("clEnqueueCopyImage", dst_image, dst_origin, region) )
         {
+            syncMirrorBeforeAccess(command_queue, src_image, num_events, event_list);
+            syncMirrorBeforeAccess(command_queue, dst_image, num_events, event_list);
             err =
                 EnqueueCopyImage(command_queue ,
                         src_image ,
@@ -3045,6 +4682,7 @@ clEnqueueCopyImage(cl_command_queue      command_queue ,
                         num_events ,
                         event_list ,
                         event );
+            invalidateMirrors(dst_image);
         }
     }
     else
@@ -3108,9 +4746,12 @@ clEnqueueCopyImageToBuffer(cl_command_queue  command_queue ,
 
         if (run_real_call)
         {
+            syncMirrorBeforeAccess(command_queue, src_image, num_events, event_list);
+            syncMirrorBeforeAccess(command_queue, dst_buffer, num_events, event_list);
             err = EnqueueCopyImageToBuffer(command_queue, src_image,
                     dst_buffer, src_origin, region, dst_offset,
                     num_events, event_list, event);
+            invalidateMirrors(dst_buffer);
         }
     }
     else
@@ -3174,9 +4815,12 @@ clEnqueueCopyBufferToImage(cl_command_queue  command_queue ,
 
         if (run_real_call)
         {
+            syncMirrorBeforeAccess(command_queue, src_buffer, num_events, event_list);
+            syncMirrorBeforeAccess(command_queue, dst_image, num_events, event_list);
             err = EnqueueCopyBufferToImage(command_queue, src_buffer,
                     dst_image, src_offset, dst_origin, region,
                     num_events, event_list, event);
+            invalidateMirrors(dst_image);
         }
     }
     else
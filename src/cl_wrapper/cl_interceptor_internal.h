@@ -57,6 +57,34 @@ typedef CL_API_ENTRY cl_int
             void *param_value,
             size_t *param_value_size_ret);
 
+/* Context APIs */
+typedef CL_API_ENTRY cl_context
+    (CL_API_CALL * interceptor_clCreateContext)(
+            const cl_context_properties *properties,
+            cl_uint num_devices,
+            const cl_device_id *devices,
+            void (CL_CALLBACK *pfn_notify)(const char *errinfo,
+                const void *private_info, size_t cb, void *user_data),
+            void *user_data,
+            cl_int *errcode_ret);
+
+typedef CL_API_ENTRY cl_context
+    (CL_API_CALL * interceptor_clCreateContextFromType)(
+            const cl_context_properties *properties,
+            cl_device_type device_type,
+            void (CL_CALLBACK *pfn_notify)(const char *errinfo,
+                const void *private_info, size_t cb, void *user_data),
+            void *user_data,
+            cl_int *errcode_ret);
+
+typedef CL_API_ENTRY cl_int
+    (CL_API_CALL * interceptor_clRetainContext)(
+            cl_context context);
+
+typedef CL_API_ENTRY cl_int
+    (CL_API_CALL * interceptor_clReleaseContext)(
+            cl_context context);
+
 /* Command Queue APIs */
 typedef CL_API_ENTRY cl_command_queue
     (CL_API_CALL * interceptor_clCreateCommandQueue)(
@@ -170,6 +198,21 @@ typedef CL_API_ENTRY void*
             cl_event *event,
             cl_int *errcode_ret);
 
+typedef CL_API_ENTRY void*
+    (CL_API_CALL * interceptor_clEnqueueMapImage)(
+            cl_command_queue command_queue,
+            cl_mem image,
+            cl_bool blocking_map,
+            cl_map_flags map_flags,
+            const size_t *origin,
+            const size_t *region,
+            size_t *image_row_pitch,
+            size_t *image_slice_pitch,
+            cl_uint num_events_in_wait_list,
+            const cl_event *event_wait_list,
+            cl_event *event,
+            cl_int *errcode_ret);
+
 typedef CL_API_ENTRY cl_int
     (CL_API_CALL * interceptor_clEnqueueUnmapMemObject)(
             cl_command_queue command_queue,
@@ -254,6 +297,13 @@ typedef CL_API_ENTRY cl_int
 
 
 /* Kernel APIs */
+#ifdef CL_VERSION_2_1
+typedef CL_API_ENTRY cl_kernel
+    (CL_API_CALL * interceptor_clCloneKernel)(
+            cl_kernel source_kernel,
+            cl_int *errcode_ret);
+#endif
+
 typedef CL_API_ENTRY cl_int
     (CL_API_CALL * interceptor_clRetainKernel)(cl_kernel kernel);
 
@@ -307,10 +357,22 @@ typedef CL_API_ENTRY cl_int
             cl_kernel kernel,
             cl_uint arg_index,
             const void *arg_value);
+
+typedef CL_API_ENTRY cl_int
+    (CL_API_CALL * interceptor_clSetKernelExecInfo)(
+            cl_kernel kernel,
+            cl_kernel_exec_info param_name,
+            size_t param_value_size,
+            const void *param_value);
 #endif
 
 
 /* Event APIs */
+typedef CL_API_ENTRY cl_int
+    (CL_API_CALL * interceptor_clWaitForEvents)(
+            cl_uint num_events,
+            const cl_event *event_list);
+
 typedef CL_API_ENTRY cl_int
     (CL_API_CALL * interceptor_clGetEventProfilingInfo)(
             cl_event event,
@@ -326,6 +388,11 @@ typedef CL_API_ENTRY cl_int
     (CL_API_CALL * interceptor_clReleaseEvent)(cl_event event);
 
 
+/* Flush and Finish APIs */
+typedef CL_API_ENTRY cl_int
+    (CL_API_CALL * interceptor_clFinish)(cl_command_queue command_queue);
+
+
 /* Enqueued Commands APIs */
 typedef CL_API_ENTRY cl_int
     (CL_API_CALL * interceptor_clEnqueueReadBuffer)(
@@ -47,6 +47,10 @@ extern void* global_dl_protect;
 void init_protect_list ( void )
 {
     protect_name("clGetDeviceInfo");
+    protect_name("clCreateContext");
+    protect_name("clCreateContextFromType");
+    protect_name("clRetainContext");
+    protect_name("clReleaseContext");
     protect_name("clCreateCommandQueue");
     protect_name("clCreateCommandQueueWithProperties");
     protect_name("clRetainCommandQueue");
@@ -60,11 +64,15 @@ void init_protect_list ( void )
     protect_name("clCreateImage3D");
     protect_name("clRetainMemObject");
     protect_name("clReleaseMemObject");
+    protect_name("clEnqueueMapBuffer");
+    protect_name("clEnqueueMapImage");
+    protect_name("clEnqueueUnmapMemObject");
     protect_name("clSVMAlloc");
     protect_name("clSVMFree");
     protect_name("clEnqueueSVMFree");
     protect_name("clEnqueueSVMMemcpy");
     protect_name("clEnqueueSVMMemFill");
+    protect_name("clCloneKernel");
     protect_name("clRetainKernel");
     protect_name("clReleaseKernel");
     protect_name("clEnqueueNDRangeKernel");
@@ -72,9 +80,12 @@ void init_protect_list ( void )
     protect_name("clEnqueueNativeKernel");
     protect_name("clSetKernelArg");
     protect_name("clSetKernelArgSVMPointer");
+    protect_name("clSetKernelExecInfo");
+    protect_name("clWaitForEvents");
     protect_name("clGetEventProfilingInfo");
     protect_name("clRetainEvent");
     protect_name("clReleaseEvent");
+    protect_name("clFinish");
     protect_name("clEnqueueReadBuffer");
     protect_name("clEnqueueReadBufferRect");
     protect_name("clEnqueueWriteBuffer");
@@ -0,0 +1,240 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "util_functions.h"
+#include "cl_err.h"
+
+#include "launch_worker.h"
+
+typedef struct launch_job_
+{
+    void (*run)(void*);
+    void *arg;
+    struct launch_job_ *next;
+} launch_job;
+
+/*
+ * One of these exists for each command queue that has had work handed off.
+ * Command queues are never really released by the detector (see
+ * clReleaseCommandQueue), so neither are their workers.
+ */
+typedef struct launch_worker_
+{
+    cl_command_queue queue;
+    /// detector-internal queue for this worker's checks
+    cl_command_queue check_queue;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    /// signalled when a job is added
+    pthread_cond_t wake;
+    /// signalled when the last pending job finishes
+    pthread_cond_t idle;
+    launch_job *head;
+    launch_job *tail;
+    uint8_t busy;
+    /// jobs that returned with work still running on the device
+    uint32_t held;
+    struct launch_worker_ *next;
+} launch_worker;
+
+static launch_worker *all_workers = NULL;
+static pthread_mutex_t all_workers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void* launch_worker_main(void *arg)
+{
+    launch_worker *worker = (launch_worker*)arg;
+
+    pthread_mutex_lock(&worker->lock);
+    while(1)
+    {
+        while(worker->head == NULL)
+            pthread_cond_wait(&worker->wake, &worker->lock);
+
+        launch_job *job = worker->head;
+        worker->head = job->next;
+        if(worker->head == NULL)
+            worker->tail = NULL;
+        worker->busy = 1;
+        pthread_mutex_unlock(&worker->lock);
+
+        job->run(job->arg);
+        free(job);
+
+        pthread_mutex_lock(&worker->lock);
+        worker->busy = 0;
+        if(worker->head == NULL && worker->held == 0)
+            pthread_cond_broadcast(&worker->idle);
+    }
+    return NULL;
+}
+
+static launch_worker* find_worker(cl_command_queue queue)
+{
+    launch_worker *worker;
+    for(worker = all_workers; worker != NULL; worker = worker->next)
+    {
+        if(worker->queue == queue)
+            break;
+    }
+    return worker;
+}
+
+static launch_worker* get_worker(cl_command_queue queue)
+{
+    launch_worker *worker;
+
+    pthread_mutex_lock(&all_workers_lock);
+    worker = find_worker(queue);
+    if(worker == NULL)
+    {
+        worker = calloc(sizeof(launch_worker), 1);
+        if(worker == NULL)
+        {
+            det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        worker->queue = queue;
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->wake, NULL);
+        pthread_cond_init(&worker->idle, NULL);
+
+        int err = pthread_create(&worker->thread, NULL, launch_worker_main, worker);
+        if(err != 0)
+        {
+            det_fprintf(stderr, "Failed to start launch worker near %s:%d\n",
+                    __FILE__, __LINE__);
+            det_fprintf(stderr, "Error reason: %s\n", strerror(err));
+            exit(-1);
+        }
+        pthread_detach(worker->thread);
+
+        worker->next = all_workers;
+        all_workers = worker;
+    }
+    pthread_mutex_unlock(&all_workers_lock);
+    return worker;
+}
+
+static void wait_for_worker(launch_worker *worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    while(worker->head != NULL || worker->busy || worker->held > 0)
+        pthread_cond_wait(&worker->idle, &worker->lock);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+void launch_worker_hold(cl_command_queue queue)
+{
+    launch_worker *worker = get_worker(queue);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->held++;
+    pthread_mutex_unlock(&worker->lock);
+}
+
+void launch_worker_release(cl_command_queue queue)
+{
+    launch_worker *worker = get_worker(queue);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->held--;
+    if(worker->held == 0 && worker->head == NULL && !worker->busy)
+        pthread_cond_broadcast(&worker->idle);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+void launch_worker_submit(cl_command_queue queue, void (*job)(void*), void *arg)
+{
+    launch_worker *worker = get_worker(queue);
+    launch_job *item = calloc(sizeof(launch_job), 1);
+    if(item == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    item->run = job;
+    item->arg = arg;
+
+    pthread_mutex_lock(&worker->lock);
+    if(worker->tail != NULL)
+        worker->tail->next = item;
+    else
+        worker->head = item;
+    worker->tail = item;
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+cl_command_queue launch_worker_check_queue(cl_command_queue queue)
+{
+    launch_worker *worker = get_worker(queue);
+
+    pthread_mutex_lock(&worker->lock);
+    if(worker->check_queue == NULL)
+    {
+        cl_int cl_err;
+        cl_context context;
+        cl_device_id device;
+
+        cl_err = clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(cl_context), &context, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        worker->check_queue = clCreateCommandQueue(context, device, 0, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return worker->check_queue;
+}
+
+void launch_worker_drain(cl_command_queue queue)
+{
+    launch_worker *worker;
+
+    pthread_mutex_lock(&all_workers_lock);
+    worker = find_worker(queue);
+    pthread_mutex_unlock(&all_workers_lock);
+
+    if(worker != NULL)
+        wait_for_worker(worker);
+}
+
+void launch_worker_drain_all(void)
+{
+    launch_worker *worker;
+
+    pthread_mutex_lock(&all_workers_lock);
+    worker = all_workers;
+    pthread_mutex_unlock(&all_workers_lock);
+
+    // Workers are only ever added to the front of the list.
+    for(; worker != NULL; worker = worker->next)
+        wait_for_worker(worker);
+}
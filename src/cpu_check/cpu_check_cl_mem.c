@@ -30,17 +30,16 @@
 
 #include "cpu_check_cl_mem.h"
 
-static void read_cl_mem_canaries(cl_command_queue cmd_queue,
+static uint32_t read_cl_mem_canaries(cl_command_queue cmd_queue,
         uint32_t num_cl_mem, void * canaries, void **buffer_ptrs,
-        void **buffer_cl_mem, const cl_event *input_event,
-        cl_event *read_events)
+        void **buffer_cl_mem, uint32_t *canary_lens,
+        const cl_event *input_event, cl_event *read_events)
 {
-    char * c_canaries = (char *)canaries;
+    // casting to char* to do pointer arithmetic.
+    char * this_canary = (char *)canaries;
+    uint32_t evt_index = 0;
     for (uint32_t i = 0; i < num_cl_mem; i++)
     {
-        // casting to char* to do pointer arithmetic.
-        void * this_canary = c_canaries + (i * POISON_REGIONS*POISON_FILL_LENGTH);
-
         cl_memobj *m1;
         m1 = cl_mem_find(get_cl_mem_alloc(), buffer_ptrs[i]);
         if(m1 == NULL)
@@ -50,28 +49,50 @@ static void read_cl_mem_canaries(cl_command_queue cmd_queue,
         }
         // found a cl_mem
         buffer_cl_mem[i] = m1->handle;
-        uint32_t offset = m1->size;
-        uint32_t evt_index = POISON_REGIONS*i;
+        canary_lens[i] = m1->canary.front + m1->canary.back;
+        size_t offset = m1->canary.front + m1->size;
 
         cl_int cl_err;
-#ifdef UNDERFLOW_CHECK
-        cl_err = clEnqueueReadBuffer(cmd_queue, m1->main_buff,
-                CL_NON_BLOCKING, 0,
-                POISON_FILL_LENGTH, this_canary, 1, input_event,
-                &(read_events[evt_index]));
-        check_cl_error(__FILE__, __LINE__, cl_err);
-
-        offset += POISON_FILL_LENGTH;
-        this_canary = (char*)this_canary + POISON_FILL_LENGTH;
-        evt_index++;
-#endif
+        if(m1->canary.front > 0)
+        {
+            cl_err = clEnqueueReadBuffer(cmd_queue, m1->main_buff,
+                    CL_NON_BLOCKING, 0,
+                    m1->canary.front, this_canary, 1, input_event,
+                    &(read_events[evt_index]));
+            check_cl_error(__FILE__, __LINE__, cl_err);
+
+            this_canary += m1->canary.front;
+            evt_index++;
+        }
 
         cl_err = clEnqueueReadBuffer(cmd_queue, m1->main_buff,
                 CL_NON_BLOCKING, offset,
-                POISON_FILL_LENGTH, this_canary, 1, input_event,
+                m1->canary.back, this_canary, 1, input_event,
                 &(read_events[evt_index]));
         check_cl_error(__FILE__, __LINE__, cl_err);
+        this_canary += m1->canary.back;
+        evt_index++;
     }
+    return evt_index;
+}
+
+/*
+ * total length of the canaries of a list of cl_mem buffers
+ */
+static size_t get_canaries_length(uint32_t num_cl_mem, void **buffer_ptrs)
+{
+    size_t len = 0;
+    for (uint32_t i = 0; i < num_cl_mem; i++)
+    {
+        cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), buffer_ptrs[i]);
+        if(m1 == NULL)
+        {
+            det_fprintf(stderr, "failure to find cl_memobj %p.\n", buffer_ptrs[i]);
+            exit(-1);
+        }
+        len += m1->canary.front + m1->canary.back;
+    }
+    return len;
 }
 
 void verify_cl_mem(kernel_info *kern_info, uint32_t num_cl_mem,
@@ -88,33 +109,35 @@ void verify_cl_mem(kernel_info *kern_info, uint32_t num_cl_mem,
     cl_command_queue cmd_queue;
     getCommandQueueForContext(kern_ctx, &cmd_queue);
 
-    void * canaries = malloc(POISON_FILL_LENGTH * POISON_REGIONS*num_cl_mem);
+    void * canaries = malloc(get_canaries_length(num_cl_mem, buffer_ptrs));
     cl_event * read_events = malloc(POISON_REGIONS*num_cl_mem * sizeof(cl_event));
     void ** buffer_cl_mem = malloc(num_cl_mem * sizeof(void*));
+    uint32_t * canary_lens = malloc(num_cl_mem * sizeof(uint32_t));
 
-    read_cl_mem_canaries(cmd_queue, num_cl_mem, canaries, buffer_ptrs,
-        buffer_cl_mem, evt, read_events);
+    uint32_t num_reads = read_cl_mem_canaries(cmd_queue, num_cl_mem,
+            canaries, buffer_ptrs, buffer_cl_mem, canary_lens, evt,
+            read_events);
 
-    cl_err = clWaitForEvents(POISON_REGIONS*num_cl_mem, read_events);
+    cl_err = clWaitForEvents(num_reads, read_events);
     check_cl_error(__FILE__, __LINE__, cl_err);
 
     // Now check the canaries for each cl_mem region
+    // casting to char* to do pointer arithmetic.
+    char * this_canary = (char *)canaries;
     for (uint32_t i = 0; i < num_cl_mem; i++)
     {
-        // casting to char* to do pointer arithmetic.
-        char * c_canaries = (char *)canaries;
-        void * this_canary = c_canaries + (i * POISON_REGIONS*POISON_FILL_LENGTH);
-
         //parse through the canary data
-        cpu_parse_canary(cmd_queue, POISON_REGIONS*POISON_FILL_LENGTH, this_canary, kern_info,
+        cpu_parse_canary(cmd_queue, canary_lens[i], (uint32_t*)this_canary, kern_info,
                 buffer_cl_mem[i], dupe);
+        this_canary += canary_lens[i];
     }
 
-    for (uint32_t i = 0; i < POISON_REGIONS*num_cl_mem; i++)
+    for (uint32_t i = 0; i < num_reads; i++)
     {
         clReleaseEvent(read_events[i]);
     }
 
+    free(canary_lens);
     free(buffer_cl_mem);
     free(read_events);
     free(canaries);
@@ -35,7 +35,7 @@
 #ifdef CL_VERSION_2_0
 static void set_up_svm_canary_copy(cl_context kern_ctx, uint32_t num_svm,
         void ** svm_ptrs, void **base_ptrs, void **map_ptrs,
-        void **canary_ptrs, uint8_t *right_context)
+        void **canary_ptrs, canary_geometry *geoms, uint8_t *right_context)
 {
     // Cast to char** so we can do pointer arithmetic
     char **c_base_ptrs = (char **)base_ptrs;
@@ -55,25 +55,21 @@ static void set_up_svm_canary_copy(cl_context kern_ctx, uint32_t num_svm,
 
         //index to beginning of canary region
         c_base_ptrs[i] = (char*)m1->main_buff;
-        uint32_t index = i*POISON_REGIONS;
-        uint32_t offset = m1->size;
-#ifdef UNDERFLOW_CHECK
-        canary_ptrs[index] = c_base_ptrs[i];
-
-        index++;
-        offset += POISON_FILL_LENGTH;
-#endif
-        canary_ptrs[index] = c_base_ptrs[i] + offset;
+        geoms[i] = m1->canary;
+        canary_ptrs[POISON_REGIONS*i] = c_base_ptrs[i];
+        canary_ptrs[POISON_REGIONS*i + POISON_REGIONS - 1] =
+            c_base_ptrs[i] + m1->canary.front + m1->size;
 
         map_ptrs[i] = clSVMAlloc(kern_ctx, CL_MEM_READ_WRITE,
-                POISON_REGIONS*POISON_FILL_LENGTH, 0);
+                m1->canary.front + m1->canary.back, 0);
     }
 }
 
 static void copy_and_map_svm_canaries(cl_context kern_ctx,
         cl_command_queue cmd_queue, uint32_t num_svm, void **canary_ptrs,
-        void **map_ptrs, cl_event * copy_events, cl_event * map_events,
-        const cl_event *incoming_evt, uint8_t * right_context)
+        const canary_geometry *geoms, void **map_ptrs, cl_event * copy_events,
+        cl_event * map_events, const cl_event *incoming_evt,
+        uint8_t * right_context)
 {
     cl_int cl_err;
     for (uint32_t i = 0; i < num_svm; i++)
@@ -86,38 +82,42 @@ static void copy_and_map_svm_canaries(cl_context kern_ctx,
             map_events[i] = create_complete_user_event(kern_ctx);
             continue;
         }
-        //copy canary region for this svm to smaller svm
-        cl_err = clEnqueueSVMMemcpy(cmd_queue, CL_NON_BLOCKING, map_ptrs[i],
-                canary_ptrs[POISON_REGIONS*i], POISON_FILL_LENGTH, 1, incoming_evt,
-                &copy_events[POISON_REGIONS*i]);
-        check_cl_error(__FILE__, __LINE__, cl_err);
+        //copy canary regions for this svm to smaller svm, front then back
+        uint32_t front = geoms[i].front;
+        if(front > 0)
+        {
+            cl_err = clEnqueueSVMMemcpy(cmd_queue, CL_NON_BLOCKING, map_ptrs[i],
+                    canary_ptrs[POISON_REGIONS*i], front, 1, incoming_evt,
+                    &copy_events[POISON_REGIONS*i]);
+            check_cl_error(__FILE__, __LINE__, cl_err);
+        }
+        else if(POISON_REGIONS > 1)
+            copy_events[POISON_REGIONS*i] = create_complete_user_event(kern_ctx);
 
-#ifdef UNDERFLOW_CHECK
-        cl_err = clEnqueueSVMMemcpy(cmd_queue, CL_NON_BLOCKING, (char*)map_ptrs[i] + POISON_FILL_LENGTH,
-                canary_ptrs[POISON_REGIONS*i + 1], POISON_FILL_LENGTH, 1, incoming_evt,
-                &copy_events[POISON_REGIONS*i + 1]);
+        cl_err = clEnqueueSVMMemcpy(cmd_queue, CL_NON_BLOCKING, (char*)map_ptrs[i] + front,
+                canary_ptrs[POISON_REGIONS*i + POISON_REGIONS - 1], geoms[i].back, 1, incoming_evt,
+                &copy_events[POISON_REGIONS*i + POISON_REGIONS - 1]);
         check_cl_error(__FILE__, __LINE__, cl_err);
-#endif
 
         //map in smaller svm
         cl_err = clEnqueueSVMMap(cmd_queue, CL_NON_BLOCKING, CL_MAP_READ,
-                map_ptrs[i], POISON_REGIONS*POISON_FILL_LENGTH, POISON_REGIONS, &copy_events[POISON_REGIONS*i],
+                map_ptrs[i], front + geoms[i].back, POISON_REGIONS, &copy_events[POISON_REGIONS*i],
                 &(map_events[i]));
         check_cl_error(__FILE__, __LINE__, cl_err);
     }
 }
 
 static void check_svm_buffers(cl_command_queue cmd_queue, uint32_t num_svm,
-        void **map_ptrs, void **svm_ptrs, uint8_t *right_context,
-        kernel_info *kern_info, uint32_t *dupe)
+        void **map_ptrs, void **svm_ptrs, const canary_geometry *geoms,
+        uint8_t *right_context, kernel_info *kern_info, uint32_t *dupe)
 {
     for (uint32_t i = 0; i < num_svm; i++)
     {
         if (right_context[i] == 0)
             continue;
         //parse through the canary data
-        cpu_parse_canary(cmd_queue, POISON_REGIONS*POISON_FILL_LENGTH, map_ptrs[i], kern_info,
-                svm_ptrs[i], dupe);
+        cpu_parse_canary(cmd_queue, geoms[i].front + geoms[i].back, map_ptrs[i],
+                kern_info, svm_ptrs[i], dupe);
     }
 }
 
@@ -185,6 +185,8 @@ void verify_svm(kernel_info *kern_info, uint32_t num_svm,
     void **base_ptrs = malloc(num_svm * sizeof(void*));
     // Array that points to the original canary regions
     void **canary_ptrs = malloc(POISON_REGIONS*num_svm * sizeof(void*));
+    // Canary lengths of each SVM buffer
+    canary_geometry *geoms = malloc(num_svm * sizeof(canary_geometry));
     // Array that points to all the mapped canaries
     void **map_ptrs = malloc(num_svm * sizeof(void*));
     cl_event * copy_events = malloc(POISON_REGIONS*num_svm * sizeof(cl_event));
@@ -193,15 +195,15 @@ void verify_svm(kernel_info *kern_info, uint32_t num_svm,
     uint8_t * right_context = calloc(num_svm, sizeof(uint8_t));
 
     set_up_svm_canary_copy(kern_ctx, num_svm, svm_ptrs, base_ptrs, map_ptrs,
-            canary_ptrs, right_context);
+            canary_ptrs, geoms, right_context);
 
     copy_and_map_svm_canaries(kern_ctx, cmd_queue, num_svm, canary_ptrs,
-            map_ptrs, copy_events, map_events, evt, right_context);
+            geoms, map_ptrs, copy_events, map_events, evt, right_context);
 
     cl_err = clWaitForEvents(num_svm, map_events);
     check_cl_error(__FILE__, __LINE__, cl_err);
-    check_svm_buffers(cmd_queue, num_svm, map_ptrs, svm_ptrs, right_context,
-            kern_info, dupe);
+    check_svm_buffers(cmd_queue, num_svm, map_ptrs, svm_ptrs, geoms,
+            right_context, kern_info, dupe);
 
     unmap_svm_buffers(kern_ctx, cmd_queue, num_svm, map_ptrs, unmap_events,
             right_context);
@@ -216,6 +218,7 @@ void verify_svm(kernel_info *kern_info, uint32_t num_svm,
     free(unmap_events);
     free(map_events);
     free(copy_events);
+    free(geoms);
     free(canary_ptrs);
     free(map_ptrs);
     free(base_ptrs);
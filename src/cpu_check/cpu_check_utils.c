@@ -27,6 +27,7 @@
 #include "check_utils.h"
 #include "overflow_error.h"
 #include "util_functions.h"
+#include "canary_policy.h"
 
 #include "cpu_check_utils.h"
 
@@ -38,6 +39,18 @@ static uint32_t divide_ceiling(uint32_t a, uint32_t b)
     return ret;
 }
 
+/*
+ * last byte of a canary that does not hold poison
+ */
+static uint32_t last_change(uint32_t check_len, const uint32_t *map_ptr)
+{
+    const uint8_t *bytes = (const uint8_t*)map_ptr;
+    uint32_t i = check_len;
+    while(i > 0 && bytes[i - 1] == poisonFill_8b)
+        i--;
+    return (i > 0) ? i - 1 : 0;
+}
+
 void cpu_parse_canary(cl_command_queue cmd_queue, uint32_t check_len,
         uint32_t *map_ptr, kernel_info *kern_info, void *buffer,
         uint32_t *dupe)
@@ -64,6 +77,8 @@ void cpu_parse_canary(cl_command_queue cmd_queue, uint32_t check_len,
                 }
 
                 overflowError(kern_info, buffer, sizeof(uint32_t)*p + q, backtrace_str);
+                noteCanaryOverflow(buffer, sizeof(uint32_t)*p + q,
+                        last_change(check_len, map_ptr));
                 printDupeWarning(kern_info->handle, dupe);
                 optionalKillOnOverflow(get_exitcode_envvar(), 0);
                 mendCanaryRegion(cmd_queue, buffer, CL_TRUE, 0, NULL, NULL);
@@ -50,7 +50,6 @@
 
 #include "bufferOverflowDetect.h"
 
-const unsigned poisonWordLen = POISON_FILL_LENGTH / sizeof(unsigned);
 const uint8_t poisonFill_8b = POISON_FILL;
 const unsigned poisonFill_32b = POISON_FILL_32B;
 
@@ -73,80 +72,239 @@ void findDuplicates(uint32_t nargs, kernel_arg *args, uint32_t **dupe_p)
     }
     dupe = calloc(nargs, sizeof(uint32_t));
     uint32_t i, j;
-    kernel_arg *arg_itr, *arg_itr2;
 
-    arg_itr = args;
     for(i=0; i < nargs; i++)
     {
         dupe[i] = i;
-        if(arg_itr->buffer)
+        if(args[i].is_set && args[i].buffer)
         {
-            arg_itr2 = args;
             for(j=0; j < i; j++)
             {
-                if(arg_itr2->buffer)
+                if(args[j].is_set && args[j].buffer)
                 {
-                    if(arg_itr->buffer->handle == arg_itr2->buffer->handle)
+                    if(args[i].buffer->handle == args[j].buffer->handle)
                     {
                         dupe[i] = j;
                         break;
                     }
                 }
-                arg_itr2 = arg_itr2->next;
             }
         }
-        arg_itr = arg_itr->next;
     }
     *dupe_p = dupe;
 }
 
+#ifdef CL_VERSION_2_0
+static int comparePointers(const void *a, const void *b)
+{
+    uintptr_t pa = (uintptr_t)*(void * const *)a;
+    uintptr_t pb = (uintptr_t)*(void * const *)b;
+    return (pa > pb) - (pa < pb);
+}
+
 /*
- * launch canary verification on either the host or gpu
+ * find the SVM allocations a kernel can reach: those passed as written
+ * arguments and those declared with clSetKernelExecInfo
+ * with fine-grain system SVM the kernel can reach anything, so no list is kept
+ * must hold kinfo->arg_lock
  *
  */
-void verifyBufferInBounds(cl_command_queue cmdQueue, cl_kernel kern, uint32_t *dupe, const cl_event *evt, cl_event *retEvt)
+static void findReachableSVM(kernel_info *kinfo, kernel_launch_plan *plan,
+        uint8_t check_read_only)
+{
+    uint32_t i, num = 0;
+
+    if(kinfo->svm_fine_grain_system)
+    {
+        plan->has_svm = 1;
+        plan->svm_sweep = 1;
+        return;
+    }
+
+    if(plan->nargs + kinfo->num_exec_svm_ptrs == 0)
+        return;
+    plan->svm_ptrs = calloc(sizeof(void*), plan->nargs + kinfo->num_exec_svm_ptrs);
+    if(plan->svm_ptrs == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // Pointers may point anywhere inside their allocation.
+    for(i = 0; i < plan->nargs; i++)
+    {
+        kernel_arg *kernArg = &kinfo->args[i];
+        cl_svm_memobj *m;
+        if(plan->arg_kind[i] != KARG_SVM ||
+                (kernArg->read_only && !check_read_only))
+            continue;
+        m = cl_svm_mem_find(get_cl_svm_mem_alloc(), *(void**)kernArg->value);
+        if(m == NULL || m->detector_internal_buffer)
+            continue;
+        plan->svm_ptrs[num++] = m->handle;
+    }
+
+    for(i = 0; i < kinfo->num_exec_svm_ptrs; i++)
+    {
+        cl_svm_memobj *m = cl_svm_mem_find(get_cl_svm_mem_alloc(),
+                kinfo->exec_svm_ptrs[i]);
+        if(m == NULL || m->detector_internal_buffer)
+            continue;
+        plan->svm_ptrs[num++] = m->handle;
+        plan->has_svm = 1;
+    }
+
+    // Applications can declare tens of thousands of pointers, so sort
+    // rather than search to drop the duplicates.
+    qsort(plan->svm_ptrs, num, sizeof(void*), comparePointers);
+    plan->num_svm = 0;
+    for(i = 0; i < num; i++)
+    {
+        if(plan->num_svm == 0 || plan->svm_ptrs[plan->num_svm - 1] != plan->svm_ptrs[i])
+            plan->svm_ptrs[plan->num_svm++] = plan->svm_ptrs[i];
+    }
+}
+#endif
+
+/*
+ * build the launch plan for a kernel from its current argument list
+ * reuses the cached plan if no argument has changed since it was built
+ *
+ */
+kernel_launch_plan* getKernelLaunchPlan(kernel_info *kinfo)
 {
-    cl_int cl_err;
     uint32_t i, nargs;
-    uint8_t hasSVM = 0;
-    kernel_info *kernInfo;
+    kernel_launch_plan *plan;
     kernel_arg *kernArg;
-    uint32_t numBuffs, numSVM, numImgs;
 
-    cl_err = clGetKernelInfo(kern, CL_KERNEL_NUM_ARGS, sizeof(nargs), &nargs, 0);
-    check_cl_error(__FILE__, __LINE__, cl_err);
+    // Hold the argument table still while we look through it. clSetKernelArg
+    // marks the plan dirty under the same lock.
+    pthread_mutex_lock(&kinfo->arg_lock);
+    if(kinfo->launch_plan != NULL && !kinfo->plan_dirty)
+    {
+        plan = kinfo->launch_plan;
+        pthread_mutex_unlock(&kinfo->arg_lock);
+        return plan;
+    }
 
-    //count out buffers to be checked
-    kernInfo = kinfo_find(get_kern_list(), kern);
-    numBuffs = 0;
-    numImgs = 0;
+    nargs = kinfo->num_args;
+
+    plan = calloc(sizeof(kernel_launch_plan), 1);
+    if(plan == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    plan->nargs = nargs;
+    findDuplicates(nargs, kinfo->args, &plan->dupe);
+    if(nargs > 0)
+    {
+        plan->arg_kind = calloc(sizeof(kernel_arg_kind), nargs);
+        plan->written = calloc(sizeof(uint8_t), nargs);
+    }
+
+    //arguments declared const, __constant or read_only cannot be written,
+    //so their canaries cannot change
+    uint8_t check_read_only = (get_check_read_only_envvar() != 0);
+
+    //classify arguments and find the buffers and images that may be written
     for(i = 0; i < nargs; i++)
     {
-        if(dupe != NULL && dupe[i] == i)
+        cl_memobj *m1 = NULL;
+        kernArg = &kinfo->args[i];
+        plan->arg_kind[i] = KARG_VALUE;
+        if(!kernArg->is_set)
+            continue;
+        m1 = kernArg->buffer;
+        if(m1 != NULL)
         {
-            cl_memobj *m1 = NULL;
-            cl_svm_memobj *m2 = NULL;
-            kernArg = karg_find(kernInfo->arg_list, i);
-            if(kernArg != NULL)
-            {
-                m1 = kernArg->buffer; //is it a cl_mem?
-                m2 = kernArg->svm_buffer;
-            }
-            if(m1 != NULL)
-            {
-                if(m1->is_image)
-                    numImgs++;
-                else
-                    numBuffs++;
-            }
-            else if(m2 != NULL)
-                hasSVM = 1;
+            plan->arg_kind[i] = (m1->is_image) ? KARG_IMAGE : KARG_BUFFER;
+            if((check_read_only || !kernArg->read_only) && !m1->canary_dropped)
+                plan->written[plan->dupe[i]] = 1;
+        }
+        else if(kernArg->svm_buffer != NULL)
+        {
+            plan->arg_kind[i] = KARG_SVM;
+            plan->has_svm = 1;
         }
     }
 
+#ifdef CL_VERSION_2_0
+    findReachableSVM(kinfo, plan, check_read_only);
+#endif
+
+    //count the unique buffers and images that need checking
+    for(i = 0; i < nargs; i++)
+    {
+        if(plan->dupe[i] != i || !plan->written[i])
+            continue;
+        if(!kinfo->args[i].buffer->has_canary)
+            plan->needs_clone = 1;
+        if(plan->arg_kind[i] == KARG_IMAGE)
+            plan->num_imgs++;
+        else
+            plan->num_buffs++;
+    }
+
+    if(plan->num_buffs > 0)
+        plan->buffer_ptrs = (void**)calloc(sizeof(void*), plan->num_buffs);
+    if(plan->num_imgs > 0)
+        plan->image_ptrs = (void**)calloc(sizeof(void*), plan->num_imgs);
+
+    uint32_t numBuffs = 0, numImgs = 0;
+    for(i = 0; i < nargs; i++)
+    {
+        if(plan->dupe[i] != i || !plan->written[i])
+            continue;
+        if(plan->arg_kind[i] == KARG_BUFFER || plan->arg_kind[i] == KARG_IMAGE)
+        {
+            kernArg = &kinfo->args[i];
+            if(plan->arg_kind[i] == KARG_IMAGE)
+                plan->image_ptrs[numImgs++] = kernArg->buffer->handle;
+            else
+                plan->buffer_ptrs[numBuffs++] = kernArg->buffer->handle;
+        }
+    }
+
+    kernel_launch_plan_delete(kinfo->launch_plan);
+    kinfo->launch_plan = plan;
+    kinfo->plan_dirty = 0;
+    pthread_mutex_unlock(&kinfo->arg_lock);
+    return plan;
+}
+
+/*
+ * launch canary verification on either the host or gpu
+ *
+ */
+void verifyBufferInBounds(cl_command_queue cmdQueue, cl_kernel kern, const cl_event *evt, cl_event *retEvt)
+{
+    kernel_info *kernInfo;
+
+    kernInfo = kinfo_find(get_kern_list(), kern);
+    verifyPlanInBounds(cmdQueue, kernInfo, getKernelLaunchPlan(kernInfo), evt, retEvt);
+}
+
+/*
+ * launch canary verification for the buffers of a specific launch plan
+ *
+ */
+void verifyPlanInBounds(cl_command_queue cmdQueue, kernel_info *kernInfo,
+        const kernel_launch_plan *plan, const cl_event *evt, cl_event *retEvt)
+{
+    uint32_t *dupe;
+    uint32_t numBuffs, numSVM, numImgs;
+
+    dupe = plan->dupe;
+    numBuffs = plan->num_buffs;
+    numImgs = plan->num_imgs;
+
     //count svm
+    //with fine-grain system SVM every live allocation is checked, otherwise
+    //only the ones the kernel was given
     numSVM = 0;
-    if(hasSVM)
+    if(plan->svm_sweep)
     {
 #ifdef CL_VERSION_2_0
         cl_svm_memobj *svmIter = cl_svm_mem_next(get_cl_svm_mem_alloc(), 0);
@@ -158,61 +316,82 @@ void verifyBufferInBounds(cl_command_queue cmdQueue, cl_kernel kern, uint32_t *d
         }
 #endif
     }
+    else
+        numSVM = plan->num_svm;
 
-    //allocate references for buffers being checked
-    void **buffer_ptrs = NULL, **image_ptrs = NULL;
+    //the cl_mem buffers and images come straight from the launch plan
+    //only SVM allocations need to be appended for this launch
+    void **buffer_ptrs = plan->buffer_ptrs, **image_ptrs = plan->image_ptrs;
     uint32_t totalBuffs = numBuffs;
     uint32_t totalSVM = numSVM;
     uint32_t totalImgs = numImgs;
-    if(totalBuffs + totalSVM > 0)
-        buffer_ptrs = (void**)calloc(sizeof(void*), totalBuffs + totalSVM);
-    if(totalImgs > 0)
-        image_ptrs = (void**)calloc(sizeof(void*), totalImgs);
-
-    //populate buffer list & image list
-    numBuffs = 0;
-    numImgs = 0;
-    for (i = 0; i < nargs; i++)
+    if(totalSVM > 0)
     {
-        if (dupe != NULL && dupe[i] == i)
+        buffer_ptrs = (void**)calloc(sizeof(void*), totalBuffs + totalSVM);
+        if(totalBuffs > 0)
+            memcpy(buffer_ptrs, plan->buffer_ptrs, sizeof(void*) * totalBuffs);
+#ifdef CL_VERSION_2_0
+        numSVM = 0;
+        if(plan->svm_sweep)
         {
-            cl_memobj *m1 = NULL;
-            kernArg = karg_find(kernInfo->arg_list, i);
-            if (kernArg != NULL)
-                m1 = kernArg->buffer; //is it a cl_mem?
-            if (m1 != NULL)
+            cl_svm_memobj *svmIter = cl_svm_mem_next(get_cl_svm_mem_alloc(), 0);
+            while(svmIter != NULL && numSVM < totalSVM)
             {
-                if(m1->is_image && image_ptrs)
-                {
-                    image_ptrs[numImgs] = m1->handle;
-                    numImgs++;
-                }
-                if(!(m1->is_image) && buffer_ptrs)
+                if(svmIter->detector_internal_buffer != 1)
                 {
-                    buffer_ptrs[numBuffs] = m1->handle;
-                    numBuffs++;
+                    buffer_ptrs[totalBuffs+numSVM] = svmIter->handle;
+                    numSVM++;
                 }
+                svmIter = cl_svm_mem_next(get_cl_svm_mem_alloc(), svmIter->handle);
             }
         }
+        else
+        {
+            //skip allocations that were freed since the plan was built
+            uint32_t i;
+            for(i = 0; i < plan->num_svm; i++)
+            {
+                cl_svm_memobj *m = cl_svm_mem_find(get_cl_svm_mem_alloc(),
+                        plan->svm_ptrs[i]);
+                if(m != NULL && m->handle == plan->svm_ptrs[i])
+                    buffer_ptrs[totalBuffs+numSVM++] = m->handle;
+            }
+        }
+#endif
+        totalSVM = numSVM;
     }
 
-    //populate buffer list
-    if(hasSVM)
-    {
 #ifdef CL_VERSION_2_0
-        numSVM = 0;
-        cl_svm_memobj *svmIter = cl_svm_mem_next(get_cl_svm_mem_alloc(), 0);
-        while(svmIter != NULL && buffer_ptrs != NULL && numSVM < totalSVM)
+    // Allocations made since the launch may still be getting canaries, so
+    // the check also waits for their fills.
+    cl_event svm_ready = NULL;
+    if(totalSVM > 0)
+    {
+        cl_uint num_init = 0, i;
+        cl_event *init = getSVMInitEvents(totalSVM, &buffer_ptrs[totalBuffs],
+                &num_init);
+        if(num_init > 0)
         {
-            if(svmIter->detector_internal_buffer != 1)
+            cl_event *wait_list = calloc(sizeof(cl_event), num_init + 1);
+            if(wait_list == NULL)
             {
-                buffer_ptrs[totalBuffs+numSVM] = svmIter->handle;
-                numSVM++;
+                det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+                exit(-1);
             }
-            svmIter = cl_svm_mem_next(get_cl_svm_mem_alloc(), svmIter->handle);
+            memcpy(wait_list, init, sizeof(cl_event) * num_init);
+            if(evt != NULL)
+                wait_list[num_init] = *evt;
+            cl_int cl_err = clEnqueueMarkerWithWaitList(cmdQueue,
+                    num_init + (evt != NULL), wait_list, &svm_ready);
+            check_cl_error(__FILE__, __LINE__, cl_err);
+            evt = &svm_ready;
+            free(wait_list);
+            for(i = 0; i < num_init; i++)
+                clReleaseEvent(init[i]);
         }
-#endif
+        free(init);
     }
+#endif
 
     uint32_t checkItems = totalBuffs + totalSVM + totalImgs;
 
@@ -260,67 +439,81 @@ void verifyBufferInBounds(cl_command_queue cmdQueue, cl_kernel kern, uint32_t *d
             clSetUserEventStatus(*retEvt, CL_COMPLETE);
         }
     }
+    else if(retEvt)
+    {
+        //nothing to check, but the caller still expects an event
+        cl_int cl_err;
+#ifdef CL_VERSION_1_2
+        cl_err = clEnqueueMarkerWithWaitList(cmdQueue, (evt != NULL), evt, retEvt);
+#else
+        cl_err = clEnqueueMarker(cmdQueue, retEvt);
+#endif
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
 
-    if(buffer_ptrs != NULL)
+    if(buffer_ptrs != plan->buffer_ptrs)
         free(buffer_ptrs);
-    if(image_ptrs != NULL)
-        free(image_ptrs);
+#ifdef CL_VERSION_2_0
+    if(svm_ready != NULL)
+        clReleaseEvent(svm_ready);
+#endif
 }
 
 /*
- * deletes the kernel, and internally created objects
+ * forget the mirrors a cloned kernel was given and return it to the kernel pool
+ * the mirrors themselves live on with the objects they mirror
+ *
+ */
+static void CL_CALLBACK returnPoisonKernel(cl_event event, cl_int status, void *user_data)
+{
+    uint32_t i;
+    cl_kernel del_kern = (cl_kernel)user_data;
+    kernel_info *del_kern_info;
+    if(event || status){}
+
+    del_kern_info = kinfo_find(get_kern_list(), del_kern);
+
+    // A pooled clone must not keep pointing at a mirror that may be
+    // released along with its object before the clone is used again.
+    for(i = 0; del_kern_info != NULL && i < del_kern_info->num_args; i++)
+    {
+        if(del_kern_info->args[i].buffer != NULL || del_kern_info->args[i].svm_buffer != NULL)
+            karg_clear(del_kern_info, i);
+    }
+
+    // Keep the clone around for the next launch of this kernel function.
+    if(del_kern_info == NULL ||
+            kpool_return(del_kern_info->program, del_kern_info->name, del_kern))
+        clReleaseKernel(del_kern);
+}
+
+/*
+ * returns a cloned kernel to the kernel pool once its launch completes
  *  Arguments:
  *      cl_kernel del_kern
  *          kernel to be deleted
- *      uint32_t *dupe
- *          list of duplicate arguments
- *          kernel argument represented by index i is unique or first if the value at index i is equal to i
+ *      cl_event evt
+ *          event of the launch of del_kern
  */
-void delPoisonKernel(cl_kernel del_kern, uint32_t *dupe)
+void delPoisonKernel(cl_kernel del_kern, cl_event evt)
 {
     cl_int cl_err;
-    uint32_t i, nargs;
-    kernel_info *del_kern_info;
-    kernel_arg *del_kern_arg;
-
-    if(dupe == NULL){ exit(-1); }
+    cl_context ctx;
 
-    cl_err = clGetKernelInfo(del_kern, CL_KERNEL_NUM_ARGS, sizeof(nargs), &nargs, 0);
+    cl_err = clGetKernelInfo(del_kern, CL_KERNEL_CONTEXT, sizeof(cl_context), &ctx, NULL);
     check_cl_error(__FILE__, __LINE__, cl_err);
 
-    del_kern_info = kinfo_find(get_kern_list(), del_kern);
-
-    // delete arguments with host pointers
-    // temporary extended copies of the original buffers were made for these
-    for(i = 0; i < nargs; i++)
+    // A clone is not handed to another launch until this one is done with it.
+    // Like the GPU checker, avoid event callbacks on NVIDIA. Giving the clone
+    // back right away is still correct there, since the arguments of an
+    // enqueued kernel are captured when it is enqueued.
+    if(!is_nvidia_platform(ctx))
     {
-        if(dupe[i] == i)
-        {
-            cl_memobj *m1 = NULL;
-            del_kern_arg = karg_remove(&del_kern_info->arg_list, i);
-            if(del_kern_arg != NULL)
-            {
-                m1 = del_kern_arg->buffer; //is it a cl_mem?
-            }
-            if(m1 != NULL)
-            {
-                if(m1->detector_internal_buffer)
-                {
-                    if(m1->host_ptr != NULL)
-                    {
-                        free(m1->host_ptr);
-                        m1->host_ptr = NULL;
-                    }
-
-                    cl_err = clReleaseMemObject(m1->handle);
-                    check_cl_error(__FILE__, __LINE__, cl_err);
-                }
-                karg_delete(del_kern_arg);
-            }
-        }
+        cl_err = clSetEventCallback(evt, CL_COMPLETE, returnPoisonKernel, del_kern);
+        check_cl_error(__FILE__, __LINE__, cl_err);
     }
-
-    clReleaseKernel(del_kern);
+    else
+        returnPoisonKernel(evt, CL_COMPLETE, del_kern);
 }
 
 /*
@@ -335,6 +528,20 @@ cl_kernel kernelDuplicate(cl_kernel kernel)
     char *kernel_name;
     size_t name_length;
 
+#ifdef CL_VERSION_2_1
+    // clCloneKernel skips the runtime's kernel creation work, but is only
+    // safe to call if the platform actually implements OpenCL 2.1.
+    cl_context ctx;
+    cl_err = clGetKernelInfo(kernel, CL_KERNEL_CONTEXT, sizeof(cl_context), &ctx, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    if(platform_supports_cl_version(ctx, 2, 1))
+    {
+        new_kernel = clCloneKernel(kernel, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        return new_kernel;
+    }
+#endif
+
     cl_err = clGetKernelInfo(kernel, CL_KERNEL_PROGRAM, sizeof(cl_program), &program, NULL);
     check_cl_error(__FILE__, __LINE__, cl_err);
 
@@ -355,50 +562,450 @@ cl_kernel kernelDuplicate(cl_kernel kernel)
 }
 
 /*
- * clone kernel replacing arguments using pre-allocated memory with internally allocated buffers
+ * remember the program and function name of a kernel
+ * these identify the kernel's clones in the kernel pool
+ *
+ */
+static void setKernelPoolKey(kernel_info *kinfo, cl_program program, const char *name)
+{
+    if(kinfo == NULL || kinfo->name != NULL)
+        return;
+    kinfo->program = program;
+    kinfo->name = strdup(name);
+    if(kinfo->name == NULL)
+    {
+        det_fprintf(stderr, "strdup failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+}
+
+static void findKernelPoolKey(kernel_info *kinfo)
+{
+    cl_int cl_err;
+    cl_program program;
+    char *kernel_name;
+    size_t name_length;
+
+    if(kinfo->name != NULL)
+        return;
+
+    cl_err = clGetKernelInfo(kinfo->handle, CL_KERNEL_PROGRAM, sizeof(cl_program), &program, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_err = clGetKernelInfo(kinfo->handle, CL_KERNEL_FUNCTION_NAME, 0, NULL, &name_length);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    kernel_name = (char *)malloc(sizeof(char) * name_length);
+
+    cl_err = clGetKernelInfo(kinfo->handle, CL_KERNEL_FUNCTION_NAME, name_length, kernel_name, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    setKernelPoolKey(kinfo, program, kernel_name);
+    kpool_add_user(program, kernel_name);
+    free(kernel_name);
+}
+
+/*
+ * objects created by the detector to mirror a user's buffer or image
+ * are copied to and from with the normal cl_mem APIs, which must not try to
+ * keep the mirrors coherent while we are doing exactly that
+ *
+ */
+static __thread uint8_t in_mirror_copy = 0;
+
+// guards the init_event of every cl_memobj
+static pthread_mutex_t buffer_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+cl_event getBufferInitEvent(cl_memobj *m)
+{
+    cl_event ret = NULL;
+    pthread_mutex_lock(&buffer_init_lock);
+    if(m->init_event != NULL)
+    {
+        cl_int status = CL_QUEUED;
+        cl_int cl_err = clGetEventInfo(m->init_event,
+                CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status,
+                NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        // Failed commands have a negative status, and are done as well.
+        if(status <= CL_COMPLETE)
+        {
+            clReleaseEvent(m->init_event);
+            m->init_event = NULL;
+        }
+        else
+        {
+            clRetainEvent(m->init_event);
+            ret = m->init_event;
+        }
+    }
+    pthread_mutex_unlock(&buffer_init_lock);
+    return ret;
+}
+
+/*
+ * make the commands enqueued on command_queue from now on wait for the
+ * canary fills of an object, if they may not have finished yet
+ *
+ */
+static void waitBufferInit(cl_command_queue command_queue, cl_memobj *m)
+{
+    cl_int cl_err;
+    cl_event init = getBufferInitEvent(m);
+    if(init == NULL)
+        return;
+#ifdef CL_VERSION_1_2
+    cl_err = clEnqueueBarrierWithWaitList(command_queue, 1, &init, NULL);
+#else
+    cl_err = clEnqueueWaitForEvents(command_queue, 1, &init);
+#endif
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clReleaseEvent(init);
+}
+
+/*
+ * the object that owns the storage shared by a buffer and its sub-buffers
+ *
+ */
+static cl_memobj* mirrorStorageOwner(cl_memobj *m)
+{
+    cl_memobj *owner;
+    if(!m->is_sub)
+        return m;
+    owner = cl_mem_find(get_cl_mem_alloc(), m->parent);
+    return (owner != NULL) ? owner : m;
+}
+
+/*
+ * copy the full contents of an object to or from its mirror
+ * if out is NULL, returns once the copy has completed
+ * otherwise returns right away, and out is the event of the copy
+ *
+ */
+static void copyMirror(cl_command_queue command_queue, const cl_memobj *m,
+        cl_mem from, cl_mem to, cl_uint num_events, const cl_event *event_list,
+        cl_event *out)
+{
+    cl_int cl_err;
+    cl_event copy_event;
+
+    in_mirror_copy = 1;
+    if(m->is_image)
+    {
+        size_t origin[] = {0,0,0}, region[3];
+        region[0] = m->image_desc.image_width;
+        region[1] = m->image_desc.image_height;
+        region[2] = m->image_desc.image_depth;
+        if(m->image_desc.image_type == CL_MEM_OBJECT_IMAGE1D_ARRAY)
+            region[1] = m->image_desc.image_array_size;
+        else if(m->image_desc.image_type == CL_MEM_OBJECT_IMAGE2D_ARRAY)
+            region[2] = m->image_desc.image_array_size;
+
+        cl_image_copy(command_queue, from, to, origin, origin, region,
+                num_events, event_list, &copy_event);
+    }
+    else
+        cl_buffer_copy(command_queue, from, to, 0, 0, m->size,
+                num_events, event_list, &copy_event);
+    in_mirror_copy = 0;
+
+    if(out != NULL)
+    {
+        *out = copy_event;
+        return;
+    }
+    cl_err = clWaitForEvents(1, &copy_event);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clReleaseEvent(copy_event);
+}
+
+/*
+ * copy the dirty mirror of a storage owner's family (if any) back into the storage
+ * uses the queue the mirror was last written on if command_queue is NULL
+ * the copy also waits for the launch that wrote the mirror, which may have
+ * been on another queue
+ * see copyMirror() for the meaning of out
+ *
+ * 1 if a copy was enqueued
+ * 0 if there was nothing to copy
+ */
+static int flushDirtyMirror(cl_memobj *owner, cl_command_queue command_queue,
+        cl_uint num_events, const cl_event *event_list, cl_event *out)
+{
+    cl_memobj *dirty = owner->dirty_mirror;
+    cl_event *wait_list = NULL;
+    if(dirty == NULL)
+        return 0;
+    if(command_queue == NULL)
+        command_queue = owner->dirty_queue;
+
+    if(owner->dirty_event != NULL)
+    {
+        wait_list = malloc(sizeof(cl_event) * (num_events + 1));
+        if(wait_list == NULL)
+        {
+            det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        if(num_events > 0)
+            memcpy(wait_list, event_list, sizeof(cl_event) * num_events);
+        wait_list[num_events++] = owner->dirty_event;
+        event_list = wait_list;
+    }
+
+    copyMirror(command_queue, dirty, dirty->mirror, dirty->handle,
+            num_events, event_list, out);
+
+    owner->dirty_mirror = NULL;
+    clReleaseCommandQueue(owner->dirty_queue);
+    owner->dirty_queue = NULL;
+    if(owner->dirty_event != NULL)
+    {
+        clReleaseEvent(owner->dirty_event);
+        owner->dirty_event = NULL;
+        free(wait_list);
+    }
+    return 1;
+}
+
+/*
+ * create a canaried object with the same description as m
+ *
+ */
+static cl_mem createMirror(const cl_memobj *m)
+{
+    cl_int cl_err;
+    cl_mem new_buffer;
+    cl_mem_flags flags;
+    cl_context new_ctx;
+
+    new_ctx = m->context;
+    flags = m->flags;
+
+    flags = flags & ~CL_MEM_USE_HOST_PTR & ~CL_MEM_COPY_HOST_PTR;
+    flags = flags & ~CL_MEM_ALLOC_HOST_PTR;
+    // The clone writes buffer mirrors and the checker reads them back,
+    // whatever the application's own buffer allowed.
+    if(!m->is_image)
+    {
+        flags &= ~(MEM_DEVICE_ACCESS_FLAGS | MEM_HOST_ACCESS_FLAGS);
+        flags |= CL_MEM_READ_WRITE;
+    }
+
+    if(m->is_image)
+    {
+#ifdef CL_VERSION_1_2
+        cl_image_desc desc;
+        desc.image_type = m->image_desc.image_type;
+        desc.image_width = m->image_desc.image_width;
+        desc.image_height = m->image_desc.image_height;
+        desc.image_depth = m->image_desc.image_depth;
+        desc.image_array_size = m->image_desc.image_array_size;
+        desc.image_row_pitch = m->image_desc.image_row_pitch;
+        desc.image_slice_pitch = m->image_desc.image_slice_pitch;
+        desc.num_mip_levels = m->image_desc.num_mip_levels;
+        desc.num_samples = m->image_desc.num_samples;
+        desc.buffer = NULL;
+        new_buffer = clCreateImage(new_ctx, flags, &m->image_format, &desc, NULL, &cl_err);
+#else
+        if(m->image_desc.image_type == CL_MEM_OBJECT_IMAGE3D)
+        {
+            new_buffer = clCreateImage3D(new_ctx, flags,
+                    &m->image_format,
+                    m->image_desc.image_width,
+                    m->image_desc.image_height,
+                    m->image_desc.image_depth,
+                    m->image_desc.image_row_pitch,
+                    m->image_desc.image_slice_pitch,
+                    m->host_ptr, &cl_err);
+        }
+        else
+        {
+            new_buffer = clCreateImage2D(new_ctx, flags,
+                    &m->image_format,
+                    m->image_desc.image_width,
+                    m->image_desc.image_height,
+                    m->image_desc.image_row_pitch,
+                    m->host_ptr, &cl_err);
+        }
+#endif // CL_VERSION_1_2
+    }
+    else
+        new_buffer = clCreateBuffer(new_ctx, flags, m->size, NULL, &cl_err);
+
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_memobj* newBuffInfo = cl_mem_find(get_cl_mem_alloc(), new_buffer);
+    newBuffInfo->detector_internal_buffer = 1;
+    // Overflows of the mirror are the application's, at its object's site.
+    newBuffInfo->alloc_site = m->alloc_site;
+    return new_buffer;
+}
+
+/*
+ * get the canaried mirror of an object, creating it on first use
+ * the mirror is only refreshed if the object was written since it was last copied
+ * the refresh waits on all of launch_events, and its event is appended to
+ * them, as are the mirror's own canary fills while they may be pending
+ *
+ */
+static cl_mem getBufferMirror(cl_command_queue command_queue, cl_memobj *m,
+        cl_uint *num_launch_events, cl_event *launch_events)
+{
+    cl_memobj *owner = mirrorStorageOwner(m);
+    cl_memobj *mirror_info;
+    cl_event init;
+
+    if(m->mirror == NULL)
+    {
+        m->mirror = createMirror(m);
+        // Make sure the first copy below happens.
+        m->mirror_epoch = owner->write_epoch - 1;
+    }
+
+    mirror_info = cl_mem_find(get_cl_mem_alloc(), m->mirror);
+    init = (mirror_info != NULL) ? getBufferInitEvent(mirror_info) : NULL;
+    if(init != NULL)
+        launch_events[(*num_launch_events)++] = init;
+
+    if(m->mirror_epoch != owner->write_epoch)
+    {
+        copyMirror(command_queue, m, m->handle, m->mirror,
+                *num_launch_events, launch_events,
+                &launch_events[*num_launch_events]);
+        (*num_launch_events)++;
+        m->mirror_epoch = owner->write_epoch;
+    }
+    return m->mirror;
+}
+
+/*
+ * copy back unsaved mirror data before an API call uses an object
+ *
+ */
+void syncMirrorBeforeAccess(cl_command_queue command_queue, cl_mem memobj,
+        cl_uint num_events, const cl_event *event_list)
+{
+    cl_memobj *m;
+    if(in_mirror_copy)
+        return;
+    m = cl_mem_find(get_cl_mem_alloc(), memobj);
+    if(m == NULL || m->detector_internal_buffer)
+        return;
+    waitBufferInit(command_queue, m);
+    flushDirtyMirror(mirrorStorageOwner(m), command_queue, num_events, event_list, NULL);
+}
+
+/*
+ * an API call wrote an object, so its mirrors are out of date
+ *
+ */
+void invalidateMirrors(cl_mem memobj)
+{
+    cl_memobj *m;
+    if(in_mirror_copy)
+        return;
+    m = cl_mem_find(get_cl_mem_alloc(), memobj);
+    if(m == NULL || m->detector_internal_buffer)
+        return;
+    mirrorStorageOwner(m)->write_epoch++;
+}
+
+/*
+ * save and release the mirror of an object that is going away
+ *
+ */
+void releaseMirror(cl_memobj *m)
+{
+    cl_memobj *owner = mirrorStorageOwner(m);
+
+    // The mirror may hold the only up-to-date copy of this object, and if
+    // this owns the storage then sub-buffers can no longer find it later.
+    if(owner->dirty_mirror == m || owner == m)
+        flushDirtyMirror(owner, NULL, 0, NULL, NULL);
+
+    if(m->mirror != NULL)
+    {
+        releaseInternalMemObject(m->mirror);
+        m->mirror = NULL;
+    }
+}
+
+/*
+ * make sure every buffer argument of the kernel sees the latest data
+ * canary fills that may still be pending are appended to launch_events.
+ * any mirror holding newer data than its storage is copied back, unless the
+ * kernel is about to use that same mirror. arguments the kernel only reads
+ * are given their original object, so their dirty mirror is always copied back.
+ * the copies wait on all of launch_events, and their events are appended to them
+ *
+ */
+static void syncKernelMirrors(cl_command_queue command_queue, kernel_info *kinfo,
+        const kernel_launch_plan *plan, cl_uint *num_launch_events,
+        cl_event *launch_events)
+{
+    uint32_t i;
+    for(i = 0; i < plan->nargs; i++)
+    {
+        cl_memobj *m, *owner;
+        cl_event init;
+        int binds_mirror;
+        if(plan->dupe[i] != i ||
+                (plan->arg_kind[i] != KARG_BUFFER && plan->arg_kind[i] != KARG_IMAGE))
+            continue;
+        m = kinfo->args[i].buffer;
+        init = getBufferInitEvent(m);
+        if(init != NULL)
+            launch_events[(*num_launch_events)++] = init;
+        owner = mirrorStorageOwner(m);
+        // createPoisonedKernel() binds the mirror only for these arguments.
+        binds_mirror = plan->written[i] && !m->has_canary;
+        if(owner->dirty_mirror != NULL &&
+                (owner->dirty_mirror != m || !binds_mirror) &&
+                flushDirtyMirror(owner, command_queue, *num_launch_events,
+                    launch_events, &launch_events[*num_launch_events]))
+            (*num_launch_events)++;
+    }
+}
+
+/*
+ * clone kernel replacing arguments using pre-allocated memory with their canaried mirrors
+ * clones are taken from the kernel pool when possible
+ * nothing here waits on the device, mirror copies are chained to the launch through launch_events
  *
  */
 cl_kernel createPoisonedKernel(cl_command_queue command_queue,
         cl_kernel kernel,
-        uint32_t *dupe)
+        const kernel_launch_plan *plan,
+        cl_uint *num_launch_events,
+        cl_event *launch_events)
 {
     uint32_t i, nargs;
     cl_int cl_err;
-    kernel_info *old_kern_info;
+    kernel_info *old_kern_info, *new_kern_info;
     kernel_arg *old_arg_info;
+    uint32_t *dupe = plan->dupe;
 
     // NOTE: Don't demangle the kernel names here. We need them the same for when we
     // call clCreateKernel below.
 
     old_kern_info = kinfo_find(get_kern_list(), kernel);
+    nargs = plan->nargs;
 
-    cl_err = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(nargs), &nargs, 0);
-    check_cl_error(__FILE__, __LINE__, cl_err);
+    syncKernelMirrors(command_queue, old_kern_info, plan,
+            num_launch_events, launch_events);
 
-    //does the original kernel have any host pointer argumrnts
-    uint8_t needInternalBuffer = 0;
-    for(i = 0; i < nargs; i++)
-    {
-        old_arg_info = karg_find(old_kern_info->arg_list, i);
-        cl_memobj *old_buffer_info = old_arg_info->buffer;
-        if(old_buffer_info != NULL)
-        {
-            if( !old_buffer_info->has_canary )
-            {
-                needInternalBuffer = 1;
-                break;
-            }
-        }
-    }
-
-    //no need to clone kernel if this is true
-    if(!needInternalBuffer)
+    //no need to clone kernel if every buffer argument already has canaries
+    if(!plan->needs_clone)
     {
         return kernel;
     }
 
+    findKernelPoolKey(old_kern_info);
+
     cl_kernel new_kernel;
-    new_kernel = kernelDuplicate(kernel);
+    new_kernel = kpool_checkout(old_kern_info->program, old_kern_info->name);
+    if(new_kernel == NULL)
+        new_kernel = kernelDuplicate(kernel);
 
     //replace arguments using host pointers
     for(i = 0; i < nargs && dupe != NULL; i++)
@@ -406,7 +1013,7 @@ cl_kernel createPoisonedKernel(cl_command_queue command_queue,
 
         if(dupe[i] == i)
         {
-            old_arg_info = karg_find(old_kern_info->arg_list, i);
+            old_arg_info = karg_find(old_kern_info, i);
             cl_memobj *old_buffer_info = old_arg_info->buffer;
             cl_svm_memobj *svmBuff = old_arg_info->svm_buffer;
 
@@ -422,81 +1029,11 @@ cl_kernel createPoisonedKernel(cl_command_queue command_queue,
                 check_cl_error(__FILE__, __LINE__, cl_err);
 #endif
             }
-            else if(!old_buffer_info->has_canary)
+            else if(!old_buffer_info->has_canary && plan->written[i])
             {
-                cl_mem new_buffer;
-                cl_mem_flags flags;
-                cl_context new_ctx;
-
-                new_ctx = old_buffer_info->context;
-                flags = old_buffer_info->flags;
-
-                flags = flags & ~CL_MEM_USE_HOST_PTR & ~CL_MEM_COPY_HOST_PTR;
-                flags = flags & ~CL_MEM_ALLOC_HOST_PTR;
-
-                if(old_buffer_info->is_image)
-                {
-#ifdef CL_VERSION_1_2
-                    cl_image_desc desc;
-                    desc.image_type = old_buffer_info->image_desc.image_type;
-                    desc.image_width = old_buffer_info->image_desc.image_width;
-                    desc.image_height = old_buffer_info->image_desc.image_height;
-                    desc.image_depth = old_buffer_info->image_desc.image_depth;
-                    desc.image_array_size = old_buffer_info->image_desc.image_array_size;
-                    desc.image_row_pitch = old_buffer_info->image_desc.image_row_pitch;
-                    desc.image_slice_pitch = old_buffer_info->image_desc.image_slice_pitch;
-                    desc.num_mip_levels = old_buffer_info->image_desc.num_mip_levels;
-                    desc.num_samples = old_buffer_info->image_desc.num_samples;
-                    desc.buffer = NULL;
-                    new_buffer = clCreateImage(new_ctx, flags, &old_buffer_info->image_format, &desc, NULL, &cl_err);
-#else
-                    if(old_buffer_info->image_desc.image_type == CL_MEM_OBJECT_IMAGE3D)
-                    {
-                        new_buffer = clCreateImage3D(new_ctx, flags,
-                                &old_buffer_info->image_format,
-                                old_buffer_info->image_desc.image_width,
-                                old_buffer_info->image_desc.image_height,
-                                old_buffer_info->image_desc.image_depth,
-                                old_buffer_info->image_desc.image_row_pitch,
-                                old_buffer_info->image_desc.image_slice_pitch,
-                                old_buffer_info->host_ptr, &cl_err);
-                    }
-                    else
-                    {
-                        new_buffer = clCreateImage2D(new_ctx, flags,
-                                &old_buffer_info->image_format,
-                                old_buffer_info->image_desc.image_width,
-                                old_buffer_info->image_desc.image_height,
-                                old_buffer_info->image_desc.image_row_pitch,
-                                old_buffer_info->host_ptr, &cl_err);
-                    }
-#endif // CL_VERSION_1_2
-                }
-                else
-                    new_buffer = clCreateBuffer(new_ctx, flags, old_buffer_info->size, NULL, &cl_err);
-
-                check_cl_error(__FILE__, __LINE__, cl_err);
-
-                cl_memobj* newBuffInfo = cl_mem_find(get_cl_mem_alloc(), new_buffer);
-                newBuffInfo->detector_internal_buffer = 1;
-
-                if(old_buffer_info->is_image)
-                {
-                    size_t origin[] = {0,0,0}, region[3];
-                    region[0] = old_buffer_info->image_desc.image_width;
-                    region[1] = old_buffer_info->image_desc.image_height;
-                    region[2] = old_buffer_info->image_desc.image_depth;
-                    if(old_buffer_info->image_desc.image_type == CL_MEM_OBJECT_IMAGE1D_ARRAY)
-                        region[1] = old_buffer_info->image_desc.image_array_size;
-                    else if(old_buffer_info->image_desc.image_type == CL_MEM_OBJECT_IMAGE2D_ARRAY)
-                        region[2] = old_buffer_info->image_desc.image_array_size;
-
-                    cl_image_copy(command_queue, old_buffer_info->handle, new_buffer, origin, origin, region, 0, 0, 0);
-                }
-                else
-                    cl_buffer_copy(command_queue, old_buffer_info->handle, new_buffer, 0, 0, old_buffer_info->size, 0, 0, 0);
-
-                cl_err = clSetKernelArg(new_kernel, i, sizeof(cl_mem), &new_buffer);
+                cl_mem mirror = getBufferMirror(command_queue, old_buffer_info,
+                        num_launch_events, launch_events);
+                cl_err = clSetKernelArg(new_kernel, i, sizeof(cl_mem), &mirror);
                 check_cl_error(__FILE__, __LINE__, cl_err);
             }
             else
@@ -507,112 +1044,108 @@ cl_kernel createPoisonedKernel(cl_command_queue command_queue,
         }
         else
         {
-            kernel_info *new_kern_info;
             kernel_arg *arg_info;
             new_kern_info = kinfo_find(get_kern_list(), new_kernel);
-            arg_info = karg_find(new_kern_info->arg_list, dupe[i]);
+            arg_info = karg_find(new_kern_info, dupe[i]);
             cl_err = clSetKernelArg(new_kernel, i, arg_info->size, arg_info->value);
             check_cl_error(__FILE__, __LINE__, cl_err);
         }
 
     }
 
-    clFinish(command_queue);
+#ifdef CL_VERSION_2_0
+    // The clone must reach the same SVM as the original, and pooled clones
+    // may still carry the declarations of an earlier launch.
+    new_kern_info = kinfo_find(get_kern_list(), new_kernel);
+    if(old_kern_info->num_exec_svm_ptrs > 0)
+    {
+        cl_err = clSetKernelExecInfo(new_kernel, CL_KERNEL_EXEC_INFO_SVM_PTRS,
+                sizeof(void*) * old_kern_info->num_exec_svm_ptrs,
+                old_kern_info->exec_svm_ptrs);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+    else
+        kinfo_set_exec_svm_ptrs(new_kern_info, 0, NULL);
+    if(old_kern_info->svm_fine_grain_system || new_kern_info->svm_fine_grain_system)
+    {
+        cl_bool fine_grain_system = old_kern_info->svm_fine_grain_system ? CL_TRUE : CL_FALSE;
+        cl_err = clSetKernelExecInfo(new_kernel,
+                CL_KERNEL_EXEC_INFO_SVM_FINE_GRAIN_SYSTEM, sizeof(cl_bool),
+                &fine_grain_system);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+#endif
+
+    // The clone goes back into the pool under the original's name.
+    new_kern_info = kinfo_find(get_kern_list(), new_kernel);
+    setKernelPoolKey(new_kern_info, old_kern_info->program, old_kern_info->name);
+    if(new_kern_info != NULL)
+        new_kern_info->pool_clone = 1;
 
     return new_kernel;
 }
 
 
 /*
- * copies contents of buffer objects from one kernel to another
- * does not create buffers, they must already exist
- *
- *      cl_kernel to
- *      cl_kernel from
- *      uint32_t * dupe
- *          list of duplicate arguments
- *      cl_command_queue command queue
- *          isn't necessary, but will speed up the process
+ * record which buffers a kernel launch has written
+ * a mirror written by the kernel now holds the newest copy of its object's
+ * data and is only copied back when something else needs that data.
+ * arguments the kernel cannot write are left alone.
  *
- * copies using size of shortest buffer
+ *      cl_kernel kernel
+ *          the user's kernel, not the clone that was actually launched
+ *      const kernel_launch_plan *plan
+ *          launch plan of the kernel
+ *      cl_command_queue command_queue
+ *          queue the kernel was launched on
+ *      const cl_event *evt
+ *          event for the kernel launch
  */
-void copyKernelBuffers(cl_kernel to, cl_kernel from,
-        uint32_t * dupe, cl_command_queue command_queue)
+void commitKernelMirrors(cl_kernel kernel, const kernel_launch_plan *plan,
+        cl_command_queue command_queue, const cl_event *evt)
 {
-    cl_int cl_err;
-    int i, nargs;
-    uint32_t temp_nargs;
-    kernel_info *from_kern_info, *to_kern_info;
-    cl_err = clGetKernelInfo(from, CL_KERNEL_NUM_ARGS, sizeof(temp_nargs), &temp_nargs, 0);
-    check_cl_error(__FILE__, __LINE__, cl_err);
-
-    assert(temp_nargs < INT_MAX);
-    nargs = temp_nargs;
-    from_kern_info = kinfo_find(get_kern_list(), from);
-    to_kern_info = kinfo_find(get_kern_list(), to);
-    assert(from_kern_info != NULL);
-    assert(to_kern_info != NULL);
+    uint32_t i;
+    kernel_info *kinfo = kinfo_find(get_kern_list(), kernel);
+    assert(kinfo != NULL);
 
-    int nevts = 0;
-    cl_event *events;
-    events = calloc(sizeof(cl_event), nargs);
-
-    cl_err = clFinish(command_queue);
-    check_cl_error(__FILE__, __LINE__, cl_err);
-    for(i = 0; i < nargs; i++)
+    for(i = 0; i < plan->nargs; i++)
     {
-        kernel_arg *from_arg_info, *to_arg_info;
-        from_arg_info = karg_find(from_kern_info->arg_list, i);
-        to_arg_info = karg_find(to_kern_info->arg_list, i);
-        assert(from_arg_info != NULL);
-        assert(to_arg_info != NULL);
-
-        if(dupe != NULL && (int)dupe[i] == i)
+        cl_memobj *m, *owner;
+        if(plan->dupe[i] != i ||
+                (plan->arg_kind[i] != KARG_BUFFER && plan->arg_kind[i] != KARG_IMAGE))
+            continue;
+        if(!plan->written[i])
+            continue;
+
+        m = kinfo->args[i].buffer;
+        owner = mirrorStorageOwner(m);
+        owner->write_epoch++;
+        if(m->has_canary)
+            continue;
+
+        // Only one mirror per storage may hold unsaved data, so a second
+        // mirror of the same storage written by this launch goes back first.
+        if(owner->dirty_mirror != NULL && owner->dirty_mirror != m)
+            flushDirtyMirror(owner, command_queue, (evt != NULL), evt, NULL);
+
+        m->mirror_epoch = owner->write_epoch;
+        if(owner->dirty_mirror == NULL)
         {
-            cl_memobj *m1 = from_arg_info->buffer; //is it a cl_mem?
-            cl_memobj *m2 = to_arg_info->buffer; //is it a cl_mem?
-            if(m1 && m2 && m1 != m2)
-            {
-                if(m1->is_image)
-                {
-                    size_t origin[] = {0, 0, 0}, region[3];
-                    uint32_t w1, w2, h1, h2, d1, d2;
-                    w1 = m1->image_desc.image_width;
-                    w2 = m2->image_desc.image_width;
-                    h1 = m1->image_desc.image_height;
-                    h2 = m2->image_desc.image_height;
-                    d1 = m1->image_desc.image_depth;
-                    d2 = m2->image_desc.image_depth;
-                    if(m2->image_desc.image_type == CL_MEM_OBJECT_IMAGE1D_ARRAY)
-                    {
-                        h1 = m1->image_desc.image_array_size;
-                        h2 = m2->image_desc.image_array_size;
-                    }
-                    else if(m2->image_desc.image_type == CL_MEM_OBJECT_IMAGE2D_ARRAY)
-                    {
-                        d1 = m1->image_desc.image_array_size;
-                        d2 = m2->image_desc.image_array_size;
-                    }
-                    region[0] = (w1 > w2) ? w2 : w1;
-                    region[1] = (h1 > h2) ? h2 : h1;
-                    region[2] = (d1 > d2) ? d2 : d1;
-
-                    cl_image_copy(command_queue, m1->handle, m2->handle, origin, origin, region, 0, 0, &events[nevts]);
-                }
-                else
-                {
-                    size_t size = m1->size;
-                    if(size > m2->size)
-                        size = m2->size;
-                    cl_buffer_copy(command_queue, m1->handle, m2->handle, 0, 0, size, 0, 0, &events[nevts]);
-                }
-                nevts++;
-            }
+            owner->dirty_mirror = m;
+            owner->dirty_queue = command_queue;
+            clRetainCommandQueue(command_queue);
         }
+        else if(owner->dirty_queue != command_queue)
+        {
+            clRetainCommandQueue(command_queue);
+            clReleaseCommandQueue(owner->dirty_queue);
+            owner->dirty_queue = command_queue;
+        }
+        // A flush on another queue must not start before this launch is done.
+        if(evt != NULL)
+            clRetainEvent(*evt);
+        if(owner->dirty_event != NULL)
+            clReleaseEvent(owner->dirty_event);
+        owner->dirty_event = (evt != NULL) ? *evt : NULL;
     }
-
-    cl_err = clWaitForEvents(nevts, events);
-    check_cl_error(__FILE__, __LINE__, cl_err);
-    free(events);
 }
-
@@ -0,0 +1,239 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <CL/cl.h>
+
+#include "util_functions.h"
+#include "cl_err.h"
+#include "detector_defines.h"
+
+#include "canary_budget.h"
+
+// how far new allocations have been degraded, each step includes the ones
+// before it
+typedef enum budget_level_
+{
+    BUDGET_FULL = 0,
+    BUDGET_SHORT,
+    BUDGET_TRAILING,
+    BUDGET_NO_IMAGES
+} budget_level;
+
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+static budget_level level = BUDGET_FULL;
+static uint64_t canary_bytes = 0;
+
+// memory limits of the context that was last looked up
+static cl_context limits_context = NULL;
+static cl_ulong limits_global = 0;
+static cl_ulong limits_alloc = 0;
+
+/*
+ * smallest global memory and allocation limit of the devices in a context
+ */
+static void get_limits(cl_context context, cl_ulong *global, cl_ulong *alloc)
+{
+    cl_int cl_err;
+    cl_uint num_dev, i;
+    cl_device_id *devices;
+
+    pthread_mutex_lock(&budget_lock);
+    if(context == limits_context)
+    {
+        *global = limits_global;
+        *alloc = limits_alloc;
+        pthread_mutex_unlock(&budget_lock);
+        return;
+    }
+    pthread_mutex_unlock(&budget_lock);
+
+    cl_err = clGetContextInfo(context, CL_CONTEXT_NUM_DEVICES, sizeof(cl_uint),
+            &num_dev, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    devices = malloc(sizeof(cl_device_id) * num_dev);
+    if(devices == NULL)
+    {
+        det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clGetContextInfo(context, CL_CONTEXT_DEVICES,
+            sizeof(cl_device_id) * num_dev, devices, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    *global = UINT64_MAX;
+    *alloc = UINT64_MAX;
+    for(i = 0; i < num_dev; i++)
+    {
+        cl_ulong dev_global, dev_alloc;
+        cl_err = clGetDeviceInfo(devices[i], CL_DEVICE_GLOBAL_MEM_SIZE,
+                sizeof(cl_ulong), &dev_global, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        // Already less the room taken by image canaries.
+        cl_err = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+                sizeof(cl_ulong), &dev_alloc, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        if(dev_global < *global)
+            *global = dev_global;
+        if(dev_alloc < *alloc)
+            *alloc = dev_alloc;
+    }
+    free(devices);
+
+    pthread_mutex_lock(&budget_lock);
+    limits_context = context;
+    limits_global = *global;
+    limits_alloc = *alloc;
+    pthread_mutex_unlock(&budget_lock);
+}
+
+/*
+ * degrade new allocations to at least a level, and say what changed
+ * must hold budget_lock
+ */
+static void raise_level(budget_level to, const char *reason)
+{
+    if(to <= level)
+        return;
+    level = to;
+
+    switch(level)
+    {
+        case BUDGET_SHORT:
+            det_fprintf(stderr, "clARMOR: %s. Canaries of new allocations are "
+                    "cut to %u bytes.\n", reason, BUDGET_SHORT_CANARY);
+            break;
+        case BUDGET_TRAILING:
+            det_fprintf(stderr, "clARMOR: %s. New allocations only get a %u "
+                    "byte back canary, their underflows will not be "
+                    "detected.\n", reason, BUDGET_SHORT_CANARY);
+            break;
+        case BUDGET_NO_IMAGES:
+            det_fprintf(stderr, "clARMOR: %s. New images get no canaries, "
+                    "their overflows will not be detected.\n", reason);
+            break;
+        default:
+            break;
+    }
+}
+
+void budgetCanaryGeometry(cl_context context, size_t size,
+        canary_geometry *geom)
+{
+    cl_ulong global, alloc;
+    budget_level cur;
+
+    get_limits(context, &global, &alloc);
+
+    pthread_mutex_lock(&budget_lock);
+    cur = level;
+    pthread_mutex_unlock(&budget_lock);
+
+    if(cur >= BUDGET_SHORT)
+    {
+        if(geom->front > BUDGET_SHORT_CANARY)
+            geom->front = BUDGET_SHORT_CANARY;
+        if(geom->back > BUDGET_SHORT_CANARY)
+            geom->back = BUDGET_SHORT_CANARY;
+    }
+    if(cur >= BUDGET_TRAILING)
+        geom->front = 0;
+
+    // The padding must not make the allocation larger than the devices
+    // allow, which would fail an allocation that would have worked.
+    uint64_t room = (size < alloc) ?
+        (alloc - size) & ~(uint64_t)(sizeof(uint32_t) - 1) : 0;
+    if(room >= sizeof(uint32_t) && size + geom->front + geom->back > alloc)
+    {
+        geom->front = 0;
+        if(geom->back > room)
+            geom->back = room;
+        det_fprintf(stderr, "clARMOR: an allocation of %zu bytes is close to "
+                "the largest the device allows. It only gets a %u byte back "
+                "canary.\n", size, geom->back);
+    }
+}
+
+int budgetDropsImageCanaries(void)
+{
+    int ret;
+    pthread_mutex_lock(&budget_lock);
+    ret = (level >= BUDGET_NO_IMAGES);
+    pthread_mutex_unlock(&budget_lock);
+    return ret;
+}
+
+int budgetMayDegrade(cl_int err)
+{
+    int ret;
+
+    if(err != CL_MEM_OBJECT_ALLOCATION_FAILURE && err != CL_OUT_OF_RESOURCES)
+        return 0;
+
+    pthread_mutex_lock(&budget_lock);
+    ret = (level < BUDGET_NO_IMAGES);
+    pthread_mutex_unlock(&budget_lock);
+    return ret;
+}
+
+void budgetAllocFailed(void)
+{
+    pthread_mutex_lock(&budget_lock);
+    if(level < BUDGET_NO_IMAGES)
+        raise_level(level + 1, "An allocation ran out of device memory");
+    pthread_mutex_unlock(&budget_lock);
+}
+
+void budgetAddCanaries(cl_context context, size_t bytes)
+{
+    cl_ulong global, alloc;
+
+    if(bytes == 0)
+        return;
+
+    get_limits(context, &global, &alloc);
+    uint64_t budget = global / CANARY_BUDGET_FRACTION;
+
+    pthread_mutex_lock(&budget_lock);
+    canary_bytes += bytes;
+    // The further over budget the canaries are, the more new allocations
+    // are degraded.
+    if(canary_bytes > 4 * budget)
+        raise_level(BUDGET_NO_IMAGES, "Canaries use too much device memory");
+    else if(canary_bytes > 2 * budget)
+        raise_level(BUDGET_TRAILING, "Canaries use too much device memory");
+    else if(canary_bytes > budget)
+        raise_level(BUDGET_SHORT, "Canaries use too much device memory");
+    pthread_mutex_unlock(&budget_lock);
+}
+
+void budgetRemoveCanaries(size_t bytes)
+{
+    pthread_mutex_lock(&budget_lock);
+    canary_bytes -= (bytes < canary_bytes) ? bytes : canary_bytes;
+    pthread_mutex_unlock(&budget_lock);
+}
@@ -0,0 +1,330 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/cl.h>
+
+#include "util_functions.h"
+#include "cl_err.h"
+#include "detector_defines.h"
+
+#include "meta_data_lists/cl_memory_lists.h"
+
+#include "canary_budget.h"
+#include "canary_policy.h"
+
+// the default alignment of clSVMAlloc, the size of the largest OpenCL type
+#define SVM_DEFAULT_ALIGNMENT 128
+
+typedef struct canary_class_
+{
+    size_t max_size;
+    canary_geometry geom;
+} canary_class;
+
+static pthread_once_t policy_once = PTHREAD_ONCE_INIT;
+
+// sorted by max_size, allocations larger than all of them use the default
+static canary_class *classes = NULL;
+static uint32_t num_classes = 0;
+
+// canary lengths learned for each allocation site, open addressed by the
+// site's return address
+typedef struct site_profile_
+{
+    uintptr_t site;
+    canary_geometry geom;
+} site_profile;
+
+static pthread_mutex_t site_lock = PTHREAD_MUTEX_INITIALIZER;
+static site_profile sites[SITE_TABLE_SIZE];
+
+// sub-buffer origin alignment of the context that was last looked up
+static pthread_mutex_t align_lock = PTHREAD_MUTEX_INITIALIZER;
+static cl_context align_context = NULL;
+static size_t align_bytes = 0;
+
+static uint32_t round_up(uint32_t len, size_t align)
+{
+    if(align == 0)
+        return len;
+    return ((len + align - 1) / align) * align;
+}
+
+static int compare_classes(const void *a, const void *b)
+{
+    size_t x = ((const canary_class*)a)->max_size;
+    size_t y = ((const canary_class*)b)->max_size;
+    return (x > y) - (x < y);
+}
+
+static void load_policy(void)
+{
+    char *policy = get_canary_policy_envvar();
+    char *saveptr = NULL;
+    char *entry;
+
+    if(policy == NULL)
+        return;
+
+    for(entry = strtok_r(policy, ",", &saveptr); entry != NULL;
+            entry = strtok_r(NULL, ",", &saveptr))
+    {
+        size_t max_size;
+        unsigned int front, back;
+        if(sscanf(entry, "%zu:%u:%u", &max_size, &front, &back) != 3 || back == 0)
+        {
+            det_fprintf(stderr, "Ignoring canary policy entry \"%s\", expected "
+                    "max_size:front:back with a non-zero back.\n", entry);
+            continue;
+        }
+
+        canary_class *grown = realloc(classes,
+                sizeof(canary_class) * (num_classes + 1));
+        if(grown == NULL)
+        {
+            det_fprintf(stderr, "Realloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        classes = grown;
+
+        // The checkers compare canaries a word at a time.
+        canary_class *c = &classes[num_classes++];
+        c->max_size = max_size;
+#ifdef UNDERFLOW_CHECK
+        c->geom.front = round_up(front, sizeof(uint32_t));
+#else
+        c->geom.front = 0;
+#endif
+        c->geom.back = round_up(back, sizeof(uint32_t));
+    }
+    free(policy);
+
+    qsort(classes, num_classes, sizeof(canary_class), compare_classes);
+}
+
+static void get_class_geometry(size_t size, canary_geometry *geom)
+{
+    uint32_t i;
+
+    pthread_once(&policy_once, load_policy);
+
+    for(i = 0; i < num_classes; i++)
+    {
+        if(size <= classes[i].max_size)
+        {
+            *geom = classes[i].geom;
+            return;
+        }
+    }
+
+    uint32_t len = get_site_feedback_envvar() ? SITE_MIN_CANARY : POISON_FILL_LENGTH;
+#ifdef UNDERFLOW_CHECK
+    geom->front = len;
+#else
+    geom->front = 0;
+#endif
+    geom->back = len;
+}
+
+/*
+ * slot of an allocation site in the profile table
+ * must hold site_lock
+ *
+ * \return
+ *      NULL if the site is not in the table and there is no room to add it
+ */
+static site_profile* find_site(uintptr_t site, int add)
+{
+    uint32_t i;
+    // Return addresses are at least 2 byte aligned, mix in the high bits.
+    uint32_t start = (uint32_t)((site >> 1) ^ (site >> 13)) % SITE_TABLE_SIZE;
+
+    for(i = 0; i < SITE_TABLE_SIZE; i++)
+    {
+        site_profile *p = &sites[(start + i) % SITE_TABLE_SIZE];
+        if(p->site == site)
+            return p;
+        if(p->site == 0)
+        {
+            if(!add)
+                return NULL;
+            p->site = site;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * lengthen the canaries of an allocation to what its site has needed before
+ */
+static void apply_site_geometry(uintptr_t site, canary_geometry *geom)
+{
+    if(site == 0 || !get_site_feedback_envvar())
+        return;
+
+    pthread_mutex_lock(&site_lock);
+    site_profile *p = find_site(site, 0);
+    if(p)
+    {
+        if(p->geom.front > geom->front)
+            geom->front = p->geom.front;
+        if(p->geom.back > geom->back)
+            geom->back = p->geom.back;
+    }
+    pthread_mutex_unlock(&site_lock);
+}
+
+static uint32_t grow_canary(uint32_t len)
+{
+    if(len >= SITE_MAX_CANARY / 2)
+        return SITE_MAX_CANARY;
+    return 2 * len;
+}
+
+size_t getSubBufferAlignment(cl_context context)
+{
+    cl_int cl_err;
+    cl_uint num_dev, i;
+    cl_device_id *devices;
+    size_t ret = 0;
+
+    pthread_mutex_lock(&align_lock);
+    if(context == align_context)
+    {
+        ret = align_bytes;
+        pthread_mutex_unlock(&align_lock);
+        return ret;
+    }
+    pthread_mutex_unlock(&align_lock);
+
+    cl_err = clGetContextInfo(context, CL_CONTEXT_NUM_DEVICES, sizeof(cl_uint),
+            &num_dev, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    devices = malloc(sizeof(cl_device_id) * num_dev);
+    if(devices == NULL)
+    {
+        det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clGetContextInfo(context, CL_CONTEXT_DEVICES,
+            sizeof(cl_device_id) * num_dev, devices, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    for(i = 0; i < num_dev; i++)
+    {
+        cl_uint align_bits;
+        cl_err = clGetDeviceInfo(devices[i], CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+                sizeof(cl_uint), &align_bits, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        if(align_bits / 8 > ret)
+            ret = align_bits / 8;
+    }
+    free(devices);
+
+    pthread_mutex_lock(&align_lock);
+    align_context = context;
+    align_bytes = ret;
+    pthread_mutex_unlock(&align_lock);
+
+    return ret;
+}
+
+void getCanaryGeometry(cl_context context, size_t size, uintptr_t site,
+        canary_geometry *geom)
+{
+    get_class_geometry(size, geom);
+    apply_site_geometry(site, geom);
+    budgetCanaryGeometry(context, size, geom);
+    if(geom->front > 0)
+        geom->front = round_up(geom->front, getSubBufferAlignment(context));
+}
+
+#ifdef CL_VERSION_2_0
+void getSVMCanaryGeometry(cl_context context, size_t size,
+        unsigned int alignment, uintptr_t site, canary_geometry *geom)
+{
+    get_class_geometry(size, geom);
+    apply_site_geometry(site, geom);
+    budgetCanaryGeometry(context, size, geom);
+    if(alignment == 0)
+        alignment = SVM_DEFAULT_ALIGNMENT;
+    if(geom->front > 0)
+        geom->front = round_up(geom->front, alignment);
+}
+#endif
+
+void noteCanaryOverflow(void *buffer, uint32_t first_byte, uint32_t last_byte)
+{
+    uintptr_t site = 0;
+    canary_geometry geom = {0, 0};
+
+    if(!get_site_feedback_envvar())
+        return;
+
+    cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), buffer);
+    if(m1)
+    {
+        if(m1->is_image)
+            return;
+        site = m1->alloc_site;
+        geom = m1->canary;
+    }
+#ifdef CL_VERSION_2_0
+    else
+    {
+        cl_svm_memobj *m2 = cl_svm_mem_find(get_cl_svm_mem_alloc(), buffer);
+        if(m2)
+        {
+            site = m2->alloc_site;
+            geom = m2->canary;
+        }
+    }
+#endif
+    if(site == 0)
+        return;
+
+    // The write may have gone further than the canary when it reached
+    // the canary's far end, or its last eighth.
+    int grow_front = (geom.front > 0 && first_byte < geom.front / 8 + sizeof(uint32_t));
+    int grow_back = (last_byte >= geom.front &&
+            last_byte + 1 >= geom.front + geom.back - geom.back / 8);
+    if(!grow_front && !grow_back)
+        return;
+
+    pthread_mutex_lock(&site_lock);
+    site_profile *p = find_site(site, 1);
+    if(p)
+    {
+        if(grow_front && grow_canary(geom.front) > p->geom.front)
+            p->geom.front = grow_canary(geom.front);
+        if(grow_back && grow_canary(geom.back) > p->geom.back)
+            p->geom.back = grow_canary(geom.back);
+    }
+    pthread_mutex_unlock(&site_lock);
+}
@@ -222,38 +222,40 @@ void mendCanaryRegion(cl_command_queue cmdQueue, void * const buffer, cl_bool bl
         {
             cl_int cl_err;
             cl_event region_event[2];
-            uint32_t offset = m1->size;
-#ifdef UNDERFLOW_CHECK
-            offset += POISON_FILL_LENGTH;
-#endif
+            uint32_t num_regions = 1;
+            size_t offset = m1->canary.front + m1->size;
 
 #ifdef CL_VERSION_1_2
             cl_err = clEnqueueFillBuffer(fillQueue, m1->main_buff, &poisonFill_8b,
-                    sizeof(uint8_t), offset, POISON_FILL_LENGTH, numEvts, waits, &region_event[0]);
-            check_cl_error(__FILE__, __LINE__, cl_err);
-#ifdef UNDERFLOW_CHECK
-            cl_err = clEnqueueFillBuffer(fillQueue, m1->main_buff, &poisonFill_8b,
-                    sizeof(uint8_t), 0, POISON_FILL_LENGTH, numEvts, waits, &region_event[1]);
+                    sizeof(uint8_t), offset, m1->canary.back, numEvts, waits, &region_event[0]);
             check_cl_error(__FILE__, __LINE__, cl_err);
-#endif
+            if(m1->canary.front > 0)
+            {
+                cl_err = clEnqueueFillBuffer(fillQueue, m1->main_buff, &poisonFill_8b,
+                        sizeof(uint8_t), 0, m1->canary.front, numEvts, waits, &region_event[num_regions++]);
+                check_cl_error(__FILE__, __LINE__, cl_err);
+            }
 
-            clEnqueueMarkerWithWaitList(fillQueue, POISON_REGIONS, region_event, &finish);
+            clEnqueueMarkerWithWaitList(fillQueue, num_regions, region_event, &finish);
 #else
-            char *poison_data = malloc(POISON_FILL_LENGTH);
-            memset(poison_data, poisonFill_8b, POISON_FILL_LENGTH);
+            uint32_t poison_len = (m1->canary.front > m1->canary.back) ?
+                m1->canary.front : m1->canary.back;
+            char *poison_data = malloc(poison_len);
+            memset(poison_data, poisonFill_8b, poison_len);
 
             cl_err = clEnqueueWriteBuffer(fillQueue, m1->main_buff,
-                    CL_NON_BLOCKING, offset, POISON_FILL_LENGTH, poison_data,
+                    CL_NON_BLOCKING, offset, m1->canary.back, poison_data,
                     numEvts, waits, &region_event[0]);
             check_cl_error(__FILE__, __LINE__, cl_err);
-#ifdef UNDERFLOW_CHECK
-            cl_err = clEnqueueWriteBuffer(fillQueue, m1->main_buff,
-                    CL_NON_BLOCKING, 0, POISON_FILL_LENGTH, poison_data,
-                    numEvts, waits, &region_event[1]);
-            check_cl_error(__FILE__, __LINE__, cl_err);
-#endif
+            if(m1->canary.front > 0)
+            {
+                cl_err = clEnqueueWriteBuffer(fillQueue, m1->main_buff,
+                        CL_NON_BLOCKING, 0, m1->canary.front, poison_data,
+                        numEvts, waits, &region_event[num_regions++]);
+                check_cl_error(__FILE__, __LINE__, cl_err);
+            }
 
-            clWaitForEvents(POISON_REGIONS, region_event);
+            clWaitForEvents(num_regions, region_event);
             free(poison_data);
 
             clEnqueueMarker(fillQueue, &finish);
@@ -272,21 +274,20 @@ void mendCanaryRegion(cl_command_queue cmdQueue, void * const buffer, cl_bool bl
 
             cl_int cl_err;
             cl_event region_event[2];
-            uint32_t offset = m2->size;
-#ifdef UNDERFLOW_CHECK
-            offset += POISON_FILL_LENGTH;
-#endif
+            uint32_t num_regions = 1;
+            size_t offset = m2->canary.front + m2->size;
 
             cl_err = clEnqueueSVMMemFill(fillQueue, (char*)m2->main_buff + offset,
-                    &poisonFill_8b, sizeof(uint8_t), POISON_FILL_LENGTH, numEvts, waits, &region_event[0]);
-            check_cl_error(__FILE__, __LINE__, cl_err);
-#ifdef UNDERFLOW_CHECK
-            cl_err = clEnqueueSVMMemFill(fillQueue, (char*)m2->main_buff,
-                    &poisonFill_8b, sizeof(uint8_t), POISON_FILL_LENGTH, numEvts, waits, &region_event[1]);
+                    &poisonFill_8b, sizeof(uint8_t), m2->canary.back, numEvts, waits, &region_event[0]);
             check_cl_error(__FILE__, __LINE__, cl_err);
-#endif
+            if(m2->canary.front > 0)
+            {
+                cl_err = clEnqueueSVMMemFill(fillQueue, (char*)m2->main_buff,
+                        &poisonFill_8b, sizeof(uint8_t), m2->canary.front, numEvts, waits, &region_event[num_regions++]);
+                check_cl_error(__FILE__, __LINE__, cl_err);
+            }
 
-            clEnqueueMarkerWithWaitList(fillQueue, POISON_REGIONS, region_event, &finish);
+            clEnqueueMarkerWithWaitList(fillQueue, num_regions, region_event, &finish);
         }
     }
 #endif
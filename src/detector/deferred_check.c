@@ -0,0 +1,557 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/cl.h>
+
+#include "util_functions.h"
+#include "cl_err.h"
+#include "detector_defines.h"
+#include "bufferOverflowDetect.h"
+
+#include "deferred_check.h"
+
+/// window_use.arg of an SVM allocation, which may not have been an argument
+#define WINDOW_NO_ARG UINT32_MAX
+
+/*
+ * one argument of one launch in the window that used a memory object
+ */
+typedef struct window_use_
+{
+    uint32_t launch;
+    uint32_t arg;
+} window_use;
+
+typedef struct window_object_
+{
+    /// object that is checked, a canaried mirror for objects without canaries
+    void *handle;
+    /// object the application passed to the kernel, named in reports
+    void *user_handle;
+    kernel_arg_kind kind;
+    uint32_t num_uses;
+    uint32_t max_uses;
+    window_use *uses;
+} window_object;
+
+struct check_window_
+{
+    cl_command_queue queue;
+    uint32_t refs;
+    /// the user's kernel for each launch, retained until the window is freed
+    uint32_t num_launches;
+    uint32_t max_launches;
+    cl_kernel *launches;
+    /// launch i used fine-grain system SVM, so it could write any SVM allocation
+    uint8_t *launch_sweep;
+    uint8_t svm_sweep;
+    uint32_t num_objects;
+    uint32_t max_objects;
+    window_object *objects;
+    /// stands in for a kernel while the window is checked
+    kernel_info *kinfo;
+    struct check_window_ *next;
+};
+
+static check_window *open_windows = NULL;
+static pthread_mutex_t window_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void* grow_array(void *array, uint32_t *max, size_t elem_size)
+{
+    uint32_t new_max = (*max == 0) ? 16 : *max * 2;
+    void *ret = realloc(array, elem_size * new_max);
+    if(ret == NULL)
+    {
+        det_fprintf(stderr, "Realloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    *max = new_max;
+    return ret;
+}
+
+static check_window* find_window(cl_command_queue queue)
+{
+    check_window *w;
+    for(w = open_windows; w != NULL; w = w->next)
+    {
+        if(w->queue == queue)
+            break;
+    }
+    return w;
+}
+
+static void window_use_object(check_window *w, void *handle, void *user_handle,
+        kernel_arg_kind kind, uint32_t launch, uint32_t arg)
+{
+    uint32_t i;
+    window_object *obj = NULL;
+
+    for(i = 0; i < w->num_objects; i++)
+    {
+        if(w->objects[i].handle == handle)
+        {
+            obj = &w->objects[i];
+            break;
+        }
+    }
+    if(obj == NULL)
+    {
+        if(w->num_objects == w->max_objects)
+            w->objects = grow_array(w->objects, &w->max_objects, sizeof(window_object));
+        obj = &w->objects[w->num_objects++];
+        memset(obj, 0, sizeof(window_object));
+        obj->handle = handle;
+        obj->user_handle = user_handle;
+        obj->kind = kind;
+    }
+
+    if(obj->num_uses == obj->max_uses)
+        obj->uses = grow_array(obj->uses, &obj->max_uses, sizeof(window_use));
+    obj->uses[obj->num_uses].launch = launch;
+    obj->uses[obj->num_uses].arg = arg;
+    obj->num_uses++;
+}
+
+/*
+ * the written buffer or image a plan lists for argument arg
+ * NULL if the plan does not check that argument
+ */
+static void* plan_object_for_arg(const kernel_launch_plan *plan, uint32_t arg)
+{
+    uint32_t i, numBuffs = 0, numImgs = 0;
+
+    if(arg >= plan->nargs)
+        return NULL;
+    arg = plan->dupe[arg];
+    if(!plan->written[arg])
+        return NULL;
+
+    for(i = 0; i < arg; i++)
+    {
+        if(plan->dupe[i] != i || !plan->written[i])
+            continue;
+        if(plan->arg_kind[i] == KARG_BUFFER)
+            numBuffs++;
+        else if(plan->arg_kind[i] == KARG_IMAGE)
+            numImgs++;
+    }
+    if(plan->arg_kind[arg] == KARG_BUFFER)
+        return plan->buffer_ptrs[numBuffs];
+    if(plan->arg_kind[arg] == KARG_IMAGE)
+        return plan->image_ptrs[numImgs];
+    return NULL;
+}
+
+int check_window_add_launch(cl_command_queue queue, cl_kernel kernel,
+        const kernel_launch_plan *user_plan, const kernel_launch_plan *plan)
+{
+    uint32_t i, launch, numBuffs = 0, numImgs = 0;
+    int full;
+
+    // The window names this kernel in its reports, so it must not go away.
+    clRetainKernel(kernel);
+
+    pthread_mutex_lock(&window_lock);
+    check_window *w = find_window(queue);
+    if(w == NULL)
+    {
+        w = calloc(sizeof(check_window), 1);
+        if(w == NULL)
+        {
+            det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        w->queue = queue;
+        w->refs = 1;
+        w->next = open_windows;
+        open_windows = w;
+    }
+
+    if(w->num_launches == w->max_launches)
+    {
+        uint32_t max = w->max_launches;
+        w->launches = grow_array(w->launches, &max, sizeof(cl_kernel));
+        w->launch_sweep = grow_array(w->launch_sweep, &w->max_launches, sizeof(uint8_t));
+    }
+    launch = w->num_launches++;
+    w->launches[launch] = kernel;
+    w->launch_sweep[launch] = plan->svm_sweep;
+    w->svm_sweep |= plan->svm_sweep;
+
+    // The two plans need not check the same arguments, e.g. when a buffer
+    // dropped its canary after the clone's plan was built, so the user's
+    // object is looked up by argument index. An argument only the clone
+    // checks is reported against the object the clone was given.
+    for(i = 0; i < plan->nargs; i++)
+    {
+        void *user_handle;
+        if(plan->dupe[i] != i || !plan->written[i])
+            continue;
+        user_handle = plan_object_for_arg(user_plan, i);
+        if(plan->arg_kind[i] == KARG_BUFFER)
+        {
+            window_use_object(w, plan->buffer_ptrs[numBuffs],
+                    (user_handle != NULL) ? user_handle : plan->buffer_ptrs[numBuffs],
+                    KARG_BUFFER, launch, i);
+            numBuffs++;
+        }
+        else if(plan->arg_kind[i] == KARG_IMAGE)
+        {
+            window_use_object(w, plan->image_ptrs[numImgs],
+                    (user_handle != NULL) ? user_handle : plan->image_ptrs[numImgs],
+                    KARG_IMAGE, launch, i);
+            numImgs++;
+        }
+    }
+    // SVM is never mirrored, so the clone reaches the same allocations.
+    for(i = 0; i < plan->num_svm; i++)
+        window_use_object(w, plan->svm_ptrs[i], plan->svm_ptrs[i], KARG_SVM,
+                launch, WINDOW_NO_ARG);
+
+    full = (w->num_launches >= DEFERRED_CHECK_MAX_LAUNCHES);
+    pthread_mutex_unlock(&window_lock);
+    return full;
+}
+
+/*
+ * take a window off the open list, the caller then owns the list's reference
+ * must hold window_lock
+ */
+static void detach_window(check_window *w)
+{
+    check_window **iter;
+    for(iter = &open_windows; *iter != NULL; iter = &(*iter)->next)
+    {
+        if(*iter == w)
+        {
+            *iter = w->next;
+            w->next = NULL;
+            return;
+        }
+    }
+}
+
+/*
+ * run one check over everything a window used, then drop the window
+ */
+static void check_window_run(check_window *w)
+{
+    uint32_t i, numBuffs = 0, numImgs = 0, numSVM = 0;
+    kernel_launch_plan plan;
+
+    memset(&plan, 0, sizeof(kernel_launch_plan));
+    for(i = 0; i < w->num_objects; i++)
+    {
+        if(w->objects[i].kind == KARG_IMAGE)
+            plan.num_imgs++;
+        else if(w->objects[i].kind == KARG_SVM)
+            plan.num_svm++;
+        else
+            plan.num_buffs++;
+    }
+    plan.svm_sweep = w->svm_sweep;
+    plan.has_svm = (plan.svm_sweep || plan.num_svm > 0);
+
+    if(plan.num_buffs + plan.num_imgs > 0 || plan.has_svm)
+    {
+        cl_int cl_err;
+        cl_event start, done = NULL;
+
+        if(plan.num_buffs > 0)
+            plan.buffer_ptrs = calloc(sizeof(void*), plan.num_buffs);
+        if(plan.num_imgs > 0)
+            plan.image_ptrs = calloc(sizeof(void*), plan.num_imgs);
+        if(plan.num_svm > 0)
+            plan.svm_ptrs = calloc(sizeof(void*), plan.num_svm);
+        for(i = 0; i < w->num_objects; i++)
+        {
+            if(w->objects[i].kind == KARG_IMAGE)
+                plan.image_ptrs[numImgs++] = w->objects[i].handle;
+            else if(w->objects[i].kind == KARG_SVM)
+                plan.svm_ptrs[numSVM++] = w->objects[i].handle;
+            else
+                plan.buffer_ptrs[numBuffs++] = w->objects[i].handle;
+        }
+
+        // The checkers report through a kernel_info. This one has no
+        // arguments of its own and points reports at the window instead.
+        w->kinfo = calloc(sizeof(kernel_info), 1);
+        if(w->kinfo == NULL)
+        {
+            det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        w->kinfo->handle = w->launches[w->num_launches - 1];
+        w->kinfo->window = w;
+
+        // Start after everything enqueued so far, even on out-of-order queues.
+#ifdef CL_VERSION_1_2
+        cl_err = clEnqueueMarkerWithWaitList(w->queue, 0, NULL, &start);
+#else
+        cl_err = clEnqueueMarker(w->queue, &start);
+#endif
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        verifyPlanInBounds(w->queue, w->kinfo, &plan, &start, &done);
+
+        if(done != NULL)
+        {
+            cl_err = clWaitForEvents(1, &done);
+            check_cl_error(__FILE__, __LINE__, cl_err);
+            clReleaseEvent(done);
+        }
+        clReleaseEvent(start);
+
+        free(plan.buffer_ptrs);
+        free(plan.image_ptrs);
+        free(plan.svm_ptrs);
+    }
+
+    check_window_release(w);
+}
+
+void check_window_flush(cl_command_queue queue)
+{
+    pthread_mutex_lock(&window_lock);
+    check_window *w = find_window(queue);
+    if(w != NULL)
+        detach_window(w);
+    pthread_mutex_unlock(&window_lock);
+
+    if(w != NULL)
+        check_window_run(w);
+}
+
+void check_window_flush_all(void)
+{
+    check_window *w, *next;
+
+    pthread_mutex_lock(&window_lock);
+    w = open_windows;
+    open_windows = NULL;
+    pthread_mutex_unlock(&window_lock);
+
+    for(; w != NULL; w = next)
+    {
+        next = w->next;
+        w->next = NULL;
+        check_window_run(w);
+    }
+}
+
+static int window_uses(const check_window *w, void *handle)
+{
+    uint32_t i;
+    for(i = 0; i < w->num_objects; i++)
+    {
+        if(w->objects[i].handle == handle || w->objects[i].user_handle == handle)
+            return 1;
+    }
+#ifdef CL_VERSION_2_0
+    if(w->svm_sweep && cl_svm_mem_find(get_cl_svm_mem_alloc(), handle) != NULL)
+        return 1;
+#endif
+    return 0;
+}
+
+void check_window_flush_object(void *handle)
+{
+    check_window *w, *next, *to_check = NULL;
+
+    pthread_mutex_lock(&window_lock);
+    for(w = open_windows; w != NULL; w = next)
+    {
+        next = w->next;
+        if(window_uses(w, handle))
+        {
+            detach_window(w);
+            w->next = to_check;
+            to_check = w;
+        }
+    }
+    pthread_mutex_unlock(&window_lock);
+
+    for(w = to_check; w != NULL; w = next)
+    {
+        next = w->next;
+        w->next = NULL;
+        check_window_run(w);
+    }
+}
+
+void check_window_retain(check_window *window)
+{
+    pthread_mutex_lock(&window_lock);
+    window->refs++;
+    pthread_mutex_unlock(&window_lock);
+}
+
+void check_window_release(check_window *window)
+{
+    uint32_t i, refs;
+
+    pthread_mutex_lock(&window_lock);
+    refs = --window->refs;
+    pthread_mutex_unlock(&window_lock);
+    if(refs > 0)
+        return;
+
+    for(i = 0; i < window->num_launches; i++)
+        clReleaseKernel(window->launches[i]);
+    for(i = 0; i < window->num_objects; i++)
+        free(window->objects[i].uses);
+    free(window->objects);
+    free(window->launches);
+    free(window->launch_sweep);
+    free(window->kinfo);
+    free(window);
+}
+
+static char* get_kernel_name(cl_kernel kernel)
+{
+    cl_int cl_err;
+    size_t size_ret = 0;
+    char *name;
+
+    cl_err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, 0, NULL, &size_ret);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    name = calloc(size_ret + 1, sizeof(char));
+    if(name == NULL)
+        return NULL;
+    cl_err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, size_ret, name, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    return name;
+}
+
+/*
+ * append one line for the launches first..last of the same kernel argument
+ */
+static char* append_candidates(char *out, const check_window *w,
+        uint32_t first, uint32_t last, uint32_t count, int64_t arg)
+{
+    char *line = NULL, *name;
+    size_t old_len = (out == NULL) ? 0 : strlen(out);
+    int len;
+
+    name = get_kernel_name(w->launches[first]);
+    if(name == NULL)
+        return out;
+
+    if(count == 1 && arg >= 0)
+        len = asprintf(&line, "   launch %u of %u: %s, argument %ld\n",
+                first + 1, w->num_launches, name, (long)arg);
+    else if(count == 1)
+        len = asprintf(&line, "   launch %u of %u: %s\n",
+                first + 1, w->num_launches, name);
+    else if(arg >= 0)
+        len = asprintf(&line, "   launches %u to %u of %u (%u times): %s, argument %ld\n",
+                first + 1, last + 1, w->num_launches, count, name, (long)arg);
+    else
+        len = asprintf(&line, "   launches %u to %u of %u (%u times): %s\n",
+                first + 1, last + 1, w->num_launches, count, name);
+    free(name);
+    if(len < 0)
+        return out;
+
+    char *grown = realloc(out, old_len + len + 1);
+    if(grown == NULL)
+    {
+        free(line);
+        return out;
+    }
+    memcpy(grown + old_len, line, len + 1);
+    free(line);
+    return grown;
+}
+
+char* check_window_candidates(const check_window *window, void *buffer)
+{
+    uint32_t i;
+    char *out = NULL;
+    const window_object *obj = NULL;
+
+    for(i = 0; i < window->num_objects; i++)
+    {
+        if(window->objects[i].handle == buffer)
+        {
+            obj = &window->objects[i];
+            break;
+        }
+    }
+
+    // Group back-to-back uses by the same kernel argument into one line.
+    uint32_t run_first = 0, run_last = 0, run_count = 0;
+    int64_t run_arg = -1;
+    uint32_t num = (obj != NULL) ? obj->num_uses : window->num_launches;
+    for(i = 0; i < num; i++)
+    {
+        uint32_t launch;
+        int64_t arg;
+        if(obj != NULL)
+        {
+            launch = obj->uses[i].launch;
+            arg = (obj->uses[i].arg == WINDOW_NO_ARG) ? (int64_t)-1 :
+                (int64_t)obj->uses[i].arg;
+        }
+        else
+        {
+            // Fine-grain system SVM can be reached from any such launch.
+            if(!window->launch_sweep[i])
+                continue;
+            launch = i;
+            arg = -1;
+        }
+
+        if(run_count > 0 && arg == run_arg &&
+                window->launches[launch] == window->launches[run_first])
+        {
+            run_last = launch;
+            run_count++;
+            continue;
+        }
+        if(run_count > 0)
+            out = append_candidates(out, window, run_first, run_last, run_count, run_arg);
+        run_first = run_last = launch;
+        run_arg = arg;
+        run_count = 1;
+    }
+    if(run_count > 0)
+        out = append_candidates(out, window, run_first, run_last, run_count, run_arg);
+
+    return out;
+}
+
+void* check_window_user_handle(const check_window *window, void *buffer)
+{
+    uint32_t i;
+    for(i = 0; i < window->num_objects; i++)
+    {
+        if(window->objects[i].handle == buffer)
+            return window->objects[i].user_handle;
+    }
+    return buffer;
+}
@@ -32,6 +32,8 @@
 #include "cl_err.h"
 #include "detector_defines.h"
 #include "meta_data_lists/cl_kernel_lists.h"
+#include "deferred_check.h"
+#include "overhead_governor.h"
 
 #include "overflow_error.h"
 
@@ -243,11 +245,14 @@ void apiOverflowError(char * const func, void * const buffer, const unsigned bad
  * returns the buffer's index
  *
  */
-int getBufferIndex(kernel_arg *argList, void* buffer)
+int getBufferIndex(const kernel_info * const kernInfo, void* buffer)
 {
-    kernel_arg *temp = argList;
-    while(temp != NULL)
+    uint32_t i;
+    for(i = 0; i < kernInfo->num_args; i++)
     {
+        const kernel_arg *temp = &kernInfo->args[i];
+        if(!temp->is_set)
+            continue;
         if(temp->buffer != NULL)
         {
             if(temp->buffer->handle == buffer)
@@ -258,11 +263,85 @@ int getBufferIndex(kernel_arg *argList, void* buffer)
             if(temp->svm_buffer->handle == buffer)
                 return temp->handle;
         }
-        temp = temp->next;
     }
     return -1;
 }
 
+/*
+ * bytes of canary before the data of a buffer or SVM region
+ *
+ */
+static uint32_t getCanaryFront(void * const buffer)
+{
+    cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), buffer);
+    if(m1)
+        return m1->canary.front;
+#ifdef CL_VERSION_2_0
+    cl_svm_memobj *m2 = cl_svm_mem_find(get_cl_svm_mem_alloc(), buffer);
+    if(m2)
+        return m2->canary.front;
+#endif
+    return 0;
+}
+
+/*
+ * print the message for an overflow found by a deferred check
+ * there is no single kernel to blame, so list every launch in the check
+ * window that could have written the buffer
+ *
+ */
+static void deferredOverflowError(const kernel_info * const kernInfo,
+        void * const buffer,
+        const unsigned bad_byte,
+        char * const backtrace_str)
+{
+    void *user_buffer = check_window_user_handle(kernInfo->window, buffer);
+
+    print_err_header();
+    print_and_log_err("************* Buffer overflow detected ***********\n");
+    buffer_overflows_observed++;
+
+    cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), buffer);
+    if(m1 && m1->is_image)
+    {
+        int x,y,z;
+        getImageCanaryXYZ(m1, bad_byte, &x, &y, &z);
+
+        print_and_log_err("Deferred check, Image: %p\n", user_buffer);
+        if(x >= 0)
+            print_and_log_err("   First dimension overflow at row %d, depth %d, %d column(s) past end.\n", y, z, x+1);
+        else if(y >= 0)
+            print_and_log_err("   Second dimension overflow at depth %d, %d row(s) past end.\n", z, y+1);
+        else
+            print_and_log_err("   Third dimension overflow %d slice(s) past end.\n", z+1);
+    }
+    else
+    {
+        if(m1)
+            print_and_log_err("Deferred check, Buffer: %p\n", user_buffer);
+        else
+            print_and_log_err("Deferred check, SVM pointer: %p\n", user_buffer);
+
+        int overflow_pos = (int)bad_byte - (int)getCanaryFront(buffer);
+        if(overflow_pos >= 0)
+            print_and_log_err("   Write Overflow %u byte(s) past end.\n", overflow_pos+1);
+        else
+            print_and_log_err("   Write Underflow %u byte(s) before start.\n", -overflow_pos);
+    }
+
+    char *candidates = check_window_candidates(kernInfo->window, buffer);
+    if(candidates)
+    {
+        print_and_log_err("   Written by one of these kernel launches:\n");
+        print_and_log_err("%s", candidates);
+        free(candidates);
+    }
+
+    if(backtrace_str)
+        print_and_log_err("%s\n", backtrace_str);
+    print_err_footer();
+}
+
 /*
  * print the message for a discovered overflow
  *
@@ -275,6 +354,12 @@ void overflowError(const kernel_info * const kernInfo,
     cl_int cl_err;
     size_t size_ret = 0;
 
+    if(kernInfo->window != NULL)
+    {
+        deferredOverflowError(kernInfo, buffer, bad_byte, backtrace_str);
+        return;
+    }
+
     print_err_header();
     print_and_log_err("************* Buffer overflow detected ***********\n");
     buffer_overflows_observed++;
@@ -301,7 +386,10 @@ void overflowError(const kernel_info * const kernInfo,
             size_ret, kernelName, NULL);
     check_cl_error(__FILE__, __LINE__, cl_err);
 
-    int argIndex = getBufferIndex(kernInfo->arg_list, buffer);
+    // Never skip checks of a kernel that is known to overflow.
+    governor_note_overflow(kernelName);
+
+    int argIndex = getBufferIndex(kernInfo, buffer);
     if(argIndex >= 0)
     {
         // Get Buffer Name
@@ -359,10 +447,7 @@ void overflowError(const kernel_info * const kernInfo,
         {
             print_and_log_err("Kernel: %s, Buffer: %s\n", kernelName, bufferName);
 
-            int overflow_pos = bad_byte;
-#ifdef UNDERFLOW_CHECK
-            overflow_pos -= POISON_FILL_LENGTH;
-#endif
+            int overflow_pos = (int)bad_byte - (int)m1->canary.front;
             if(overflow_pos >= 0)
                 print_and_log_err("   Write Overflow %u byte(s) past end.\n", overflow_pos+1);
             else
@@ -378,10 +463,7 @@ void overflowError(const kernel_info * const kernInfo,
         // Can't get buffer name for SVM pointer.
         print_and_log_err("Kernel: %s, SVM pointer: %p\n", kernelName, buffer);
 
-        int overflow_pos = bad_byte;
-#ifdef UNDERFLOW_CHECK
-        overflow_pos -= POISON_FILL_LENGTH;
-#endif
+        int overflow_pos = (int)bad_byte - (int)getCanaryFront(buffer);
         if(overflow_pos >= 0)
             print_and_log_err("   Write Overflow %u byte(s) past end.\n", overflow_pos+1);
         else
@@ -402,6 +484,11 @@ void printDupeWarning(const cl_kernel kern, const uint32_t * const dupe)
 {
     cl_int cl_err;
     uint32_t i, nargs;
+
+    // Deferred checks cover many launches and have no argument list.
+    if(dupe == NULL)
+        return;
+
     cl_err = clGetKernelInfo(kern, CL_KERNEL_NUM_ARGS, sizeof(nargs), &nargs,
             NULL);
     check_cl_error(__FILE__, __LINE__, cl_err);
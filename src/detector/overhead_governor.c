@@ -0,0 +1,270 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/cl.h>
+
+#include "util_functions.h"
+#include "cl_err.h"
+#include "detector_defines.h"
+
+#include "overhead_governor.h"
+
+typedef struct governor_sample_
+{
+    cl_event launch_event;
+    cl_event check_event;
+    uint64_t host_us;
+} governor_sample;
+
+static pthread_mutex_t governor_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// every kernel is checked once per check_period launches
+static uint32_t check_period = 1;
+
+// launches waiting to complete, oldest first
+static governor_sample pending[GOVERNOR_MAX_PENDING];
+static uint32_t pending_first = 0;
+static uint32_t num_pending = 0;
+
+// measurements since the check period last changed
+static uint32_t window_samples = 0;
+static uint64_t window_kern_ns = 0;
+static uint64_t window_check_ns = 0;
+
+static char **overflowed_kernels = NULL;
+static uint32_t num_overflowed = 0;
+
+int governor_enabled(void)
+{
+    return (get_overhead_target_envvar() > 0);
+}
+
+/*
+ * the function name of a kernel, free it when done
+ * the pool key's copy is used if the kernel already has one
+ */
+static char* get_kernel_name(kernel_info *kinfo)
+{
+    cl_int cl_err;
+    size_t size_ret = 0;
+    char *name;
+
+    if(kinfo->name != NULL)
+        name = strdup(kinfo->name);
+    else
+    {
+        cl_err = clGetKernelInfo(kinfo->handle, CL_KERNEL_FUNCTION_NAME, 0, NULL, &size_ret);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        name = calloc(size_ret + 1, sizeof(char));
+        if(name != NULL)
+        {
+            cl_err = clGetKernelInfo(kinfo->handle, CL_KERNEL_FUNCTION_NAME, size_ret, name, NULL);
+            check_cl_error(__FILE__, __LINE__, cl_err);
+        }
+    }
+    if(name == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    return name;
+}
+
+int governor_should_check(kernel_info *kinfo)
+{
+    int check, lookup;
+    uint32_t seen;
+    uint32_t i;
+    char *name;
+
+    pthread_mutex_lock(&governor_lock);
+    check = (kinfo->governor_launches % check_period == 0) ||
+        kinfo->governor_overflowed;
+    kinfo->governor_launches++;
+    seen = kinfo->governor_overflows_seen;
+    lookup = (!check && seen != num_overflowed);
+    pthread_mutex_unlock(&governor_lock);
+
+    if(!lookup)
+        return check;
+
+    // Some kernel has overflowed since this one last looked, so see whether
+    // it was this one. The name is found without holding the lock, and only
+    // the newly reported names are compared.
+    name = get_kernel_name(kinfo);
+    pthread_mutex_lock(&governor_lock);
+    for(i = seen; i < num_overflowed; i++)
+    {
+        if(!strcmp(overflowed_kernels[i], name))
+        {
+            kinfo->governor_overflowed = 1;
+            break;
+        }
+    }
+    kinfo->governor_overflows_seen = num_overflowed;
+    check = kinfo->governor_overflowed;
+    pthread_mutex_unlock(&governor_lock);
+    free(name);
+
+    return check;
+}
+
+static void release_sample(governor_sample *s)
+{
+    clReleaseEvent(s->launch_event);
+    if(s->check_event)
+        clReleaseEvent(s->check_event);
+}
+
+static int event_complete(cl_event evt)
+{
+    cl_int status;
+    cl_int cl_err = clGetEventInfo(evt, CL_EVENT_COMMAND_EXECUTION_STATUS,
+            sizeof(cl_int), &status, NULL);
+    // errors count as complete, so the sample is dropped rather than kept
+    return (cl_err != CL_SUCCESS || status <= CL_COMPLETE);
+}
+
+static int get_profile(cl_event evt, cl_profiling_info param, cl_ulong *val)
+{
+    return (clGetEventProfilingInfo(evt, param, sizeof(cl_ulong), val, NULL)
+            == CL_SUCCESS);
+}
+
+/*
+ * move the check period towards the overhead target
+ * must hold governor_lock
+ */
+static void update_check_period(void)
+{
+    uint64_t target = get_overhead_target_envvar();
+
+    if(window_kern_ns == 0)
+        return;
+
+    if(window_check_ns * 100 > window_kern_ns * target)
+    {
+        if(check_period < GOVERNOR_MAX_CHECK_PERIOD)
+            check_period *= 2;
+    }
+    else if(window_check_ns * 200 < window_kern_ns * target)
+    {
+        if(check_period > 1)
+            check_period /= 2;
+    }
+
+    window_samples = 0;
+    window_kern_ns = 0;
+    window_check_ns = 0;
+}
+
+/*
+ * measure every pending launch that has finished, in launch order
+ * must hold governor_lock
+ */
+static void collect_samples(void)
+{
+    while(num_pending > 0)
+    {
+        governor_sample *s = &pending[pending_first];
+        cl_ulong kern_start, kern_end, check_end;
+
+        if(!event_complete(s->launch_event) ||
+                (s->check_event && !event_complete(s->check_event)))
+            break;
+
+        if(get_profile(s->launch_event, CL_PROFILING_COMMAND_START, &kern_start) &&
+                get_profile(s->launch_event, CL_PROFILING_COMMAND_END, &kern_end) &&
+                kern_end >= kern_start)
+        {
+            window_kern_ns += kern_end - kern_start;
+            window_check_ns += s->host_us * 1000;
+            // Checks done on the host have no device time.
+            if(s->check_event &&
+                    get_profile(s->check_event, CL_PROFILING_COMMAND_END, &check_end) &&
+                    check_end > kern_end)
+                window_check_ns += check_end - kern_end;
+            window_samples++;
+        }
+
+        release_sample(s);
+        pending_first = (pending_first + 1) % GOVERNOR_MAX_PENDING;
+        num_pending--;
+
+        if(window_samples >= GOVERNOR_SAMPLE_WINDOW)
+            update_check_period();
+    }
+}
+
+void governor_add_sample(cl_event launch_event, cl_event check_event,
+        uint64_t host_us)
+{
+    pthread_mutex_lock(&governor_lock);
+
+    collect_samples();
+
+    if(num_pending == GOVERNOR_MAX_PENDING)
+    {
+        release_sample(&pending[pending_first]);
+        pending_first = (pending_first + 1) % GOVERNOR_MAX_PENDING;
+        num_pending--;
+    }
+
+    governor_sample *s = &pending[(pending_first + num_pending) % GOVERNOR_MAX_PENDING];
+    s->launch_event = launch_event;
+    s->check_event = check_event;
+    s->host_us = host_us;
+    num_pending++;
+
+    pthread_mutex_unlock(&governor_lock);
+}
+
+void governor_note_overflow(const char *kernel_name)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&governor_lock);
+    for(i = 0; i < num_overflowed; i++)
+    {
+        if(!strcmp(overflowed_kernels[i], kernel_name))
+            break;
+    }
+    if(i == num_overflowed)
+    {
+        char **grown = realloc(overflowed_kernels,
+                sizeof(char*) * (num_overflowed + 1));
+        char *name = strdup(kernel_name);
+        if(grown == NULL || name == NULL)
+        {
+            det_fprintf(stderr, "Realloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        overflowed_kernels = grown;
+        overflowed_kernels[num_overflowed++] = name;
+    }
+    pthread_mutex_unlock(&governor_lock);
+}
@@ -0,0 +1,322 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <CL/cl.h>
+
+#include "util_functions.h"
+#include "cl_err.h"
+
+#include "checker_binary_cache.h"
+
+// first bytes of every cache file, change it when the layout changes
+static const char cache_magic[] = "clARMOR checker binary 1\n";
+
+/*
+ * cache file layout after the magic:
+ *      uint64_t key length, then the key
+ *      uint64_t binary length, uint64_t hash of the binary, then the binary
+ */
+
+static uint64_t fnv_hash(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+    for(size_t i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t hash_bytes(const void *data, size_t len)
+{
+    return fnv_hash(14695981039346656037ULL, data, len);
+}
+
+static char* get_device_string(cl_device_id device, cl_device_info param)
+{
+    size_t size_ret = 0;
+    cl_int cl_err = clGetDeviceInfo(device, param, 0, NULL, &size_ret);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    char *str = calloc(size_ret + 1, sizeof(char));
+    if(str == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clGetDeviceInfo(device, param, size_ret, str, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    return str;
+}
+
+/*
+ * everything a device's binary depends on
+ * the file it is kept in is named after the key's hash
+ */
+static char* get_cache_key(cl_device_id device, const char *src,
+        const char *options)
+{
+    char *name = get_device_string(device, CL_DEVICE_NAME);
+    char *driver = get_device_string(device, CL_DRIVER_VERSION);
+    char *key;
+    int len = asprintf(&key, "%s\n%s\n%s\n%016llx\n", name, driver, options,
+            (unsigned long long)hash_bytes(src, strlen(src)));
+    CHECK_ASPRINTF_RET(len);
+    free(name);
+    free(driver);
+    return key;
+}
+
+static char* get_cache_path(const char *dir, const char *key)
+{
+    char *path;
+    int len = asprintf(&path, "%s/%016llx.bin", dir,
+            (unsigned long long)hash_bytes(key, strlen(key)));
+    CHECK_ASPRINTF_RET(len);
+    return path;
+}
+
+static int read_u64(FILE *f, uint64_t *val)
+{
+    return fread(val, sizeof(uint64_t), 1, f) == 1;
+}
+
+/*
+ * the binary saved under key, checked against the key and its hash
+ * returns NULL if the entry is missing, stale or corrupt
+ */
+static unsigned char* read_entry(const char *path, const char *key,
+        size_t *bin_len)
+{
+    FILE *f = fopen(path, "rb");
+    if(f == NULL)
+        return NULL;
+
+    unsigned char *bin = NULL;
+    char magic[sizeof(cache_magic)];
+    uint64_t key_len, len, hash;
+    size_t want_key_len = strlen(key);
+    char *stored_key = NULL;
+
+    if(fread(magic, 1, sizeof(cache_magic), f) != sizeof(cache_magic) ||
+            memcmp(magic, cache_magic, sizeof(cache_magic)) ||
+            !read_u64(f, &key_len) || key_len != want_key_len)
+        goto done;
+
+    stored_key = malloc(want_key_len);
+    if(stored_key == NULL ||
+            fread(stored_key, 1, want_key_len, f) != want_key_len ||
+            memcmp(stored_key, key, want_key_len) ||
+            !read_u64(f, &len) || !read_u64(f, &hash) || len == 0)
+        goto done;
+
+    bin = malloc(len);
+    if(bin == NULL || fread(bin, 1, len, f) != len ||
+            hash_bytes(bin, len) != hash)
+    {
+        free(bin);
+        bin = NULL;
+        goto done;
+    }
+    *bin_len = len;
+
+done:
+    free(stored_key);
+    fclose(f);
+    return bin;
+}
+
+/*
+ * Write an entry next to its final path and rename it into place, so that
+ * runs sharing the cache never read a half-written file.
+ */
+static void write_entry(const char *path, const char *key,
+        const unsigned char *bin, size_t bin_len)
+{
+    char *tmp_path;
+    int len = asprintf(&tmp_path, "%s.%d.tmp", path, (int)getpid());
+    CHECK_ASPRINTF_RET(len);
+
+    FILE *f = fopen(tmp_path, "wb");
+    if(f == NULL)
+    {
+        free(tmp_path);
+        return;
+    }
+
+    uint64_t key_len = strlen(key);
+    uint64_t blen = bin_len;
+    uint64_t hash = hash_bytes(bin, bin_len);
+    int ok = (fwrite(cache_magic, 1, sizeof(cache_magic), f) ==
+                sizeof(cache_magic)) &&
+        fwrite(&key_len, sizeof(uint64_t), 1, f) == 1 &&
+        fwrite(key, 1, key_len, f) == key_len &&
+        fwrite(&blen, sizeof(uint64_t), 1, f) == 1 &&
+        fwrite(&hash, sizeof(uint64_t), 1, f) == 1 &&
+        fwrite(bin, 1, bin_len, f) == bin_len;
+    ok = (fclose(f) == 0) && ok;
+
+    if(!ok || rename(tmp_path, path) != 0)
+        unlink(tmp_path);
+    free(tmp_path);
+}
+
+static cl_device_id* get_context_devices(cl_context context, cl_uint *num_dev)
+{
+    cl_int cl_err = clGetContextInfo(context, CL_CONTEXT_NUM_DEVICES,
+            sizeof(cl_uint), num_dev, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_device_id *devices = malloc(sizeof(cl_device_id) * *num_dev);
+    if(devices == NULL)
+    {
+        det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clGetContextInfo(context, CL_CONTEXT_DEVICES,
+            sizeof(cl_device_id) * *num_dev, devices, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    return devices;
+}
+
+cl_program checker_cache_load(cl_context context, const char *src,
+        const char *options)
+{
+    char *dir = get_checker_cache_envvar();
+    if(dir == NULL)
+        return NULL;
+
+    cl_uint num_dev;
+    cl_device_id *devices = get_context_devices(context, &num_dev);
+    unsigned char **bins = calloc(sizeof(unsigned char*), num_dev);
+    size_t *lens = calloc(sizeof(size_t), num_dev);
+    if(bins == NULL || lens == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    cl_program prog = NULL;
+    cl_uint i;
+    for(i = 0; i < num_dev; i++)
+    {
+        char *key = get_cache_key(devices[i], src, options);
+        char *path = get_cache_path(dir, key);
+        bins[i] = read_entry(path, key, &lens[i]);
+        free(path);
+        free(key);
+        if(bins[i] == NULL)
+            break;
+    }
+
+    if(i == num_dev)
+    {
+        cl_int cl_err;
+        prog = clCreateProgramWithBinary(context, num_dev, devices, lens,
+                (const unsigned char**)bins, NULL, &cl_err);
+        // A driver that no longer accepts the binary, despite reporting the
+        // same version, gets the checker built from source instead.
+        if(cl_err != CL_SUCCESS)
+            prog = NULL;
+        else if(clBuildProgram(prog, num_dev, devices, options, NULL, NULL) !=
+                CL_SUCCESS)
+        {
+            clReleaseProgram(prog);
+            prog = NULL;
+        }
+    }
+
+    for(i = 0; i < num_dev; i++)
+        free(bins[i]);
+    free(bins);
+    free(lens);
+    free(devices);
+    free(dir);
+    return prog;
+}
+
+void checker_cache_store(cl_program prog, const char *src,
+        const char *options)
+{
+    char *dir = get_checker_cache_envvar();
+    if(dir == NULL)
+        return;
+    // Fails harmlessly if the directory is already there.
+    mkdir(dir, 0777);
+
+    cl_int cl_err;
+    cl_uint num_dev;
+    cl_err = clGetProgramInfo(prog, CL_PROGRAM_NUM_DEVICES, sizeof(cl_uint),
+            &num_dev, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_device_id *devices = malloc(sizeof(cl_device_id) * num_dev);
+    size_t *lens = malloc(sizeof(size_t) * num_dev);
+    unsigned char **bins = calloc(sizeof(unsigned char*), num_dev);
+    if(devices == NULL || lens == NULL || bins == NULL)
+    {
+        det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clGetProgramInfo(prog, CL_PROGRAM_DEVICES,
+            sizeof(cl_device_id) * num_dev, devices, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES,
+            sizeof(size_t) * num_dev, lens, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    for(cl_uint i = 0; i < num_dev; i++)
+    {
+        bins[i] = malloc(lens[i] ? lens[i] : 1);
+        if(bins[i] == NULL)
+        {
+            det_fprintf(stderr, "Malloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+    cl_err = clGetProgramInfo(prog, CL_PROGRAM_BINARIES,
+            sizeof(unsigned char*) * num_dev, bins, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    for(cl_uint i = 0; i < num_dev; i++)
+    {
+        // Some devices cannot hand their binaries out.
+        if(lens[i] > 0)
+        {
+            char *key = get_cache_key(devices[i], src, options);
+            char *path = get_cache_path(dir, key);
+            write_entry(path, key, bins[i], lens[i]);
+            free(path);
+            free(key);
+        }
+        free(bins[i]);
+    }
+    free(bins);
+    free(lens);
+    free(devices);
+    free(dir);
+}
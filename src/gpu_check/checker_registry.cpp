@@ -0,0 +1,203 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <CL/cl.h>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "util_functions.h"
+#include "cl_err.h"
+
+#include "checker_binary_cache.h"
+#include "checker_registry.h"
+
+// Sources are told apart by address, see checker_kernel_get().
+// Kernels belong to a registry thread number rather than a pthread_t, since
+// the latter is reused once a thread has been joined.
+typedef std::pair<cl_context, const char*> checker_program_key;
+typedef std::pair<std::string, uint64_t> checker_kernel_id;
+typedef std::pair<checker_program_key, checker_kernel_id> checker_kernel_key;
+
+static std::map<checker_program_key, cl_program> checker_programs;
+static std::map<checker_kernel_key, cl_kernel> checker_kernels;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+static uint64_t next_thread_num = 0;
+static __thread uint64_t thread_num = 0;
+
+#ifdef DEBUG
+static uint32_t numBuilds = 0;
+#endif
+
+#ifdef CL_VERSION_2_0
+static const char *build_options = "-cl-std=CL2.0";
+#else
+static const char *build_options = "";
+#endif
+
+static cl_program build_checker_program(cl_context context, const char *src)
+{
+    cl_program prog = checker_cache_load(context, src, build_options);
+    if (prog != NULL)
+        return prog;
+
+#ifdef DEBUG
+    det_printf("building kernel %u\n", __sync_fetch_and_add(&numBuilds, 1));
+#endif
+    const char *slist[2] = {src, 0};
+
+    cl_int cl_err;
+    prog = clCreateProgramWithSource(context, 1, slist, NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clBuildProgram(prog, 0, NULL, build_options, NULL, NULL);
+
+    if (cl_err == CL_BUILD_PROGRAM_FAILURE)
+        print_program_build_err(context, prog, cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    checker_cache_store(prog, src, build_options);
+    return prog;
+}
+
+// Runs as a thread exits, releasing every kernel it was handed.
+static void release_thread_kernels(void *num)
+{
+    uint64_t exiting = (uint64_t)(uintptr_t)num;
+
+    pthread_mutex_lock(&registry_lock);
+    std::map<checker_kernel_key, cl_kernel>::iterator kit =
+        checker_kernels.begin();
+    while (kit != checker_kernels.end())
+    {
+        if (kit->first.second.second == exiting)
+        {
+            clReleaseKernel(kit->second);
+            checker_kernels.erase(kit++);
+        }
+        else
+            ++kit;
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+static void create_thread_key(void)
+{
+    if (pthread_key_create(&thread_key, release_thread_kernels) != 0)
+    {
+        det_fprintf(stderr, "pthread_key_create failed at %s:%d\n",
+                __FILE__, __LINE__);
+        exit(-1);
+    }
+}
+
+static uint64_t get_thread_num(void)
+{
+    if (thread_num == 0)
+    {
+        pthread_once(&thread_key_once, create_thread_key);
+        thread_num = __sync_add_and_fetch(&next_thread_num, 1);
+        pthread_setspecific(thread_key, (void*)(uintptr_t)thread_num);
+    }
+    return thread_num;
+}
+
+cl_kernel checker_kernel_get(cl_context context, const char *name,
+        const char *src)
+{
+    checker_program_key prog_key(context, src);
+    checker_kernel_key kern_key(prog_key,
+            checker_kernel_id(name, get_thread_num()));
+
+    pthread_mutex_lock(&registry_lock);
+    std::map<checker_kernel_key, cl_kernel>::iterator kit =
+        checker_kernels.find(kern_key);
+    if (kit != checker_kernels.end())
+    {
+        cl_kernel kernel = kit->second;
+        pthread_mutex_unlock(&registry_lock);
+        return kernel;
+    }
+    std::map<checker_program_key, cl_program>::iterator pit =
+        checker_programs.find(prog_key);
+    cl_program prog = (pit != checker_programs.end()) ? pit->second : NULL;
+    pthread_mutex_unlock(&registry_lock);
+
+    // Builds can take a while, so other threads are not held up by them.
+    // If two threads build the same program, the first one to finish wins.
+    if (prog == NULL)
+    {
+        cl_program built = build_checker_program(context, src);
+        pthread_mutex_lock(&registry_lock);
+        std::pair<std::map<checker_program_key, cl_program>::iterator, bool>
+            ins = checker_programs.insert(std::make_pair(prog_key, built));
+        prog = ins.first->second;
+        pthread_mutex_unlock(&registry_lock);
+        if (!ins.second)
+            clReleaseProgram(built);
+    }
+
+    // Only this thread creates kernels with this key.
+    cl_int cl_err;
+    cl_kernel kernel = clCreateKernel(prog, name, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    pthread_mutex_lock(&registry_lock);
+    checker_kernels[kern_key] = kernel;
+    pthread_mutex_unlock(&registry_lock);
+    return kernel;
+}
+
+void checker_registry_release_context(cl_context context)
+{
+    pthread_mutex_lock(&registry_lock);
+    std::map<checker_kernel_key, cl_kernel>::iterator kit =
+        checker_kernels.begin();
+    while (kit != checker_kernels.end())
+    {
+        if (kit->first.first.first == context)
+        {
+            clReleaseKernel(kit->second);
+            checker_kernels.erase(kit++);
+        }
+        else
+            ++kit;
+    }
+    std::map<checker_program_key, cl_program>::iterator pit =
+        checker_programs.begin();
+    while (pit != checker_programs.end())
+    {
+        if (pit->first.first == context)
+        {
+            clReleaseProgram(pit->second);
+            checker_programs.erase(pit++);
+        }
+        else
+            ++pit;
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
@@ -0,0 +1,317 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <CL/cl.h>
+
+#include "detector_defines.h"
+#include "util_functions.h"
+#include "cl_err.h"
+#include "cl_utils.h"
+#include "meta_data_lists/cl_memory_lists.h"
+
+#include "checker_scratch.h"
+
+typedef struct scratch_slot_
+{
+    cl_mem buffer;
+    void *svm;      // set instead of buffer for SVM scratch
+    size_t size;
+    uint8_t busy;
+    struct scratch_slot_ *next;             // ring of the context
+    struct scratch_slot_ *next_borrowed;    // slots of the same check
+} scratch_slot;
+
+typedef struct scratch_arena_
+{
+    cl_context context;
+    scratch_slot *cursor;   // the next search starts here
+    uint32_t num_idle;
+    // the context was released, so slots are freed when they are given back
+    uint8_t draining;
+    struct scratch_arena_ *next;
+} scratch_arena;
+
+struct check_scratch_
+{
+    cl_context context;
+    scratch_slot *borrowed;
+};
+
+static pthread_mutex_t scratch_lock = PTHREAD_MUTEX_INITIALIZER;
+static scratch_arena *arenas = NULL;
+
+/*
+ * find the arena of a context, creating it if create is set
+ * must hold scratch_lock
+ */
+static scratch_arena* get_arena(cl_context context, int create)
+{
+    scratch_arena *arena = arenas;
+    while(arena != NULL && arena->context != context)
+        arena = arena->next;
+    if(arena == NULL && create)
+    {
+        arena = calloc(1, sizeof(scratch_arena));
+        if(arena == NULL)
+        {
+            det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        arena->context = context;
+        arena->next = arenas;
+        arenas = arena;
+    }
+    return arena;
+}
+
+/*
+ * take a slot out of the ring of its arena
+ * must hold scratch_lock
+ */
+static void unlink_slot(scratch_arena *arena, scratch_slot *slot)
+{
+    if(slot->next == slot)
+    {
+        arena->cursor = NULL;
+        return;
+    }
+    scratch_slot *prev = slot;
+    while(prev->next != slot)
+        prev = prev->next;
+    prev->next = slot->next;
+    if(arena->cursor == slot)
+        arena->cursor = slot->next;
+}
+
+static void free_slot(cl_context context, scratch_slot *slot)
+{
+#ifdef CL_VERSION_2_0
+    if(slot->svm != NULL)
+        clSVMFree(context, slot->svm);
+    else
+#endif
+        releaseInternalMemObject(slot->buffer);
+    (void)context;
+    free(slot);
+}
+
+static scratch_slot* new_slot(cl_context context, size_t size, int svm)
+{
+    scratch_slot *slot = calloc(1, sizeof(scratch_slot));
+    if(slot == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    slot->size = SCRATCH_MIN_SIZE;
+    while(slot->size < size)
+        slot->size *= 2;
+    slot->busy = 1;
+
+#ifdef CL_VERSION_2_0
+    if(svm)
+    {
+        slot->svm = clSVMAlloc(context, CL_MEM_READ_WRITE, slot->size, 0);
+        if(slot->svm == NULL)
+        {
+            det_fprintf(stderr, "Failed to SVMAlloc at %s:%d\n", __FILE__,
+                    __LINE__);
+            exit(-1);
+        }
+        cl_svm_memobj *m1 = cl_svm_mem_find(get_cl_svm_mem_alloc(), slot->svm);
+        if(m1 == NULL)
+        {
+            det_fprintf(stderr, "failure to find cl_svm_memobj at %s:%d.\n",
+                    __FILE__, __LINE__);
+            exit(-1);
+        }
+        m1->detector_internal_buffer = 1;
+        return slot;
+    }
+#else
+    (void)svm;
+#endif
+    cl_int cl_err;
+    slot->buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, slot->size, NULL,
+            &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    return slot;
+}
+
+static scratch_slot* borrow_slot(check_scratch *scratch, size_t size, int svm)
+{
+    scratch_slot *slot = NULL;
+
+    pthread_mutex_lock(&scratch_lock);
+    scratch_arena *arena = get_arena(scratch->context, 1);
+    arena->draining = 0;
+    scratch_slot *s = arena->cursor;
+    if(s != NULL)
+    {
+        do
+        {
+            if(!s->busy && s->size >= size && ((s->svm != NULL) == svm))
+            {
+                slot = s;
+                break;
+            }
+            s = s->next;
+        } while(s != arena->cursor);
+    }
+    if(slot != NULL)
+    {
+        slot->busy = 1;
+        arena->num_idle--;
+        arena->cursor = slot->next;
+    }
+    pthread_mutex_unlock(&scratch_lock);
+
+    if(slot == NULL)
+    {
+        // Allocating goes back through the interceptor, so do it unlocked.
+        slot = new_slot(scratch->context, size, svm);
+        pthread_mutex_lock(&scratch_lock);
+        arena = get_arena(scratch->context, 1);
+        if(arena->cursor == NULL)
+        {
+            slot->next = slot;
+            arena->cursor = slot;
+        }
+        else
+        {
+            slot->next = arena->cursor->next;
+            arena->cursor->next = slot;
+        }
+        pthread_mutex_unlock(&scratch_lock);
+    }
+
+    slot->next_borrowed = scratch->borrowed;
+    scratch->borrowed = slot;
+    return slot;
+}
+
+check_scratch* scratch_begin(cl_context context)
+{
+    check_scratch *scratch = calloc(1, sizeof(check_scratch));
+    if(scratch == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    scratch->context = context;
+    return scratch;
+}
+
+cl_mem scratch_buffer(check_scratch *scratch, size_t size)
+{
+    return borrow_slot(scratch, size, 0)->buffer;
+}
+
+#ifdef CL_VERSION_2_0
+void* scratch_svm(check_scratch *scratch, size_t size)
+{
+    return borrow_slot(scratch, size, 1)->svm;
+}
+#endif
+
+void scratch_end(check_scratch *scratch)
+{
+    scratch_slot *to_free = NULL;
+
+    if(scratch == NULL)
+        return;
+
+    pthread_mutex_lock(&scratch_lock);
+    scratch_arena *arena = get_arena(scratch->context, 0);
+    scratch_slot *slot = scratch->borrowed;
+    while(slot != NULL)
+    {
+        scratch_slot *next = slot->next_borrowed;
+        slot->busy = 0;
+        if(arena->draining || arena->num_idle >= SCRATCH_MAX_IDLE)
+        {
+            unlink_slot(arena, slot);
+            slot->next_borrowed = to_free;
+            to_free = slot;
+        }
+        else
+            arena->num_idle++;
+        slot = next;
+    }
+    pthread_mutex_unlock(&scratch_lock);
+
+    while(to_free != NULL)
+    {
+        scratch_slot *next = to_free->next_borrowed;
+        free_slot(scratch->context, to_free);
+        to_free = next;
+    }
+    free(scratch);
+}
+
+void scratch_release_context(cl_context context)
+{
+    scratch_slot *to_free = NULL;
+
+    pthread_mutex_lock(&scratch_lock);
+    scratch_arena **a = &arenas;
+    while(*a != NULL && (*a)->context != context)
+        a = &(*a)->next;
+    if(*a == NULL)
+    {
+        pthread_mutex_unlock(&scratch_lock);
+        return;
+    }
+
+    scratch_arena *arena = *a;
+    arena->draining = 1;
+    scratch_slot *s = arena->cursor;
+    while(arena->num_idle > 0)
+    {
+        scratch_slot *next = s->next;
+        if(!s->busy)
+        {
+            unlink_slot(arena, s);
+            arena->num_idle--;
+            s->next_borrowed = to_free;
+            to_free = s;
+        }
+        s = next;
+    }
+    // Checks still in flight need the arena to give their slots back to.
+    if(arena->cursor == NULL)
+    {
+        *a = arena->next;
+        free(arena);
+    }
+    pthread_mutex_unlock(&scratch_lock);
+
+    while(to_free != NULL)
+    {
+        scratch_slot *next = to_free->next_borrowed;
+        free_slot(context, to_free);
+        to_free = next;
+    }
+}
@@ -31,14 +31,90 @@
 
 #include "copy_canary_cl_buffer.h"
 
+/*
+ * canary lengths of a buffer being checked
+ * the first num_cl_mem buffer_ptrs are cl_mem, the rest SVM
+ */
+static canary_geometry get_geometry(uint32_t num_cl_mem, void **buffer_ptrs,
+        uint32_t i)
+{
+    if(i < num_cl_mem)
+    {
+        cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), buffer_ptrs[i]);
+        if(m1 == NULL)
+        {
+            det_fprintf(stderr, "failure to find cl_memobj at %s:%d.\n", __FILE__,
+                    __LINE__);
+            exit(-1);
+        }
+        return m1->canary;
+    }
+#ifdef CL_VERSION_2_0
+    cl_svm_memobj *m2 = cl_svm_mem_find(get_cl_svm_mem_alloc(), buffer_ptrs[i]);
+    if(m2 == NULL)
+    {
+        det_fprintf(stderr, "failure to find cl_svm_memobj at %s:%d.\n", __FILE__,
+                __LINE__);
+        exit(-1);
+    }
+    return m2->canary;
+#else
+    det_fprintf(stderr, "SVM buffer without OpenCL 2.0 at %s:%d.\n", __FILE__,
+            __LINE__);
+    exit(-1);
+#endif
+}
+
+/*
+ * Every buffer's canaries are copied into a slot of slot_len bytes, the
+ * front canary first and the back canary right after it. Slots are as long
+ * as the longest canaries being checked, and the rest of a shorter slot is
+ * filled with poison so it can never be reported.
+ */
+static uint32_t get_slot_len(uint32_t total_buffs, uint32_t num_cl_mem,
+        void **buffer_ptrs, int *uniform)
+{
+    uint32_t slot_len = 0;
+    *uniform = 1;
+    for(uint32_t i = 0; i < total_buffs; i++)
+    {
+        canary_geometry geom = get_geometry(num_cl_mem, buffer_ptrs, i);
+        uint32_t len = geom.front + geom.back;
+        if(i > 0 && len != slot_len)
+            *uniform = 0;
+        if(len > slot_len)
+            slot_len = len;
+    }
+    return slot_len;
+}
+
 static cl_mem create_clmem_copies(cl_context kern_ctx,
         cl_command_queue cmd_queue, uint32_t num_cl_mem, void **buffer_ptrs,
+        uint32_t slot_len, int uniform, check_scratch *scratch,
         const cl_event *evt, cl_event *events, cl_event *mend_events)
 {
     cl_int cl_err;
-    cl_mem clmem_canary_copies = clCreateBuffer(kern_ctx, 0,
-            POISON_FILL_LENGTH*POISON_REGIONS*num_cl_mem, 0, &cl_err);
-    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem clmem_canary_copies = scratch_buffer(scratch, slot_len*num_cl_mem);
+
+    cl_event copy_wait[2] = {*evt, NULL};
+    uint32_t num_copy_wait = 1;
+    if(!uniform)
+    {
+#ifdef CL_VERSION_1_2
+        cl_err = clEnqueueFillBuffer(cmd_queue, clmem_canary_copies,
+                &poisonFill_32b, sizeof(uint32_t), 0, slot_len*num_cl_mem,
+                0, NULL, &copy_wait[num_copy_wait++]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+#else
+        char *poison_data = malloc(slot_len*num_cl_mem);
+        memset(poison_data, poisonFill_8b, slot_len*num_cl_mem);
+        cl_err = clEnqueueWriteBuffer(cmd_queue, clmem_canary_copies,
+                CL_BLOCKING, 0, slot_len*num_cl_mem, poison_data, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        free(poison_data);
+#endif
+    }
+
     for(uint32_t i = 0; i < num_cl_mem; i++)
     {
         cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), buffer_ptrs[i]);
@@ -50,19 +126,21 @@ static cl_mem create_clmem_copies(cl_context kern_ctx,
         }
 
         uint32_t index = i * POISON_REGIONS;
-        uint32_t offset = m1->size;
-#ifdef UNDERFLOW_CHECK
-        cl_buffer_copy(cmd_queue, m1->main_buff, clmem_canary_copies,
-                0, index*POISON_FILL_LENGTH,
-                POISON_FILL_LENGTH, 1, evt, &events[index]);
-
-        index++;
-        offset += POISON_FILL_LENGTH;
-#endif
+        size_t slot = (size_t)i * slot_len;
+        if(POISON_REGIONS > 1)
+        {
+            if(m1->canary.front > 0)
+                cl_buffer_copy(cmd_queue, m1->main_buff, clmem_canary_copies,
+                        0, slot, m1->canary.front, num_copy_wait, copy_wait,
+                        &events[index]);
+            else
+                events[index] = create_complete_user_event(kern_ctx);
+            index++;
+        }
 
         cl_buffer_copy(cmd_queue, m1->main_buff, clmem_canary_copies,
-                offset, index*POISON_FILL_LENGTH,
-                POISON_FILL_LENGTH, 1, evt, &events[index]);
+                m1->canary.front + m1->size, slot + m1->canary.front,
+                m1->canary.back, num_copy_wait, copy_wait, &events[index]);
 
         cl_event copy_finish;
         clEnqueueMarkerWithWaitList(cmd_queue, POISON_REGIONS, &events[POISON_REGIONS*i], &copy_finish);
@@ -70,32 +148,31 @@ static cl_mem create_clmem_copies(cl_context kern_ctx,
         mend_this_canary(kern_ctx, cmd_queue, m1->handle, copy_finish,
                 &mend_events[i]);
     }
+    if(num_copy_wait > 1)
+        clReleaseEvent(copy_wait[1]);
     return clmem_canary_copies;
 }
 
 static void *create_svm_copies(cl_context kern_ctx, cl_command_queue cmd_queue,
-        uint32_t num_svm, void **buffer_ptrs, const cl_event *evt,
-        cl_event *events, cl_event *mend_events)
+        uint32_t num_svm, void **buffer_ptrs, uint32_t slot_len, int uniform,
+        check_scratch *scratch, const cl_event *evt, cl_event *events,
+        cl_event *mend_events)
 {
     void *svm_canary_copies;
 #ifdef CL_VERSION_2_0
     cl_svm_memobj *m1;
-    svm_canary_copies = clSVMAlloc(kern_ctx, CL_MEM_READ_WRITE,
-            POISON_REGIONS*POISON_FILL_LENGTH*num_svm, 0);
-    if (svm_canary_copies == NULL)
-    {
-        det_fprintf(stderr, "Failed to SVMAlloc at %s:%d\n", __FILE__,
-                __LINE__);
-        exit(-1);
-    }
-    m1 = cl_svm_mem_find(get_cl_svm_mem_alloc(), svm_canary_copies);
-    if (m1 == NULL)
+    cl_int cl_err;
+    svm_canary_copies = scratch_svm(scratch, slot_len*num_svm);
+
+    cl_event copy_wait[2] = {*evt, NULL};
+    uint32_t num_copy_wait = 1;
+    if(!uniform)
     {
-        det_fprintf(stderr, "failure to find cl_svm_memobj at %s:%d.\n", __FILE__,
-                __LINE__);
-        exit(-1);
+        cl_err = clEnqueueSVMMemFill(cmd_queue, svm_canary_copies,
+                &poisonFill_32b, sizeof(uint32_t), slot_len*num_svm, 0, NULL,
+                &copy_wait[num_copy_wait++]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
     }
-    m1->detector_internal_buffer = 1;
 
     for(uint32_t i = 0; i < num_svm; i++)
     {
@@ -108,26 +185,27 @@ static void *create_svm_copies(cl_context kern_ctx, cl_command_queue cmd_queue,
         }
 
         char *base_ptr = (char*)m1->main_buff;
-        uint32_t offset = m1->size;
         uint32_t index = i * POISON_REGIONS;
-        char *canary_ptr = base_ptr;
-        char *map_ptr = ((char*)svm_canary_copies)+(index*POISON_FILL_LENGTH);
-
-        cl_int cl_err;
-#ifdef UNDERFLOW_CHECK
-        cl_err = clEnqueueSVMMemcpy(cmd_queue, CL_NON_BLOCKING, map_ptr,
-                canary_ptr, POISON_FILL_LENGTH, 1, evt, &events[index]);
-        check_cl_error(__FILE__, __LINE__, cl_err);
+        char *slot_ptr = ((char*)svm_canary_copies) + (size_t)i * slot_len;
 
-        offset += POISON_FILL_LENGTH;
-        index += 1;
-#endif
-
-        canary_ptr = base_ptr + offset;
-        map_ptr = ((char*)svm_canary_copies)+(index*POISON_FILL_LENGTH);
+        if(POISON_REGIONS > 1)
+        {
+            if(m1->canary.front > 0)
+            {
+                cl_err = clEnqueueSVMMemcpy(cmd_queue, CL_NON_BLOCKING, slot_ptr,
+                        base_ptr, m1->canary.front, num_copy_wait, copy_wait,
+                        &events[index]);
+                check_cl_error(__FILE__, __LINE__, cl_err);
+            }
+            else
+                events[index] = create_complete_user_event(kern_ctx);
+            index++;
+        }
 
-        cl_err = clEnqueueSVMMemcpy(cmd_queue, CL_NON_BLOCKING, map_ptr,
-                canary_ptr, POISON_FILL_LENGTH, 1, evt, &events[index]);
+        cl_err = clEnqueueSVMMemcpy(cmd_queue, CL_NON_BLOCKING,
+                slot_ptr + m1->canary.front,
+                base_ptr + m1->canary.front + m1->size, m1->canary.back,
+                num_copy_wait, copy_wait, &events[index]);
         check_cl_error(__FILE__, __LINE__, cl_err);
 
         cl_event copy_finish;
@@ -135,12 +213,17 @@ static void *create_svm_copies(cl_context kern_ctx, cl_command_queue cmd_queue,
 
         mend_this_canary(kern_ctx, cmd_queue, m1->handle, copy_finish, &mend_events[i]);
     }
+    if(num_copy_wait > 1)
+        clReleaseEvent(copy_wait[1]);
 #else
     svm_canary_copies = NULL;
     (void)kern_ctx;
     (void)cmd_queue;
     (void)num_svm;
     (void)buffer_ptrs;
+    (void)slot_len;
+    (void)uniform;
+    (void)scratch;
     (void)evt;
     (void)events;
     (void)mend_events;
@@ -148,9 +231,14 @@ static void *create_svm_copies(cl_context kern_ctx, cl_command_queue cmd_queue,
     return svm_canary_copies;
 }
 
+/*
+ * table of pointers to each SVM canary region, and a matching table of
+ * region lengths in words, for checking the canaries where they are
+ */
 static void ** create_svm_ptr_copies(cl_context kern_ctx,
         cl_command_queue cmd_queue, uint32_t num_svm, void **buffer_ptrs,
-        void **ret_clmem, const cl_event *evt, cl_event *events)
+        check_scratch *scratch, void **ret_clmem, cl_mem *ret_lens,
+        const cl_event *evt, cl_event *events)
 {
     void **ret_poison_ptrs;
     if (num_svm == 0)
@@ -166,10 +254,10 @@ static void ** create_svm_ptr_copies(cl_context kern_ctx,
         return NULL;
 
     ret_poison_ptrs = calloc(sizeof(void*), POISON_REGIONS*num_svm);
-    cl_mem temp_ptr = clCreateBuffer(kern_ctx, 0, sizeof(void*) * POISON_REGIONS*num_svm, 0,
-            &cl_err);
+    cl_uint *region_lens = calloc(sizeof(cl_uint), POISON_REGIONS*num_svm);
+    cl_mem temp_ptr = scratch_buffer(scratch, sizeof(void*) * POISON_REGIONS*num_svm);
     *ret_clmem = (void*)temp_ptr;
-    check_cl_error(__FILE__, __LINE__, cl_err);
+    *ret_lens = scratch_buffer(scratch, sizeof(cl_uint) * POISON_REGIONS*num_svm);
 
     for(uint32_t i = 0; i < num_svm; i++)
     {
@@ -183,18 +271,25 @@ static void ** create_svm_ptr_copies(cl_context kern_ctx,
 
         char *ptr_base = (char *)m1->main_buff;
         uint32_t index = i * POISON_REGIONS;
-        uint32_t offset = m1->size;
-#ifdef UNDERFLOW_CHECK
-        ret_poison_ptrs[index] = ptr_base;
-        index++;
-        offset += POISON_FILL_LENGTH;
-#endif
-        ret_poison_ptrs[index] = ptr_base + offset;
+        if(POISON_REGIONS > 1)
+        {
+            ret_poison_ptrs[index] = ptr_base;
+            region_lens[index] = m1->canary.front / sizeof(cl_uint);
+            index++;
+        }
+        ret_poison_ptrs[index] = ptr_base + m1->canary.front + m1->size;
+        region_lens[index] = m1->canary.back / sizeof(cl_uint);
     }
     cl_err = clEnqueueWriteBuffer(cmd_queue, *ret_clmem, CL_NON_BLOCKING,
             0, sizeof(void*) * POISON_REGIONS*num_svm, ret_poison_ptrs, 1, evt,
             &events[0]);
     check_cl_error(__FILE__, __LINE__, cl_err);
+    // The lengths are only read by this call, so it can block.
+    cl_err = clEnqueueWriteBuffer(cmd_queue, *ret_lens, CL_BLOCKING,
+            0, sizeof(cl_uint) * POISON_REGIONS*num_svm, region_lens, 0, NULL,
+            NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    free(region_lens);
     // We only need one event from this one.
     for (uint32_t i = 1; i < POISON_REGIONS*num_svm; i++)
         events[i] = create_complete_user_event(kern_ctx);
@@ -202,7 +297,9 @@ static void ** create_svm_ptr_copies(cl_context kern_ctx,
     ret_poison_ptrs = NULL;
     (void)cmd_queue;
     (void)buffer_ptrs;
+    (void)scratch;
     (void)ret_clmem;
+    (void)ret_lens;
     (void)evt;
     for (uint32_t i = 0; i < POISON_REGIONS*num_svm; i++)
         events[i] = create_complete_user_event(kern_ctx);
@@ -212,18 +309,17 @@ static void ** create_svm_ptr_copies(cl_context kern_ctx,
 
 static cl_event perform_cl_buffer_checks(cl_context kern_ctx,
         cl_command_queue cmd_queue, uint32_t num_cl_mem, uint32_t num_svm,
-        uint32_t total_buffs, cl_mem clmem_canary_copies,
-        void *svm_canary_copies, int copy_svm_ptrs, cl_event *init_evts,
-        cl_event *mend_events, cl_mem result)
+        uint32_t total_buffs, uint32_t slot_len, cl_mem clmem_canary_copies,
+        void *svm_canary_copies, int copy_svm_ptrs, cl_mem svm_lens,
+        cl_event *init_evts, cl_event *mend_events, cl_mem result)
 {
-    size_t global_work[3] = {POISON_REGIONS*poisonWordLen, 1, 1};
+    size_t global_work[3] = {1, 1, 1};
     size_t local_work[3] = {256, 1, 1};
     size_t max_work_items[3] = {1, 1, 1};
-    global_work[0] *= POISON_REGIONS*total_buffs;
 
-    uint32_t buff_end = num_cl_mem * POISON_REGIONS*poisonWordLen;
-    uint32_t svm_end = buff_end + num_svm * POISON_REGIONS*poisonWordLen;
-    unsigned len_in_words = POISON_REGIONS*poisonWordLen;
+    unsigned len_in_words = slot_len / sizeof(uint32_t);
+    uint32_t buff_end = num_cl_mem * len_in_words;
+    uint32_t svm_end = buff_end + num_svm * len_in_words;
 
     cl_kernel check_kern;
 #ifdef CL_VERSION_2_0
@@ -235,6 +331,7 @@ static cl_event perform_cl_buffer_checks(cl_context kern_ctx,
         {
             cl_set_arg_and_check(check_kern, 5, sizeof(cl_mem),
                     &svm_canary_copies);
+            cl_set_arg_and_check(check_kern, 7, sizeof(cl_mem), &svm_lens);
         }
         else
             cl_set_svm_arg_and_check(check_kern, 5, svm_canary_copies);
@@ -244,6 +341,7 @@ static cl_event perform_cl_buffer_checks(cl_context kern_ctx,
 #else
     (void)svm_canary_copies;
     (void)copy_svm_ptrs;
+    (void)svm_lens;
 #endif
     {
         check_kern = get_canary_check_kernel_no_svm(kern_ctx);
@@ -259,7 +357,12 @@ static cl_event perform_cl_buffer_checks(cl_context kern_ctx,
     clGetContextInfo(kern_ctx, CL_CONTEXT_DEVICES, sizeof(cl_device_id), &dev_id, NULL);
     clGetKernelWorkGroupInfo(check_kern, dev_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), max_work_items, NULL);
 
+    // Each work-item checks CHECK_WORDS_PER_ITEM words.
+    uint32_t num_items = (svm_end + CHECK_WORDS_PER_ITEM - 1) /
+        CHECK_WORDS_PER_ITEM;
     local_work[0] = max_work_items[0];
+    global_work[0] = ((num_items + local_work[0] - 1) / local_work[0]) *
+        local_work[0];
 
     cl_event kern_end;
     launchOclKernelStruct ocl_args = setup_ocl_args(cmd_queue, check_kern,
@@ -306,7 +409,6 @@ void verify_cl_buffer_copy(cl_context kern_ctx, cl_command_queue cmd_queue,
         int copy_svm_ptrs, kernel_info *kern_info, uint32_t *dupe,
         const cl_event *evt, cl_event *ret_evt)
 {
-    cl_int cl_err;
     uint32_t total_buffs = num_cl_mem + num_svm;
 
     if(total_buffs == 0)
@@ -320,51 +422,56 @@ void verify_cl_buffer_copy(cl_context kern_ctx, cl_command_queue cmd_queue,
     void *svm_canary_copies = NULL;
     void **poison_pointers = NULL;
 
+    cl_mem svm_lens = NULL;
+
     cl_event *events = calloc(sizeof(cl_event), (POISON_REGIONS*total_buffs+1));
     cl_event *mend_events = calloc(sizeof(cl_event), (total_buffs));
 
+    int uniform;
+    uint32_t slot_len = get_slot_len(total_buffs, num_cl_mem, buffer_ptrs,
+            &uniform);
+
+    check_scratch *scratch = scratch_begin(kern_ctx);
     if (num_cl_mem > 0)
     {
         clmem_canary_copies = create_clmem_copies(kern_ctx, cmd_queue,
-                num_cl_mem, buffer_ptrs, evt, events, mend_events);
+                num_cl_mem, buffer_ptrs, slot_len, uniform, scratch, evt,
+                events, mend_events);
     }
     else
-    {
-        clmem_canary_copies = clCreateBuffer(kern_ctx, 0, 1, 0, &cl_err);
-        check_cl_error(__FILE__, __LINE__, cl_err);
-    }
+        clmem_canary_copies = scratch_buffer(scratch, 1);
 
     uint32_t first_svm_evt_index = POISON_REGIONS*num_cl_mem;
     if (num_svm > 0 && copy_svm_ptrs)
     {
         poison_pointers = create_svm_ptr_copies(kern_ctx, cmd_queue,
-                num_svm, &(buffer_ptrs[num_cl_mem]), &svm_canary_copies,
-                evt, &(events[first_svm_evt_index]));
+                num_svm, &(buffer_ptrs[num_cl_mem]), scratch,
+                &svm_canary_copies, &svm_lens, evt,
+                &(events[first_svm_evt_index]));
         for (uint32_t i = num_cl_mem; i < total_buffs; i++)
             mend_events[i] = create_complete_user_event(kern_ctx);
     }
     else if (num_svm > 0)
     {
         svm_canary_copies = create_svm_copies(kern_ctx, cmd_queue, num_svm,
-                &(buffer_ptrs[num_cl_mem]), evt, &(events[first_svm_evt_index]),
-                &(mend_events[num_cl_mem]));
+                &(buffer_ptrs[num_cl_mem]), slot_len, uniform, scratch, evt,
+                &(events[first_svm_evt_index]), &(mend_events[num_cl_mem]));
     }
 
+    // The first and last change of each buffer.
     uint32_t finish_evt_index = POISON_REGIONS*total_buffs;
-    cl_mem result = create_result_buffer(kern_ctx, cmd_queue, total_buffs,
-            &events[finish_evt_index]);
+    cl_mem result = create_result_buffer(kern_ctx, cmd_queue, 2*total_buffs,
+            scratch, &events[finish_evt_index]);
 
     cl_event kern_end = perform_cl_buffer_checks(kern_ctx, cmd_queue,
-            num_cl_mem, num_svm, total_buffs, clmem_canary_copies,
-            svm_canary_copies, copy_svm_ptrs, events, mend_events, result);
+            num_cl_mem, num_svm, total_buffs, slot_len, clmem_canary_copies,
+            svm_canary_copies, copy_svm_ptrs, svm_lens, events, mend_events,
+            result);
 
     for (uint32_t i = 0; i < total_buffs; i++)
     {
-        uint32_t evt_index = POISON_REGIONS*i;
-        clReleaseEvent(events[evt_index]);
-#ifdef UNDERFLOW_CHECK
-        clReleaseEvent(events[evt_index+1]);
-#endif
+        for (uint32_t n = 0; n < POISON_REGIONS; n++)
+            clReleaseEvent(events[POISON_REGIONS*i + n]);
         clReleaseEvent(mend_events[i]);
     }
     clReleaseEvent(events[finish_evt_index]);
@@ -372,18 +479,16 @@ void verify_cl_buffer_copy(cl_context kern_ctx, cl_command_queue cmd_queue,
     free(mend_events);
 
     cl_event read_result;
-    int * first_change = get_change_buffer(cmd_queue, total_buffs, result, 1,
+    int * first_change = get_change_buffer(cmd_queue, 2*total_buffs, result, 1,
             &kern_end, &read_result);
 
     if(ret_evt)
         *ret_evt = read_result;
 
     analyze_check_results(cmd_queue, read_result, kern_info, total_buffs,
-            buffer_ptrs, svm_canary_copies, copy_svm_ptrs, poison_pointers,
-            first_change, dupe);
+            buffer_ptrs, scratch, poison_pointers, first_change,
+            &first_change[total_buffs], dupe);
 
     clReleaseEvent(kern_end);
-    clReleaseMemObject(result);
-    clReleaseMemObject(clmem_canary_copies);
 }
 
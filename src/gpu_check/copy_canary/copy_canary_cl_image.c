@@ -174,11 +174,9 @@ void verify_cl_images_copy(cl_context kern_ctx, cl_command_queue cmd_queue,
     uint32_t total_canary_len = find_canary_ends(image_ptrs, num_images,
             canary_ends);
 
-    // Create a buffer big enough to hold all of the canaries
-    cl_int cl_err;
-    cl_mem canary_copies = clCreateBuffer(kern_ctx, 0, total_canary_len, 0,
-            &cl_err);
-    check_cl_error(__FILE__, __LINE__, cl_err);
+    // Borrow a buffer big enough to hold all of the canaries
+    check_scratch *scratch = scratch_begin(kern_ctx);
+    cl_mem canary_copies = scratch_buffer(scratch, total_canary_len);
 
     cl_event *events = calloc(sizeof(cl_event), (num_images+1));
     cl_event *mend_events = calloc(sizeof(cl_event), (num_images));
@@ -194,7 +192,7 @@ void verify_cl_images_copy(cl_context kern_ctx, cl_command_queue cmd_queue,
     }
 
     cl_mem result = create_result_buffer(kern_ctx, cmd_queue, num_images,
-            &events[num_images]);
+            scratch, &events[num_images]);
 
     // At this point, copying the canaries is events[0] through events[n-1]
     // and initializing the results buffer is events[n].
@@ -220,8 +218,5 @@ void verify_cl_images_copy(cl_context kern_ctx, cl_command_queue cmd_queue,
         *ret_evt = read_result;
 
     analyze_check_results(cmd_queue, read_result, kern_info, num_images,
-            image_ptrs, NULL, 0, NULL, firstChange, dupe);
-
-    clReleaseMemObject(result);
-    clReleaseMemObject(canary_copies);
+            image_ptrs, scratch, NULL, firstChange, NULL, dupe);
 }
@@ -0,0 +1,361 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+#include <stdio.h>
+
+#include "detector_defines.h"
+#include "util_functions.h"
+#include "universal_copy.h"
+#include "cl_err.h"
+#include "cl_utils.h"
+#include "../gpu_check_utils.h"
+
+#include "copy_canary_fused.h"
+
+// descriptor of each object, see findCorruptionFused
+#define DESC_END            0
+#define DESC_FRONT_WORDS    1
+#define DESC_FRONT_PTR      2
+#define DESC_BACK_PTR       3
+#define DESC_LEN            4
+
+static cl_memobj* find_cl_memobj(void *handle)
+{
+    cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), handle);
+    if(m1 == NULL)
+    {
+        det_fprintf(stderr, "failure to find cl_memobj at %s:%d.\n", __FILE__,
+                __LINE__);
+        exit(-1);
+    }
+    return m1;
+}
+
+static uint32_t image_canary_len(cl_memobj *img)
+{
+    uint32_t i_lim, j_lim, k_lim, i_dat, j_dat, k_dat;
+    get_image_dimensions(img->image_desc, &i_lim, &j_lim, &k_lim, &i_dat,
+            &j_dat, &k_dat);
+    size_t data_size = getImageDataSize(&img->image_format);
+    return get_image_canary_size(img->image_desc.image_type, data_size,
+            i_lim, j_lim, j_dat, k_dat);
+}
+
+/*
+ * Objects are ordered cl_mem buffers that are copied, then images, then
+ * cl_mem buffers backed by SVM, then SVM. The canaries of the first two are
+ * copied into one buffer, each starting on a word, and the canaries of the
+ * others are checked where they are.
+ * returns the number of canary words of the copied objects
+ */
+static uint32_t build_descriptors(uint32_t num_cl_mem, uint32_t num_svm,
+        uint32_t num_images, void **buffer_ptrs, void **image_ptrs,
+        void **objs, cl_ulong *desc, int *padded, uint32_t *num_copied)
+{
+    uint32_t num_objs = num_cl_mem + num_images + num_svm;
+    uint32_t n = 0;
+    for(uint32_t i = 0; i < num_cl_mem; i++)
+    {
+        if(find_cl_memobj(buffer_ptrs[i])->svm_backing == NULL)
+            objs[n++] = buffer_ptrs[i];
+    }
+    for(uint32_t i = 0; i < num_images; i++)
+        objs[n++] = image_ptrs[i];
+    *num_copied = n;
+    for(uint32_t i = 0; i < num_cl_mem; i++)
+    {
+        if(find_cl_memobj(buffer_ptrs[i])->svm_backing != NULL)
+            objs[n++] = buffer_ptrs[i];
+    }
+    for(uint32_t i = 0; i < num_svm; i++)
+        objs[n++] = buffer_ptrs[num_cl_mem + i];
+
+    uint32_t num_mem = n - num_svm;
+    uint32_t words = 0;
+    uint32_t copied_words = 0;
+    *padded = 0;
+
+    for(uint32_t i = 0; i < num_objs; i++)
+    {
+        cl_ulong *d = &desc[DESC_LEN*i];
+        uint32_t len = 0;
+        char *base = NULL;
+        canary_geometry geom = {0, 0};
+        size_t size = 0;
+        if(i < *num_copied)
+        {
+            cl_memobj *m1 = find_cl_memobj(objs[i]);
+            if(m1->is_image)
+                len = image_canary_len(m1);
+            else
+                len = m1->canary.front + m1->canary.back;
+            if(len % sizeof(uint32_t))
+                *padded = 1;
+        }
+        else if(i < num_mem)
+        {
+            cl_memobj *m1 = find_cl_memobj(objs[i]);
+            base = (char*)m1->svm_backing;
+            geom = m1->canary;
+            size = m1->size;
+        }
+        else
+        {
+#ifdef CL_VERSION_2_0
+            cl_svm_memobj *m2 = cl_svm_mem_find(get_cl_svm_mem_alloc(),
+                    objs[i]);
+            if(m2 == NULL)
+            {
+                det_fprintf(stderr, "failure to find cl_svm_memobj at %s:%d.\n",
+                        __FILE__, __LINE__);
+                exit(-1);
+            }
+            base = (char*)m2->main_buff;
+            geom = m2->canary;
+            size = m2->size;
+#else
+            det_fprintf(stderr, "SVM buffer without OpenCL 2.0 at %s:%d.\n",
+                    __FILE__, __LINE__);
+            exit(-1);
+#endif
+        }
+
+        if(base != NULL)
+        {
+            len = geom.front + geom.back;
+            d[DESC_FRONT_WORDS] = geom.front / sizeof(uint32_t);
+            d[DESC_FRONT_PTR] = (cl_ulong)(uintptr_t)base;
+            d[DESC_BACK_PTR] = (cl_ulong)(uintptr_t)(base + geom.front + size);
+        }
+
+        words += (len + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+        d[DESC_END] = words;
+        if(i < *num_copied)
+            copied_words = words;
+    }
+    return copied_words;
+}
+
+/*
+ * copy the front and back canaries of a cl_mem buffer next to each other
+ */
+static void copy_buffer_canaries(cl_context kern_ctx,
+        cl_command_queue cmd_queue, cl_memobj *m1, cl_mem canary_copies,
+        size_t offset, cl_event wait, cl_event *copy_finish)
+{
+    cl_event events[2];
+    uint32_t n = 0;
+
+    if(m1->canary.front > 0)
+        cl_buffer_copy(cmd_queue, m1->main_buff, canary_copies, 0, offset,
+                m1->canary.front, 1, &wait, &events[n++]);
+    if(m1->canary.back > 0)
+        cl_buffer_copy(cmd_queue, m1->main_buff, canary_copies,
+                m1->canary.front + m1->size, offset + m1->canary.front,
+                m1->canary.back, 1, &wait, &events[n++]);
+    if(n == 0)
+        events[n++] = create_complete_user_event(kern_ctx);
+
+    cl_int cl_err = clEnqueueMarkerWithWaitList(cmd_queue, n, events,
+            copy_finish);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    for(uint32_t i = 0; i < n; i++)
+        clReleaseEvent(events[i]);
+}
+
+static cl_event perform_fused_checks(cl_context kern_ctx,
+        cl_command_queue cmd_queue, uint32_t num_objs, uint32_t total_words,
+        uint32_t copied_words, cl_mem desc_buf, cl_mem canary_copies, cl_mem result,
+        uint32_t num_init_evts, cl_event *init_evts, uint32_t num_mend,
+        cl_event *mend_events)
+{
+    size_t global_work[3] = {1, 1, 1};
+    size_t local_work[3] = {256, 1, 1};
+    size_t max_work_items[3] = {1, 1, 1};
+
+    cl_kernel check_kern = get_canary_check_kernel_fused(kern_ctx);
+    cl_set_arg_and_check(check_kern, 0, sizeof(unsigned), &num_objs);
+    cl_set_arg_and_check(check_kern, 1, sizeof(unsigned), &total_words);
+    cl_set_arg_and_check(check_kern, 2, sizeof(unsigned), &copied_words);
+    cl_set_arg_and_check(check_kern, 3, sizeof(unsigned), &poisonFill_32b);
+    cl_set_arg_and_check(check_kern, 4, sizeof(cl_mem), &desc_buf);
+    cl_set_arg_and_check(check_kern, 5, sizeof(cl_mem), &canary_copies);
+    cl_set_arg_and_check(check_kern, 6, sizeof(cl_mem), &result);
+
+    cl_device_id dev_id;
+    clGetContextInfo(kern_ctx, CL_CONTEXT_DEVICES, sizeof(cl_device_id), &dev_id, NULL);
+    clGetKernelWorkGroupInfo(check_kern, dev_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), max_work_items, NULL);
+
+    // Each work-item checks CHECK_WORDS_PER_ITEM words.
+    uint32_t num_items = (total_words + CHECK_WORDS_PER_ITEM - 1) /
+        CHECK_WORDS_PER_ITEM;
+    local_work[0] = max_work_items[0];
+    global_work[0] = ((num_items + local_work[0] - 1) / local_work[0]) *
+        local_work[0];
+
+    cl_event kern_end;
+    launchOclKernelStruct ocl_args = setup_ocl_args(cmd_queue, check_kern,
+            1, NULL, global_work, local_work, num_init_evts, init_evts,
+            &kern_end);
+    cl_int cl_err = runNDRangeKernel( &ocl_args );
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    if(global_tool_stats_flags & STATS_CHECKER_TIME)
+    {
+        clFinish(cmd_queue);
+        uint64_t times[4];
+        populateKernelTimes(&kern_end, &times[0], &times[1], &times[2],
+                &times[3]);
+        add_to_kern_runtime((times[3] - times[2]) / 1000);
+    }
+
+    cl_event finish;
+    if(!get_error_envvar() && num_mend > 0)
+    {
+        cl_event mend_finish;
+        cl_err = clEnqueueMarkerWithWaitList(cmd_queue, num_mend,
+                mend_events, &mend_finish);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_event evt_list[] = {mend_finish, kern_end};
+        cl_err = clEnqueueMarkerWithWaitList(cmd_queue, 2, evt_list, &finish);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        clReleaseEvent(mend_finish);
+        clReleaseEvent(kern_end);
+    }
+    else
+        finish = kern_end;
+    return finish;
+}
+
+/*
+ * launch one checker kernel for the cl_mem buffers, svm and images of a launch
+ */
+void verify_fused_copy(cl_context kern_ctx, cl_command_queue cmd_queue,
+        uint32_t num_cl_mem, uint32_t num_svm, uint32_t num_images,
+        void **buffer_ptrs, void **image_ptrs, kernel_info *kern_info,
+        uint32_t *dupe, const cl_event *evt, cl_event *ret_evt)
+{
+    cl_int cl_err;
+    uint32_t num_objs = num_cl_mem + num_images + num_svm;
+
+    if(num_objs == 0)
+    {
+        if (ret_evt != NULL)
+            *ret_evt = create_complete_user_event(kern_ctx);
+        return;
+    }
+
+    void **objs = calloc(sizeof(void*), num_objs);
+    // Kept until the check ends, it is freed with the results.
+    cl_ulong *desc = calloc(sizeof(cl_ulong), DESC_LEN*num_objs);
+    if(objs == NULL || desc == NULL)
+    {
+        det_fprintf(stderr, "Calloc failed at %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    int padded;
+    uint32_t num_copied;
+    uint32_t copied_words = build_descriptors(num_cl_mem, num_svm, num_images,
+            buffer_ptrs, image_ptrs, objs, desc, &padded, &num_copied);
+    uint32_t total_words = (uint32_t)desc[DESC_LEN*(num_objs-1) + DESC_END];
+
+    check_scratch *scratch = scratch_begin(kern_ctx);
+    size_t copies_len = sizeof(uint32_t) * (copied_words ? copied_words : 1);
+    cl_mem canary_copies = scratch_buffer(scratch, copies_len);
+
+    // Every copy waits for the user's kernel, and for the poison fill of the
+    // bytes that round canaries up to whole words.
+    cl_event copy_wait = *evt;
+    clRetainEvent(copy_wait);
+    if(padded)
+    {
+        cl_event wait_list[2] = {*evt, NULL};
+        cl_err = clEnqueueFillBuffer(cmd_queue, canary_copies,
+                &poisonFill_32b, sizeof(uint32_t), 0, copies_len, 0, NULL,
+                &wait_list[1]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        clReleaseEvent(copy_wait);
+        cl_err = clEnqueueMarkerWithWaitList(cmd_queue, 2, wait_list,
+                &copy_wait);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        clReleaseEvent(wait_list[1]);
+    }
+
+    // The kernel waits for every copy, the descriptors, the result
+    // initialization and, for canaries checked in place, the user's kernel.
+    uint32_t num_init_evts = num_copied + 3;
+    cl_event *init_evts = calloc(sizeof(cl_event), num_init_evts);
+    cl_event *mend_events = calloc(sizeof(cl_event), num_copied + 1);
+    for(uint32_t i = 0; i < num_copied; i++)
+    {
+        cl_memobj *m1 = find_cl_memobj(objs[i]);
+        size_t offset = (i > 0) ?
+            sizeof(uint32_t) * desc[DESC_LEN*(i-1) + DESC_END] : 0;
+        if(!m1->is_image)
+            copy_buffer_canaries(kern_ctx, cmd_queue, m1, canary_copies,
+                    offset, copy_wait, &init_evts[i]);
+        else
+            copy_image_canaries(cmd_queue, m1, canary_copies, offset,
+                    &copy_wait, &init_evts[i]);
+        mend_this_canary(kern_ctx, cmd_queue, m1->handle, init_evts[i],
+                &mend_events[i]);
+    }
+
+    cl_mem desc_buf = scratch_buffer(scratch,
+            sizeof(cl_ulong) * DESC_LEN*num_objs);
+    cl_err = clEnqueueWriteBuffer(cmd_queue, desc_buf, CL_NON_BLOCKING, 0,
+            sizeof(cl_ulong) * DESC_LEN*num_objs, desc, 0, NULL,
+            &init_evts[num_copied]);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    // The first and last change of each object.
+    cl_mem result = create_result_buffer(kern_ctx, cmd_queue, 2*num_objs,
+            scratch, &init_evts[num_copied + 1]);
+    init_evts[num_copied + 2] = copy_wait;
+
+    cl_event kern_end = perform_fused_checks(kern_ctx, cmd_queue, num_objs,
+            total_words, copied_words, desc_buf, canary_copies, result, num_init_evts,
+            init_evts, num_copied, mend_events);
+
+    for(uint32_t i = 0; i < num_init_evts; i++)
+        clReleaseEvent(init_evts[i]);
+    for(uint32_t i = 0; i < num_copied; i++)
+        clReleaseEvent(mend_events[i]);
+    free(init_evts);
+    free(mend_events);
+
+    cl_event read_result;
+    int *first_change = get_change_buffer(cmd_queue, 2*num_objs, result, 1,
+            &kern_end, &read_result);
+
+    if(ret_evt)
+        *ret_evt = read_result;
+
+    analyze_check_results(cmd_queue, read_result, kern_info, num_objs, objs,
+            scratch, (void**)desc, first_change, &first_change[num_objs],
+            dupe);
+
+    if(!ret_evt)
+        clReleaseEvent(read_result);
+    clReleaseEvent(kern_end);
+    free(objs);
+}
@@ -29,9 +29,24 @@
 #include "../gpu_check_utils.h"
 #include "copy_canary_cl_image.h"
 #include "copy_canary_cl_buffer.h"
+#include "copy_canary_fused.h"
 
 #include "gpu_check_copy_canary.h"
 
+/*
+ * whether the canaries of any cl_mem buffer can be checked where they are
+ */
+static int has_svm_backed(uint32_t num_cl_mem, void **buffer_ptrs)
+{
+    for(uint32_t i = 0; i < num_cl_mem; i++)
+    {
+        cl_memobj *m1 = cl_mem_find(get_cl_mem_alloc(), buffer_ptrs[i]);
+        if(m1 != NULL && m1->svm_backing != NULL)
+            return 1;
+    }
+    return 0;
+}
+
 void verify_on_gpu_copy_canary(cl_command_queue cmd_queue, uint32_t num_cl_mem,
         uint32_t num_svm, uint32_t num_images, void **buffer_ptrs,
         void **image_ptrs, int copy_svm_ptrs, kernel_info *kern_info,
@@ -55,6 +70,20 @@ void verify_on_gpu_copy_canary(cl_command_queue cmd_queue, uint32_t num_cl_mem,
     else
         input_evt = *evt;
 
+    // Launches that use images as well as buffers or SVM are checked with
+    // one kernel and one readback rather than one pipeline for each. So are
+    // buffers backed by SVM when canaries are read through pointers, as
+    // that kernel reads them in place rather than copying them out.
+    if ((num_images > 0 && num_cl_mem + num_svm > 0) ||
+            (copy_svm_ptrs && has_svm_backed(num_cl_mem, buffer_ptrs)))
+    {
+        verify_fused_copy(kern_ctx, cmd_queue, num_cl_mem, num_svm,
+                num_images, buffer_ptrs, image_ptrs, kern_info, dupe,
+                &input_evt, ret_evt);
+        output_kern_runtime();
+        return;
+    }
+
     verify_cl_buffer_copy(kern_ctx, cmd_queue, num_cl_mem, num_svm,
             buffer_ptrs, copy_svm_ptrs, kern_info, dupe, &input_evt,
             &(evt_list[num_events]));
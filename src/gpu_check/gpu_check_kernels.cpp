@@ -27,11 +27,18 @@
 #include "gpu_check_kernels.h"
 
 //canary length must be a multiple of 4 (to do check in 32 bit words) (word comparisons)
-//canary length must be a multiple of the local group size (usually larger than previous requirement) (work_group_scan)
+//each work-item checks CHECK_WORDS_PER_ITEM consecutive words, and only looks at them one by one
+//when a vector load shows that one of them is not poison
+//canary lengths may differ between buffers, so work-items past the end of the canaries return early
+//and each one that finds a corruption does its own atomic_min rather than a work group reduction,
+//since corrupted words are rare and every work-item would otherwise have to wait at a barrier
+//each check writes the first corrupted byte of every buffer, followed by INT_MAX minus the last
+//corrupted byte (rounded up to its word) of every buffer, so a single atomic_min finds both
 //
 //compareWithPoison - compare word with poison, then find first byte in word that differs
+//allPoison - whether a vector of words all match the canary value
 //findCorruption - parse through cl_mem and svm buffers, find words that do not match canaries
-const char *buffer_copy_canary_src =
+std::string buffer_copy_canary_src =
 "uint compareWithPoison(uint poison,\n\
                             uint localBuff,\n\
                             uint index,\n\
@@ -51,7 +58,22 @@ const char *buffer_copy_canary_src =
         }\n\
     }\n\
     return ret;\n\
-}\n\n\
+}\n\
+\n\
+int allPoison(uint poison, __global uint *B)\n\
+{\n\
+    return all(vload"+std::to_string(CHECK_WORDS_PER_ITEM)+"(0, B) == (uint"+std::to_string(CHECK_WORDS_PER_ITEM)+")poison);\n\
+}\n\
+\n\
+void reportCorruption(uint ret,\n\
+                            uint buffID,\n\
+                            uint numBuffs,\n\
+                            __global uint *first)\n\
+{\n\
+    atomic_min(&first[buffID], ret);\n\
+    atomic_min(&first[numBuffs + buffID], INT_MAX - (ret | 3));\n\
+}\n\
+\n\
 __kernel void findCorruption(uint canaryLen,\n\
                             uint buffEnd,\n\
                             uint svmEnd,\n\
@@ -62,30 +84,40 @@ __kernel void findCorruption(uint canaryLen,\n\
 #endif
 "                            __global uint *first)\n\
 {\n\
-    int tid = get_global_id(0);\n\
-    if(tid >= svmEnd) return;\n\
-    uint buffID = tid / canaryLen;\n\
-    uint localBuff = tid % canaryLen;\n\
-    int lid = get_local_id(0);\n\
-    uint ret = INT_MAX;\n\
-    if(tid < buffEnd)\n\
+    uint start = "+std::to_string(CHECK_WORDS_PER_ITEM)+" * get_global_id(0);\n\
+    if(start >= svmEnd) return;\n\
+    uint end = min(start + "+std::to_string(CHECK_WORDS_PER_ITEM)+", svmEnd);\n\
+    if(end == start + "+std::to_string(CHECK_WORDS_PER_ITEM)+")\n\
     {\n\
-        ret = compareWithPoison(poison, localBuff, tid, (__global uchar*)B);\n\
-    }\n"
+        if(end <= buffEnd)\n\
+        {\n\
+            if(allPoison(poison, B + start)) return;\n\
+        }\n"
 #ifdef CL_VERSION_2_0
-"    else\n\
-    {\n\
-        ret = compareWithPoison(poison, localBuff, tid - buffEnd, (__global uchar*)C);\n\
-    }\n\
-    uint wgRet = work_group_scan_inclusive_min(ret);\n\
-    if(lid == get_local_size(0)-1 || tid == svmEnd-1)\n\
+"        else if(start >= buffEnd)\n\
+        {\n\
+            if(allPoison(poison, C + (start - buffEnd))) return;\n\
+        }\n"
+#endif
+"    }\n\
+    for(uint tid = start; tid < end; tid++)\n\
     {\n\
-        atomic_min((global uint*)&first[buffID], (uint)wgRet);\n\
-    }\n"
-#else
-"    atomic_min((global unsigned int*)&first[buffID], ret);\n"
+        uint ret = INT_MAX;\n\
+        if(tid < buffEnd)\n\
+        {\n\
+            ret = compareWithPoison(poison, tid % canaryLen, tid, (__global uchar*)B);\n\
+        }\n"
+#ifdef CL_VERSION_2_0
+"        else\n\
+        {\n\
+            ret = compareWithPoison(poison, tid % canaryLen, tid - buffEnd, (__global uchar*)C);\n\
+        }\n"
 #endif
-"}\n\n\
+"        if(ret != INT_MAX)\n\
+            reportCorruption(ret, tid / canaryLen, svmEnd / canaryLen, first);\n\
+    }\n\
+}\n\
+\n\
 __kernel void findCorruptionNoSVM(uint canaryLen,\n\
                                 uint buffEnd,\n\
                                 uint svmEnd,\n\
@@ -93,30 +125,116 @@ __kernel void findCorruptionNoSVM(uint canaryLen,\n\
                                 __global uint *B,\n\
                                 __global uint *first)\n\
 {\n\
-    int tid = get_global_id(0);\n\
-    if(tid >= svmEnd) return;\n\
-    uint buffID = tid / canaryLen;\n\
-    uint localBuff = tid % canaryLen;\n\
-    int lid = get_local_id(0);\n\
+    uint start = "+std::to_string(CHECK_WORDS_PER_ITEM)+" * get_global_id(0);\n\
+    if(start >= buffEnd) return;\n\
+    uint end = min(start + "+std::to_string(CHECK_WORDS_PER_ITEM)+", buffEnd);\n\
+    if(end == start + "+std::to_string(CHECK_WORDS_PER_ITEM)+" && allPoison(poison, B + start)) return;\n\
+    for(uint tid = start; tid < end; tid++)\n\
+    {\n\
+        uint ret = compareWithPoison(poison, tid % canaryLen, tid, (__global uchar*)B);\n\
+        if(ret != INT_MAX)\n\
+            reportCorruption(ret, tid / canaryLen, svmEnd / canaryLen, first);\n\
+    }\n\
+}";
+
+const char * get_buffer_copy_canary_src(void)
+{
+    return buffer_copy_canary_src.c_str();
+}
+
+//every object being checked has a descriptor of four ulongs: the end of its canary words,
+//counted across all objects, then for SVM that is checked in place the number of words in its
+//front canary and pointers to its front and back canaries, which are zero for canaries that were
+//copied into B. Copied canaries come first, so their words in B are indexed by their position
+//among all canary words, and the first copiedWords of them can be checked as vectors.
+//
+//findCorruptionFused - check the canaries of cl_mem buffers, images and SVM in one dispatch
+std::string fused_copy_canary_src =
+"uint compareWithPoison(uint poison,\n\
+                            uint localBuff,\n\
+                            uint index,\n\
+                            __global uchar *B)\n\
+{\n\
     uint ret = INT_MAX;\n\
-    if(tid < buffEnd)\n\
+    if(poison != ((__global uint*)B)[index])\n\
     {\n\
-        ret = compareWithPoison(poison, localBuff, tid, (__global uchar*)B);\n\
-    }\n"
-#ifdef CL_VERSION_2_0
-"    uint wgRet = work_group_scan_inclusive_min(ret);\n\
-    if(lid == get_local_size(0)-1 || tid == svmEnd-1)\n\
+        uint i;\n\
+        for(i=0; i < 4; i++)\n\
+        {\n\
+            if((poison & 0xFF) != B[4*index+i])\n\
+            {\n\
+                ret = 4*localBuff + i;\n\
+                break;\n\
+            }\n\
+        }\n\
+    }\n\
+    return ret;\n\
+}\n\
+\n\
+int allPoison(uint poison, __global uint *B)\n\
+{\n\
+    return all(vload"+std::to_string(CHECK_WORDS_PER_ITEM)+"(0, B) == (uint"+std::to_string(CHECK_WORDS_PER_ITEM)+")poison);\n\
+}\n\
+\n\
+void reportCorruption(uint ret,\n\
+                            uint buffID,\n\
+                            uint numBuffs,\n\
+                            __global uint *first)\n\
+{\n\
+    atomic_min(&first[buffID], ret);\n\
+    atomic_min(&first[numBuffs + buffID], INT_MAX - (ret | 3));\n\
+}\n\
+\n\
+__kernel void findCorruptionFused(uint numObjs,\n\
+                            uint totalWords,\n\
+                            uint copiedWords,\n\
+                            uint poison,\n\
+                            __global ulong *desc,\n\
+                            __global uint *B,\n\
+                            __global uint *first)\n\
+{\n\
+    uint start = "+std::to_string(CHECK_WORDS_PER_ITEM)+" * get_global_id(0);\n\
+    if(start >= totalWords) return;\n\
+    uint end = min(start + "+std::to_string(CHECK_WORDS_PER_ITEM)+", totalWords);\n\
+    if(end == start + "+std::to_string(CHECK_WORDS_PER_ITEM)+" && end <= copiedWords && allPoison(poison, B + start)) return;\n\
+    uint lo = 0;\n\
+    uint hi = numObjs - 1;\n\
+    while(lo < hi)\n\
+    {\n\
+        uint mid = (lo + hi) / 2;\n\
+        if(start < desc[4*mid]) hi = mid;\n\
+        else lo = mid + 1;\n\
+    }\n\
+    for(uint tid = start; tid < end; tid++)\n\
     {\n\
-        atomic_min((global uint*)&first[buffID], (uint)wgRet);\n\
-    }\n"
-#else
-"    atomic_min((global uint*)&first[buffID], ret);\n"
+        while(tid >= desc[4*lo]) lo++;\n\
+        uint localBuff = tid - ((lo > 0) ? (uint)desc[4*(lo-1)] : 0);\n\
+        uint ret;\n"
+#ifdef CL_VERSION_2_0
+"        if(desc[4*lo+2] != 0)\n\
+        {\n\
+            uint frontWords = (uint)desc[4*lo+1];\n\
+            uint index = localBuff;\n\
+            __global uint *val_ptr = (__global uint*)desc[4*lo+2];\n\
+            if(index >= frontWords)\n\
+            {\n\
+                index -= frontWords;\n\
+                val_ptr = (__global uint*)desc[4*lo+3];\n\
+            }\n\
+            ret = compareWithPoison(poison, localBuff, index, (__global uchar*)val_ptr);\n\
+            if(ret != INT_MAX) val_ptr[index] = poison;\n\
+        }\n\
+        else\n"
 #endif
-"}";
+"            ret = compareWithPoison(poison, localBuff, tid, (__global uchar*)B);\n\
+        if(ret != INT_MAX)\n\
+            reportCorruption(ret, lo, numObjs, first);\n\
+    }\n\
+}";
 
-const char * get_buffer_copy_canary_src(void)
+const char * get_fused_copy_canary_src(void)
 {
-    return buffer_copy_canary_src;
+    return fused_copy_canary_src.c_str();
 }
 
 const char *image_copy_canary_src =
@@ -193,11 +311,11 @@ __kernel void locateDiffParts(uint length,\n\
                             uint poison,\n\
                             uint offset,\n\
                             __global uchar *B,\n\
-                            __global uint *first)\n\
+                            __global uint *first,\n\
+                            uint numChecks)\n\
 {\n\
     int tid = get_global_id(0);\n\
     if(tid >= length) return;\n\
-    int lid = get_local_id(0);\n\
     uint ret = INT_MAX;\n\
     __global uint *canary = (__global uint*)(B+offset);\n\
     int diff = offset % 4;\n\
@@ -208,17 +326,13 @@ __kernel void locateDiffParts(uint length,\n\
     else\n\
     {\n\
         ret = compareWithPoison(poison, tid, canary);\n\
-    }\n"
-#ifdef CL_VERSION_2_0
-"    uint wgRet = work_group_scan_inclusive_min(ret);\n\
-    if(lid == get_local_size(0)-1 || tid == length-1)\n\
+    }\n\
+    if(ret != INT_MAX)\n\
     {\n\
-        atomic_min(&first[buffID], wgRet);\n\
-    }\n"
-#else
-    "atomic_min(&first[buffID], ret);\n"
-#endif
-"}";
+        atomic_min(&first[buffID], ret);\n\
+        atomic_min(&first[numChecks + buffID], INT_MAX - (ret | 3));\n\
+    }\n\
+}";
 
 const char * get_single_buffer_src(void)
 {
@@ -246,41 +360,63 @@ std::string buffer_and_ptr_copy_src =
         ((__global uint*)B)[index] = poison;\n\
     }\n\
     return ret;\n\
-}\n\n\
+}\n\
+\n\
+int allPoison(uint poison, __global uint *B)\n\
+{\n\
+    return all(vload"+std::to_string(CHECK_WORDS_PER_ITEM)+"(0, B) == (uint"+std::to_string(CHECK_WORDS_PER_ITEM)+")poison);\n\
+}\n\
+\n\
+void reportCorruption(uint ret,\n\
+                            uint buffID,\n\
+                            uint numBuffs,\n\
+                            __global uint *first)\n\
+{\n\
+    atomic_min(&first[buffID], ret);\n\
+    atomic_min(&first[numBuffs + buffID], INT_MAX - (ret | 3));\n\
+}\n\
+\n\
 __kernel void locateDiffSVMPtr(uint length,\n\
                             uint endBuffs,\n\
                             uint endSVM,\n\
                             uint poison,\n\
                             __global uint *B,\n\
                             __global ulong *C,\n\
-                            __global uint *first)\n\
+                            __global uint *first,\n\
+                            __global uint *lens)\n\
 {\n\
-    int tid = get_global_id(0);\n\
-    if(tid >= endSVM) return;\n\
-    int lid = get_local_id(0);\n\
-    uint buffID = tid/(length);\n\
-    uint localBuff = tid % length;\n\
-    uint ret = INT_MAX;\n\
-    if(tid < endBuffs)\n\
+    uint start = "+std::to_string(CHECK_WORDS_PER_ITEM)+" * get_global_id(0);\n\
+    if(start >= endSVM) return;\n\
+    uint end = min(start + "+std::to_string(CHECK_WORDS_PER_ITEM)+", endSVM);\n\
+    if(end == start + "+std::to_string(CHECK_WORDS_PER_ITEM)+" && end <= endBuffs && allPoison(poison, B + start)) return;\n\
+    for(uint tid = start; tid < end; tid++)\n\
     {\n\
-        ret = compareWithPoison(poison, localBuff, tid, (__global uchar*)B);\n\
-    }\n"
+        uint localBuff = tid % length;\n\
+        uint ret = INT_MAX;\n\
+        if(tid < endBuffs)\n\
+        {\n\
+            ret = compareWithPoison(poison, localBuff, tid, (__global uchar*)B);\n\
+        }\n"
 #ifdef CL_VERSION_2_0
-"    else\n\
-    {\n\
-        uint index = tid % (length/"+std::to_string(POISON_REGIONS)+");\n\
-        __global uint *val_ptr = (__global uint*)C[(tid - endBuffs) / (length/"+std::to_string(POISON_REGIONS)+")];\n\
-        ret = compareWithPoison(poison, localBuff, index, (__global uchar*)val_ptr);\n\
-    }\n"
-    "uint wgRet = work_group_scan_inclusive_min(ret);\n\
-    if(lid == get_local_size(0)-1)\n\
-    {\n\
-        atomic_min((global uint*)&first[buffID], (uint)wgRet);\n\
-    }\n"
-#else
-    "atomic_min((__global uint*)&first[buffID], (uint)ret);\n"
+"        else\n\
+        {\n\
+            uint svmID = (tid - endBuffs) / length;\n\
+            uint index = localBuff;\n\
+            uint region = 0;\n\
+            while(region < "+std::to_string(POISON_REGIONS)+" && index >= lens["+std::to_string(POISON_REGIONS)+"*svmID + region])\n\
+            {\n\
+                index -= lens["+std::to_string(POISON_REGIONS)+"*svmID + region];\n\
+                region++;\n\
+            }\n\
+            if(region == "+std::to_string(POISON_REGIONS)+") continue;\n\
+            __global uint *val_ptr = (__global uint*)C["+std::to_string(POISON_REGIONS)+"*svmID + region];\n\
+            ret = compareWithPoison(poison, localBuff, index, (__global uchar*)val_ptr);\n\
+        }\n"
 #endif
-"}";
+"        if(ret != INT_MAX)\n\
+            reportCorruption(ret, tid / length, endSVM / length, first);\n\
+    }\n\
+}";
 
 const char * get_buffer_and_ptr_copy_src(void)
 {
@@ -48,6 +48,15 @@ const char * get_buffer_copy_canary_src(void);
  */
 const char * get_image_copy_canary_src(void);
 
+/*!
+ * Returns the OpenCL source code for the kernel that checks the canaries of
+ * cl_mem buffers, images and SVM regions of one launch together. cl_mem and
+ * image canaries are copied into one "all canary" buffer, SVM canaries are
+ * checked in place, and a table of descriptors tells the kernel where the
+ * canaries of each object are.
+ */
+const char * get_fused_copy_canary_src(void);
+
 /*!
  * Returns the OpenCL source code for kernels that check the canary values
  * from a single buffer. This allows the kernel to check and mend the canaries
@@ -33,6 +33,9 @@
 #include "check_utils.h"
 #include "universal_copy.h"
 #include "overflow_error.h"
+#include "deferred_check.h"
+#include "canary_policy.h"
+#include "checker_registry.h"
 
 #include "gpu_check_utils.h"
 
@@ -169,12 +172,16 @@ static void report_kernel_overflows(uint32_t num_buffs, int *first_change,
     uint32_t i;
     uint8_t found_an_overflow = 0;
     uint32_t *dupe = data->dupe;
+    int *last_change = data->last_change;
 
     for(i = 0; i < num_buffs; i++)
     {
         if(first_change[i] < INT_MAX)
         {
             overflowError(kern_info, argMap[i], first_change[i], data->backtrace_str);
+            if(last_change)
+                noteCanaryOverflow(argMap[i], first_change[i],
+                        INT_MAX - last_change[i]);
             found_an_overflow = 1;
         }
     }
@@ -204,23 +211,12 @@ static void verify_callback(cl_event event, cl_int status, void* verif_data)
     report_kernel_overflows(num_buffs, first_change, argMap, kern_info, data);
 
     clReleaseKernel(kern_info->handle);
+    if(kern_info->window)
+        check_window_release(kern_info->window);
+    else if(kern_info->snapshot)
+        kinfo_snapshot_release(kern_info);
 
-#ifdef CL_VERSION_2_0
-    void *used_svm = data->used_svm;
-    int used_svm_is_clmem = data->used_svm_is_clmem;
-    if(used_svm)
-    {
-        cl_command_queue cmd_queue = data->cmd_queue;
-        cl_context ctx;
-        cl_int cl_err = clGetCommandQueueInfo(cmd_queue, CL_QUEUE_CONTEXT,
-                sizeof(cl_context), &ctx, 0);
-        check_cl_error(__FILE__, __LINE__, cl_err);
-        if (used_svm_is_clmem)
-            releaseInternalMemObject(used_svm);
-        else
-            clSVMFree(ctx, used_svm);
-    }
-#endif
+    scratch_end(data->scratch);
 
     if (poison_pointers)
         free(poison_pointers);
@@ -234,14 +230,15 @@ static void verify_callback(cl_event event, cl_int status, void* verif_data)
 #endif //KERN_CALLBACK
 
 cl_mem create_result_buffer(cl_context kern_ctx,
-        cl_command_queue cmd_queue, uint32_t num_buffers, cl_event *ret_evt)
+        cl_command_queue cmd_queue, uint32_t num_buffers,
+        check_scratch *scratch, cl_event *ret_evt)
 {
     cl_int cl_err;
     cl_mem result;
-    // Create buffer to hold the results of the buffer overflow checks.
+    // Borrow a buffer to hold the results of the buffer overflow checks.
     // Fill it with INT_MAX to initialize it.
-    result = clCreateBuffer(kern_ctx, CL_MEM_READ_WRITE, sizeof(int)*num_buffers, 0, &cl_err);
-    check_cl_error(__FILE__, __LINE__, cl_err);
+    (void)kern_ctx;
+    result = scratch_buffer(scratch, sizeof(int)*num_buffers);
 #ifdef CL_VERSION_1_2
     int fill = INT_MAX;
     cl_err = clEnqueueFillBuffer(cmd_queue, result, &fill, sizeof(int), 0,
@@ -282,12 +279,18 @@ int * get_change_buffer(cl_command_queue cmd_queue, uint32_t num_buff,
 
 void analyze_check_results(cl_command_queue cmd_queue, cl_event readback_evt,
         kernel_info *kern_info, uint32_t num_buffers, void **buffer_ptrs,
-        void* used_svm, int used_svm_is_clmem, void **poison_ptrs,
-        int *first_change, uint32_t *dupe)
+        check_scratch *scratch, void **poison_ptrs,
+        int *first_change, int *last_change, uint32_t *dupe)
 {
 #ifdef KERN_CALLBACK
     // Make sure that the user does not clRelease this kernel and blow us up.
     clRetainKernel(kern_info->handle);
+    // A deferred check's kernel_info belongs to its window, and a
+    // background check's to its job.
+    if(kern_info->window)
+        check_window_retain(kern_info->window);
+    else if(kern_info->snapshot)
+        kinfo_snapshot_retain(kern_info);
 
     // Gather the information about all the buffers we're going to check
     void **arg_map;
@@ -300,11 +303,10 @@ void analyze_check_results(cl_command_queue cmd_queue, cl_event readback_evt,
     verif_info *data = calloc(sizeof(verif_info), 1);
     data->kern_info = kern_info;
     data->first_change = first_change;
+    data->last_change = last_change;
     data->argMap = arg_map;
     data->num_buffs = num_buffers;
-    data->cmd_queue = cmd_queue;
-    data->used_svm = used_svm;
-    data->used_svm_is_clmem = used_svm_is_clmem;
+    data->scratch = scratch;
     data->poison_pointers = poison_ptrs;
     data->parent = pthread_self();
 
@@ -316,14 +318,15 @@ void analyze_check_results(cl_command_queue cmd_queue, cl_event readback_evt,
     }
 
     // Deep copy dupe, because it can be freed before the callback happens.
-    uint32_t nargs;
-    cl_int cl_err = clGetKernelInfo(kern_info->handle, CL_KERNEL_NUM_ARGS,
-            sizeof(nargs), &nargs, 0);
-    check_cl_error(__FILE__, __LINE__, cl_err);
-    uint32_t *dupe_copy = malloc(nargs * sizeof(uint32_t));
-    for (uint32_t i = 0; i < nargs; i++)
-        dupe_copy[i] = dupe[i];
-    data->dupe = dupe_copy;
+    cl_int cl_err;
+    if(dupe != NULL)
+    {
+        uint32_t nargs = kern_info->num_args;
+        uint32_t *dupe_copy = malloc(nargs * sizeof(uint32_t));
+        for (uint32_t i = 0; i < nargs; i++)
+            dupe_copy[i] = dupe[i];
+        data->dupe = dupe_copy;
+    }
 
     // The checker kernel will run after we are finished reading back the
     // results of the check kernel.
@@ -350,6 +353,7 @@ void analyze_check_results(cl_command_queue cmd_queue, cl_event readback_evt,
     verif_info data;
     data.parent = pthread_self();
     data.dupe = dupe;
+    data.last_change = last_change;
     data.backtrace_str = NULL;
 
     if(get_print_backtrace_envvar())
@@ -360,19 +364,7 @@ void analyze_check_results(cl_command_queue cmd_queue, cl_event readback_evt,
     report_kernel_overflows(num_buffers, first_change, buffer_ptrs, kern_info,
             &data);
 
-#ifdef CL_VERSION_2_0
-    if(used_svm)
-    {
-        cl_context ctx;
-        cl_int cl_err = clGetCommandQueueInfo(cmd_queue, CL_QUEUE_CONTEXT,
-                sizeof(cl_context), &ctx, 0);
-        check_cl_error(__FILE__, __LINE__, cl_err);
-        if (used_svm_is_clmem)
-            releaseInternalMemObject(used_svm);
-        else
-            clSVMFree(ctx, used_svm);
-    }
-#endif
+    scratch_end(scratch);
 
     if (data.backtrace_str)
         free(data.backtrace_str);
@@ -424,105 +416,6 @@ void mend_this_canary(cl_context kern_ctx, cl_command_queue cmd_queue,
         *mend_event = create_complete_user_event(kern_ctx);
 }
 
-#ifdef DEBUG
-    uint32_t numBuilds = 0;
-#endif
-
-static void check_if_same_kernel(cl_kernel *kernel_ptr, cl_context context,
-    const char *name)
-{
-    cl_kernel kernel = *kernel_ptr;
-    if(kernel != NULL)
-    {
-        cl_context last_ctx;
-        clGetKernelInfo(kernel, CL_KERNEL_CONTEXT, sizeof(cl_context),
-                &last_ctx, 0);
-        if(last_ctx != context)
-        {
-            clReleaseKernel(kernel);
-            *kernel_ptr = NULL;
-        }
-        else
-        {
-            size_t size_ret;
-            char *kernelName = NULL;
-
-            cl_int cl_err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, 0,
-                    NULL, &size_ret);
-            check_cl_error(__FILE__, __LINE__, cl_err);
-            if (size_ret == 0)
-            {
-                det_fprintf(stderr, "Bad calloc size (%lu) at %s:%d\n",
-                        size_ret, __FILE__, __LINE__);
-                exit(-1);
-            }
-            kernelName = calloc(size_ret, sizeof(char));
-            if (kernelName == NULL)
-            {
-                det_fprintf(stderr, "Calloc failed at %s:%d (size: %lu)\n",
-                        __FILE__, __LINE__, size_ret);
-                exit(-1);
-            }
-            cl_err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME,
-                    size_ret, kernelName, NULL);
-            check_cl_error(__FILE__, __LINE__, cl_err);
-
-            if(strcmp(kernelName, name) != 0)
-            {
-                clReleaseKernel(kernel);
-                *kernel_ptr = NULL;
-            }
-            free(kernelName);
-        }
-    }
-}
-
-// Create a kernel using the provided context, kernel name, and source string.
-// If the kernel already exists for the given parameters, it is returned
-// without rebuilding. Otherwise, a new kernel is created.
-// Currently, only the last kernel built is cached.
-// Update the internals to a map if performance suffers from this
-static cl_kernel get_kernel_for_context(cl_kernel *kernel_ptr,
-        cl_context context, const char* name, const char* src)
-{
-    // If we aren't asking for the same kernel, this will release the kernel
-    // and set the kernel at kernel_ptr to NULL.
-    check_if_same_kernel(kernel_ptr, context, name);
-    cl_kernel kernel = *kernel_ptr;
-
-    if(kernel == NULL)
-    {
-#ifdef DEBUG
-        det_printf("building kernel %u\n", numBuilds++);
-#endif
-        const char *slist[2] = {src, 0};
-
-        cl_int cl_err;
-        cl_program prog = clCreateProgramWithSource(context, 1, slist, NULL,
-                &cl_err);
-        check_cl_error(__FILE__, __LINE__, cl_err);
-#ifdef CL_VERSION_2_0
-        cl_err = clBuildProgram(prog, 0, NULL, "-cl-std=CL2.0", NULL, NULL);
-#else
-        cl_err = clBuildProgram(prog, 0, NULL, "", NULL, NULL);
-#endif
-
-        if (cl_err == CL_BUILD_PROGRAM_FAILURE)
-            print_program_build_err(context, prog, cl_err);
-        check_cl_error(__FILE__, __LINE__, cl_err);
-
-        kernel = clCreateKernel(prog, name, &cl_err);
-        check_cl_error(__FILE__, __LINE__, cl_err);
-        clReleaseProgram(prog);
-    }
-    *kernel_ptr = kernel;
-    return kernel;
-}
-
-cl_kernel check_canary_kern = NULL;
-cl_kernel check_canary_kern_no_svm = NULL;
-cl_kernel check_img_canary_kern = NULL;
-
 // retrieve kernel based on pre-compiler directive
 cl_kernel get_canary_check_kernel(cl_context context)
 {
@@ -543,8 +436,7 @@ cl_kernel get_canary_check_kernel(cl_context context)
             source = get_buffer_copy_canary_src();
             break;
     }
-    return get_kernel_for_context(&check_canary_kern, context,
-            kernel_name, source);
+    return checker_kernel_get(context, kernel_name, source);
 }
 
 cl_kernel get_canary_check_kernel_no_svm(cl_context context)
@@ -562,14 +454,19 @@ cl_kernel get_canary_check_kernel_no_svm(cl_context context)
             source = get_buffer_copy_canary_src();
             break;
     }
-    return get_kernel_for_context(&check_canary_kern_no_svm, context,
-            kernel_name, source);
+    return checker_kernel_get(context, kernel_name, source);
 }
 
 cl_kernel get_canary_check_kernel_image(cl_context context)
 {
     const char *kernel_name = "findCorruption";
     const char *source = get_image_copy_canary_src();
-    return get_kernel_for_context(&check_img_canary_kern, context,
-                kernel_name, source);
+    return checker_kernel_get(context, kernel_name, source);
+}
+
+cl_kernel get_canary_check_kernel_fused(cl_context context)
+{
+    const char *kernel_name = "findCorruptionFused";
+    const char *source = get_fused_copy_canary_src();
+    return checker_kernel_get(context, kernel_name, source);
 }
@@ -33,6 +33,7 @@
 #include "detector_defines.h"
 #include "meta_data_lists/cl_kernel_lists.h"
 #include "meta_data_lists/cl_memory_lists.h"
+#include "checker_scratch.h"
 
 typedef struct verif_info_ verif_info;
 /*!
@@ -43,12 +44,11 @@ struct verif_info_
 {
     kernel_info *kern_info;
     int *first_change;
+    int *last_change;
     void **argMap;
     unsigned groups;
     unsigned num_buffs;
-    cl_command_queue cmd_queue;
-    void* used_svm;
-    int used_svm_is_clmem;
+    check_scratch *scratch;
     void **poison_pointers;
     pthread_t parent;
     uint32_t *dupe;
@@ -103,11 +103,14 @@ void copy_image_canaries(cl_command_queue cmdQueue, cl_memobj *img, cl_mem dst_b
  *      cmd_queue for buffer
  * \param num_buffers
  *      number for result entries in new buffer
+ * \param scratch
+ *      scratch memory of the check, the buffer is borrowed from it
  * \param ret_evt
  *      create completion event
  */
 cl_mem create_result_buffer(cl_context kern_ctx,
-        cl_command_queue cmd_queue, uint32_t num_buffers, cl_event *ret_evt);
+        cl_command_queue cmd_queue, uint32_t num_buffers,
+        check_scratch *scratch, cl_event *ret_evt);
 
 /*!
  * Read back the results buffer.
@@ -134,7 +137,7 @@ int * get_change_buffer(cl_command_queue cmd_queue, uint32_t num_buff,
  * to check the results of the detection.
  *
  * \param cmd_queue
- *      use this command queue to clean up svm
+ *      command queue the check ran on
  * \param readback_evt
  *      wait for this event to start check
  * \param kern_info
@@ -143,23 +146,22 @@ int * get_change_buffer(cl_command_queue cmd_queue, uint32_t num_buff,
  *      number of buffers checked
  * \param buffer_ptrs
  *      list of buffers checked
- * \param used_svm
- *      svm copy buffer for copy check
- *      cl_mem buffer of svm pointers for pointer check
- * \param used_svm_is_clmem
- *      0 for copy check
- *      1 for pointer check
+ * \param scratch
+ *      scratch memory of the check, given back once the results are read
  * \param poison_pointers
  *      pointers to canary regions
  * \param first_change
  *      index of first change in a canary region, -1 for none
+ * \param last_change
+ *      INT_MAX minus the index of the last change in each canary region,
+ *      stored in the same allocation as first_change. NULL if not known.
  * \param dupe
  *      duplicate argument list
  */
 void analyze_check_results(cl_command_queue cmd_queue, cl_event readback_evt,
         kernel_info *kern_info, uint32_t num_buffers, void **buffer_ptrs,
-        void * used_svm, int used_svm_is_clmem, void ** poison_pointers,
-        int *first_change, uint32_t *dupe);
+        check_scratch *scratch, void ** poison_pointers,
+        int *first_change, int *last_change, uint32_t *dupe);
 
 /*!
  * Fill cl_mem/svm/image canary region with canary value
@@ -190,6 +192,8 @@ void output_kern_runtime(void);
 /*!
  * Return the canary check kernels for a given context. If the kernel does not
  * yet exist for this context, it is created, compiled, etc.
+ * Each host thread gets its own kernel, so its arguments can be set without
+ * locking. This holds for all of the kernels below.
  * Which kernel you get is based on environment settings and
  * the number of buffers to check.
  */
@@ -202,6 +206,13 @@ cl_kernel get_canary_check_kernel(cl_context context);
  */
 cl_kernel get_canary_check_kernel_no_svm(cl_context context);
 
+/*!
+ * Return the kernel that checks cl_mem buffers, images and SVM in one
+ * dispatch for a given context. If the kernel does not yet exist for this
+ * context, it is created, compiled etc.
+ */
+cl_kernel get_canary_check_kernel_fused(cl_context context);
+
 /*!
  * Return the image canary check kernel for a given context. If the kernel does
  * not yet exist for this context, it is created, compiled etc.
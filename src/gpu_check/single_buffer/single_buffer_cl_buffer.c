@@ -34,11 +34,11 @@
 static void perform_cl_buffer_checks(cl_command_queue cmd_queue,
         cl_kernel check_kern, cl_event init_evt, cl_event real_kern_evt,
         cl_mem * result, uint32_t num_buffers, void **buffer_ptrs,
-        int is_svm, cl_event *check_events)
+        int is_svm, uint32_t *fronts, cl_event *check_events)
 {
     // Set up kernel invocation constants
     cl_int cl_err;
-    size_t global_work[3] = {poisonWordLen, 1, 1};
+    size_t global_work[3] = {1, 1, 1};
     size_t local_work[3] = {256, 1, 1};
     size_t max_work_items[3] = {1, 1, 1};
     cl_event kern_wait[2] = {init_evt, real_kern_evt};
@@ -56,15 +56,18 @@ static void perform_cl_buffer_checks(cl_command_queue cmd_queue,
             1, NULL, global_work, local_work, 2, kern_wait, NULL);
 
     // Set up constant cl_mem checker kernel arguments
-    cl_set_arg_and_check(check_kern, 0, sizeof(unsigned), &poisonWordLen);
     cl_set_arg_and_check(check_kern, 2, sizeof(unsigned), &poisonFill_32b);
     cl_set_arg_and_check(check_kern, 5, sizeof(void*), result);
+    // The last changes are stored after the first changes of every region.
+    uint32_t num_checks = POISON_REGIONS*num_buffers;
+    cl_set_arg_and_check(check_kern, 6, sizeof(unsigned), &num_checks);
 
     // We check each buffer independently
     for(uint32_t i = 0; i < num_buffers; i++)
     {
         void *mem_handle = NULL;
-        uint32_t mem_size = 0;
+        size_t mem_size = 0;
+        canary_geometry geom = {0, 0};
         if (is_svm)
         {
 #ifdef CL_VERSION_2_0
@@ -77,6 +80,7 @@ static void perform_cl_buffer_checks(cl_command_queue cmd_queue,
             }
             mem_handle = m1->main_buff;
             mem_size = m1->size;
+            geom = m1->canary;
 #endif
         }
         else
@@ -89,23 +93,34 @@ static void perform_cl_buffer_checks(cl_command_queue cmd_queue,
             }
             mem_handle = (void*)(m1->main_buff);
             mem_size = m1->size;
+            geom = m1->canary;
         }
+        fronts[i] = geom.front;
 
         for(uint32_t n = 0; n < POISON_REGIONS; n++)
         {
-            uint32_t offset;
+            uint32_t offset, length;
             uint32_t index = POISON_REGIONS*i + n;
-#ifdef UNDERFLOW_CHECK
-            if(n == 0)
-                offset = 0;
+            if(n == POISON_REGIONS - 1)
+            {
+                offset = geom.front + mem_size;
+                length = geom.back / sizeof(unsigned);
+            }
             else
             {
-                offset = mem_size + POISON_FILL_LENGTH;
+                offset = 0;
+                length = geom.front / sizeof(unsigned);
             }
-#else
-            offset = mem_size;
-#endif
 
+            // Buffers without an underflow canary have nothing to check here.
+            if(length == 0)
+            {
+                check_events[index] = create_complete_user_event(kern_ctx);
+                continue;
+            }
+
+            global_work[0] = ((length + local_work[0] - 1) / local_work[0]) * local_work[0];
+            cl_set_arg_and_check(check_kern, 0, sizeof(unsigned), &length);
             cl_set_arg_and_check(check_kern, 1, sizeof(unsigned), &index);
             cl_set_arg_and_check(check_kern, 3, sizeof(unsigned), &offset);
             if (is_svm)
@@ -147,6 +162,7 @@ static void perform_cl_buffer_checks(cl_command_queue cmd_queue,
 typedef struct clbk_cmpct_data_
 {
     int *first_change;
+    uint32_t *fronts;
     uint32_t num_buff;
     cl_event complete;
 }clbk_cmpct_data;
@@ -157,6 +173,7 @@ static void format_result_buff(cl_event event, cl_int status, void* verif_data)
     if(event || status){}
     clbk_cmpct_data *data = (clbk_cmpct_data*)verif_data;
     int *first_change = data->first_change;
+    uint32_t *fronts = data->fronts;
     uint32_t num_buff = data->num_buff;
 
     for(uint32_t i=0; i < num_buff; i++)
@@ -166,14 +183,28 @@ static void format_result_buff(cl_event event, cl_int status, void* verif_data)
         half2 = first_change[POISON_REGIONS*i + 1];
 
         if(half2 < INT_MAX)
-            half2 += POISON_FILL_LENGTH;
+            half2 += fronts[i];
 
         first_change[i] = (half1 < half2) ? half1 : half2;
     }
 
+    // The last change is in the back canary if it has one.
+    int *last_change = &first_change[POISON_REGIONS*num_buff];
+    for(uint32_t i=0; i < num_buff; i++)
+    {
+        int last = last_change[POISON_REGIONS*i + 1];
+        if(last < INT_MAX)
+            last -= fronts[i];
+        else
+            last = last_change[POISON_REGIONS*i];
+
+        first_change[num_buff + i] = last;
+    }
+
     cl_err = clSetUserEventStatus(data->complete, CL_COMPLETE);
     check_cl_error(__FILE__, __LINE__, cl_err);
 
+    free(fronts);
     free(data);
 }
 
@@ -192,18 +223,21 @@ void verify_cl_buffer_single(cl_context kern_ctx, cl_command_queue cmd_queue,
     cl_event init_evt;
 
     cl_kernel check_kern = get_canary_check_kernel(kern_ctx);
-    cl_mem result = create_result_buffer(kern_ctx, cmd_queue, POISON_REGIONS*num_buff,
-            &init_evt);
+    // The first and last change of each region.
+    check_scratch *scratch = scratch_begin(kern_ctx);
+    cl_mem result = create_result_buffer(kern_ctx, cmd_queue, 2*POISON_REGIONS*num_buff,
+            scratch, &init_evt);
     cl_event *check_events = calloc(sizeof(cl_event), POISON_REGIONS*num_buff);
+    uint32_t *fronts = calloc(sizeof(uint32_t), num_buff);
 
     // This will walk through all of the cl_mem buffers and launch a GPU kernel
     // to check whether their canaries have been corrupted.
     perform_cl_buffer_checks(cmd_queue, check_kern, init_evt, *evt, &result,
-            num_buff, buffer_ptrs, is_svm, check_events);
+            num_buff, buffer_ptrs, is_svm, fronts, check_events);
 
     // Read back the results from all of the checks into 'first_change'.
     cl_event readback_evt;
-    int *first_change = get_change_buffer(cmd_queue, POISON_REGIONS*num_buff, result,
+    int *first_change = get_change_buffer(cmd_queue, 2*POISON_REGIONS*num_buff, result,
             POISON_REGIONS*num_buff, check_events, &readback_evt);
     if(ret_evt != NULL)
         *ret_evt = readback_evt;
@@ -217,6 +251,7 @@ void verify_cl_buffer_single(cl_context kern_ctx, cl_command_queue cmd_queue,
 
     clbk_cmpct_data *verif_data = malloc(sizeof(clbk_cmpct_data));
     verif_data->first_change = first_change;
+    verif_data->fronts = fronts;
     verif_data->num_buff = num_buff;
     verif_data->complete = user_evt;
 
@@ -236,6 +271,7 @@ void verify_cl_buffer_single(cl_context kern_ctx, cl_command_queue cmd_queue,
 
 #else
     (void)format_result_buff;
+    free(fronts);
     user_evt = readback_evt;
 #endif
 
@@ -243,13 +279,12 @@ void verify_cl_buffer_single(cl_context kern_ctx, cl_command_queue cmd_queue,
     //when feeding a user event to clSetEventCallback
     // Finally, check the results of the memory checks above.
     analyze_check_results(cmd_queue, user_evt, kern_info, num_buff,
-            buffer_ptrs, NULL, 0, NULL, first_change, dupe);
+            buffer_ptrs, scratch, NULL, first_change,
+            &first_change[num_buff], dupe);
 
-    // Release the memory objects and events that are used by the read.
+    // Release the events that are used by the read.
     // Because they're queued, this is OK. The release won't destroy them until
     // they are no longer needed.
-    cl_err = clReleaseMemObject(result);
-    check_cl_error(__FILE__, __LINE__, cl_err);
     for (uint32_t i = 0; i < num_buff; i++)
     {
         cl_err = clReleaseEvent(check_events[i]);
@@ -160,8 +160,9 @@ void verify_cl_images_single(cl_context kern_ctx, cl_command_queue cmd_queue,
     }
 
     cl_event init_evt;
+    check_scratch *scratch = scratch_begin(kern_ctx);
     cl_mem result = create_result_buffer(kern_ctx, cmd_queue, num_images,
-            &init_evt);
+            scratch, &init_evt);
     cl_event *check_events = malloc(sizeof(cl_event) * num_images);
 
     // This will walk through all of the cl_mem buffers and launch a GPU kernel
@@ -177,10 +178,9 @@ void verify_cl_images_single(cl_context kern_ctx, cl_command_queue cmd_queue,
     if(ret_evt != NULL)
         *ret_evt = readback_evt;
 
-    // Release the memory objects and events that are used by the read.
+    // Release the events that are used by the read.
     // Because they're queued, this is OK. The release won't destroy them until
     // they are no longer needed.
-    clReleaseMemObject(result);
     free(canary_lengths);
     for (uint32_t i = 0; i < num_images; i++)
     {
@@ -191,5 +191,5 @@ void verify_cl_images_single(cl_context kern_ctx, cl_command_queue cmd_queue,
 
     // Finally, check the results of the memory checks above.
     analyze_check_results(cmd_queue, readback_evt, kern_info, num_images,
-            image_ptrs, NULL, 0, NULL, first_change, dupe);
+            image_ptrs, scratch, NULL, first_change, NULL, dupe);
 }
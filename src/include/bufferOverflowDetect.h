@@ -44,7 +44,7 @@
  * \param nargs
  *      number of arguments to the kernel
  * \param args
- *      list to information about kernel arguments
+ *      table of information about kernel arguments, indexed by arg index
  * \param dupe_p
  *      Output
  *      pointer to duplicate list to be created
@@ -54,6 +54,20 @@
  */
 void findDuplicates(uint32_t nargs, kernel_arg *args, uint32_t **dupe_p);
 
+/*!
+ * Get the launch plan for a kernel, rebuilding it from the kernel's argument
+ * list if this is the first launch or if an argument has changed since the
+ * plan was last built. The plan is owned by the kernel_info and stays valid
+ * until the next launch after an argument changes. Like the OpenCL runtime,
+ * this expects the application not to set a kernel's arguments while another
+ * thread is enqueueing it.
+ *
+ * \param kinfo
+ *      internal record of the kernel being launched
+ * \return launch plan for the kernel's current arguments
+ */
+kernel_launch_plan* getKernelLaunchPlan(kernel_info *kinfo);
+
 /*!
  * uses one of the overflow detection methods to verify the integrity of the canary regions
  * by default chooses between checking on cpu vs gpu, by number of active buffers
@@ -61,29 +75,47 @@ void findDuplicates(uint32_t nargs, kernel_arg *args, uint32_t **dupe_p);
  * \param cmdQueue
  *      cl_command_queue on which to perform the verification
  * \param kern
- *      cl_kernel to verify
- * \param dupe
- *      list of duplicate kernel arguments
+ *      cl_kernel to verify, its launch plan provides the buffers to check
+ * \param evt
+ *      leading event, synchronization point for start of check
+ * \param retEvt
+ *      end event, synchronization point for end of check
+ */
+void verifyBufferInBounds(cl_command_queue cmdQueue, cl_kernel kern, const cl_event *evt, cl_event *retEvt);
+
+/*!
+ * same as verifyBufferInBounds, but checks the buffers of a given launch plan
+ * instead of the kernel's current one, e.g. a copy taken when it was launched
+ *
+ * \param cmdQueue
+ *      cl_command_queue on which to perform the verification
+ * \param kernInfo
+ *      internal record of the kernel that was launched, used for reporting
+ * \param plan
+ *      launch plan that provides the buffers to check
  * \param evt
  *      leading event, synchronization point for start of check
  * \param retEvt
  *      end event, synchronization point for end of check
  */
-void verifyBufferInBounds(cl_command_queue cmdQueue, cl_kernel kern, uint32_t *dupe, const cl_event *evt, cl_event *retEvt);
+void verifyPlanInBounds(cl_command_queue cmdQueue, kernel_info *kernInfo,
+        const kernel_launch_plan *plan, const cl_event *evt, cl_event *retEvt);
 
 /*!
- * deletes the kernel and any arguments created by the overflow detector
+ * gives a cloned kernel back to the pool of cloned kernels, once the launch
+ * that used it has completed
  *
  * \param del_kern
  *      cl_kernel deletion target
- * \param dupe
- *      list of duplicate kernel arguments
+ * \param evt
+ *      event of the launch of del_kern
  */
-void delPoisonKernel(cl_kernel del_kern, uint32_t *dupe);
+void delPoisonKernel(cl_kernel del_kern, cl_event evt);
 
 /*!
  * create a copy kernel
- * arguments uninitialized
+ * uses clCloneKernel if the platform supports OpenCL 2.1, in which case the
+ * arguments are copied from kernel, otherwise arguments are uninitialized
  *
  * \param kernel
  *      kernel to copy
@@ -93,34 +125,95 @@ cl_kernel kernelDuplicate(cl_kernel kernel);
 
 /*!
  * If there are buffers that still need to be expanded with canaries,
- *  this function will create a new kernel with the updated arguments
+ *  this function will create a new kernel with the updated arguments.
+ *  Clones are reused through the kernel pool.
  * If all buffers have canaries, returns the argument kernel
+ * Any copies needed to bring the arguments up to date are enqueued without
+ *  waiting for them, the kernel launch must wait on launch_events instead.
  *
  * \param command_queue
  *      create the new kernel on this queue
  * \param kernel
  *      use this kernel to create the new kernel
- * \param dupe
- *      list of duplicate kernel arguments
+ * \param plan
+ *      launch plan of kernel
+ * \param num_launch_events
+ *      Input/Output
+ *      number of events in launch_events
+ * \param launch_events
+ *      Input/Output
+ *      on input, the events the kernel launch waits on. The canary fills
+ *      of the arguments and the events of any copies enqueued here are
+ *      appended, so this must have room for 4 * plan->nargs more events.
  * \return kernel with poisoned buffers
  */
 cl_kernel createPoisonedKernel(cl_command_queue command_queue,
         cl_kernel kernel,
-        uint32_t *dupe);
+        const kernel_launch_plan *plan,
+        cl_uint *num_launch_events,
+        cl_event *launch_events);
 
 /*!
- * copies buffer arguments across kernels
- *
- * \param to
- *      copy buffers to this kernel
- * \param from
- *      copy buffers from this kernel
- * \param dupe
- *      list of duplicate kernel arguments
+ * record the buffers written by a kernel launch, so that their mirrors
+ * are copied back to the user's objects when those are next accessed
+ *
+ * \param kernel
+ *      the user's kernel that was launched
+ * \param plan
+ *      launch plan of kernel
  * \param command_queue
- *      copy using this cl_command_queue
+ *      queue the kernel was launched on
+ * \param evt
+ *      event of the kernel launch
+ */
+void commitKernelMirrors(cl_kernel kernel, const kernel_launch_plan *plan,
+        cl_command_queue command_queue, const cl_event *evt);
+
+/*!
+ * Call this before an API call touches the contents of a cl_mem object.
+ * If a mirror of the object (or of a buffer sharing its storage) holds data
+ * written by a kernel, it is copied back first. Commands enqueued on
+ * command_queue from then on also wait for the object's canary fills.
+ *
+ * \param command_queue
+ *      queue of the API call
+ * \param memobj
+ *      cl_mem about to be read or written
+ * \param num_events
+ *      number of events in event_list
+ * \param event_list
+ *      events the API call waits on
+ */
+void syncMirrorBeforeAccess(cl_command_queue command_queue, cl_mem memobj,
+        cl_uint num_events, const cl_event *event_list);
+
+/*!
+ * Get the event that completes once the canaries of a new padded buffer
+ * are filled, or NULL if they already are.
+ *
+ * \param m
+ *      buffer, or sub-buffer of one, about to be used
+ * \return retained event, which the caller releases
+ */
+cl_event getBufferInitEvent(cl_memobj *m);
+
+/*!
+ * Call this after an API call writes the contents of a cl_mem object.
+ * Mirrors of the object and of buffers sharing its storage are refreshed
+ * before their next use by a kernel.
+ *
+ * \param memobj
+ *      cl_mem that was written
+ */
+void invalidateMirrors(cl_mem memobj);
+
+/*!
+ * Copy back any unsaved data and release the mirror of an object that is
+ * about to be destroyed.
+ *
+ * \param m
+ *      object being destroyed
  */
-void copyKernelBuffers(cl_kernel to, cl_kernel from,
-        uint32_t * dupe, cl_command_queue command_queue);
+void releaseMirror(cl_memobj *m);
 
 #endif //__BUFFER_OVERFLOW_DETECT_H
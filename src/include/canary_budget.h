@@ -0,0 +1,119 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+
+/*! \file canary_budget.h
+ * Keeps canaries from pushing an application out of device memory.
+ * Canary bytes are counted against 1/CANARY_BUDGET_FRACTION of the global
+ * memory of the smallest device in a context, and allocations that fail
+ * for lack of memory, but fit without canaries, are retried with less
+ * canary. New allocations are degraded one step each time the canaries make
+ * an allocation fail, and further the more the canaries are over budget:
+ * first their canaries are shortened to BUDGET_SHORT_CANARY bytes, then they
+ * only get a back canary, and last of all images are made without canaries
+ * and are no longer checked. Steps
+ * are never undone, and each one is logged.
+ */
+
+#ifndef __CANARY_BUDGET_H
+#define __CANARY_BUDGET_H
+
+#include <stddef.h>
+#include <CL/cl.h>
+
+#include "detector_defines.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Cut a new allocation's canaries down to what the budget allows. The
+ * canaries are also shortened if the padded allocation would be larger
+ * than the devices can allocate at once.
+ *
+ * \param context
+ *      context the allocation is made in
+ * \param size
+ *      bytes of data the application asked for
+ * \param geom
+ *      canary lengths the policy chose, shortened in place
+ */
+void budgetCanaryGeometry(cl_context context, size_t size,
+        canary_geometry *geom);
+
+/*!
+ * Whether new images should be made without canaries.
+ *
+ * \return
+ *      1 if images are no longer padded
+ *      else 0
+ */
+int budgetDropsImageCanaries(void);
+
+/*!
+ * Whether a failed padded allocation could be made again with less canary.
+ * Callers first make the allocation without any canary, and only call
+ * budgetAllocFailed() if that works. An allocation that also fails without
+ * canaries is failed for the application, and degrades nothing.
+ *
+ * \param err
+ *      error the allocation failed with
+ * \return
+ *      1 if the failure was for lack of memory and new allocations can still
+ *      be degraded
+ *      else 0
+ */
+int budgetMayDegrade(cl_int err);
+
+/*!
+ * Degrade new allocations one step after a padded allocation failed where
+ * the same allocation without canaries fits. The allocation should then be
+ * made again, with canaries from budgetCanaryGeometry() or, for images,
+ * budgetDropsImageCanaries().
+ */
+void budgetAllocFailed(void);
+
+/*!
+ * Count the canaries of a new allocation against the budget.
+ *
+ * \param context
+ *      context the allocation was made in
+ * \param bytes
+ *      bytes of canary in the allocation
+ */
+void budgetAddCanaries(cl_context context, size_t bytes);
+
+/*!
+ * Give back the canaries of a released allocation.
+ *
+ * \param bytes
+ *      bytes of canary in the allocation
+ */
+void budgetRemoveCanaries(size_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__CANARY_BUDGET_H
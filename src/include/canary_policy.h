@@ -0,0 +1,118 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+
+/*! \file canary_policy.h
+ * Chooses how much canary surrounds each buffer and SVM allocation.
+ * By default every allocation gets POISON_FILL_LENGTH bytes on each side.
+ * CLARMOR_CANARY_POLICY can give allocations up to a size their own canary
+ * lengths, e.g. "4096:0:256" for 256 bytes after, and none before, every
+ * allocation of at most 4 KB. Several classes are separated by commas.
+ *
+ * With CLARMOR_SITE_FEEDBACK, allocations without a class start with
+ * SITE_MIN_CANARY bytes instead. Each allocation remembers the call site
+ * that made it, and when an overflow runs into the far end of a canary the
+ * site's later allocations get twice as much, up to SITE_MAX_CANARY.
+ *
+ * Whatever the policy chooses is then cut down to fit the canary budget,
+ * see canary_budget.h.
+ */
+
+#ifndef __CANARY_POLICY_H
+#define __CANARY_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <CL/cl.h>
+
+#include "detector_defines.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Canaries for a new cl_mem buffer. The front canary is rounded up so that
+ * the data starts on a sub-buffer origin every device in the context allows.
+ *
+ * \param context
+ *      context the buffer is created in
+ * \param size
+ *      bytes of data the application asked for
+ * \param site
+ *      return address of the application's call, 0 if unknown
+ * \param geom
+ *      return canary lengths
+ */
+void getCanaryGeometry(cl_context context, size_t size, uintptr_t site,
+        canary_geometry *geom);
+
+#ifdef CL_VERSION_2_0
+/*!
+ * Canaries for a new SVM allocation. The front canary is rounded up so that
+ * the pointer returned to the application keeps the requested alignment.
+ *
+ * \param context
+ *      context the allocation is made in
+ * \param size
+ *      bytes of data the application asked for
+ * \param alignment
+ *      alignment passed to clSVMAlloc, 0 for the default
+ * \param site
+ *      return address of the application's call, 0 if unknown
+ * \param geom
+ *      return canary lengths
+ */
+void getSVMCanaryGeometry(cl_context context, size_t size,
+        unsigned int alignment, uintptr_t site, canary_geometry *geom);
+#endif
+
+/*!
+ * Alignment that sub-buffer origins need on every device in a context.
+ *
+ * \param context
+ *      context the sub-buffers are created in
+ * \return
+ *      largest CL_DEVICE_MEM_BASE_ADDR_ALIGN of the devices, in bytes
+ */
+size_t getSubBufferAlignment(cl_context context);
+
+/*!
+ * Tell the allocation site of a buffer or SVM region how far an overflow
+ * of it went, so later allocations there can get longer canaries.
+ *
+ * \param buffer
+ *      cl_mem or SVM pointer that overflowed
+ * \param first_byte
+ *      first corrupted byte, counted from the start of the front canary as
+ *      in overflow reports
+ * \param last_byte
+ *      last corrupted byte, counted the same way
+ */
+void noteCanaryOverflow(void *buffer, uint32_t first_byte, uint32_t last_byte);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__CANARY_POLICY_H
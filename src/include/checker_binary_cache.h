@@ -0,0 +1,76 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+/*! \file checker_binary_cache.h
+ * Compiled checker programs saved in the CLARMOR_CHECKER_CACHE directory,
+ * so that later runs skip building the checkers from source. There is one
+ * file per device, keyed by the device name, its driver version, the build
+ * options and a hash of the checker source.
+ */
+
+#ifndef __CHECKER_BINARY_CACHE_H
+#define __CHECKER_BINARY_CACHE_H
+
+#include <CL/cl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Create and build a checker program from the cached binaries of every
+ * device in a context.
+ *
+ * \param context
+ *      context the program is for
+ * \param src
+ *      checker source the binaries were built from
+ * \param options
+ *      build options the binaries were built with
+ * \return
+ *      built program
+ *      NULL if there is no cache, or any device's entry is missing, stale
+ *      or corrupt. The program must then be built from source.
+ */
+cl_program checker_cache_load(cl_context context, const char *src,
+        const char *options);
+
+/*!
+ * Save the binaries of a checker program built from source. Nothing is
+ * saved if there is no cache, and failures to write it are ignored.
+ *
+ * \param prog
+ *      built program
+ * \param src
+ *      checker source prog was built from
+ * \param options
+ *      build options prog was built with
+ */
+void checker_cache_store(cl_program prog, const char *src,
+        const char *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__CHECKER_BINARY_CACHE_H
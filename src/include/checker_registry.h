@@ -0,0 +1,71 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+/*! \file checker_registry.h
+ * Built checker kernels, kept for every context they were built in. Each
+ * checker source is built once per context, and every host thread is given
+ * its own kernel object from that program, so threads that check at the
+ * same time never overwrite each other's arguments. A thread's kernels are
+ * released when it exits.
+ */
+
+#ifndef __CHECKER_REGISTRY_H
+#define __CHECKER_REGISTRY_H
+
+#include <CL/cl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Get a checker kernel that only the calling thread uses. The program is
+ * built from src the first time any thread asks for it in a context.
+ *
+ * \param context
+ *      context the check runs in
+ * \param name
+ *      kernel function name
+ * \param src
+ *      kernel source. Sources are told apart by address, so it must stay
+ *      valid and unchanged for as long as the process runs.
+ * \return
+ *      kernel owned by the registry, do not release it
+ */
+cl_kernel checker_kernel_get(cl_context context, const char *name,
+        const char *src);
+
+/*!
+ * Release every checker program and kernel of a context. Later checks in
+ * the context build them again.
+ *
+ * \param context
+ *      context the application is releasing
+ */
+void checker_registry_release_context(cl_context context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__CHECKER_REGISTRY_H
@@ -0,0 +1,105 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+/*! \file checker_scratch.h
+ * Device scratch memory for GPU canary checks. Each context keeps a ring of
+ * preallocated buffers that checks borrow their canary copies, pointer
+ * tables and result buffers from, and give back once the check's results
+ * have been read. Busy buffers are skipped, so many checks can be in flight,
+ * and the ring grows when none of the free buffers is big enough.
+ */
+
+#ifndef __CHECKER_SCRATCH_H
+#define __CHECKER_SCRATCH_H
+
+#include <stddef.h>
+#include <CL/cl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Scratch memory borrowed by one check.
+ */
+typedef struct check_scratch_ check_scratch;
+
+/*!
+ * Start borrowing scratch memory for a check.
+ *
+ * \param context
+ *      context the check runs in
+ * \return
+ *      scratch set to pass to the functions below
+ */
+check_scratch* scratch_begin(cl_context context);
+
+/*!
+ * Borrow a cl_mem buffer. Its contents are undefined.
+ *
+ * \param scratch
+ *      scratch set of the check
+ * \param size
+ *      bytes needed, the buffer may be larger
+ * \return
+ *      buffer that belongs to the check until scratch_end()
+ */
+cl_mem scratch_buffer(check_scratch *scratch, size_t size);
+
+#ifdef CL_VERSION_2_0
+/*!
+ * Borrow a coarse-grained SVM region. Its contents are undefined.
+ *
+ * \param scratch
+ *      scratch set of the check
+ * \param size
+ *      bytes needed, the region may be larger
+ * \return
+ *      SVM pointer that belongs to the check until scratch_end()
+ */
+void* scratch_svm(check_scratch *scratch, size_t size);
+#endif
+
+/*!
+ * Give back everything a check borrowed. Only call this once no command
+ * that uses the scratch memory can still run.
+ *
+ * \param scratch
+ *      scratch set of the check, freed
+ */
+void scratch_end(check_scratch *scratch);
+
+/*!
+ * Free the idle scratch memory of a context, e.g. when it is released. The
+ * scratch memory of checks still in flight is freed when they end.
+ *
+ * \param context
+ *      context whose scratch memory is freed
+ */
+void scratch_release_context(cl_context context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__CHECKER_SCRATCH_H
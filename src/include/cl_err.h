@@ -33,6 +33,10 @@
 #define CL_USE_DEPRECATED_OPENCL_2_0_APIS
 #include <CL/cl.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*!
  * This function takes an OpenCL error value, from a cl_int, and translates
  * it into the string that describes the error.
@@ -74,4 +78,8 @@ void check_cl_error(const char * const file_name, const int line_num,
 void print_program_build_err(cl_context context, cl_program prog,
         cl_int cl_err);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // _CL_ERR_H_
@@ -85,6 +85,25 @@ cl_int runNDRangeKernel(launchOclKernelStruct *ocl_args);
  */
 void *internalSVMAlloc(cl_context context, cl_svm_mem_flags flags,
         size_t size, unsigned int alignment);
+
+/*!
+ * clSVMAlloc() fills the canaries of coarse-grained SVM without waiting.
+ * Commands that use or check an allocation must wait on its fills, which
+ * are found here. Fills that have finished are forgotten.
+ *
+ * \param num_ptrs
+ *      number of SVM pointers
+ * \param svm_ptrs
+ *      pointers into the allocations, NULL for every live allocation
+ * \param num_events
+ *      returns the number of events
+ * \return
+ *      malloc'd array of the fills that may still be running, each retained
+ *      for the caller
+ *      NULL if there are none
+ */
+cl_event *getSVMInitEvents(cl_uint num_ptrs, void * const *svm_ptrs,
+        cl_uint *num_events);
 #endif
 
 /*!
@@ -0,0 +1,140 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+/*! \file deferred_check.h
+ * Canary checks that are put off until the application synchronizes with a
+ * command queue. Each queue collects the kernel launches made since its last
+ * check in a check window, and one check of every buffer those launches used
+ * runs at the next synchronization point.
+ */
+
+#ifndef __DEFERRED_CHECK_H
+#define __DEFERRED_CHECK_H
+
+#include <stdint.h>
+#include <CL/cl.h>
+
+#include "meta_data_lists/cl_kernel_lists.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Launches since the last check on a command queue, and which of their
+ * arguments used each buffer.
+ */
+typedef struct check_window_ check_window;
+
+/*!
+ * Add a kernel launch to the check window of its command queue.
+ *
+ * \param queue
+ *      command queue the kernel was launched on
+ * \param kernel
+ *      the user's kernel, named in overflow reports
+ * \param user_plan
+ *      launch plan of the user's kernel
+ * \param plan
+ *      launch plan of the kernel that was actually launched, its buffers
+ *      are the ones that will be checked. Same as user_plan unless the
+ *      kernel was cloned with canaried mirrors.
+ * \return
+ *      1 if the window has reached DEFERRED_CHECK_MAX_LAUNCHES launches and
+ *      should be checked now
+ *      else 0
+ */
+int check_window_add_launch(cl_command_queue queue, cl_kernel kernel,
+        const kernel_launch_plan *user_plan, const kernel_launch_plan *plan);
+
+/*!
+ * Check every buffer used since the last check on a command queue and start
+ * a new window. Returns once the check has finished.
+ *
+ * \param queue
+ *      command queue that is being synchronized with
+ */
+void check_window_flush(cl_command_queue queue);
+
+/*!
+ * Check the windows of all command queues.
+ */
+void check_window_flush_all(void);
+
+/*!
+ * Check the windows of all command queues that used a memory object,
+ * e.g. before that object is released.
+ *
+ * \param handle
+ *      cl_mem or SVM pointer
+ */
+void check_window_flush_object(void *handle);
+
+/*!
+ * Take a reference to a window that is being checked, e.g. for an
+ * overflow report that is made from an event callback.
+ *
+ * \param window
+ *      window to keep around
+ */
+void check_window_retain(check_window *window);
+
+/*!
+ * Drop a reference to a window. The last one frees it.
+ *
+ * \param window
+ *      window to release
+ */
+void check_window_release(check_window *window);
+
+/*!
+ * Describe the launches in a window that could have overflowed a buffer.
+ *
+ * \param window
+ *      window the overflow was found in
+ * \param buffer
+ *      cl_mem or SVM pointer that overflowed
+ * \return
+ *      string with one line per group of candidate launches, free() it
+ *      NULL if an allocation failed
+ */
+char* check_window_candidates(const check_window *window, void *buffer);
+
+/*!
+ * Find the object the application passed to its kernels for an object that
+ * a window checked, which differ when the check used a canaried mirror.
+ *
+ * \param window
+ *      window the overflow was found in
+ * \param buffer
+ *      cl_mem or SVM pointer that was checked
+ * \return
+ *      the application's cl_mem or SVM pointer
+ */
+void* check_window_user_handle(const check_window *window, void *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__DEFERRED_CHECK_H
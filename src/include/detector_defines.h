@@ -38,6 +38,18 @@
 //#define SEQUENTIAL
 #define KERN_CALLBACK
 
+//with CLARMOR_DEFERRED_CHECK, check a command queue after this many launches
+//even if the application has not synchronized with it yet
+#define DEFERRED_CHECK_MAX_LAUNCHES 1024
+
+//with CLARMOR_OVERHEAD_TARGET, every kernel is still checked at least once
+//per this many launches
+#define GOVERNOR_MAX_CHECK_PERIOD 64
+//completed launches measured before the check period is adjusted
+#define GOVERNOR_SAMPLE_WINDOW 32
+//launches that may be waiting to be measured, older ones are dropped
+#define GOVERNOR_MAX_PENDING 256
+
 #define UNDERFLOW_CHECK
 
 //measured in bytes
@@ -48,6 +60,36 @@
 #define POISON_REGIONS 1
 #endif
 
+//canary lengths in bytes for CLARMOR_SITE_FEEDBACK, before and after growth
+#define SITE_MIN_CANARY 256
+#define SITE_MAX_CANARY (1 << 20)
+//allocation sites that are profiled, later ones keep the minimum canaries
+#define SITE_TABLE_SIZE 1024
+
+//slabs that CLARMOR_SLAB_ALLOC packs buffers of at most SLAB_MAX_BUFFER bytes into
+#define SLAB_SIZE (4 << 20)
+#define SLAB_MAX_BUFFER (64 << 10)
+
+//canaries may use 1/CANARY_BUDGET_FRACTION of the smallest device's memory
+//before they are shortened to BUDGET_SHORT_CANARY bytes
+#define CANARY_BUDGET_FRACTION 8
+#define BUDGET_SHORT_CANARY 256
+
+//freed SVM pooled per context is trimmed to SVM_POOL_LOW_WATER bytes once it
+//passes SVM_POOL_HIGH_WATER, and a region is only reused for requests of at
+//least 1/SVM_POOL_MAX_OVERSIZE of its size
+#define SVM_POOL_HIGH_WATER (256 << 20)
+#define SVM_POOL_LOW_WATER (64 << 20)
+#define SVM_POOL_MAX_OVERSIZE 2
+
+//checker scratch buffers are at least SCRATCH_MIN_SIZE bytes, and a context
+//keeps at most SCRATCH_MAX_IDLE of them that no check is using
+#define SCRATCH_MIN_SIZE 4096
+#define SCRATCH_MAX_IDLE 32
+
+//canary words each work-item of the GPU checker kernels compares, must be 2, 4, 8 or 16
+#define CHECK_WORDS_PER_ITEM 4
+
 //measured in array indexes
 #define IMAGE_POISON_WIDTH 16
 #define IMAGE_POISON_HEIGHT 16
@@ -56,9 +98,28 @@
 #define POISON_FILL 0xC2
 #define POISON_FILL_32B 0xC2C2C2C2
 
+//flags that limit how the device and host may access a cl_mem
+#define MEM_DEVICE_ACCESS_FLAGS (CL_MEM_READ_WRITE | CL_MEM_WRITE_ONLY | CL_MEM_READ_ONLY)
+#ifdef CL_VERSION_1_2
+#define MEM_HOST_ACCESS_FLAGS (CL_MEM_HOST_WRITE_ONLY | CL_MEM_HOST_READ_ONLY | CL_MEM_HOST_NO_ACCESS)
+#else
+#define MEM_HOST_ACCESS_FLAGS 0
+#endif
+
+/*!
+ * Where the canaries of a padded buffer or SVM region are. The data follows
+ * front bytes of canary, and back bytes of canary follow the data. Canary
+ * positions reported by the checkers count from the start of the front
+ * canary and continue into the back canary.
+ */
+typedef struct canary_geometry_
+{
+    uint32_t front; ///< 0 if underflows are not checked
+    uint32_t back;
+} canary_geometry;
+
 extern const uint8_t poisonFill_8b; ///< 8 bit poison fill
 extern const uint32_t poisonFill_32b; ///< 32 bit poison fill
-extern const unsigned poisonWordLen; ///< length of canary region in 32 bit words
 
 #ifndef CL_VERSION_1_2
 typedef struct _cl_image_desc {
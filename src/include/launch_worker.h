@@ -0,0 +1,103 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+/*! \file launch_worker.h
+ * Per-queue background threads that finish the detector's work for kernel
+ * launches after clEnqueueNDRangeKernel() has returned to the application.
+ */
+
+#ifndef __LAUNCH_WORKER_H
+#define __LAUNCH_WORKER_H
+
+#include <CL/cl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Hand a job to the worker thread of a command queue, starting the thread
+ * if the queue does not have one yet. Jobs for the same queue run one at a
+ * time, in the order they were submitted.
+ *
+ * \param queue
+ *      command queue the job's work is enqueued on
+ * \param job
+ *      function the worker calls with arg
+ * \param arg
+ *      argument passed to job, owned by the job from here on
+ */
+void launch_worker_submit(cl_command_queue queue, void (*job)(void*), void *arg);
+
+/*!
+ * Get the command queue the worker of a command queue uses for its own
+ * checks. It is created on the same device the first time it is asked for.
+ * Checker work is kept off the user's queue so that commands the user
+ * enqueues behind a launch can wait for its checks without blocking them.
+ *
+ * \param queue
+ *      user command queue
+ * \return
+ *      detector-internal command queue on the same device as queue
+ */
+cl_command_queue launch_worker_check_queue(cl_command_queue queue);
+
+/*!
+ * Keep the worker of a command queue from counting as idle after the
+ * current job returns, until launch_worker_release() is called. Jobs use
+ * this for work they leave running on the device.
+ *
+ * \param queue
+ *      command queue of the job
+ */
+void launch_worker_hold(cl_command_queue queue);
+
+/*!
+ * Undo one launch_worker_hold(). May be called from any thread, such as an
+ * event callback.
+ *
+ * \param queue
+ *      command queue of the job
+ */
+void launch_worker_release(cl_command_queue queue);
+
+/*!
+ * Wait until every job submitted for a command queue has finished, along
+ * with any work the jobs left running.
+ * Returns right away if the queue has no worker.
+ *
+ * \param queue
+ *      command queue to wait for
+ */
+void launch_worker_drain(cl_command_queue queue);
+
+/*!
+ * Wait until the workers of every command queue are idle.
+ */
+void launch_worker_drain_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__LAUNCH_WORKER_H
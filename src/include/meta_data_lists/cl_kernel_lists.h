@@ -28,6 +28,7 @@
 #ifndef __CL_KERNEL_LISTS_H__
 #define __CL_KERNEL_LISTS_H__
 
+#include <pthread.h>
 #include "cl_memory_lists.h"
 
 #ifdef __cplusplus
@@ -37,6 +38,12 @@ extern "C" {
 #define CL_USE_DEPRECATED_OPENCL_2_0_APIS
 #include <CL/cl.h>
 
+/*!
+ * Arguments up to this size are stored inside the kernel_arg itself, so that
+ * setting scalars, cl_mem handles and SVM pointers never touches the heap.
+ */
+#define KARG_INLINE_VALUE_SIZE 16
+
 /*!
  * Information about an argument to an OpenCL kernel. This is created in the
  * OpenCL API calls that set kernel arguments (as well as kernel SVM args).
@@ -44,86 +51,268 @@ extern "C" {
  * passing a buffer that we want to analyze, and then pass that same arg
  * to a new kernel or to a kernel that should check canary values.
  */
-typedef struct kernel_arg_list_
+typedef struct kernel_arg_
 {
     cl_uint handle; ///arg_index;
+    uint8_t is_set;
     size_t size;
+    /// Points at inline_value for small arguments, heap memory otherwise.
+    /// NULL if the argument was set with a NULL value (e.g. local memory).
     void * value;
     cl_memobj * buffer;
     cl_svm_memobj * svm_buffer;
-    /// Need to keep a 'next' pointer so we can make a linked list of arguments.
-    /// We need to walk through all of them later in the code
-    struct kernel_arg_list_ * next;
+    /// The kernel cannot write through this argument (a const or __constant
+    /// pointer, or a read_only image). 0 if the runtime could not tell us.
+    uint8_t read_only;
+    union
+    {
+        cl_ulong align;
+        uint8_t bytes[KARG_INLINE_VALUE_SIZE];
+    } inline_value;
 } kernel_arg;
 
-// There is no function here to get a global list of arguments. Instead, the
-// arg_list is associated with the kernel_info struct below. Every kernel has
-// its own linked list of kernel_arg arguments.
+/*!
+ * How the detector treats a particular kernel argument at launch time.
+ */
+typedef enum kernel_arg_kind_
+{
+    KARG_VALUE = 0, ///not a memory object, passed by value
+    KARG_BUFFER,    ///cl_mem buffer
+    KARG_IMAGE,     ///cl_mem image
+    KARG_SVM        ///SVM pointer
+} kernel_arg_kind;
 
 /*!
- * Add kernel arg to linked list.
+ * Everything the detector derives from a kernel's arguments before it can
+ * launch and check that kernel. Building this requires walking the argument
+ * list several times, so it is built once and reused by every launch until
+ * clSetKernelArg() or clSetKernelArgSVMPointer() changes an argument.
+ */
+typedef struct kernel_launch_plan_
+{
+    uint32_t nargs;
+    /// dupe[i] == i if arg i is unique in the set of indexes <= i,
+    /// otherwise the index of the first occurrence of that buffer
+    uint32_t *dupe;
+    kernel_arg_kind *arg_kind;
+    /// written[i] is set for unique buffer and image arguments the kernel
+    /// can write through, at this or any duplicate index. Only these are
+    /// checked and copied back.
+    uint8_t *written;
+    /// at least one written buffer argument has no canary region, so the
+    /// kernel must be cloned with canaried copies of those buffers
+    uint8_t needs_clone;
+    /// the kernel can reach SVM, through arguments or clSetKernelExecInfo
+    uint8_t has_svm;
+    /// the kernel may use any SVM allocation (fine-grain system SVM), so
+    /// every live one is checked instead of svm_ptrs
+    uint8_t svm_sweep;
+    uint32_t num_svm;
+    /// base pointers of the unique SVM allocations that are passed as
+    /// written arguments or declared with clSetKernelExecInfo()
+    void **svm_ptrs;
+    uint32_t num_buffs;
+    uint32_t num_imgs;
+    /// handles of the unique written cl_mem buffer and image arguments
+    void **buffer_ptrs;
+    void **image_ptrs;
+} kernel_launch_plan;
+
+/*!
+ * Free a launch plan and all of its arrays.
  *
- * \param list
- *      linked list pointer
- * \param item
- *      pointer to kernel argument info struct
+ * \param plan
+ *      launch plan to delete
+ */
+void kernel_launch_plan_delete(kernel_launch_plan *plan);
+
+/*!
+ * Make a deep copy of a launch plan, e.g. to check a launch after the
+ * kernel's arguments may have changed again.
+ *
+ * \param plan
+ *      launch plan to copy
+ * \return
+ *      pointer to the copy, free it with kernel_launch_plan_delete()
+ *      NULL if an allocation failed
+ */
+kernel_launch_plan* kernel_launch_plan_copy(const kernel_launch_plan *plan);
+
+/*!
+ * Information about an OpenCL kernel. In particular, the reference count
+ * (so that we can know when the kernel is released in the OpenCL runtime
+ * and thus remove this structure) and the table of arguments to the kernel.
+ * launch_plan caches the argument analysis used by each launch and is
+ * rebuilt whenever plan_dirty is set.
+ */
+typedef struct kernel_info_list_
+{
+    cl_kernel   handle;
+    uint32_t    ref_count;
+    uint32_t    num_args;
+    /// num_args entries, indexed by argument index
+    kernel_arg  *args;
+    /// Guards args, so threads setting arguments on different kernels
+    /// never wait on each other.
+    pthread_mutex_t arg_lock;
+    kernel_launch_plan *launch_plan;
+    uint8_t     plan_dirty;
+    /// Program and function name, used to find clones of this kernel in
+    /// the kernel pool. Only filled in once the kernel needs a clone.
+    cl_program  program;
+    char        *name;
+    /// This is one of the detector's pooled clones, not a kernel of the
+    /// application's.
+    uint8_t     pool_clone;
+    /// Only set on the stand-in kernel_info of a deferred check, whose
+    /// overflows are reported against the launches in this window.
+    struct check_window_ *window;
+    /// This is a copy of a kernel's arguments taken for a later check. It is
+    /// in no list, and ref_count counts the checks still using it.
+    uint8_t     snapshot;
+    /// Launches of this kernel seen by the overhead governor.
+    uint32_t    governor_launches;
+    /// Number of overflowed kernel names the governor has compared this
+    /// kernel's name against, and whether one of them matched.
+    uint32_t    governor_overflows_seen;
+    uint8_t     governor_overflowed;
+    /// SVM pointers declared with CL_KERNEL_EXEC_INFO_SVM_PTRS
+    uint32_t    num_exec_svm_ptrs;
+    void        **exec_svm_ptrs;
+    /// CL_KERNEL_EXEC_INFO_SVM_FINE_GRAIN_SYSTEM was set to CL_TRUE
+    uint8_t     svm_fine_grain_system;
+} kernel_info;
+
+/*!
+ * Allocate a kinfo structure and an empty argument table for it.
+ * The structure is not added to any list.
+ *
+ * \param handle
+ *      cl_kernel this information describes
+ * \param num_args
+ *      the kernel's CL_KERNEL_NUM_ARGS
+ * \return
+ *      pointer to the new kernel information
+ *      NULL if an allocation failed
+ */
+kernel_info* kinfo_create(cl_kernel handle, uint32_t num_args);
+
+/*!
+ * Allocate a kinfo structure for a copy of a kernel, e.g. one made with
+ * clCloneKernel(), or a snapshot of a kernel's arguments at launch. Argument
+ * values, SVM declarations, the launch plan and the kernel pool key are
+ * copied from the original. The structure is not added to any list.
+ *
+ * \param from
+ *      information about the kernel that was copied
+ * \param handle
+ *      the new cl_kernel
+ * \return
+ *      pointer to the new kernel information
+ *      NULL if an allocation failed
+ */
+kernel_info* kinfo_clone(kernel_info *from, cl_kernel handle);
+
+/*!
+ * Take another reference to a kinfo snapshot, see kernel_info.snapshot.
+ *
+ * \param snapshot
+ *      snapshot made with kinfo_clone()
+ */
+void kinfo_snapshot_retain(kernel_info *snapshot);
+
+/*!
+ * Drop a reference to a kinfo snapshot, deleting it with the last one.
+ *
+ * \param snapshot
+ *      snapshot made with kinfo_clone()
+ */
+void kinfo_snapshot_release(kernel_info *snapshot);
+
+// There is no function here to get a global list of arguments. Instead, every
+// kernel_info owns a table of its kernel_arg arguments, indexed by the
+// argument index. These functions work on that table.
+
+/*!
+ * Record the value of the {handle}th argument of a kernel, replacing any
+ * previous value. If the argument actually changed, the kernel's launch
+ * plan is marked as needing a rebuild.
+ *
+ * \param kinfo
+ *      kernel information
+ * \param handle
+ *      kernel argument index
+ * \param size
+ *      argument size
+ * \param value
+ *      argument value, copied. May be NULL.
+ * \param buffer
+ *      cl_mem record if the argument is a tracked buffer, else NULL
+ * \param svm_buffer
+ *      SVM record if the argument is a tracked SVM pointer, else NULL
  * \return
  *      0 success
  *      other fail
  */
-int karg_insert(kernel_arg **list, kernel_arg *item);
+int karg_set(kernel_info *kinfo, const cl_uint handle, size_t size,
+        const void *value, cl_memobj *buffer, cl_svm_memobj *svm_buffer);
 
 /*!
- * If the {handle}th kernel arg exists, remove it from the list and
- * return a pointer to it.
+ * If the {handle}th kernel arg has been set, return a pointer to it.
  *
- * \param list
- *      linked list pointer
+ * \param kinfo
+ *      kernel information
  * \param handle
  *      kernel argument index
  * \return
  *      pointer to kernel argument info
  *      else NULL
  */
-kernel_arg* karg_remove(kernel_arg **list, const cl_uint handle);
+kernel_arg* karg_find(kernel_info *kinfo, const cl_uint handle);
 
 /*!
- * If the {handle}th kernel arg exists, return a pointer to it.
+ * Forget the {handle}th kernel arg, e.g. because the buffer it referred to
+ * has been released.
  *
- * \param list
- *      linked list pointer
+ * \param kinfo
+ *      kernel information
  * \param handle
  *      kernel argument index
  * \return
- *      pointer to kernel argument info
- *      else NULL
+ *      0 success
+ *      other fail
  */
-kernel_arg* karg_find(kernel_arg *const list, const cl_uint handle);
+int karg_clear(kernel_info *kinfo, const cl_uint handle);
 
 /*!
- * Free a particular kernel argument structure. If you don't remove it from
- * the linked list before deleting it, you're likely to see a segfault.
+ * Record the SVM pointers a kernel reaches indirectly, as passed to
+ * clSetKernelExecInfo(CL_KERNEL_EXEC_INFO_SVM_PTRS). Replaces any pointers
+ * set before.
  *
- * \param item
- *      kernel argument info pointer
+ * \param kinfo
+ *      kernel information
+ * \param num_ptrs
+ *      number of pointers
+ * \param ptrs
+ *      the pointers, copied
  * \return
  *      0 success
  *      other fail
  */
-int karg_delete(kernel_arg *item);
-
+int kinfo_set_exec_svm_ptrs(kernel_info *kinfo, uint32_t num_ptrs,
+        void * const *ptrs);
 
 /*!
- * Information about an OpenCL kernel. In particular, the reference count
- * (so that we can know when the kernel is released in the OpenCL runtime
- * and thus remove this structure) and the list of argumnets to the kernel.
+ * Record whether a kernel may use any SVM allocation, as passed to
+ * clSetKernelExecInfo(CL_KERNEL_EXEC_INFO_SVM_FINE_GRAIN_SYSTEM).
+ *
+ * \param kinfo
+ *      kernel information
+ * \param fine_grain_system
+ *      1 if the kernel may use any SVM allocation
  */
-typedef struct kernel_info_list_
-{
-    cl_kernel   handle;
-    uint32_t    ref_count;
-    kernel_arg  *arg_list;
-} kernel_info;
+void kinfo_set_svm_fine_grain_system(kernel_info *kinfo,
+        uint8_t fine_grain_system);
 
 /*!
  * A global list of pointers to the kernel_info descriptors in the system.
@@ -188,6 +377,101 @@ kernel_info* kinfo_find(void* map_v, cl_kernel handle);
  */
 int kinfo_delete(kernel_info *item);
 
+/*!
+ * Counters describing how well the pool of cloned kernels is working.
+ */
+typedef struct kernel_pool_stats_
+{
+    uint64_t hits;      ///checkouts satisfied from the pool
+    uint64_t misses;    ///checkouts that needed a new clone
+    uint64_t idle;      ///clones currently waiting in the pool
+    uint64_t in_use;    ///clones currently checked out
+    uint64_t high_in_use;
+} kernel_pool_stats;
+
+/*!
+ * Take a cloned kernel of function {name} in {program} out of the pool.
+ * Clones that are still referenced by a pending overflow check are not
+ * handed out. If this returns NULL, the caller should create a new clone
+ * and later give it to kpool_return().
+ *
+ * \param program
+ *      program the kernel was created from
+ * \param name
+ *      kernel function name
+ * \return
+ *      a cloned kernel that no other launch is using
+ *      else NULL
+ */
+cl_kernel kpool_checkout(cl_program program, const char *name);
+
+/*!
+ * Give a cloned kernel back to the pool so that a later launch of the same
+ * kernel function can reuse it instead of creating a new one. This fails
+ * once the application has released every kernel of that function, and the
+ * caller should then release the clone itself.
+ *
+ * \param program
+ *      program the kernel was created from
+ * \param name
+ *      kernel function name
+ * \param kernel
+ *      the cloned kernel
+ * \return
+ *      0 success
+ *      other fail
+ */
+int kpool_return(cl_program program, const char *name, cl_kernel kernel);
+
+/*!
+ * Note that one more of the application's kernels of function {name} in
+ * {program} may need clones. Clones are only pooled while a function has
+ * such kernels.
+ *
+ * \param program
+ *      program the kernel was created from
+ * \param name
+ *      kernel function name
+ */
+void kpool_add_user(cl_program program, const char *name);
+
+/*!
+ * Note that one of the application's kernels added with kpool_add_user()
+ * was released. When this returns 1, the caller should release every clone
+ * that kpool_drain() hands back for this function.
+ *
+ * \param program
+ *      program the kernel was created from
+ * \param name
+ *      kernel function name
+ * \return
+ *      1 if that was the function's last kernel
+ *      else 0
+ */
+int kpool_remove_user(cl_program program, const char *name);
+
+/*!
+ * Take any idle clone of function {name} in {program} out of the pool,
+ * whether or not a pending check still holds it.
+ *
+ * \param program
+ *      program the kernel was created from
+ * \param name
+ *      kernel function name
+ * \return
+ *      an idle clone that the caller must release
+ *      NULL once the function has no idle clones left
+ */
+cl_kernel kpool_drain(cl_program program, const char *name);
+
+/*!
+ * Read the kernel pool's counters.
+ *
+ * \param stats
+ *      Output
+ */
+void kpool_get_stats(kernel_pool_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
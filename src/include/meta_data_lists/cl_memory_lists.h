@@ -58,14 +58,53 @@ typedef struct cl_memobj_list_
     uint8_t is_image;
     cl_image_format image_format;
     cl_image_desc image_desc;
-    /// If this is a subBuffer, we need its origin
+    /// If this is a subBuffer, we need its origin and the buffer it came from
     uint8_t is_sub;
     size_t origin;
+    cl_mem parent;
     ///buffers with host pointers, images with buffers, and sub buffers do not have canaries
     uint8_t has_canary;
+    /// canary lengths of a buffer with canaries, images use IMAGE_POISON_*
+    canary_geometry canary;
+    /// return address of the call that created the object
+    uintptr_t alloc_site;
+    /// Small buffers may be packed into a slab, where each canary is shared
+    /// with a neighbour. main_buff is then the sub-buffer of the slab that
+    /// starts at slab_offset and holds this buffer and its canaries.
+    cl_mem slab;
+    size_t slab_offset;
+    /// With CLARMOR_SVM_BACKED, main_buff may be created over a coarse-grained
+    /// SVM allocation. Its base is kept here so that the checkers can read
+    /// the canaries in place. NULL when main_buff is ordinary device memory.
+    void *svm_backing;
+    /// The canaries of a new padded buffer are filled (and its data uploaded)
+    /// without waiting, and init_event completes once they are. Commands that
+    /// use the buffer, or a sub-buffer of it, wait for init_event until it is
+    /// seen complete. NULL when there is nothing left to wait for.
+    cl_event init_event;
+    /// Bytes of canary counted against the canary budget.
+    size_t canary_bytes;
+    /// Images the canary budget left without canaries are never checked,
+    /// nor given a mirror.
+    uint8_t canary_dropped;
     /// This flag tells whether this was a buffer created by the user,
     /// or whether it is some buffer internal to the detector itself.
     uint8_t detector_internal_buffer;
+    /// Objects without canaries are passed to kernels through a canaried
+    /// mirror that lives as long as this object does. The mirror holds the
+    /// object's data as of mirror_epoch.
+    cl_mem mirror;
+    uint32_t mirror_epoch;
+    /// A buffer and its sub-buffers share storage. These fields are only used
+    /// on the buffer that owns the storage. write_epoch is bumped whenever the
+    /// storage is written, which makes every mirror of it out of date, and
+    /// dirty_mirror is the one mirror (if any) holding data that has not been
+    /// copied back into the storage yet, last written by the launch of
+    /// dirty_event on dirty_queue.
+    uint32_t write_epoch;
+    struct cl_memobj_list_ *dirty_mirror;
+    cl_command_queue dirty_queue;
+    cl_event dirty_event;
 } cl_memobj;
 
 /*!
@@ -147,7 +186,13 @@ typedef struct cl_svm_memobj_list_
     cl_svm_mem_flags flags;
     size_t size;
     unsigned int alignment;
+    canary_geometry canary;
+    uintptr_t alloc_site;
     uint8_t detector_internal_buffer;
+    /// Canary fills of a coarse-grained allocation that may not have
+    /// finished yet. Commands that use or check the allocation wait on them.
+    cl_event init_events[2];
+    uint32_t num_init_events;
 } cl_svm_memobj;
 #else // !CL_VERSION_2_0
 /*!
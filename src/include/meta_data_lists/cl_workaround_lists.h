@@ -37,16 +37,20 @@ extern "C" {
 
 #ifdef CL_VERSION_2_0
 /*!
- * Fine-grained SVM allocation caches.
- * The following code is used to cache FG SVM allocations, because the AMD
- * OpenCL runtime does not properly free these. As such, we never call the free
- * functions for these fine-grained buffers. If we allocate one of them, we
- * cache it on the request to free it. We then search our caches for furture
- * allocations to see if one of our previous allocations would work.
+ * SVM allocation pool.
+ * The AMD OpenCL runtime does not properly free fine-grained SVM, so
+ * allocating and freeing it repeatedly eventually runs out of resources.
+ * Instead of freeing SVM allocations, we keep them in a per-context pool and
+ * hand them back out for later allocations of a similar size. Free regions
+ * are bucketed by the power of two their size rounds up to and by the
+ * alignment of their base address. A region is only reused for a request of
+ * at least 1/SVM_POOL_MAX_OVERSIZE of its size, and once the pool of a
+ * context holds more than SVM_POOL_HIGH_WATER bytes it is trimmed back to
+ * SVM_POOL_LOW_WATER bytes. All of these functions are thread-safe.
  *
- * Call this right after you call clSVMAlloc(CL_MEM_SVM_FINE_GRAIN_BUFFER).
- * This lets us keep track of all fine-grained SVM allocations so that we can
- * cache them. No return value.
+ * Call this right after a real clSVMAlloc() that svm_pool_get() could not
+ * satisfy. This lets us keep track of the allocation so that it can be pooled
+ * when it is freed. No return value.
  *
  * \param context
  *      alloc context
@@ -56,48 +60,87 @@ extern "C" {
  *      configuration flags
  * \param size
  *      length of allocation
+ */
+void svm_pool_track(cl_context context, void *base, cl_svm_mem_flags flags,
+        size_t size);
+
+/*!
+ * Call this before trying to call clSVMAlloc(). If a previously-allocated-
+ * and-then-freed region is big enough, no more than SVM_POOL_MAX_OVERSIZE
+ * times too big, has the same flags and is at least as aligned, it is taken
+ * out of the pool and returned.
+ *
+ * \param context
+ *      alloc context
+ * \param flags
+ *      configuration flags
+ * \param size
+ *      length of allocation
  * \param alignment
- *      page alignement
-*/
-void cl_svm_fg_alloc(cl_context context, void * base, cl_svm_mem_flags flags,
-                        size_t size, unsigned int alignment);
+ *      requested alignment, 0 for the default
+ * \return
+ *      NULL if there is no proper region. You must clSVMAlloc yourself.
+ *          ===or===
+ *      void* pointer to the previously allocated region
+ */
+void *svm_pool_get(cl_context context, cl_svm_mem_flags flags, size_t size,
+        unsigned int alignment);
 
 /*!
- * Call this *before* calling clSMVFree(). Do this *FOR ALL SVM BUFFERS*.
+ * Call this *before* calling clSVMFree(). Do this *FOR ALL SVM BUFFERS*.
  *
- * This will check if the address was allocated as an SVM buffer. If so, it
- * put it in our FG SVM cache. At that point, you don't need to actually
- * call clSVMFree().
+ * If the address was allocated through the pool, it is put back in the pool
+ * and you must not call clSVMFree() on it. Afterwards, call svm_pool_trim()
+ * to find regions that the pool no longer wants to keep.
  *
  * \param context
  *      free context
  * \param base
  *      free base pointer
  * \return
- *      0 if this we successfully "freed" a FG SVM region.
- *      1 if we did not succesffully "free" a FG SVM region.
+ *      0 if the region was pooled.
+ *      1 if the pool did not know the region.
  *          IF THIS RETURNS 1, YOU MUST CALL clSVMFree() to avoid leaks.
  */
-int cl_svm_fg_free(cl_context context, void* base);
+int svm_pool_put(cl_context context, void *base);
 
 /*!
- * Call this before trying to call clSVMAlloc(CL_MEM_SVM_FINE_GRAIN_BUFFER).
- * If you have a previously-allocated-and-then-freed FG SVM allocation, this
- * will try to find it for you. If the previous region is big enough and has
- * the right alignment, we will return it.
+ * Take a region out of the pool of a context that should really be freed,
+ * either because the pool is over its high-water mark or because the
+ * context is going away. Call it until it returns NULL and clSVMFree() each
+ * region it returns.
  *
  * \param context
- * \param size
- * \param alignment
+ *      context whose pool is trimmed
+ * \param drain
+ *      if non-zero, every pooled region of the context is returned
  * \return
- *      NULL if there is no proper FG SVM region. You must clSVMAlloc yourself.
- *          ===or===
- *      void* pointer to the previously allocated region that's big enough to
- *      hold your request and has the right alignment..
+ *      region to clSVMFree()
+ *      NULL once the pool is small enough
  */
-void *find_free_svm(cl_context context, size_t size, unsigned int alignment);
+void *svm_pool_trim(cl_context context, int drain);
 #endif // CL_VERSION_2_0
 
+/*!
+ * Counters describing how well the SVM allocation pool is working.
+ */
+typedef struct svm_pool_stats_
+{
+    uint64_t hits;          ///allocations satisfied from the pool
+    uint64_t misses;        ///allocations that needed a real clSVMAlloc
+    uint64_t trimmed;       ///pooled regions that were really freed
+    uint64_t pooled_bytes;  ///bytes currently waiting in the pool
+    uint64_t high_pooled_bytes;
+} svm_pool_stats;
+
+/*!
+ * Read the SVM pool's counters.
+ *
+ * \param stats
+ *      Output
+ */
+void svm_pool_get_stats(svm_pool_stats *stats);
+
 
 
 /*!
@@ -0,0 +1,92 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+/*! \file overhead_governor.h
+ * Keeps the cost of canary checks inside the CLARMOR_OVERHEAD_TARGET budget.
+ * The time spent checking is compared with the time the application's
+ * kernels ran, and each kernel is checked only once every check period
+ * launches. The period doubles while checks cost more than the target and
+ * halves again once they cost less than half of it.
+ */
+
+#ifndef __OVERHEAD_GOVERNOR_H
+#define __OVERHEAD_GOVERNOR_H
+
+#include <stdint.h>
+#include <CL/cl.h>
+
+#include "meta_data_lists/cl_kernel_lists.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Whether an overhead target was set.
+ *
+ * \return
+ *      1 if check frequency is being governed
+ *      else 0
+ */
+int governor_enabled(void);
+
+/*!
+ * Decide whether a kernel launch is checked.
+ * The first launch of every kernel is checked, as is at least one launch in
+ * GOVERNOR_MAX_CHECK_PERIOD. Kernels that have overflowed are always checked.
+ *
+ * \param kinfo
+ *      kernel_info of the user's kernel, counts its launches
+ * \return
+ *      1 if the launch should be checked
+ *      else 0
+ */
+int governor_should_check(kernel_info *kinfo);
+
+/*!
+ * Measure a kernel launch once it has completed.
+ *
+ * \param launch_event
+ *      event of the user's kernel, owned by the governor from here on
+ * \param check_event
+ *      event that completes when the launch's checks have, owned by the
+ *      governor from here on. NULL if the launch was not checked.
+ * \param host_us
+ *      time spent setting up the checks on the host
+ */
+void governor_add_sample(cl_event launch_event, cl_event check_event,
+        uint64_t host_us);
+
+/*!
+ * Always check a kernel function from now on.
+ *
+ * \param kernel_name
+ *      function name of the kernel that overflowed
+ */
+void governor_note_overflow(const char *kernel_name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__OVERHEAD_GOVERNOR_H
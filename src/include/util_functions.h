@@ -51,6 +51,8 @@ extern "C" {
 #define STATS_KERN_ENQ_TIME     1
 #define STATS_CHECKER_TIME      2
 #define STATS_MEM_OVERHEAD      4
+#define STATS_KERNEL_POOL       8
+#define STATS_SVM_POOL          16
 extern uint32_t global_tool_stats_flags;
 
 #define __CLARMOR_PERFSTAT_OUTFILE__ "CLARMOR_PERFSTAT_OUTFILE"
@@ -58,6 +60,16 @@ extern char * global_tool_stats_outfile;
 
 #define __BACKTRACE__ "CLARMOR_PRINT_BACKTRACE"
 #define __CLARMOR_DISABLE_API_CHECK__ "CLARMOR_DISABLE_API_CHECK"
+#define __CLARMOR_ASYNC_CHECK__ "CLARMOR_ASYNC_CHECK"
+#define __CLARMOR_DEFERRED_CHECK__ "CLARMOR_DEFERRED_CHECK"
+#define __CLARMOR_OVERHEAD_TARGET__ "CLARMOR_OVERHEAD_TARGET"
+#define __CLARMOR_CHECK_READ_ONLY__ "CLARMOR_CHECK_READ_ONLY"
+#define __CLARMOR_PRESERVE_FLAGS__ "CLARMOR_PRESERVE_FLAGS"
+#define __CLARMOR_CANARY_POLICY__ "CLARMOR_CANARY_POLICY"
+#define __CLARMOR_SITE_FEEDBACK__ "CLARMOR_SITE_FEEDBACK"
+#define __CLARMOR_SLAB_ALLOC__ "CLARMOR_SLAB_ALLOC"
+#define __CLARMOR_SVM_BACKED__ "CLARMOR_SVM_BACKED"
+#define __CLARMOR_CHECKER_CACHE__ "CLARMOR_CHECKER_CACHE"
 
 #define __CLARMOR_DEVICE_SELECT__ "CLARMOR_DEVICE_SELECT"
 
@@ -115,6 +127,99 @@ int get_gpu_strat_envvar(void);
  */
 int get_disable_api_check_envvar(void);
 
+/*!
+ * Get the environment variable that tells the buffer overflow detector
+ * to finish checking kernel launches on a background thread
+ *
+ * \return
+ *      0 default, no environment variable.
+ */
+int get_async_check_envvar(void);
+
+/*!
+ * Get the environment variable that tells the buffer overflow detector
+ * to put off checking kernel launches until the application synchronizes
+ *
+ * \return
+ *      0 default, no environment variable.
+ */
+int get_deferred_check_envvar(void);
+
+/*!
+ * Get the environment variable that sets how much slower, in percent, the
+ * buffer overflow detector may make the application's kernels
+ *
+ * \return
+ *      0 default, no environment variable. Every launch is checked.
+ */
+int get_overhead_target_envvar(void);
+
+/*!
+ * Get the environment variable that tells the buffer overflow detector
+ * to also check kernel arguments that are declared read-only
+ *
+ * \return
+ *      0 default, no environment variable.
+ */
+int get_check_read_only_envvar(void);
+
+/*!
+ * Get the environment variable that tells the buffer overflow detector
+ * to keep the application's access flags on the buffers it pads
+ *
+ * \return
+ *      0 default, no environment variable. Padded buffers are READ_WRITE.
+ */
+int get_preserve_flags_envvar(void);
+
+/*!
+ * Get the environment variable that sets the canary sizes used for
+ * buffers and SVM of different sizes
+ *
+ * \return
+ *      policy string, free() it
+ *      NULL if the environment variable isn't found.
+ */
+char* get_canary_policy_envvar(void);
+
+/*!
+ * Get the environment variable that sizes canaries by allocation site,
+ * growing them at sites whose overflows ran past the whole canary
+ *
+ * \return
+ *      0 default, no environment variable. Canaries only depend on size.
+ */
+int get_site_feedback_envvar(void);
+
+/*!
+ * Get the environment variable that packs small buffers into shared slabs,
+ * with one canary between neighbouring buffers
+ *
+ * \return
+ *      0 default, no environment variable. Every buffer is padded alone.
+ */
+int get_slab_alloc_envvar(void);
+
+/*!
+ * Get the environment variable that places padded cl_mem buffers in
+ * coarse-grained SVM, so their canaries can be checked where they are
+ *
+ * \return
+ *      0 default, no environment variable. Canaries are copied to be checked.
+ */
+int get_svm_backed_envvar(void);
+
+/*!
+ * Get the environment variable that names the directory compiled checker
+ * kernels are cached in
+ *
+ * \return
+ *      directory path, free() it
+ *      NULL if the environment variable isn't found. Checkers are built
+ *      from source in every run.
+ */
+char* get_checker_cache_envvar(void);
+
 /*!
  * Retrieve CLARMOR_PERFSTAT_MODE from environment
  *
@@ -211,6 +316,19 @@ void print_backtrace(FILE* where_to);
  */
 int is_nvidia_platform(cl_context context);
 
+/*!
+ * does the platform of this context report at least OpenCL major.minor
+ *
+ * \param context
+ *      check the platform of this context
+ * \param major
+ *      required major version
+ * \param minor
+ *      required minor version
+ * \return 1 if supported, 0 otherwise
+ */
+int platform_supports_cl_version(cl_context context, int major, int minor);
+
 /*!
  * returns 1 if this system is running on an OpenCL runtime where image
  * functions can cause lockups when we try to wrap it with clASRMOR.
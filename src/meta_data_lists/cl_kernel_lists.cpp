@@ -21,37 +21,195 @@
  ********************************************************************************/
 
 
+#include <string.h>
 #include <map>
+#include <string>
+#include <utility>
+#include <vector>
 #include "generic_lists.hpp"
 #include "meta_data_lists/cl_kernel_lists.h"
 
-pthread_mutex_t kernel_arg_lock = PTHREAD_MUTEX_INITIALIZER;
+static void karg_free_value(kernel_arg *item)
+{
+    if (item->value != NULL && item->value != item->inline_value.bytes)
+        free(item->value);
+    item->value = NULL;
+}
 
-int karg_insert(kernel_arg **list, kernel_arg *item)
+int karg_set(kernel_info *kinfo, const cl_uint handle, size_t size,
+        const void *value, cl_memobj *buffer, cl_svm_memobj *svm_buffer)
 {
-    return insert<kernel_arg>(list, item, &kernel_arg_lock);
+    if (kinfo == NULL || handle >= kinfo->num_args)
+        return L_FAIL;
+
+    int ret = L_SUCCESS;
+    pthread_mutex_lock(&kinfo->arg_lock);
+    kernel_arg *item = &kinfo->args[handle];
+
+    // Setting an argument to the value it already holds is common (e.g. once
+    // per launch in a loop), so only throw away the launch plan if the
+    // argument really changed.
+    bool changed = (!item->is_set ||
+            item->size != size ||
+            item->buffer != buffer ||
+            item->svm_buffer != svm_buffer ||
+            (item->value == NULL) != (value == NULL) ||
+            (value != NULL && memcmp(item->value, value, size) != 0));
+
+    if (changed)
+    {
+        if (value == NULL)
+            karg_free_value(item);
+        else if (size <= KARG_INLINE_VALUE_SIZE)
+        {
+            karg_free_value(item);
+            item->value = item->inline_value.bytes;
+        }
+        else if (item->value == NULL || item->value == item->inline_value.bytes ||
+                item->size != size)
+        {
+            karg_free_value(item);
+            item->value = malloc(size);
+        }
+
+        if (value != NULL && item->value == NULL)
+        {
+            item->is_set = 0;
+            ret = L_FAIL;
+        }
+        else
+        {
+            if (value != NULL)
+                memcpy(item->value, value, size);
+            item->size = size;
+            item->buffer = buffer;
+            item->svm_buffer = svm_buffer;
+            item->is_set = 1;
+        }
+        kinfo->plan_dirty = 1;
+    }
+
+    pthread_mutex_unlock(&kinfo->arg_lock);
+    return ret;
 }
 
-kernel_arg* karg_remove(kernel_arg **list, const cl_uint handle)
+kernel_arg* karg_find(kernel_info *kinfo, const cl_uint handle)
 {
-    return remove<kernel_arg, const cl_uint>(list, handle, &kernel_arg_lock);
+    if (kinfo == NULL || handle >= kinfo->num_args)
+        return NULL;
+    kernel_arg *ret = NULL;
+    pthread_mutex_lock(&kinfo->arg_lock);
+    if (kinfo->args[handle].is_set)
+        ret = &kinfo->args[handle];
+    pthread_mutex_unlock(&kinfo->arg_lock);
+    return ret;
 }
 
-kernel_arg* karg_find(kernel_arg *const list, const cl_uint handle)
+int karg_clear(kernel_info *kinfo, const cl_uint handle)
 {
-    return find<kernel_arg, const cl_uint>(list, handle, &kernel_arg_lock);
+    if (kinfo == NULL || handle >= kinfo->num_args)
+        return L_FAIL;
+    pthread_mutex_lock(&kinfo->arg_lock);
+    kernel_arg *item = &kinfo->args[handle];
+    karg_free_value(item);
+    item->size = 0;
+    item->buffer = NULL;
+    item->svm_buffer = NULL;
+    item->is_set = 0;
+    kinfo->plan_dirty = 1;
+    pthread_mutex_unlock(&kinfo->arg_lock);
+    return L_SUCCESS;
 }
 
-int karg_delete(kernel_arg *item)
+
+int kinfo_set_exec_svm_ptrs(kernel_info *kinfo, uint32_t num_ptrs,
+        void * const *ptrs)
 {
-    if(item == NULL)
-        return L_SUCCESS;
-    if (item->value)
-        free(item->value);
-    free(item);
+    void **copy = NULL;
+    if (kinfo == NULL)
+        return L_FAIL;
+    if (num_ptrs > 0)
+    {
+        copy = (void**)malloc(sizeof(void*) * num_ptrs);
+        if (copy == NULL)
+            return L_FAIL;
+        memcpy(copy, ptrs, sizeof(void*) * num_ptrs);
+    }
+
+    pthread_mutex_lock(&kinfo->arg_lock);
+    if (kinfo->exec_svm_ptrs)
+        free(kinfo->exec_svm_ptrs);
+    kinfo->exec_svm_ptrs = copy;
+    kinfo->num_exec_svm_ptrs = num_ptrs;
+    kinfo->plan_dirty = 1;
+    pthread_mutex_unlock(&kinfo->arg_lock);
     return L_SUCCESS;
 }
 
+void kinfo_set_svm_fine_grain_system(kernel_info *kinfo,
+        uint8_t fine_grain_system)
+{
+    pthread_mutex_lock(&kinfo->arg_lock);
+    if (kinfo->svm_fine_grain_system != fine_grain_system)
+        kinfo->plan_dirty = 1;
+    kinfo->svm_fine_grain_system = fine_grain_system;
+    pthread_mutex_unlock(&kinfo->arg_lock);
+}
+
+
+void kernel_launch_plan_delete(kernel_launch_plan *plan)
+{
+    if(plan == NULL)
+        return;
+    if (plan->dupe)
+        free(plan->dupe);
+    if (plan->arg_kind)
+        free(plan->arg_kind);
+    if (plan->written)
+        free(plan->written);
+    if (plan->svm_ptrs)
+        free(plan->svm_ptrs);
+    if (plan->buffer_ptrs)
+        free(plan->buffer_ptrs);
+    if (plan->image_ptrs)
+        free(plan->image_ptrs);
+    free(plan);
+}
+
+
+template <typename T>
+static bool plan_copy_array(T **to, const T *from, uint32_t n)
+{
+    *to = NULL;
+    if (from == NULL || n == 0)
+        return true;
+    *to = (T*)malloc(sizeof(T) * n);
+    if (*to == NULL)
+        return false;
+    memcpy(*to, from, sizeof(T) * n);
+    return true;
+}
+
+kernel_launch_plan* kernel_launch_plan_copy(const kernel_launch_plan *plan)
+{
+    kernel_launch_plan *copy = (kernel_launch_plan*)malloc(sizeof(kernel_launch_plan));
+    if (copy == NULL)
+        return NULL;
+    *copy = *plan;
+    bool ok = plan_copy_array(&copy->dupe, plan->dupe, plan->nargs);
+    ok = plan_copy_array(&copy->arg_kind, plan->arg_kind, plan->nargs) && ok;
+    ok = plan_copy_array(&copy->written, plan->written, plan->nargs) && ok;
+    ok = plan_copy_array(&copy->buffer_ptrs, plan->buffer_ptrs, plan->num_buffs) && ok;
+    ok = plan_copy_array(&copy->image_ptrs, plan->image_ptrs, plan->num_imgs) && ok;
+    ok = plan_copy_array(&copy->svm_ptrs, plan->svm_ptrs, plan->num_svm) && ok;
+    if (!ok)
+    {
+        kernel_launch_plan_delete(copy);
+        return NULL;
+    }
+    return copy;
+}
+
 
 std::map<cl_kernel, kernel_info*> global_kernels_list;
 pthread_mutex_t kernel_info_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -61,6 +219,110 @@ void* get_kern_list( void )
     return &global_kernels_list;
 }
 
+kernel_info* kinfo_create(cl_kernel handle, uint32_t num_args)
+{
+    kernel_info *item = (kernel_info*)calloc(sizeof(kernel_info), 1);
+    if (item == NULL)
+        return NULL;
+    if (num_args > 0)
+    {
+        item->args = (kernel_arg*)calloc(sizeof(kernel_arg), num_args);
+        if (item->args == NULL)
+        {
+            free(item);
+            return NULL;
+        }
+    }
+    for (uint32_t i = 0; i < num_args; i++)
+        item->args[i].handle = i;
+    item->handle = handle;
+    item->num_args = num_args;
+    pthread_mutex_init(&item->arg_lock, NULL);
+    return item;
+}
+
+kernel_info* kinfo_clone(kernel_info *from, cl_kernel handle)
+{
+    kernel_info *item = kinfo_create(handle, from->num_args);
+    if (item == NULL)
+        return NULL;
+    item->ref_count = 1;
+    item->plan_dirty = 1;
+
+    bool ok = true;
+    pthread_mutex_lock(&from->arg_lock);
+    for (uint32_t i = 0; i < from->num_args; i++)
+    {
+        kernel_arg *src = &from->args[i];
+        kernel_arg *dst = &item->args[i];
+        dst->read_only = src->read_only;
+        if (!src->is_set)
+            continue;
+        if (src->value != NULL)
+        {
+            if (src->size <= KARG_INLINE_VALUE_SIZE)
+                dst->value = dst->inline_value.bytes;
+            else
+                dst->value = malloc(src->size);
+            if (dst->value == NULL)
+            {
+                ok = false;
+                break;
+            }
+            memcpy(dst->value, src->value, src->size);
+        }
+        dst->size = src->size;
+        dst->buffer = src->buffer;
+        dst->svm_buffer = src->svm_buffer;
+        dst->is_set = 1;
+    }
+    if (ok && from->num_exec_svm_ptrs > 0)
+    {
+        item->exec_svm_ptrs = (void**)malloc(sizeof(void*) * from->num_exec_svm_ptrs);
+        if (item->exec_svm_ptrs == NULL)
+            ok = false;
+        else
+        {
+            memcpy(item->exec_svm_ptrs, from->exec_svm_ptrs,
+                    sizeof(void*) * from->num_exec_svm_ptrs);
+            item->num_exec_svm_ptrs = from->num_exec_svm_ptrs;
+        }
+    }
+    item->svm_fine_grain_system = from->svm_fine_grain_system;
+    // The arguments were just copied, so an up to date plan still fits them.
+    if (ok && from->launch_plan != NULL && !from->plan_dirty)
+    {
+        item->launch_plan = kernel_launch_plan_copy(from->launch_plan);
+        item->plan_dirty = (item->launch_plan == NULL);
+    }
+    if (ok && from->name != NULL)
+    {
+        item->program = from->program;
+        item->name = strdup(from->name);
+        if (item->name == NULL)
+            ok = false;
+    }
+    pthread_mutex_unlock(&from->arg_lock);
+
+    if (!ok)
+    {
+        kinfo_delete(item);
+        return NULL;
+    }
+    return item;
+}
+
+void kinfo_snapshot_retain(kernel_info *snapshot)
+{
+    __sync_add_and_fetch(&snapshot->ref_count, 1);
+}
+
+void kinfo_snapshot_release(kernel_info *snapshot)
+{
+    if (__sync_sub_and_fetch(&snapshot->ref_count, 1) == 0)
+        kinfo_delete(snapshot);
+}
+
 int kinfo_insert(void* map_v, kernel_info *item)
 {
     return map_insert<cl_kernel, kernel_info*>(map_v, item, &kernel_info_lock);
@@ -80,17 +342,144 @@ int kinfo_delete(kernel_info *item)
 {
     if(item == NULL)
         return L_SUCCESS;
-    kernel_arg *lp = item->arg_list;
 
-    while(lp)
-    {
-        kernel_arg *temp = lp;
-        lp = lp->next;
-        karg_delete(temp);
-        temp = NULL;
-    }
+    for (uint32_t i = 0; i < item->num_args; i++)
+        karg_free_value(&item->args[i]);
+    if (item->args)
+        free(item->args);
+    pthread_mutex_destroy(&item->arg_lock);
 
+    kernel_launch_plan_delete(item->launch_plan);
+    if (item->name)
+        free(item->name);
+    if (item->exec_svm_ptrs)
+        free(item->exec_svm_ptrs);
     free(item);
 
     return L_SUCCESS;
 }
+
+
+typedef std::pair<cl_program, std::string> kernel_pool_key;
+std::map<kernel_pool_key, std::vector<cl_kernel> > global_kernel_pool;
+// Number of the application's kernels of each function that may need clones.
+std::map<kernel_pool_key, uint32_t> global_kernel_pool_users;
+kernel_pool_stats global_kernel_pool_stats;
+pthread_mutex_t kernel_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+cl_kernel kpool_checkout(cl_program program, const char *name)
+{
+    if (name == NULL)
+        return NULL;
+
+    cl_kernel ret = NULL;
+    pthread_mutex_lock(&kernel_pool_lock);
+    std::map<kernel_pool_key, std::vector<cl_kernel> >::iterator it =
+        global_kernel_pool.find(kernel_pool_key(program, name));
+    if (it != global_kernel_pool.end())
+    {
+        std::vector<cl_kernel> &idle = it->second;
+        for (size_t i = 0; i < idle.size(); i++)
+        {
+            // A pending checker callback holds an extra reference to the
+            // kernel whose arguments it reports on. Leave those alone.
+            kernel_info *kinfo = kinfo_find(&global_kernels_list, idle[i]);
+            if (kinfo != NULL && kinfo->ref_count > 1)
+                continue;
+            ret = idle[i];
+            idle.erase(idle.begin() + i);
+            break;
+        }
+    }
+
+    if (ret != NULL)
+    {
+        global_kernel_pool_stats.hits++;
+        global_kernel_pool_stats.idle--;
+    }
+    else
+        global_kernel_pool_stats.misses++;
+    global_kernel_pool_stats.in_use++;
+    if (global_kernel_pool_stats.in_use > global_kernel_pool_stats.high_in_use)
+        global_kernel_pool_stats.high_in_use = global_kernel_pool_stats.in_use;
+    pthread_mutex_unlock(&kernel_pool_lock);
+    return ret;
+}
+
+int kpool_return(cl_program program, const char *name, cl_kernel kernel)
+{
+    if (name == NULL || kernel == NULL)
+        return L_FAIL;
+
+    int ret = L_SUCCESS;
+    kernel_pool_key key(program, name);
+    pthread_mutex_lock(&kernel_pool_lock);
+    // Once every kernel of this function is gone, nothing will check the
+    // clone out again, so it is not worth keeping.
+    if (global_kernel_pool_users.count(key))
+    {
+        global_kernel_pool[key].push_back(kernel);
+        global_kernel_pool_stats.idle++;
+    }
+    else
+        ret = L_FAIL;
+    if (global_kernel_pool_stats.in_use > 0)
+        global_kernel_pool_stats.in_use--;
+    pthread_mutex_unlock(&kernel_pool_lock);
+    return ret;
+}
+
+void kpool_add_user(cl_program program, const char *name)
+{
+    if (name == NULL)
+        return;
+    pthread_mutex_lock(&kernel_pool_lock);
+    global_kernel_pool_users[kernel_pool_key(program, name)]++;
+    pthread_mutex_unlock(&kernel_pool_lock);
+}
+
+int kpool_remove_user(cl_program program, const char *name)
+{
+    if (name == NULL)
+        return 0;
+
+    int last = 0;
+    pthread_mutex_lock(&kernel_pool_lock);
+    std::map<kernel_pool_key, uint32_t>::iterator it =
+        global_kernel_pool_users.find(kernel_pool_key(program, name));
+    if (it != global_kernel_pool_users.end() && --it->second == 0)
+    {
+        global_kernel_pool_users.erase(it);
+        last = 1;
+    }
+    pthread_mutex_unlock(&kernel_pool_lock);
+    return last;
+}
+
+cl_kernel kpool_drain(cl_program program, const char *name)
+{
+    if (name == NULL)
+        return NULL;
+
+    cl_kernel ret = NULL;
+    pthread_mutex_lock(&kernel_pool_lock);
+    std::map<kernel_pool_key, std::vector<cl_kernel> >::iterator it =
+        global_kernel_pool.find(kernel_pool_key(program, name));
+    if (it != global_kernel_pool.end())
+    {
+        ret = it->second.back();
+        it->second.pop_back();
+        if (it->second.empty())
+            global_kernel_pool.erase(it);
+        global_kernel_pool_stats.idle--;
+    }
+    pthread_mutex_unlock(&kernel_pool_lock);
+    return ret;
+}
+
+void kpool_get_stats(kernel_pool_stats *stats)
+{
+    pthread_mutex_lock(&kernel_pool_lock);
+    *stats = global_kernel_pool_stats;
+    pthread_mutex_unlock(&kernel_pool_lock);
+}
@@ -21,93 +21,216 @@
  ********************************************************************************/
 
 #include <map>
+#include <tuple>
+#include <vector>
 #include <unordered_map>
+#include <pthread.h>
 #include "generic_lists.hpp"
 #include "meta_data_lists/cl_workaround_lists.h"
+#include "detector_defines.h"
+
+svm_pool_stats global_svm_pool_stats;
+pthread_mutex_t svm_pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
 #ifdef CL_VERSION_2_0
 /******************************************************************************
- * Fine-grained SVM allocation caches
+ * SVM allocation pool
  *****************************************************************************/
 typedef struct {
     void * base;
     cl_svm_mem_flags flags;
     size_t size;
-    unsigned int alignment;
-} fg_svm_region;
+} svm_region;
+
+// Free regions are bucketed on (flags, size class, alignment class), where the
+// size class is the power of two the size rounds up to and the alignment class
+// is that of the lowest set bit of the base address.
+typedef std::tuple<cl_svm_mem_flags, unsigned, unsigned> svm_bucket_key;
+
+typedef struct {
+    // Keyed based on the pointer, for allocs and frees
+    std::map<uint64_t, svm_region> allocated;
+    // Regions that are waiting for reuse, most recently freed at the back
+    std::map<svm_bucket_key, std::vector<svm_region> > free;
+    size_t pooled_bytes;
+    int trimming;
+} svm_context_pool;
+
+// SVM allocations come from a particular context.
+std::map<cl_context, svm_context_pool> global_svm_pools;
+
+static unsigned size_class(size_t size)
+{
+    unsigned c = 0;
+    while (c < 63 && ((size_t)1 << c) < size)
+        c++;
+    return c;
+}
 
-// All of these are initially keyd on the context, because SVM allocations
-// come from a particular context.
+static unsigned align_class(const void *base)
+{
+    uint64_t addr = (uint64_t)base;
+    if (addr == 0)
+        return 63;
+    return __builtin_ctzll(addr);
+}
 
-// Keyed based on the pointer, for allocs and frees
-std::map< cl_context, std::map<uint64_t, fg_svm_region> > allocated_fg_svms;
-// Keyed based on the available size, holds what "free" SVMs we have
-std::map< cl_context, std::multimap<size_t, fg_svm_region> > free_fg_svms;
+static svm_bucket_key bucket_key(const svm_region &r)
+{
+    return svm_bucket_key(r.flags, size_class(r.size), align_class(r.base));
+}
+
+static void remove_pooled(svm_context_pool &pool, svm_region &r)
+{
+    pool.pooled_bytes -= r.size;
+    global_svm_pool_stats.pooled_bytes -= r.size;
+}
 
-void cl_svm_fg_alloc(cl_context context, void* base, cl_svm_mem_flags flags,
-        size_t size, unsigned int alignment)
+void svm_pool_track(cl_context context, void *base, cl_svm_mem_flags flags,
+        size_t size)
 {
-    fg_svm_region temp;
+    svm_region temp;
     temp.base = base;
     temp.flags = flags;
     temp.size = size;
-    temp.alignment = alignment;
-    std::pair<uint64_t, fg_svm_region> insert_me((uint64_t)(temp.base), temp);
-    (allocated_fg_svms[context]).insert(insert_me);
+    pthread_mutex_lock(&svm_pool_lock);
+    global_svm_pools[context].allocated[(uint64_t)base] = temp;
+    pthread_mutex_unlock(&svm_pool_lock);
 }
 
-int cl_svm_fg_free(cl_context context, void* base)
+void *svm_pool_get(cl_context context, cl_svm_mem_flags flags, size_t size,
+        unsigned int alignment)
 {
-    std::map<cl_context, std::map<uint64_t, fg_svm_region> >::iterator
-        cur_ctx_pair = allocated_fg_svms.find(context);
-    if (cur_ctx_pair == allocated_fg_svms.end())
-        return 1;
+    void *ret = NULL;
 
-    std::map<uint64_t, fg_svm_region> *cur_ctx_fg_svm = &(cur_ctx_pair->second);
-    std::map<uint64_t, fg_svm_region>::iterator result;
-    result = cur_ctx_fg_svm->find((uint64_t)base);
+    // A zero alignment means the size of the largest OpenCL data type.
+    unsigned min_align = size_class(alignment ? alignment : 128);
+    unsigned first = size_class(size);
 
-    if (result != cur_ctx_fg_svm->end())
+    pthread_mutex_lock(&svm_pool_lock);
+    std::map<cl_context, svm_context_pool>::iterator cur_ctx_pair =
+        global_svm_pools.find(context);
+    if (cur_ctx_pair != global_svm_pools.end())
     {
-        fg_svm_region temp = result->second;
-        cur_ctx_fg_svm->erase(result);
-        (free_fg_svms[context]).insert(
-                std::pair<size_t, fg_svm_region>(temp.size, temp));
-        return 0;
+        svm_context_pool &pool = cur_ctx_pair->second;
+        // Regions in the next size class up can still be within
+        // SVM_POOL_MAX_OVERSIZE of the request.
+        for (unsigned c = first; c <= first + 1 && ret == NULL; c++)
+        {
+            std::map<svm_bucket_key, std::vector<svm_region> >::iterator it =
+                pool.free.lower_bound(svm_bucket_key(flags, c, min_align));
+            for (; it != pool.free.end() && ret == NULL; ++it)
+            {
+                if (std::get<0>(it->first) != flags ||
+                        std::get<1>(it->first) != c)
+                    break;
+                std::vector<svm_region> &bucket = it->second;
+                for (size_t i = bucket.size(); i-- > 0; )
+                {
+                    svm_region temp = bucket[i];
+                    if (temp.size < size ||
+                            temp.size / SVM_POOL_MAX_OVERSIZE > size)
+                        continue;
+                    bucket.erase(bucket.begin() + i);
+                    remove_pooled(pool, temp);
+                    pool.allocated[(uint64_t)temp.base] = temp;
+                    ret = temp.base;
+                    break;
+                }
+            }
+        }
     }
-    return 1;
+
+    if (ret != NULL)
+        global_svm_pool_stats.hits++;
+    else
+        global_svm_pool_stats.misses++;
+    pthread_mutex_unlock(&svm_pool_lock);
+    return ret;
 }
 
-void *find_free_svm(cl_context context, size_t size, unsigned int alignment)
+int svm_pool_put(cl_context context, void *base)
 {
-    std::map<cl_context, std::multimap<size_t, fg_svm_region> >::iterator
-        cur_ctx_pair = free_fg_svms.find(context);
-    if (cur_ctx_pair == free_fg_svms.end())
-        return NULL;
-
-    std::multimap<uint64_t, fg_svm_region> *cur_ctx_free_svm;
-    cur_ctx_free_svm = &(cur_ctx_pair->second);
-    std::multimap<uint64_t, fg_svm_region>::iterator result;
-    result = cur_ctx_free_svm->lower_bound(size);
+    int ret = 1;
+    pthread_mutex_lock(&svm_pool_lock);
+    std::map<cl_context, svm_context_pool>::iterator cur_ctx_pair =
+        global_svm_pools.find(context);
+    if (cur_ctx_pair != global_svm_pools.end())
+    {
+        svm_context_pool &pool = cur_ctx_pair->second;
+        std::map<uint64_t, svm_region>::iterator result =
+            pool.allocated.find((uint64_t)base);
+        if (result != pool.allocated.end())
+        {
+            svm_region temp = result->second;
+            pool.allocated.erase(result);
+            pool.free[bucket_key(temp)].push_back(temp);
+            pool.pooled_bytes += temp.size;
+            global_svm_pool_stats.pooled_bytes += temp.size;
+            if (global_svm_pool_stats.pooled_bytes >
+                    global_svm_pool_stats.high_pooled_bytes)
+                global_svm_pool_stats.high_pooled_bytes =
+                    global_svm_pool_stats.pooled_bytes;
+            if (pool.pooled_bytes > SVM_POOL_HIGH_WATER)
+                pool.trimming = 1;
+            ret = 0;
+        }
+    }
+    pthread_mutex_unlock(&svm_pool_lock);
+    return ret;
+}
 
-    while (result != cur_ctx_free_svm->end())
+void *svm_pool_trim(cl_context context, int drain)
+{
+    void *ret = NULL;
+    pthread_mutex_lock(&svm_pool_lock);
+    std::map<cl_context, svm_context_pool>::iterator cur_ctx_pair =
+        global_svm_pools.find(context);
+    if (cur_ctx_pair != global_svm_pools.end())
     {
-        fg_svm_region temp = result->second;
-        if (temp.alignment == alignment)
+        svm_context_pool &pool = cur_ctx_pair->second;
+        if (pool.trimming && pool.pooled_bytes <= SVM_POOL_LOW_WATER)
+            pool.trimming = 0;
+        if (drain || pool.trimming)
         {
-            cur_ctx_free_svm->erase(result);
-            std::pair<uint64_t, fg_svm_region> insert_me(
-                    (uint64_t)(temp.base), temp);
-            (allocated_fg_svms[context]).insert(insert_me);
-            return (void*)(temp.base);
+            // Give back the oldest region of the largest size class first,
+            // so that the pool shrinks with as few frees as possible.
+            std::map<svm_bucket_key, std::vector<svm_region> >::iterator it,
+                largest = pool.free.end();
+            for (it = pool.free.begin(); it != pool.free.end(); ++it)
+            {
+                if (!it->second.empty() && (largest == pool.free.end() ||
+                            std::get<1>(it->first) > std::get<1>(largest->first)))
+                    largest = it;
+            }
+            if (largest != pool.free.end())
+            {
+                svm_region temp = largest->second.front();
+                largest->second.erase(largest->second.begin());
+                if (largest->second.empty())
+                    pool.free.erase(largest);
+                remove_pooled(pool, temp);
+                global_svm_pool_stats.trimmed++;
+                ret = temp.base;
+            }
+            else
+                pool.trimming = 0;
         }
-        else
-            ++result;
+        if (drain && ret == NULL && pool.allocated.empty())
+            global_svm_pools.erase(cur_ctx_pair);
     }
-    return NULL;
+    pthread_mutex_unlock(&svm_pool_lock);
+    return ret;
 }
 #endif // CL_VERSION_2_0
 
+void svm_pool_get_stats(svm_pool_stats *stats)
+{
+    pthread_mutex_lock(&svm_pool_lock);
+    *stats = global_svm_pool_stats;
+    pthread_mutex_unlock(&svm_pool_lock);
+}
+
 
 
 std::unordered_map<cl_context, commandQueueCache*> global_cmd_queue_cache;
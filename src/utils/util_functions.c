@@ -170,6 +170,196 @@ int get_disable_api_check_envvar(void)
     }
 }
 
+int get_async_check_envvar(void)
+{
+    char * async_check_envvar = NULL;
+    if (getenv(__CLARMOR_ASYNC_CHECK__) == NULL)
+        return 0;
+    else
+    {
+        unsigned int ret_val = 0;
+        if (!get_env_util(&async_check_envvar, __CLARMOR_ASYNC_CHECK__))
+        {
+            if (async_check_envvar != NULL)
+            {
+                ret_val = strtoul(async_check_envvar, NULL, 0);
+                free(async_check_envvar);
+            }
+        }
+
+        return ret_val;
+    }
+}
+
+int get_deferred_check_envvar(void)
+{
+    char * deferred_check_envvar = NULL;
+    if (getenv(__CLARMOR_DEFERRED_CHECK__) == NULL)
+        return 0;
+    else
+    {
+        unsigned int ret_val = 0;
+        if (!get_env_util(&deferred_check_envvar, __CLARMOR_DEFERRED_CHECK__))
+        {
+            if (deferred_check_envvar != NULL)
+            {
+                ret_val = strtoul(deferred_check_envvar, NULL, 0);
+                free(deferred_check_envvar);
+            }
+        }
+
+        return ret_val;
+    }
+}
+
+int get_overhead_target_envvar(void)
+{
+    char * overhead_target_envvar = NULL;
+    if (getenv(__CLARMOR_OVERHEAD_TARGET__) == NULL)
+        return 0;
+    else
+    {
+        unsigned int ret_val = 0;
+        if (!get_env_util(&overhead_target_envvar, __CLARMOR_OVERHEAD_TARGET__))
+        {
+            if (overhead_target_envvar != NULL)
+            {
+                ret_val = strtoul(overhead_target_envvar, NULL, 0);
+                free(overhead_target_envvar);
+            }
+        }
+
+        return ret_val;
+    }
+}
+
+int get_check_read_only_envvar(void)
+{
+    char * check_read_only_envvar = NULL;
+    if (getenv(__CLARMOR_CHECK_READ_ONLY__) == NULL)
+        return 0;
+    else
+    {
+        unsigned int ret_val = 0;
+        if (!get_env_util(&check_read_only_envvar, __CLARMOR_CHECK_READ_ONLY__))
+        {
+            if (check_read_only_envvar != NULL)
+            {
+                ret_val = strtoul(check_read_only_envvar, NULL, 0);
+                free(check_read_only_envvar);
+            }
+        }
+
+        return ret_val;
+    }
+}
+
+int get_preserve_flags_envvar(void)
+{
+    char * preserve_flags_envvar = NULL;
+    if (getenv(__CLARMOR_PRESERVE_FLAGS__) == NULL)
+        return 0;
+    else
+    {
+        unsigned int ret_val = 0;
+        if (!get_env_util(&preserve_flags_envvar, __CLARMOR_PRESERVE_FLAGS__))
+        {
+            if (preserve_flags_envvar != NULL)
+            {
+                ret_val = strtoul(preserve_flags_envvar, NULL, 0);
+                free(preserve_flags_envvar);
+            }
+        }
+
+        return ret_val;
+    }
+}
+
+int get_site_feedback_envvar(void)
+{
+    char * site_feedback_envvar = NULL;
+    if (getenv(__CLARMOR_SITE_FEEDBACK__) == NULL)
+        return 0;
+    else
+    {
+        unsigned int ret_val = 0;
+        if (!get_env_util(&site_feedback_envvar, __CLARMOR_SITE_FEEDBACK__))
+        {
+            if (site_feedback_envvar != NULL)
+            {
+                ret_val = strtoul(site_feedback_envvar, NULL, 0);
+                free(site_feedback_envvar);
+            }
+        }
+
+        return ret_val;
+    }
+}
+
+int get_slab_alloc_envvar(void)
+{
+    char * slab_alloc_envvar = NULL;
+    if (getenv(__CLARMOR_SLAB_ALLOC__) == NULL)
+        return 0;
+    else
+    {
+        unsigned int ret_val = 0;
+        if (!get_env_util(&slab_alloc_envvar, __CLARMOR_SLAB_ALLOC__))
+        {
+            if (slab_alloc_envvar != NULL)
+            {
+                ret_val = strtoul(slab_alloc_envvar, NULL, 0);
+                free(slab_alloc_envvar);
+            }
+        }
+
+        return ret_val;
+    }
+}
+
+int get_svm_backed_envvar(void)
+{
+    char * svm_backed_envvar = NULL;
+    if (getenv(__CLARMOR_SVM_BACKED__) == NULL)
+        return 0;
+    else
+    {
+        unsigned int ret_val = 0;
+        if (!get_env_util(&svm_backed_envvar, __CLARMOR_SVM_BACKED__))
+        {
+            if (svm_backed_envvar != NULL)
+            {
+                ret_val = strtoul(svm_backed_envvar, NULL, 0);
+                free(svm_backed_envvar);
+            }
+        }
+
+        return ret_val;
+    }
+}
+
+char* get_checker_cache_envvar(void)
+{
+    char * checker_cache_envvar = NULL;
+    if (getenv(__CLARMOR_CHECKER_CACHE__) != NULL)
+    {
+        if (!get_env_util(&checker_cache_envvar, __CLARMOR_CHECKER_CACHE__))
+            return checker_cache_envvar;
+    }
+    return NULL;
+}
+
+char* get_canary_policy_envvar(void)
+{
+    char * canary_policy_envvar = NULL;
+    if (getenv(__CLARMOR_CANARY_POLICY__) != NULL)
+    {
+        if (!get_env_util(&canary_policy_envvar, __CLARMOR_CANARY_POLICY__))
+            return canary_policy_envvar;
+    }
+    return NULL;
+}
+
 int get_tool_perf_envvar(void)
 {
     char * perf_envvar = NULL;
@@ -493,6 +683,52 @@ int is_nvidia_platform(cl_context context)
     return ret;
 }
 
+int platform_supports_cl_version(cl_context context, int major, int minor)
+{
+    cl_int cl_err;
+    size_t size_dev;
+    cl_device_id *device;
+    cl_platform_id platform;
+    size_t platform_version_len = 0;
+    char *platform_version;
+
+    cl_err = clGetContextInfo(context, CL_CONTEXT_DEVICES,
+        0, NULL, &size_dev);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    device = malloc(size_dev);
+
+    cl_err = clGetContextInfo(context, CL_CONTEXT_DEVICES,
+        size_dev, device, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_err = clGetDeviceInfo(device[0], CL_DEVICE_PLATFORM,
+        sizeof(cl_platform_id), &platform, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_err = clGetPlatformInfo(platform, CL_PLATFORM_VERSION, 0, NULL,
+            &platform_version_len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    platform_version = calloc(platform_version_len, sizeof(char));
+
+    cl_err = clGetPlatformInfo(platform, CL_PLATFORM_VERSION,
+        platform_version_len, platform_version, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    // Version string looks like "OpenCL <major>.<minor> <vendor info>"
+    int plat_major = 0, plat_minor = 0;
+    int ret = 0;
+    if (sscanf(platform_version, "OpenCL %d.%d", &plat_major, &plat_minor) == 2)
+    {
+        ret = (plat_major > major ||
+                (plat_major == major && plat_minor >= minor)) ? 1 : 0;
+    }
+    free(platform_version);
+    free(device);
+
+    return ret;
+}
+
 int opencl_broken_images(void)
 {
     char * broken_images_envvar = NULL;
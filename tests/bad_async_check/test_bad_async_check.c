@@ -0,0 +1,94 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found when launches are checked on
+// a background thread. Right after the overflowing launch, the kernel is
+// given another buffer and launched again, and the overflowed buffer is
+// released, all before the check can have run.
+#include "common_test_functions.h"
+
+#define NUM_LAUNCHES 8
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = i;\n"\
+"    }\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Background checks with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Bad async_check Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    size_t work_items_to_use = buffer_size / sizeof(cl_uint);
+    cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint), &buffer_size);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    for (int i = 0; i < NUM_LAUNCHES; i++)
+    {
+        // This will create a buffer overflow in one launch, because of the
+        // "buffer_size-10" below
+        uint64_t size = (i == NUM_LAUNCHES / 2) ? buffer_size-10 : buffer_size;
+        cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            size,  NULL, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &buffer);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+            &work_items_to_use, NULL, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        // The check of this launch may still be waiting to run, and must
+        // not be disturbed by the buffer going away.
+        clReleaseMemObject(buffer);
+    }
+
+    clFinish(cmd_queue);
+    printf("Done Running Bad async_check Test.\n");
+    return 0;
+}
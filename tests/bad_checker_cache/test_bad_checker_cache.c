@@ -0,0 +1,107 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found when the detector keeps its
+// compiled checkers in a cache on disk. The test runs in two contexts one
+// after the other. The first context builds the checkers and saves them,
+// and the second loads them from the cache. One launch in each context
+// overflows.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *in, __global uint *out, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        out[i] = in[i] + i;\n"\
+"    }\n"\
+"}\n";
+
+// Create a new context, launch the kernel in it and tear it down. If
+// overflow is set, the output buffer is too small for the kernel.
+static void run_in_new_context(cl_platform_id platform, cl_device_id device,
+        uint64_t buffer_size, int overflow)
+{
+    cl_int cl_err;
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    cl_mem in_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY,
+            buffer_size, NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    // This will create a buffer overflow when asked to, because of the
+    // "buffer_size-10" below
+    uint64_t out_size = overflow ? buffer_size-10 : buffer_size;
+    cl_mem out_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
+            out_size, NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_uint len = buffer_size / sizeof(cl_uint);
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &in_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_mem), &out_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 2, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clFinish(cmd_queue);
+
+    clReleaseMemObject(out_buffer);
+    clReleaseMemObject(in_buffer);
+    clReleaseKernel(test_kernel);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(cmd_queue);
+    clReleaseContext(context);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Cached checkers with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+
+    // Run the actual test.
+    printf("\n\nRunning Bad checker_cache Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    run_in_new_context(platform, device, buffer_size, 1);
+    run_in_new_context(platform, device, buffer_size, 1);
+
+    printf("Done Running Bad checker_cache Test.\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found in a CL_MEM_USE_HOST_PTR
+// buffer when its launches are chained with events. The first launch waits
+// on a user event that is only set after both launches are enqueued, so the
+// launches must not block. The second launch overflows the buffer.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = cl_mem_buffer[i] * 2 + 1;\n"\
+"    }\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Event-chained host pointer launches with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Bad host_ptr_events Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    // The host memory is larger than the buffer, so that writing past the
+    // end of the buffer stays in memory this program owns.
+    cl_uint *host_ptr = calloc(buffer_size + 64, 1);
+    if (host_ptr == NULL)
+    {
+        fprintf(stderr, "calloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    // This will create a buffer overflow because of the "buffer_size-10" below
+    cl_mem buffer = clCreateBuffer(context,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, (buffer_size-10), host_ptr,
+        &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_uint lens[2] = {(buffer_size-10) / sizeof(cl_uint),
+        buffer_size / sizeof(cl_uint)};
+    size_t work_items_to_use = buffer_size / sizeof(cl_uint);
+
+    cl_event start_event = clCreateUserEvent(context, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_event launch_events[2];
+
+    for (int i = 0; i < 2; i++)
+    {
+        // The first launch waits on the user event, the second on the first.
+        cl_event wait_event = (i == 0) ? start_event : launch_events[0];
+        cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &buffer);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint), &lens[i]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        printf("Launch %d writes %u entries.\n", i, lens[i]);
+        cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+            &work_items_to_use, NULL, 1, &wait_event, &launch_events[i]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+
+    // Nothing can have run yet, so launching must not have waited for the
+    // kernels to finish.
+    printf("Both launches enqueued, releasing the user event.\n");
+    cl_err = clSetUserEventStatus(start_event, CL_COMPLETE);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clWaitForEvents(1, &launch_events[1]);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    clFinish(cmd_queue);
+    clReleaseEvent(launch_events[0]);
+    clReleaseEvent(launch_events[1]);
+    clReleaseEvent(start_event);
+    clReleaseMemObject(buffer);
+    free(host_ptr);
+    printf("Done Running Bad host_ptr_events Test.\n");
+    return 0;
+}
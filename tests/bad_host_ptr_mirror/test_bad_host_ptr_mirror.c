@@ -0,0 +1,144 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found in buffers that the detector
+// checks through canaried mirrors: a CL_MEM_USE_HOST_PTR buffer and a
+// SubBuffer. The same kernel is launched several times, so the mirrors are
+// kept from one launch to the next. The second launch overflows the host
+// pointer buffer and the third overflows the SubBuffer.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *host_buffer, uint host_len,\n"\
+"        __global uint *sub_buffer, uint sub_len, uint val) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < host_len) {\n"\
+"        host_buffer[i] += 1;\n"\
+"    }\n"\
+"    if (i < sub_len) {\n"\
+"        sub_buffer[i] = i + val;\n"\
+"    }\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+    uint64_t sub_buffer_size = DEFAULT_BUFFER_SIZE / 2;
+
+    // Check input options.
+    check_opts(argc, argv, "Mirrored buffers with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Bad host_ptr_mirror Test...\n");
+    printf("    Using buffer size: %llu and SubBuffer size: %llu\n",
+            (long long unsigned)buffer_size,
+            (long long unsigned)sub_buffer_size);
+
+    // The host memory is larger than the buffer, so that writing past the
+    // end of the buffer stays in memory this program owns.
+    cl_uint *host_ptr = calloc(buffer_size + 64, 1);
+    cl_uint *pattern = malloc(buffer_size);
+    if (host_ptr == NULL || pattern == NULL)
+    {
+        fprintf(stderr, "Allocation near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    // This will create a buffer overflow because of the "buffer_size-10" below
+    cl_mem host_buffer = clCreateBuffer(context,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, (buffer_size-10), host_ptr,
+        &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_buffer_region buff_reg;
+    buff_reg.origin = 0;
+    // The SubBuffer is short by 10 bytes as well.
+    buff_reg.size = sub_buffer_size-10;
+    cl_mem parent_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        buffer_size,  NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem sub_buffer = clCreateSubBuffer(parent_buffer, CL_MEM_READ_WRITE,
+        CL_BUFFER_CREATE_TYPE_REGION, &buff_reg, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_uint host_entries = buffer_size / sizeof(cl_uint);
+    cl_uint sub_entries = sub_buffer_size / sizeof(cl_uint);
+    size_t work_items_to_use = host_entries;
+
+    cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &host_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 2, sizeof(cl_mem), &sub_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    for (cl_uint iter = 0; iter < 3; iter++)
+    {
+        // The host changes the buffer between launches, which the mirror
+        // has to pick up.
+        for (cl_uint i = 0; i < host_entries; i++)
+            pattern[i] = i + iter;
+        cl_err = clEnqueueWriteBuffer(cmd_queue, host_buffer, CL_TRUE, 0,
+                buffer_size-10, pattern, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        cl_uint host_len = (iter == 1) ? host_entries :
+            (buffer_size-10) / sizeof(cl_uint);
+        cl_uint sub_len = (iter == 2) ? sub_entries :
+            (sub_buffer_size-10) / sizeof(cl_uint);
+        cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint), &host_len);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 3, sizeof(cl_uint), &sub_len);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 4, sizeof(cl_uint), &iter);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        printf("Launch %u writes %u and %u entries.\n", iter, host_len,
+                sub_len);
+        cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+            &work_items_to_use, NULL, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+
+    clFinish(cmd_queue);
+    clReleaseMemObject(sub_buffer);
+    clReleaseMemObject(parent_buffer);
+    clReleaseMemObject(host_buffer);
+    free(pattern);
+    free(host_ptr);
+    printf("Done Running Bad host_ptr_mirror Test.\n");
+    return 0;
+}
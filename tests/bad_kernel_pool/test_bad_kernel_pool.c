@@ -0,0 +1,124 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found in kernels that the detector
+// has to clone to check, when the clones are reused between launches. The
+// buffer is created with CL_MEM_USE_HOST_PTR, so it has no canary of its own.
+// The last launch, from a kernel created after another was released,
+// overflows it.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len, uint val) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = i + val;\n"\
+"    }\n"\
+"}\n";
+
+static void launch(cl_command_queue cmd_queue, cl_kernel kernel,
+        cl_mem buffer, cl_uint len, cl_uint val)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = len;
+
+    cl_err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 2, sizeof(cl_uint), &val);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+}
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Pooled kernel clones with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and two kernels of the same function, which share
+    // one pool of clones.
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel first_kernel = setup_kernel(program, "test");
+    cl_kernel second_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Bad kernel_pool Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    // The host memory is larger than the buffer, so that writing past the
+    // end of the buffer stays in memory this program owns.
+    cl_uint *host_ptr = calloc(buffer_size + 64, 1);
+    if (host_ptr == NULL)
+    {
+        fprintf(stderr, "calloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    // This will create a buffer overflow because of the "buffer_size-10" below
+    cl_mem buffer = clCreateBuffer(context,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, (buffer_size-10), host_ptr,
+        &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_uint good_len = (buffer_size-10) / sizeof(cl_uint);
+    cl_uint bad_len = buffer_size / sizeof(cl_uint);
+
+    // Interleave launches of both kernels so that each returns its clone
+    // to the pool and takes one back out.
+    for (cl_uint i = 0; i < 4; i++)
+        launch(cmd_queue, (i % 2) ? second_kernel : first_kernel, buffer,
+                good_len, i);
+    clFinish(cmd_queue);
+
+    // Releasing a kernel must leave the pool usable by the others.
+    clReleaseKernel(first_kernel);
+    cl_kernel third_kernel = setup_kernel(program, "test");
+    launch(cmd_queue, second_kernel, buffer, good_len, 4);
+
+    printf("Launching %u work items to write %u entries into a buffer of "
+            "%u entries.\n", bad_len, bad_len, good_len);
+    launch(cmd_queue, third_kernel, buffer, bad_len, 5);
+
+    clFinish(cmd_queue);
+    clReleaseKernel(second_kernel);
+    clReleaseKernel(third_kernel);
+    clReleaseMemObject(buffer);
+    free(host_ptr);
+    printf("Done Running Bad kernel_pool Test.\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that an overflow is found in a buffer so close to the
+// largest allocation the device allows that full canaries do not fit around
+// it. The detector must shorten its canaries rather than fail the
+// allocation, and the kernel writes one entry past the end of the buffer.
+#include "common_test_functions.h"
+
+// How far below the device's largest allocation the buffer is.
+#define ROOM_LEFT 64
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, ulong start, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[start + i] = i;\n"\
+"    }\n"\
+"}\n";
+
+// The device may not really have this much memory free, which is not what
+// this test is about.
+static void skip_if_out_of_memory(cl_int cl_err)
+{
+    if (cl_err == CL_MEM_OBJECT_ALLOCATION_FAILURE ||
+            cl_err == CL_OUT_OF_RESOURCES)
+    {
+        output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+        printf("Could not make the largest buffer. Skipping Bad max_alloc Test.\n");
+        exit(0);
+    }
+    check_cl_error(__FILE__, __LINE__, cl_err);
+}
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+
+    // Check input options.
+    check_opts(argc, argv, "Largest buffer with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    cl_ulong max_alloc;
+    cl_err = clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+            sizeof(cl_ulong), &max_alloc, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_ulong buffer_size = (max_alloc - ROOM_LEFT) &
+        ~(cl_ulong)(sizeof(cl_uint) - 1);
+
+    // Run the actual test.
+    printf("\n\nRunning Bad max_alloc Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, buffer_size,
+        NULL, &cl_err);
+    skip_if_out_of_memory(cl_err);
+
+    // Only the last few entries are written.
+    cl_ulong start = buffer_size / sizeof(cl_uint) - 4;
+    // This will create a buffer overflow because of the "+ 1" below
+    cl_uint len = 4 + 1;
+    cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_ulong), &start);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 2, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    size_t work_items_to_use = len;
+    printf("Writing %u entries from entry %llu.\n", len,
+            (long long unsigned)start);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    skip_if_out_of_memory(cl_err);
+
+    clFinish(cmd_queue);
+    clReleaseMemObject(buffer);
+    printf("Done Running Bad max_alloc Test.\n");
+    return 0;
+}
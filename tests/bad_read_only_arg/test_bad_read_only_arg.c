@@ -0,0 +1,113 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are still found in the written buffers
+// of a kernel whose other buffers are read-only. The input is a const
+// CL_MEM_USE_HOST_PTR buffer, and the output buffer is too small.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global const uint *input, __constant uint *scale,\n"\
+"        __global uint *output, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        output[i] = input[i % (len / 2)] * scale[0];\n"\
+"    }\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Read-only kernel arguments with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Bad read_only_arg Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    // The input holds half as many entries as the output.
+    cl_uint len = buffer_size / sizeof(cl_uint);
+    cl_uint *input_ptr = malloc(buffer_size / 2);
+    if (input_ptr == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    for (cl_uint i = 0; i < len / 2; i++)
+        input_ptr[i] = i;
+    cl_uint scale = 3;
+
+    cl_mem input = clCreateBuffer(context,
+        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, buffer_size / 2, input_ptr,
+        &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem scale_buffer = clCreateBuffer(context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint), &scale,
+        &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    // This will create a buffer overflow because of the "buffer_size-10" below
+    cl_mem output = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
+        (buffer_size-10),  NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &input);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_mem), &scale_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 2, sizeof(cl_mem), &output);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 3, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    size_t work_items_to_use = len;
+    printf("Launching %zu work items to write %u entries.\n",
+            work_items_to_use, len);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    clFinish(cmd_queue);
+    clReleaseMemObject(output);
+    clReleaseMemObject(scale_buffer);
+    clReleaseMemObject(input);
+    free(input_ptr);
+    printf("Done Running Bad read_only_arg Test.\n");
+    return 0;
+}
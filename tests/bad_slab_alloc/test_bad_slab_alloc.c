@@ -0,0 +1,103 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found in small buffers that the
+// detector packs into slabs, where neighbouring buffers share a canary.
+// Every buffer is filled, then one of them is overflowed by one entry.
+#include "common_test_functions.h"
+
+#define NUM_BUFFERS 16
+#define SMALL_BUFFER_SIZE 1000
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len, uint val) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = val;\n"\
+"    }\n"\
+"}\n";
+
+static void fill(cl_command_queue cmd_queue, cl_kernel kernel, cl_mem buffer,
+        cl_uint len, cl_uint val)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 2, sizeof(cl_uint), &val);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+}
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+
+    // Check input options.
+    check_opts(argc, argv, "Slab-allocated buffers with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Bad slab_alloc Test...\n");
+    printf("    Using %d buffers of size: %d\n", NUM_BUFFERS, SMALL_BUFFER_SIZE);
+
+    cl_mem buffers[NUM_BUFFERS];
+    cl_uint len = SMALL_BUFFER_SIZE / sizeof(cl_uint);
+    for (cl_uint b = 0; b < NUM_BUFFERS; b++)
+    {
+        buffers[b] = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            SMALL_BUFFER_SIZE,  NULL, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        fill(cmd_queue, test_kernel, buffers[b], len, b);
+    }
+    clFinish(cmd_queue);
+
+    // Write one entry into the canary this buffer shares with the next.
+    printf("Writing %u entries into buffer %d.\n", len + 1, NUM_BUFFERS / 2);
+    fill(cmd_queue, test_kernel, buffers[NUM_BUFFERS / 2], len + 1,
+            NUM_BUFFERS / 2);
+    clFinish(cmd_queue);
+
+    for (int b = 0; b < NUM_BUFFERS; b++)
+        clReleaseMemObject(buffers[b]);
+    printf("Done Running Bad slab_alloc Test.\n");
+    return 0;
+}
@@ -0,0 +1,120 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found in SVM that a kernel uses
+// right after it is allocated, while its canaries may still be being filled
+// in. Several allocations are each launched on at once, and one of them is
+// overflowed.
+#include "common_test_functions.h"
+
+#define NUM_ALLOCS 8
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *svm_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        svm_buffer[i] += i;\n"\
+"    }\n"\
+"}\n";
+
+#ifdef CL_VERSION_2_0
+static void launch(cl_command_queue cmd_queue, cl_kernel kernel, void *svm,
+        cl_uint len)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArgSVMPointer(kernel, 0, svm);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+}
+#endif // CL_VERSION_2_0
+
+int main(int argc, char** argv)
+{
+#ifdef CL_VERSION_2_0
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE / NUM_ALLOCS;
+
+    // Check input options.
+    check_opts(argc, argv, "Newly allocated SVM with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+
+    if(!device_supports_svm(device, 0))
+    {
+        output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+        printf("Coarse-grained SVM not supported. Skipping Bad svm_alloc_launch Test.\n");
+        return 0;
+    }
+
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Bad svm_alloc_launch Test...\n");
+    printf("    Using %d allocations of size: %llu\n", NUM_ALLOCS,
+            (long long unsigned)buffer_size);
+
+    cl_uint len = buffer_size / sizeof(cl_uint);
+    void *allocs[NUM_ALLOCS];
+    for (int a = 0; a < NUM_ALLOCS; a++)
+    {
+        // This will create a buffer overflow in one allocation, because of
+        // the "buffer_size-10" below
+        uint64_t size = (a == NUM_ALLOCS / 2) ? buffer_size-10 : buffer_size;
+        allocs[a] = clSVMAlloc(context, CL_MEM_READ_WRITE, size, 0);
+        if (allocs[a] == NULL)
+        {
+            fprintf(stderr, "clSVMAlloc near %s:%d failed.\n", __FILE__,
+                    __LINE__);
+            exit(-1);
+        }
+        launch(cmd_queue, test_kernel, allocs[a], len);
+    }
+
+    clFinish(cmd_queue);
+    for (int a = 0; a < NUM_ALLOCS; a++)
+        clSVMFree(context, allocs[a]);
+    printf("Done Running Bad svm_alloc_launch Test.\n");
+#else // CL_VERSION_2_0
+    (void)argc;
+    (void)argv;
+    output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+    printf("OpenCL 2.0 not supported. Skipping Bad svm_alloc_launch Test.\n");
+#endif // CL_VERSION_2_0
+    return 0;
+}
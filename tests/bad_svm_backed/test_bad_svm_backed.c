@@ -0,0 +1,129 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found when the detector places
+// cl_mem buffers in SVM and checks their canaries in place. A kernel is
+// given one such buffer and one USE_HOST_PTR buffer, whose canaries are
+// still copied out to be checked. The first launch overflows the normal
+// buffer, and the second launch overflows the USE_HOST_PTR buffer.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *buffer, __global uint *host_buffer,\n"\
+"                   uint buffer_len, uint host_len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < buffer_len) {\n"\
+"        buffer[i] = i;\n"\
+"    }\n"\
+"    if (i < host_len) {\n"\
+"        host_buffer[i] += i;\n"\
+"    }\n"\
+"}\n";
+
+static void launch(cl_command_queue cmd_queue, cl_kernel kernel,
+        cl_mem buffer, cl_mem host_buffer, cl_uint len)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &host_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 2, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 3, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clFinish(cmd_queue);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+    cl_int cl_err;
+
+    // Check input options.
+    check_opts(argc, argv, "SVM-backed buffers with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Bad svm_backed Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    cl_uint len = buffer_size / sizeof(cl_uint);
+
+    // The host memory is larger than the buffers, so that writing past the
+    // end of them does not write past the end of the host memory.
+    cl_uint *host_ptr = calloc(buffer_size + 64, 1);
+    if (host_ptr == NULL)
+    {
+        fprintf(stderr, "calloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // This will create a buffer overflow in the normal buffer, because of
+    // the "buffer_size-10" below
+    cl_mem bad_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            buffer_size-10, NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem good_host_buffer = clCreateBuffer(context,
+            CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, buffer_size, host_ptr,
+            &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    launch(cmd_queue, test_kernel, bad_buffer, good_host_buffer, len);
+    clReleaseMemObject(good_host_buffer);
+
+    // This will create a buffer overflow in the USE_HOST_PTR buffer,
+    // because of the "buffer_size-10" below
+    cl_mem good_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            buffer_size, NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem bad_host_buffer = clCreateBuffer(context,
+            CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, buffer_size-10, host_ptr,
+            &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    launch(cmd_queue, test_kernel, good_buffer, bad_host_buffer, len);
+
+    clReleaseMemObject(bad_host_buffer);
+    clReleaseMemObject(good_buffer);
+    clReleaseMemObject(bad_buffer);
+    free(host_ptr);
+    printf("Done Running Bad svm_backed Test.\n");
+    return 0;
+}
@@ -0,0 +1,117 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found in SVM allocations that reuse
+// memory freed by earlier allocations of the same size. The middle round
+// overflows its allocation, and the rounds after it, which may get the same
+// memory back, must not be blamed for it.
+#include "common_test_functions.h"
+
+#define NUM_ROUNDS 5
+#define NUM_SIZES 4
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *svm_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        svm_buffer[i] = i;\n"\
+"    }\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+#ifdef CL_VERSION_2_0
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t sizes[NUM_SIZES] = {1000, 1024, 4000, 65536};
+
+    // Check input options.
+    check_opts(argc, argv, "Reused SVM with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+
+    if(!device_supports_svm(device, 0))
+    {
+        output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+        printf("Coarse-grained SVM not supported. Skipping Bad svm_pool Test.\n");
+        return 0;
+    }
+
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Bad svm_pool Test...\n");
+
+    for (int round = 0; round < NUM_ROUNDS; round++)
+    {
+        void *allocs[NUM_SIZES];
+        for (int s = 0; s < NUM_SIZES; s++)
+        {
+            allocs[s] = clSVMAlloc(context, CL_MEM_READ_WRITE, sizes[s], 0);
+            if (allocs[s] == NULL)
+            {
+                fprintf(stderr, "clSVMAlloc near %s:%d failed.\n", __FILE__,
+                        __LINE__);
+                exit(-1);
+            }
+
+            // Write one entry past the end of the first size in one round.
+            cl_uint len = sizes[s] / sizeof(cl_uint);
+            if (round == NUM_ROUNDS / 2 && s == 0)
+                len++;
+            size_t work_items_to_use = len;
+            cl_err = clSetKernelArgSVMPointer(test_kernel, 0, allocs[s]);
+            check_cl_error(__FILE__, __LINE__, cl_err);
+            cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint), &len);
+            check_cl_error(__FILE__, __LINE__, cl_err);
+            cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+                &work_items_to_use, NULL, 0, NULL, NULL);
+            check_cl_error(__FILE__, __LINE__, cl_err);
+        }
+        clFinish(cmd_queue);
+
+        // Free in a different order than allocated.
+        for (int s = NUM_SIZES - 1; s >= 0; s--)
+            clSVMFree(context, allocs[s]);
+    }
+
+    printf("Done Running Bad svm_pool Test.\n");
+#else // CL_VERSION_2_0
+    (void)argc;
+    (void)argv;
+    output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+    printf("OpenCL 2.0 not supported. Skipping Bad svm_pool Test.\n");
+#endif // CL_VERSION_2_0
+    return 0;
+}
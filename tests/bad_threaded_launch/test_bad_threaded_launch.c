@@ -0,0 +1,157 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that overflows are found in kernels that several
+// threads launch at once. Each thread has its own queue, kernel and buffer,
+// and launches many times. The threads then exit and a new set of threads
+// does the same with the same queues and kernels. One launch of one thread
+// in the second round writes one entry past the end of its buffer.
+#include "common_test_functions.h"
+#include <pthread.h>
+
+#define NUM_THREADS 4
+#define NUM_ROUNDS 2
+#define LAUNCHES_PER_THREAD 10
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len, uint val) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = val;\n"\
+"    }\n"\
+"}\n";
+
+typedef struct thread_args_
+{
+    cl_command_queue cmd_queue;
+    cl_kernel kernel;
+    cl_mem buffer;
+    cl_uint len;
+    cl_uint thread_num;
+    cl_uint round;
+} thread_args;
+
+static void launch(cl_command_queue cmd_queue, cl_kernel kernel,
+        cl_mem buffer, cl_uint len, cl_uint val)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 2, sizeof(cl_uint), &val);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clFinish(cmd_queue);
+}
+
+static void *launch_many(void *in)
+{
+    thread_args *args = (thread_args*)in;
+
+    for (cl_uint l = 0; l < LAUNCHES_PER_THREAD; l++)
+    {
+        // This will create a buffer overflow in one launch of one thread,
+        // because of the "len+1" below
+        int overflow = (args->round == NUM_ROUNDS - 1 &&
+                args->thread_num == NUM_THREADS / 2 &&
+                l == LAUNCHES_PER_THREAD / 2);
+        cl_uint len = overflow ? args->len+1 : args->len;
+        cl_uint val = args->thread_num * LAUNCHES_PER_THREAD + l;
+        launch(args->cmd_queue, args->kernel, args->buffer, len, val);
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE / NUM_THREADS;
+    cl_int cl_err;
+
+    // Check input options.
+    check_opts(argc, argv, "Kernels launched by many threads with Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+
+    // Build the program. Each thread gets its own queue and kernel, since
+    // kernel arguments cannot be set from several threads at once.
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+
+    // Run the actual test.
+    printf("\n\nRunning Bad threaded_launch Test...\n");
+    printf("    Using %d threads launching %d times on buffers of size: "
+            "%llu\n", NUM_THREADS, LAUNCHES_PER_THREAD,
+            (long long unsigned)buffer_size);
+
+    pthread_t threads[NUM_THREADS];
+    thread_args args[NUM_THREADS];
+    for (cl_uint t = 0; t < NUM_THREADS; t++)
+    {
+        args[t].cmd_queue = setup_cmd_queue(context, device);
+        args[t].kernel = setup_kernel(program, "test");
+        args[t].buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            buffer_size, NULL, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        args[t].len = buffer_size / sizeof(cl_uint);
+        args[t].thread_num = t;
+    }
+    for (cl_uint r = 0; r < NUM_ROUNDS; r++)
+    {
+        for (int t = 0; t < NUM_THREADS; t++)
+        {
+            args[t].round = r;
+            if (pthread_create(&threads[t], NULL, launch_many, &args[t]))
+            {
+                fprintf(stderr, "pthread_create near %s:%d failed.\n",
+                        __FILE__, __LINE__);
+                exit(-1);
+            }
+        }
+        for (int t = 0; t < NUM_THREADS; t++)
+            pthread_join(threads[t], NULL);
+    }
+
+    // After the threads have exited, the main thread launches once more
+    // with one of their kernels.
+    launch(args[0].cmd_queue, args[0].kernel, args[0].buffer, args[0].len, 0);
+
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        clReleaseMemObject(args[t].buffer);
+        clReleaseKernel(args[t].kernel);
+        clReleaseCommandQueue(args[t].cmd_queue);
+    }
+    printf("Done Running Bad threaded_launch Test.\n");
+    return 0;
+}
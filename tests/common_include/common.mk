@@ -20,6 +20,7 @@
 
 # BENCH_NAME is the name of the executable for this benchmark
 # EXPECTED_ERRORS is the number of buffer overflows you expect the tool to find
+# DETECT_FLAGS are extra options to run the tool with, e.g. --async_check
 
 include ../../make/master.mk
 
@@ -76,11 +77,11 @@ build_test: $(BENCH_NAME).exe
 
 .PHONY: run_test
 run_test: build_test
-	$(DETECT_SCRIPT) -l -w $(THIS_DIR) -- "$(THIS_DIR)/$(BENCH_NAME).exe"
+	$(DETECT_SCRIPT) $(DETECT_FLAGS) -l -w $(THIS_DIR) -- "$(THIS_DIR)/$(BENCH_NAME).exe"
 
 .PHONY: run_cpu_test
 run_cpu_test: build_test
-	$(DETECT_SCRIPT) -l -w $(THIS_DIR) -- "$(THIS_DIR)/$(BENCH_NAME).exe -t cpu"
+	$(DETECT_SCRIPT) $(DETECT_FLAGS) -l -w $(THIS_DIR) -- "$(THIS_DIR)/$(BENCH_NAME).exe -t cpu"
 
 $(BENCH_NAME).exe: $(UTILS_DIR_COBJECTS) $(UTILS_DIR_CPPOBJECTS) $(TEST_COBJECTS) $(TEST_CPPOBJECTS)
 	$(CC) $^ $(LDFLAGS) -lm -ldl -o $@
@@ -22,6 +22,7 @@
 # Just set "BENCH_NAME" before including this to make a valid test makefile.
 
 # BENCH_NAME is the name of the executable for this benchmark
+# DETECT_FLAGS are extra options to run the tool with, e.g. --async_check
 
 # The number of expected buffer overflow errors should be saved out by the
 # test benchmark into a file called "Errfile" in the benchmark's directory.
@@ -89,11 +90,11 @@ build_test: $(BENCH_NAME).exe
 
 .PHONY: run_test
 run_test: build_test
-	$(DETECT_SCRIPT) -l -w $(THIS_DIR) -- "$(THIS_DIR)/$(BENCH_NAME).exe"
+	$(DETECT_SCRIPT) $(DETECT_FLAGS) -l -w $(THIS_DIR) -- "$(THIS_DIR)/$(BENCH_NAME).exe"
 
 .PHONY: run_cpu_test
 run_cpu_test: build_test
-	$(DETECT_SCRIPT) -l -w $(THIS_DIR) -- "$(THIS_DIR)/$(BENCH_NAME).exe -t cpu"
+	$(DETECT_SCRIPT) $(DETECT_FLAGS) -l -w $(THIS_DIR) -- "$(THIS_DIR)/$(BENCH_NAME).exe -t cpu"
 
 $(BENCH_NAME).exe: $(UTILS_DIR_COBJECTS) $(UTILS_DIR_CPPOBJECTS) $(TEST_COBJECTS) $(TEST_CPPOBJECTS)
 	$(CC) $^ $(LDFLAGS) -lm -ldl -o $@
@@ -0,0 +1,93 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that buffers whose canaries come from a canary
+// policy do not cause false overflows. There is a buffer in each size class
+// of the policy, including a class that has no canary before the buffer,
+// and one larger than every class.
+#include "common_test_functions.h"
+
+// The Makefile runs the detector with the canary policy
+// 4096:64:64,65536:0:256, so these fall in its first class, its second
+// class, and neither.
+#define NUM_SIZES 3
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = i;\n"\
+"    }\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t sizes[NUM_SIZES] = {1024, 32768, DEFAULT_BUFFER_SIZE};
+
+    // Check input options.
+    check_opts(argc, argv, "Canary policy without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good canary_policy Test...\n");
+
+    for (int s = 0; s < NUM_SIZES; s++)
+    {
+        cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            sizes[s],  NULL, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        cl_uint len = sizes[s] / sizeof(cl_uint);
+        cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &buffer);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint), &len);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        size_t work_items_to_use = len;
+        printf("Writing %u entries into a buffer of %llu bytes.\n", len,
+                (long long unsigned)sizes[s]);
+        cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+            &work_items_to_use, NULL, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        clFinish(cmd_queue);
+        clReleaseMemObject(buffer);
+    }
+
+    printf("Done Running Good canary_policy Test.\n");
+    return 0;
+}
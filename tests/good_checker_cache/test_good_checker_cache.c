@@ -0,0 +1,130 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that there are no false positives when the detector
+// keeps its compiled checkers in a cache on disk. The test runs in two
+// contexts one after the other. The first context builds the checkers and
+// saves them, and the second loads them from the cache. The data in each
+// context must be unchanged by the checks.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *in, __global uint *out, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        out[i] = in[i] + i;\n"\
+"    }\n"\
+"}\n";
+
+// Create a new context, launch the kernel in it, check its output and tear
+// it down.
+static void run_in_new_context(cl_platform_id platform, cl_device_id device,
+        uint64_t buffer_size)
+{
+    cl_int cl_err;
+    cl_uint len = buffer_size / sizeof(cl_uint);
+    cl_uint *host_buffer = malloc(buffer_size);
+    if (host_buffer == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    for (cl_uint i = 0; i < len; i++)
+        host_buffer[i] = i;
+
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    cl_mem in_buffer = clCreateBuffer(context,
+            CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, buffer_size, host_buffer,
+            &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    // In this case, the output buffer is large enough for the kernel.
+    // This will not create a buffer overflow.
+    cl_mem out_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
+            buffer_size, NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &in_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_mem), &out_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 2, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clFinish(cmd_queue);
+
+    cl_err = clEnqueueReadBuffer(cmd_queue, out_buffer, CL_TRUE, 0,
+            buffer_size, host_buffer, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    for (cl_uint i = 0; i < len; i++)
+    {
+        if (host_buffer[i] != 2 * i)
+        {
+            fprintf(stderr, "Entry %u is %u instead of %u\n", i,
+                    host_buffer[i], 2 * i);
+            exit(-1);
+        }
+    }
+    free(host_buffer);
+
+    clReleaseMemObject(out_buffer);
+    clReleaseMemObject(in_buffer);
+    clReleaseKernel(test_kernel);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(cmd_queue);
+    clReleaseContext(context);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Cached checkers without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+
+    // Run the actual test.
+    printf("\n\nRunning Good checker_cache Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    run_in_new_context(platform, device, buffer_size);
+    run_in_new_context(platform, device, buffer_size);
+
+    printf("Done Running Good checker_cache Test.\n");
+    return 0;
+}
@@ -0,0 +1,128 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that kernels cloned by the application with
+// clCloneKernel() are checked against their own arguments. The clone is
+// given a smaller buffer than the source kernel, and a length that fits it.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = i;\n"\
+"    }\n"\
+"}\n";
+
+#ifdef CL_VERSION_2_1
+// clCloneKernel() first appeared in OpenCL 2.1
+static int device_supports_clone(cl_device_id device)
+{
+    cl_int cl_err;
+    char version[256];
+    int major = 0, minor = 0;
+    cl_err = clGetDeviceInfo(device, CL_DEVICE_VERSION, sizeof(version),
+            version, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    if (sscanf(version, "OpenCL %d.%d", &major, &minor) != 2)
+        return 0;
+    return (major > 2 || (major == 2 && minor >= 1));
+}
+#endif // CL_VERSION_2_1
+
+int main(int argc, char** argv)
+{
+#ifdef CL_VERSION_2_1
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "clCloneKernel without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+
+    if(!device_supports_clone(device))
+    {
+        output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+        printf("clCloneKernel not supported. Skipping Good clone_kernel Test.\n");
+        return 0;
+    }
+
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good clone_kernel Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    size_t work_items_to_use = buffer_size / sizeof(cl_uint);
+    uint64_t small_size = buffer_size / 2;
+    cl_uint small_len = small_size / sizeof(cl_uint);
+    cl_mem large_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        buffer_size,  NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem small_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        small_size,  NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &large_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint), &buffer_size);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    // Changing the clone's arguments must leave test_kernel's alone.
+    cl_kernel clone_kernel = clCloneKernel(test_kernel, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(clone_kernel, 0, sizeof(cl_mem), &small_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(clone_kernel, 1, sizeof(cl_uint), &small_len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    printf("Launching both kernels with %zu work items.\n", work_items_to_use);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, clone_kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    clFinish(cmd_queue);
+    printf("Done Running Good clone_kernel Test.\n");
+#else // CL_VERSION_2_1
+    (void)argc;
+    (void)argv;
+    output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+    printf("OpenCL 2.1 not supported. Skipping Good clone_kernel Test.\n");
+#endif // CL_VERSION_2_1
+    return 0;
+}
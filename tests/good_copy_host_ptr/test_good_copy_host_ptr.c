@@ -0,0 +1,128 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that buffers whose contents are copied from the host
+// when they are created hold exactly that data, and that the copy does not
+// cause false overflows. The host memory is changed right after each buffer
+// is created, which must not reach the buffer.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] += 1;\n"\
+"    }\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "CL_MEM_COPY_HOST_PTR without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good copy_host_ptr Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    cl_uint *host_data = malloc(buffer_size);
+    if (host_data == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_uint *host_copy = malloc(buffer_size);
+    if (host_copy == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // Sizes that are and are not multiples of the entry size, with and
+    // without CL_MEM_ALLOC_HOST_PTR.
+    uint64_t sizes[4] = {buffer_size, buffer_size - 2, 4096, 6};
+    cl_mem_flags flags[4] = {CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
+        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR};
+    for (int b = 0; b < 4; b++)
+    {
+        for (cl_uint i = 0; i < buffer_size / sizeof(cl_uint); i++)
+            host_data[i] = i * 3 + b;
+        cl_mem buffer = clCreateBuffer(context, flags[b], sizes[b],
+            host_data, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        memset(host_data, 0xff, buffer_size);
+
+        // Only whole entries are written by the kernel.
+        cl_uint len = sizes[b] / sizeof(cl_uint);
+        cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &buffer);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint), &len);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        size_t work_items_to_use = len;
+        printf("Launching %zu work items on a buffer of %llu bytes.\n",
+                work_items_to_use, (long long unsigned)sizes[b]);
+        cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+            &work_items_to_use, NULL, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        cl_err = clEnqueueReadBuffer(cmd_queue, buffer, CL_TRUE, 0, sizes[b],
+                host_copy, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        for (cl_uint i = 0; i < len; i++)
+        {
+            if (host_copy[i] != i * 3 + b + 1)
+            {
+                fprintf(stderr, "Buffer %d entry %u is %u instead of %u at "
+                        "%s:%d\n", b, i, host_copy[i], i * 3 + b + 1,
+                        __FILE__, __LINE__);
+                exit(-1);
+            }
+        }
+        clReleaseMemObject(buffer);
+    }
+    free(host_copy);
+
+    clFinish(cmd_queue);
+    free(host_data);
+    printf("Done Running Good copy_host_ptr Test.\n");
+    return 0;
+}
@@ -0,0 +1,124 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that putting checks off until the application
+// synchronizes does not find false overflows. Several launches share two
+// buffers, one of which is released before any synchronization, and the
+// other is read back to check what the launches wrote.
+#include "common_test_functions.h"
+
+#define NUM_LAUNCHES 6
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len, uint val) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = i + val;\n"\
+"    }\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Deferred checks without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good deferred_check Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    cl_mem kept_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        buffer_size,  NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem released_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        buffer_size,  NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_uint released_len = buffer_size / sizeof(cl_uint);
+    cl_uint kept_len = buffer_size / sizeof(cl_uint);
+    size_t work_items_to_use = buffer_size / sizeof(cl_uint);
+
+    // Launches alternate between the two buffers. None of them waits for
+    // another, so their checks all pile up in one window.
+    for (cl_uint i = 0; i < NUM_LAUNCHES; i++)
+    {
+        cl_mem *buffer = (i % 2) ? &released_buffer : &kept_buffer;
+        cl_uint len = (i % 2) ? released_len : kept_len;
+        cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), buffer);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint), &len);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 2, sizeof(cl_uint), &i);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        printf("Launch %u writes %u entries.\n", i, len);
+        cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+            &work_items_to_use, NULL, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+
+    // The second buffer goes away before the application synchronizes.
+    clReleaseMemObject(released_buffer);
+
+    // A blocking read synchronizes with the queue.
+    cl_uint *host_copy = malloc(buffer_size);
+    if (host_copy == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clEnqueueReadBuffer(cmd_queue, kept_buffer, CL_TRUE, 0,
+            buffer_size, host_copy, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    // The last launch of the first buffer was launch NUM_LAUNCHES - 2.
+    for (cl_uint i = 0; i < kept_len; i++)
+    {
+        if (host_copy[i] != i + NUM_LAUNCHES - 2)
+        {
+            fprintf(stderr, "Entry %u is %u instead of %u at %s:%d\n", i,
+                    host_copy[i], i + NUM_LAUNCHES - 2, __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+    free(host_copy);
+
+    clFinish(cmd_queue);
+    clReleaseMemObject(kept_buffer);
+    printf("Done Running Good deferred_check Test.\n");
+    return 0;
+}
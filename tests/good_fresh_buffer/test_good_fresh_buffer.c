@@ -0,0 +1,159 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that buffers can be used as soon as they are created.
+// The detector fills their canaries without waiting for the device, so each
+// buffer is first used by a kernel on a different queue than the one the
+// detector filled it on. Buffers small enough to share a slab are tested as
+// well as large ones, and a sub-buffer is used after its parent was released.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] += 1;\n"\
+"    }\n"\
+"}\n";
+
+static void add_one(cl_command_queue cmd_queue, cl_kernel kernel,
+        cl_mem buffer, cl_uint len)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+}
+
+// Read len entries back and check that entry i holds i + first.
+static void verify(cl_command_queue cmd_queue, cl_mem buffer, cl_uint len,
+        cl_uint first)
+{
+    cl_int cl_err;
+    cl_uint *host_copy = malloc(len * sizeof(cl_uint));
+    if (host_copy == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clEnqueueReadBuffer(cmd_queue, buffer, CL_TRUE, 0,
+            len * sizeof(cl_uint), host_copy, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    for (cl_uint i = 0; i < len; i++)
+    {
+        if (host_copy[i] != i + first)
+        {
+            fprintf(stderr, "Entry %u is %u instead of %u\n", i,
+                    host_copy[i], i + first);
+            exit(-1);
+        }
+    }
+    free(host_copy);
+}
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Using new buffers without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue launch_queue = setup_cmd_queue(context, device);
+    cl_command_queue read_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good fresh_buffer Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    cl_uint *host_data = malloc(buffer_size);
+    if (host_data == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // In this case, every kernel stays inside its buffer.
+    // This will not create a buffer overflow.
+    uint64_t sizes[3] = {64, 4096, buffer_size};
+    for (int b = 0; b < 3; b++)
+    {
+        cl_uint len = sizes[b] / sizeof(cl_uint);
+        for (cl_uint i = 0; i < len; i++)
+            host_data[i] = i + b;
+        cl_mem buffer = clCreateBuffer(context,
+                CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizes[b],
+                host_data, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        memset(host_data, 0xff, sizes[b]);
+
+        add_one(launch_queue, test_kernel, buffer, len);
+        clFinish(launch_queue);
+        verify(read_queue, buffer, len, b + 1);
+        clReleaseMemObject(buffer);
+    }
+
+    // The parent is gone before its sub-buffer is first used.
+    cl_uint len = buffer_size / sizeof(cl_uint);
+    for (cl_uint i = 0; i < len; i++)
+        host_data[i] = i;
+    cl_mem parent = clCreateBuffer(context,
+            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, buffer_size,
+            host_data, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_buffer_region region;
+    region.origin = 0;
+    region.size = buffer_size / 2;
+    cl_mem sub_buffer = clCreateSubBuffer(parent, CL_MEM_READ_WRITE,
+            CL_BUFFER_CREATE_TYPE_REGION, &region, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clReleaseMemObject(parent);
+
+    add_one(launch_queue, test_kernel, sub_buffer, len / 2);
+    clFinish(launch_queue);
+    verify(read_queue, sub_buffer, len / 2, 1);
+    clReleaseMemObject(sub_buffer);
+
+    clFinish(read_queue);
+    free(host_data);
+    printf("Done Running Good fresh_buffer Test.\n");
+    return 0;
+}
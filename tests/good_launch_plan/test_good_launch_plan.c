@@ -0,0 +1,104 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that a kernel whose arguments change between launches
+// is checked against the buffers it was last given. Each launch gets a
+// buffer and a length that fit each other, so no launch should be found to
+// overflow, even though an earlier launch of the same kernel wrote further.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = i;\n"\
+"    }\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+    uint64_t small_size = DEFAULT_BUFFER_SIZE / 2;
+
+    // Check input options.
+    check_opts(argc, argv, "Changing kernel arguments without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good launch_plan Test...\n");
+    printf("    Using buffer sizes: %llu and %llu\n",
+            (long long unsigned)buffer_size,
+            (long long unsigned)small_size);
+
+    cl_mem large_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        buffer_size,  NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem small_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        small_size,  NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    size_t work_items_to_use = buffer_size / sizeof(cl_uint);
+
+    // Swap the buffer and its length between launches. The length is
+    // changed on its own in the last launch, which shrinks what is written.
+    cl_mem launch_buffers[4] = {large_buffer, small_buffer, large_buffer,
+        large_buffer};
+    cl_uint launch_lens[4] = {buffer_size / sizeof(cl_uint),
+        small_size / sizeof(cl_uint), buffer_size / sizeof(cl_uint),
+        small_size / sizeof(cl_uint)};
+    for (int i = 0; i < 4; i++)
+    {
+        cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem),
+                &launch_buffers[i]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint),
+                &launch_lens[i]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        printf("Launch %d writes %llu entries into a %s buffer.\n", i,
+                (long long unsigned)launch_lens[i],
+                (launch_buffers[i] == small_buffer) ? "small" : "large");
+        cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+            &work_items_to_use, NULL, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+
+    clFinish(cmd_queue);
+    printf("Done Running Good launch_plan Test.\n");
+    return 0;
+}
@@ -0,0 +1,117 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that a kernel with many arguments, a __local argument
+// and a large structure by value can be checked without the detector finding
+// a false overflow.
+#include "common_test_functions.h"
+
+#define NUM_BUFFERS 8
+
+// The structure is passed by value, so it is copied into the kernel
+// arguments along with the buffers.
+typedef struct test_params_
+{
+    cl_uint lens[NUM_BUFFERS];
+    cl_uint pad[24];
+} test_params;
+
+const char *kernel_source = "\n"\
+"typedef struct test_params_ {\n"\
+"    uint lens[8];\n"\
+"    uint pad[24];\n"\
+"} test_params;\n"\
+"\n"\
+"__kernel void test(__global uint *b0, __global uint *b1,\n"\
+"        __global uint *b2, __global uint *b3, __global uint *b4,\n"\
+"        __global uint *b5, __global uint *b6, __global uint *b7,\n"\
+"        __local uint *scratch, test_params params) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    scratch[get_local_id(0) % 64] = i;\n"\
+"    if (i < params.lens[0]) b0[i] = i;\n"\
+"    if (i < params.lens[1]) b1[i] = i;\n"\
+"    if (i < params.lens[2]) b2[i] = i;\n"\
+"    if (i < params.lens[3]) b3[i] = i;\n"\
+"    if (i < params.lens[4]) b4[i] = i;\n"\
+"    if (i < params.lens[5]) b5[i] = i;\n"\
+"    if (i < params.lens[6]) b6[i] = i;\n"\
+"    if (i < params.lens[7]) b7[i] = scratch[get_local_id(0) % 64];\n"\
+"}\n";
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE / NUM_BUFFERS;
+
+    // Check input options.
+    check_opts(argc, argv, "Many kernel arguments without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good many_args Test...\n");
+    printf("    Using %d buffers of size: %llu\n", NUM_BUFFERS,
+            (long long unsigned)buffer_size);
+
+    test_params params;
+    memset(&params, 0, sizeof(test_params));
+    for (int i = 0; i < NUM_BUFFERS; i++)
+    {
+        cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            buffer_size,  NULL, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, i, sizeof(cl_mem), &buffer);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        params.lens[i] = buffer_size / sizeof(cl_uint);
+    }
+    cl_err = clSetKernelArg(test_kernel, NUM_BUFFERS, 64 * sizeof(cl_uint),
+            NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, NUM_BUFFERS + 1, sizeof(test_params),
+            &params);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    size_t work_items_to_use = buffer_size / sizeof(cl_uint);
+    printf("Launching %zu work items to write %zu entries in each buffer.\n",
+            work_items_to_use, work_items_to_use);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    clFinish(cmd_queue);
+    printf("Done Running Good many_args Test.\n");
+    return 0;
+}
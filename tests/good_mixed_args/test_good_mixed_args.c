@@ -0,0 +1,237 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that a kernel given a cl_mem buffer, an SVM
+// allocation, and an image at the same time has no false positives, and that
+// checking all of their canaries together leaves the data in each of them
+// unchanged.
+#include "common_test_functions.h"
+
+#define IMAGE_WIDTH 256
+#define IMAGE_HEIGHT 256
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *buffer, uint buffer_len,\n"\
+"                   __global uint *svm_buffer, uint svm_len,\n"\
+"                   write_only image2d_t image, uint width, uint height) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < buffer_len) {\n"\
+"        buffer[i] = i;\n"\
+"    }\n"\
+"    if (i < svm_len) {\n"\
+"        svm_buffer[i] = i;\n"\
+"    }\n"\
+"    if (i < width * height) {\n"\
+"        int2 coord = {i % width, i / width};\n"\
+"        write_imageui(image, coord, (uint4)(i));\n"\
+"    }\n"\
+"}\n";
+
+#ifdef CL_VERSION_2_0
+static void launch(cl_command_queue cmd_queue, cl_kernel kernel,
+        cl_mem buffer, void *svm, cl_mem image, cl_uint len)
+{
+    cl_int cl_err;
+    cl_uint width = IMAGE_WIDTH;
+    cl_uint height = IMAGE_HEIGHT;
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArgSVMPointer(kernel, 2, svm);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 3, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 4, sizeof(cl_mem), &image);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 5, sizeof(cl_uint), &width);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 6, sizeof(cl_uint), &height);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clFinish(cmd_queue);
+}
+
+static cl_mem create_image(cl_context context)
+{
+    cl_int cl_err;
+    cl_image_desc description;
+    memset(&description, 0, sizeof(cl_image_desc));
+    description.image_type = CL_MEM_OBJECT_IMAGE2D;
+    description.image_width = IMAGE_WIDTH;
+    description.image_height = IMAGE_HEIGHT;
+    description.image_array_size = 1;
+
+    // Each image entry is a single channel made of 4-byte uints.
+    cl_image_format format;
+    format.image_channel_order = CL_R;
+    format.image_channel_data_type = CL_UNSIGNED_INT32;
+
+    cl_mem image = clCreateImage(context, CL_MEM_WRITE_ONLY, &format,
+            &description, NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    return image;
+}
+
+static void *svm_alloc(cl_context context, uint64_t size)
+{
+    void *svm = clSVMAlloc(context, CL_MEM_READ_WRITE, size, 0);
+    if (svm == NULL)
+    {
+        fprintf(stderr, "clSVMAlloc near %s:%d failed.\n", __FILE__,
+                __LINE__);
+        exit(-1);
+    }
+    return svm;
+}
+
+static void verify(cl_command_queue cmd_queue, cl_mem buffer, void *svm,
+        cl_mem image, cl_uint len)
+{
+    cl_int cl_err;
+    cl_uint *host_buffer = malloc(len * sizeof(cl_uint));
+    if (host_buffer == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clEnqueueReadBuffer(cmd_queue, buffer, CL_TRUE, 0,
+            len * sizeof(cl_uint), host_buffer, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    for (cl_uint i = 0; i < len; i++)
+    {
+        if (host_buffer[i] != i)
+        {
+            fprintf(stderr, "Buffer entry %u is %u instead of %u\n", i,
+                    host_buffer[i], i);
+            exit(-1);
+        }
+    }
+
+    cl_err = clEnqueueSVMMap(cmd_queue, CL_TRUE, CL_MAP_READ, svm,
+            len * sizeof(cl_uint), 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_uint *svm_uints = (cl_uint *)svm;
+    for (cl_uint i = 0; i < len; i++)
+    {
+        if (svm_uints[i] != i)
+        {
+            fprintf(stderr, "SVM entry %u is %u instead of %u\n", i,
+                    svm_uints[i], i);
+            exit(-1);
+        }
+    }
+    cl_err = clEnqueueSVMUnmap(cmd_queue, svm, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {IMAGE_WIDTH, IMAGE_HEIGHT, 1};
+    cl_err = clEnqueueReadImage(cmd_queue, image, CL_TRUE, origin, region,
+            0, 0, host_buffer, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    for (cl_uint i = 0; i < IMAGE_WIDTH * IMAGE_HEIGHT; i++)
+    {
+        if (host_buffer[i] != i)
+        {
+            fprintf(stderr, "Image entry %u is %u instead of %u\n", i,
+                    host_buffer[i], i);
+            exit(-1);
+        }
+    }
+    free(host_buffer);
+}
+#endif // CL_VERSION_2_0
+
+int main(int argc, char** argv)
+{
+#ifdef CL_VERSION_2_0
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+    cl_int cl_err;
+
+    // Check input options.
+    check_opts(argc, argv, "Mixed buffer, SVM, and image args without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    if (images_are_broken(device))
+    {
+        output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+        printf("This device does not properly support an implementation of ");
+        printf("OpenCL images. As such, we cannot test them.\n");
+        printf("Skipping Good mixed_args Test.\n");
+        return 0;
+    }
+    if(!device_supports_svm(device, 0))
+    {
+        output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+        printf("Coarse-grained SVM not supported. Skipping Good mixed_args Test.\n");
+        return 0;
+    }
+
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good mixed_args Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    cl_uint len = buffer_size / sizeof(cl_uint);
+    cl_mem image = create_image(context);
+
+    // In this case, every region is large enough for the kernel. We launch
+    // twice on the same arguments so that the second check runs on canaries
+    // that were reset by the first one.
+    // This will not create a buffer overflow.
+    cl_mem good_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            buffer_size, NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    void *good_svm = svm_alloc(context, buffer_size);
+    for (int launch_num = 0; launch_num < 2; launch_num++)
+        launch(cmd_queue, test_kernel, good_buffer, good_svm, image, len);
+    verify(cmd_queue, good_buffer, good_svm, image, len);
+
+    clSVMFree(context, good_svm);
+    clReleaseMemObject(good_buffer);
+    clReleaseMemObject(image);
+    printf("Done Running Good mixed_args Test.\n");
+#else // CL_VERSION_2_0
+    (void)argc;
+    (void)argv;
+    output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+    printf("OpenCL 2.0 not supported. Skipping Good mixed_args Test.\n");
+#endif // CL_VERSION_2_0
+    return 0;
+}
@@ -0,0 +1,147 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that buffers whose sizes are not a multiple of the
+// number of canary bytes the detector compares at once have no false
+// positives. Every byte of each buffer is written, so the data must end
+// right where the canary begins, and that data must be unchanged by the
+// checks.
+#include "common_test_functions.h"
+
+#define NUM_BUFFERS 6
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uchar *b0, __global uchar *b1,\n"\
+"                   __global uchar *b2, __global uchar *b3,\n"\
+"                   __global uchar *b4, __global uchar *b5,\n"\
+"                   uint l0, uint l1, uint l2, uint l3, uint l4, uint l5) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    uchar value = (uchar)(i * 7 + 1);\n"\
+"    if (i < l0) b0[i] = value;\n"\
+"    if (i < l1) b1[i] = value;\n"\
+"    if (i < l2) b2[i] = value;\n"\
+"    if (i < l3) b3[i] = value;\n"\
+"    if (i < l4) b4[i] = value;\n"\
+"    if (i < l5) b5[i] = value;\n"\
+"}\n";
+
+static const uint64_t buffer_sizes[NUM_BUFFERS] = {
+    4, 13, 1000, 4101, 65541, DEFAULT_BUFFER_SIZE + 3
+};
+
+static void launch(cl_command_queue cmd_queue, cl_kernel kernel,
+        cl_mem *buffers, const cl_uint *lens)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = 0;
+    for (int b = 0; b < NUM_BUFFERS; b++)
+    {
+        cl_err = clSetKernelArg(kernel, b, sizeof(cl_mem), &buffers[b]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(kernel, NUM_BUFFERS + b, sizeof(cl_uint),
+                &lens[b]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        if (lens[b] > work_items_to_use)
+            work_items_to_use = lens[b];
+    }
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clFinish(cmd_queue);
+}
+
+static void verify(cl_command_queue cmd_queue, cl_mem buffer, cl_uint len)
+{
+    cl_int cl_err;
+    cl_uchar *host_buffer = malloc(len);
+    if (host_buffer == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clEnqueueReadBuffer(cmd_queue, buffer, CL_TRUE, 0, len,
+            host_buffer, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    for (cl_uint i = 0; i < len; i++)
+    {
+        cl_uchar expected = (cl_uchar)(i * 7 + 1);
+        if (host_buffer[i] != expected)
+        {
+            fprintf(stderr, "Entry %u of a %u byte buffer is %u instead of "
+                    "%u\n", i, len, host_buffer[i], expected);
+            exit(-1);
+        }
+    }
+    free(host_buffer);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    cl_int cl_err;
+
+    // Check input options.
+    check_opts(argc, argv, "Odd buffer sizes without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good odd_sizes Test...\n");
+
+    cl_mem buffers[NUM_BUFFERS];
+    cl_uint lens[NUM_BUFFERS];
+    for (int b = 0; b < NUM_BUFFERS; b++)
+    {
+        printf("    Using buffer size: %llu\n",
+                (long long unsigned)buffer_sizes[b]);
+        buffers[b] = clCreateBuffer(context, CL_MEM_READ_WRITE,
+                buffer_sizes[b], NULL, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        lens[b] = buffer_sizes[b];
+    }
+
+    // In this case, the kernel writes exactly the bytes of each buffer.
+    // Launching twice checks the canaries again after the first check.
+    // This will not create a buffer overflow.
+    launch(cmd_queue, test_kernel, buffers, lens);
+    launch(cmd_queue, test_kernel, buffers, lens);
+    for (int b = 0; b < NUM_BUFFERS; b++)
+        verify(cmd_queue, buffers[b], lens[b]);
+
+    for (int b = 0; b < NUM_BUFFERS; b++)
+        clReleaseMemObject(buffers[b]);
+    printf("Done Running Good odd_sizes Test.\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that buffers padded by the detector keep the access
+// flags the application gave them, and that using them as the application
+// meant does not cause false overflows.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global const uint *input, __global uint *output,\n"\
+"        uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        output[i] = input[i % 16] + 1;\n"\
+"    }\n"\
+"}\n";
+
+static void check_flags(cl_mem buffer, cl_mem_flags expected)
+{
+    cl_int cl_err;
+    cl_mem_flags flags;
+    const cl_mem_flags access = CL_MEM_READ_WRITE | CL_MEM_WRITE_ONLY |
+        CL_MEM_READ_ONLY;
+    cl_err = clGetMemObjectInfo(buffer, CL_MEM_FLAGS, sizeof(cl_mem_flags),
+            &flags, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    if ((flags & access) != (expected & access))
+    {
+        fprintf(stderr, "Buffer has flags %llx instead of %llx at %s:%d\n",
+                (long long unsigned)(flags & access),
+                (long long unsigned)(expected & access), __FILE__, __LINE__);
+        exit(-1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Preserved buffer flags without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good preserve_flags Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    cl_uint input_data[16];
+    for (cl_uint i = 0; i < 16; i++)
+        input_data[i] = i;
+    cl_mem_flags input_flags = CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR;
+    cl_mem_flags output_flags = CL_MEM_WRITE_ONLY;
+    cl_mem input = clCreateBuffer(context, input_flags, sizeof(input_data),
+        input_data, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem output = clCreateBuffer(context, output_flags, buffer_size,
+        NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    check_flags(input, input_flags);
+    check_flags(output, output_flags);
+
+    cl_uint len = buffer_size / sizeof(cl_uint);
+    cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem), &input);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_mem), &output);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(test_kernel, 2, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    size_t work_items_to_use = len;
+    printf("Launching %zu work items.\n", work_items_to_use);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_uint *host_copy = malloc(buffer_size);
+    if (host_copy == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clEnqueueReadBuffer(cmd_queue, output, CL_TRUE, 0, buffer_size,
+            host_copy, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    for (cl_uint i = 0; i < len; i++)
+    {
+        if (host_copy[i] != (i % 16) + 1)
+        {
+            fprintf(stderr, "Entry %u is %u instead of %u at %s:%d\n", i,
+                    host_copy[i], (i % 16) + 1, __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+    free(host_copy);
+
+    clFinish(cmd_queue);
+    clReleaseMemObject(output);
+    clReleaseMemObject(input);
+    printf("Done Running Good preserve_flags Test.\n");
+    return 0;
+}
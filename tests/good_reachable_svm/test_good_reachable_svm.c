@@ -0,0 +1,160 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that checking only the SVM that a kernel can reach
+// does not find false overflows. The kernel is given a pointer into the
+// middle of an allocation, and reaches another through a pointer declared
+// with clSetKernelExecInfo(), while many other SVM allocations are alive.
+#include "common_test_functions.h"
+
+#define NUM_ALLOCS 32
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *direct, uint direct_len,\n"\
+"        __global void *table_in, uint indirect_len) {\n"\
+"    __global uint **table = (__global uint**)table_in;\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < direct_len) {\n"\
+"        direct[i] = i;\n"\
+"    }\n"\
+"    if (i < indirect_len) {\n"\
+"        table[0][i] = i;\n"\
+"    }\n"\
+"}\n";
+
+#ifdef CL_VERSION_2_0
+static void launch(cl_command_queue cmd_queue, cl_kernel kernel,
+        void *direct, cl_uint direct_len, cl_uint indirect_len,
+        size_t work_items_to_use)
+{
+    cl_int cl_err;
+    cl_err = clSetKernelArgSVMPointer(kernel, 0, direct);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_uint), &direct_len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 3, sizeof(cl_uint), &indirect_len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    printf("Launching to write %u direct and %u indirect entries.\n",
+            direct_len, indirect_len);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+}
+#endif // CL_VERSION_2_0
+
+int main(int argc, char** argv)
+{
+#ifdef CL_VERSION_2_0
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t alloc_size = DEFAULT_BUFFER_SIZE / 16;
+    uint64_t offset = 1024;
+
+    // Check input options.
+    check_opts(argc, argv, "Reachable SVM without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+
+    if(!device_supports_svm(device, 0))
+    {
+        output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+        printf("Coarse-grained SVM not supported. Skipping Good reachable_svm Test.\n");
+        return 0;
+    }
+
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good reachable_svm Test...\n");
+    printf("    Using %d allocations of size: %llu\n", NUM_ALLOCS,
+            (long long unsigned)alloc_size);
+
+    // Only two of these are used by the kernel, the rest are just alive.
+    void *allocs[NUM_ALLOCS];
+    for (int i = 0; i < NUM_ALLOCS; i++)
+    {
+        allocs[i] = clSVMAlloc(context, CL_MEM_READ_WRITE, alloc_size, 0);
+        if (allocs[i] == NULL)
+        {
+            fprintf(stderr, "clSVMAlloc near %s:%d failed.\n", __FILE__,
+                    __LINE__);
+            exit(-1);
+        }
+    }
+    void **table = clSVMAlloc(context, CL_MEM_READ_WRITE, sizeof(void*), 0);
+    if (table == NULL)
+    {
+        fprintf(stderr, "clSVMAlloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // The table points at one allocation, which the kernel is told about.
+    void *indirect = allocs[NUM_ALLOCS - 1];
+    cl_err = clEnqueueSVMMap(cmd_queue, CL_TRUE, CL_MAP_WRITE, table,
+        sizeof(void*), 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    table[0] = indirect;
+    cl_err = clEnqueueSVMUnmap(cmd_queue, table, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArgSVMPointer(test_kernel, 2, table);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelExecInfo(test_kernel, CL_KERNEL_EXEC_INFO_SVM_PTRS,
+            sizeof(void*), &indirect);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    // The direct pointer starts part way into its allocation.
+    void *direct = (char*)allocs[NUM_ALLOCS / 2] + offset;
+    cl_uint direct_len = (alloc_size - offset) / sizeof(cl_uint);
+    cl_uint indirect_len = alloc_size / sizeof(cl_uint);
+    size_t work_items_to_use = alloc_size / sizeof(cl_uint) + 2;
+
+    launch(cmd_queue, test_kernel, direct, direct_len, 0, work_items_to_use);
+    launch(cmd_queue, test_kernel, direct, 0, indirect_len,
+            work_items_to_use);
+    launch(cmd_queue, test_kernel, direct, direct_len, indirect_len,
+            work_items_to_use);
+
+    clFinish(cmd_queue);
+    for (int i = 0; i < NUM_ALLOCS; i++)
+        clSVMFree(context, allocs[i]);
+    clSVMFree(context, table);
+    printf("Done Running Good reachable_svm Test.\n");
+#else // CL_VERSION_2_0
+    (void)argc;
+    (void)argv;
+    output_fake_errors(OUTPUT_FILE_NAME, EXPECTED_ERRORS);
+    printf("OpenCL 2.0 not supported. Skipping Good reachable_svm Test.\n");
+#endif // CL_VERSION_2_0
+    return 0;
+}
@@ -0,0 +1,182 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that a kernel which only reads a buffer sees what an
+// earlier kernel wrote to it. The buffer is a CL_MEM_USE_HOST_PTR buffer,
+// and the writes first go to the detector's canaried copy of it. The buffer
+// is written whole, and then through a sub-buffer, and each time a kernel
+// taking it as a const argument reads it back.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void write_buffer(__global uint *buffer, uint len, uint val) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        buffer[i] = i + val;\n"\
+"    }\n"\
+"}\n"\
+"__kernel void read_buffer(__global const uint *input,\n"\
+"        __global uint *output, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        output[i] = input[i] * 2;\n"\
+"    }\n"\
+"}\n";
+
+static void read_buffer(cl_command_queue cmd_queue, cl_kernel kernel,
+        cl_mem input, cl_mem output, cl_uint len)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 2, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+}
+
+static void write_buffer(cl_command_queue cmd_queue, cl_kernel kernel,
+        cl_mem buffer, cl_uint len, cl_uint val)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 2, sizeof(cl_uint), &val);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+}
+
+// Read the output back and compare it against what the reading kernel should
+// have found: entries below half were written with first_val, and the rest
+// with second_val starting again from index 0.
+static void verify(cl_command_queue cmd_queue, cl_mem output, cl_uint len,
+        cl_uint first_val, cl_uint second_val)
+{
+    cl_int cl_err;
+    cl_uint half = len / 2;
+    cl_uint *host_copy = malloc(len * sizeof(cl_uint));
+    if (host_copy == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clEnqueueReadBuffer(cmd_queue, output, CL_TRUE, 0,
+            len * sizeof(cl_uint), host_copy, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    for (cl_uint i = 0; i < len; i++)
+    {
+        cl_uint expected = (i < half) ? (i + first_val) * 2 :
+            (i - half + second_val) * 2;
+        if (host_copy[i] != expected)
+        {
+            fprintf(stderr, "Entry %u is %u instead of %u\n", i,
+                    host_copy[i], expected);
+            exit(-1);
+        }
+    }
+    free(host_copy);
+}
+
+int main(int argc, char** argv)
+{
+    cl_int cl_err;
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+
+    // Check input options.
+    check_opts(argc, argv, "Reading a written buffer without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernels
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel write_kernel = setup_kernel(program, "write_buffer");
+    cl_kernel read_kernel = setup_kernel(program, "read_buffer");
+
+    // Run the actual test.
+    printf("\n\nRunning Good read_after_write Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    cl_uint len = buffer_size / sizeof(cl_uint);
+    cl_uint *host_ptr = calloc(buffer_size, 1);
+    if (host_ptr == NULL)
+    {
+        fprintf(stderr, "calloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_mem buffer = clCreateBuffer(context,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, buffer_size, host_ptr,
+        &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem output = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
+        buffer_size,  NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    // The second half of the buffer is also reached through a sub-buffer.
+    cl_buffer_region region;
+    region.origin = buffer_size / 2;
+    region.size = buffer_size / 2;
+    cl_mem sub_buffer = clCreateSubBuffer(buffer, CL_MEM_READ_WRITE,
+            CL_BUFFER_CREATE_TYPE_REGION, &region, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    // In this case, every kernel stays inside its buffers.
+    // This will not create a buffer overflow.
+    // Write the whole buffer, then read it in a kernel that cannot write it.
+    write_buffer(cmd_queue, write_kernel, buffer, len, 5);
+    read_buffer(cmd_queue, read_kernel, buffer, output, len);
+    verify(cmd_queue, output, len, 5, 5 + len / 2);
+
+    // Now write only its second half, through the sub-buffer. Reading the
+    // sub-buffer and the whole buffer must both see the new values.
+    write_buffer(cmd_queue, write_kernel, sub_buffer, len / 2, 7);
+    read_buffer(cmd_queue, read_kernel, sub_buffer, output, len / 2);
+    verify(cmd_queue, output, len / 2, 7, 7 + len / 4);
+    read_buffer(cmd_queue, read_kernel, buffer, output, len);
+    verify(cmd_queue, output, len, 5, 7);
+
+    clFinish(cmd_queue);
+    clReleaseMemObject(sub_buffer);
+    clReleaseMemObject(output);
+    clReleaseMemObject(buffer);
+    free(host_ptr);
+    printf("Done Running Good read_after_write Test.\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that checking many launches in a row, reusing the
+// detector's temporary checking memory, does not find false overflows. The
+// launches run in two contexts one after the other.
+#include "common_test_functions.h"
+
+#define NUM_BUFFERS 3
+#define NUM_LAUNCHES 20
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = i;\n"\
+"    }\n"\
+"}\n";
+
+// Run NUM_LAUNCHES launches over NUM_BUFFERS buffers in a new context. If
+// bad_launch is below NUM_LAUNCHES, that launch overflows its buffer.
+static void run_launches(cl_platform_id platform, cl_device_id device,
+        uint64_t buffer_size, int bad_launch)
+{
+    cl_int cl_err;
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // The context is held twice, and must only be torn down on the last
+    // release.
+    cl_err = clRetainContext(context);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+
+    cl_mem buffers[NUM_BUFFERS];
+    for (int b = 0; b < NUM_BUFFERS; b++)
+    {
+        buffers[b] = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            buffer_size,  NULL, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+
+    cl_uint good_len = buffer_size / sizeof(cl_uint);
+    cl_uint bad_len = good_len + 1;
+    size_t work_items_to_use = bad_len;
+    for (int i = 0; i < NUM_LAUNCHES; i++)
+    {
+        cl_err = clSetKernelArg(test_kernel, 0, sizeof(cl_mem),
+                &buffers[i % NUM_BUFFERS]);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(test_kernel, 1, sizeof(cl_uint),
+                (i == bad_launch) ? &bad_len : &good_len);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clEnqueueNDRangeKernel(cmd_queue, test_kernel, 1, NULL,
+            &work_items_to_use, NULL, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+    }
+    clFinish(cmd_queue);
+
+    for (int b = 0; b < NUM_BUFFERS; b++)
+        clReleaseMemObject(buffers[b]);
+    clReleaseKernel(test_kernel);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(cmd_queue);
+    clReleaseContext(context);
+    clReleaseContext(context);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE / 4;
+
+    // Check input options.
+    check_opts(argc, argv, "Repeated checks without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+
+    // Run the actual test.
+    printf("\n\nRunning Good repeat_check Test...\n");
+    printf("    Using %d launches on buffers of size: %llu\n", NUM_LAUNCHES,
+            (long long unsigned)buffer_size);
+
+    run_launches(platform, device, buffer_size, NUM_LAUNCHES);
+    run_launches(platform, device, buffer_size, NUM_LAUNCHES);
+
+    printf("Done Running Good repeat_check Test.\n");
+    return 0;
+}
@@ -0,0 +1,143 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that there are no false positives when the detector
+// places cl_mem buffers in SVM and checks their canaries in place. A kernel
+// is given one such buffer and one USE_HOST_PTR buffer, whose canaries are
+// still copied out to be checked. The data in both must be unchanged by the
+// checks.
+#include "common_test_functions.h"
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *buffer, __global uint *host_buffer,\n"\
+"                   uint buffer_len, uint host_len) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < buffer_len) {\n"\
+"        buffer[i] = i;\n"\
+"    }\n"\
+"    if (i < host_len) {\n"\
+"        host_buffer[i] += i;\n"\
+"    }\n"\
+"}\n";
+
+static void launch(cl_command_queue cmd_queue, cl_kernel kernel,
+        cl_mem buffer, cl_mem host_buffer, cl_uint len)
+{
+    cl_int cl_err;
+    size_t work_items_to_use = len;
+    cl_err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &host_buffer);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 2, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clSetKernelArg(kernel, 3, sizeof(cl_uint), &len);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_err = clEnqueueNDRangeKernel(cmd_queue, kernel, 1, NULL,
+        &work_items_to_use, NULL, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    clFinish(cmd_queue);
+}
+
+static void verify(cl_command_queue cmd_queue, cl_mem buffer,
+        cl_uint len, cl_uint scale)
+{
+    cl_int cl_err;
+    cl_uint *host_copy = malloc(len * sizeof(cl_uint));
+    if (host_copy == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    cl_err = clEnqueueReadBuffer(cmd_queue, buffer, CL_TRUE, 0,
+            len * sizeof(cl_uint), host_copy, 0, NULL, NULL);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    for (cl_uint i = 0; i < len; i++)
+    {
+        if (host_copy[i] != i * scale)
+        {
+            fprintf(stderr, "Entry %u is %u instead of %u\n", i,
+                    host_copy[i], i * scale);
+            exit(-1);
+        }
+    }
+    free(host_copy);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE;
+    cl_int cl_err;
+
+    // Check input options.
+    check_opts(argc, argv, "SVM-backed buffers without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+    cl_command_queue cmd_queue = setup_cmd_queue(context, device);
+
+    // Build the program and kernel
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+    cl_kernel test_kernel = setup_kernel(program, "test");
+
+    // Run the actual test.
+    printf("\n\nRunning Good svm_backed Test...\n");
+    printf("    Using buffer size: %llu\n", (long long unsigned)buffer_size);
+
+    cl_uint len = buffer_size / sizeof(cl_uint);
+
+    cl_uint *host_ptr = calloc(buffer_size, 1);
+    if (host_ptr == NULL)
+    {
+        fprintf(stderr, "calloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // In this case, both buffers are large enough for the kernel. It is
+    // launched twice, so the USE_HOST_PTR buffer ends up holding 2*i.
+    // This will not create a buffer overflow.
+    cl_mem good_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+            buffer_size, NULL, &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    cl_mem good_host_buffer = clCreateBuffer(context,
+            CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, buffer_size, host_ptr,
+            &cl_err);
+    check_cl_error(__FILE__, __LINE__, cl_err);
+    launch(cmd_queue, test_kernel, good_buffer, good_host_buffer, len);
+    launch(cmd_queue, test_kernel, good_buffer, good_host_buffer, len);
+    verify(cmd_queue, good_buffer, len, 1);
+    verify(cmd_queue, good_host_buffer, len, 2);
+
+    clReleaseMemObject(good_host_buffer);
+    clReleaseMemObject(good_buffer);
+    free(host_ptr);
+    printf("Done Running Good svm_backed Test.\n");
+    return 0;
+}
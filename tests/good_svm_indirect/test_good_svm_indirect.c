@@ -108,8 +108,16 @@ int main(int argc, char** argv)
     check_cl_error(__FILE__, __LINE__, cl_err);
 
     // Allocate a sub-buffer into each of these base buffer entries.
+    // The kernel only reaches them through base_buffer, so they are also
+    // kept here to declare them to the runtime.
     unsigned int i;
     cl_uint *temp_len = (cl_uint *)base_lengths;
+    void **indirect_ptrs = malloc(sizeof(void*) * num_sets);
+    if (indirect_ptrs == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
     for (i = 0; i < num_sets; i++)
     {
         base_buffer[i] = clSVMAlloc(context, CL_MEM_READ_WRITE,
@@ -120,6 +128,7 @@ int main(int argc, char** argv)
                     __LINE__);
             exit(-1);
         }
+        indirect_ptrs[i] = base_buffer[i];
         temp_len[i] = buffer_size;
     }
 
@@ -137,6 +146,11 @@ int main(int argc, char** argv)
     check_cl_error(__FILE__, __LINE__, cl_err);
     cl_err = clSetKernelArgSVMPointer(test_kernel, 2, base_lengths);
     check_cl_error(__FILE__, __LINE__, cl_err);
+    // SVM that is not a kernel argument must be declared before the kernel
+    // can use it.
+    cl_err = clSetKernelExecInfo(test_kernel, CL_KERNEL_EXEC_INFO_SVM_PTRS,
+            sizeof(void*) * num_sets, indirect_ptrs);
+    check_cl_error(__FILE__, __LINE__, cl_err);
 
     size_t work_items_to_use = num_sets;
 
@@ -146,6 +160,7 @@ int main(int argc, char** argv)
     check_cl_error(__FILE__, __LINE__, cl_err);
 
     clFinish(cmd_queue);
+    free(indirect_ptrs);
     printf("Done Running Good Indirect SVM Test.\n");
 #else // CL_VERSION_2_0
     (void)argc;
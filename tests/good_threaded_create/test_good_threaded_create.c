@@ -0,0 +1,149 @@
+/********************************************************************************
+ * Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ********************************************************************************/
+
+
+// A test to make sure that buffers several threads create at once are set
+// up correctly and do not cause false overflows. Each thread makes, fills
+// and reads back its own buffers.
+#include "common_test_functions.h"
+#include <pthread.h>
+
+#define NUM_THREADS 4
+#define BUFFERS_PER_THREAD 8
+
+const char *kernel_source = "\n"\
+"__kernel void test(__global uint *cl_mem_buffer, uint len, uint val) {\n"\
+"    uint i = get_global_id(0);\n"\
+"    if (i < len) {\n"\
+"        cl_mem_buffer[i] = val;\n"\
+"    }\n"\
+"}\n";
+
+typedef struct thread_args_
+{
+    cl_context context;
+    cl_command_queue cmd_queue;
+    cl_kernel kernel;
+    uint64_t buffer_size;
+    cl_uint thread_num;
+} thread_args;
+
+static void *create_and_fill(void *in)
+{
+    thread_args *args = (thread_args*)in;
+    cl_int cl_err;
+    cl_uint len = args->buffer_size / sizeof(cl_uint);
+    cl_uint *host_copy = malloc(args->buffer_size);
+    if (host_copy == NULL)
+    {
+        fprintf(stderr, "malloc near %s:%d failed.\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    for (cl_uint b = 0; b < BUFFERS_PER_THREAD; b++)
+    {
+        cl_mem buffer = clCreateBuffer(args->context, CL_MEM_READ_WRITE,
+            args->buffer_size,  NULL, &cl_err);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        cl_uint val = args->thread_num * BUFFERS_PER_THREAD + b;
+        size_t work_items_to_use = len;
+        cl_err = clSetKernelArg(args->kernel, 0, sizeof(cl_mem), &buffer);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(args->kernel, 1, sizeof(cl_uint), &len);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clSetKernelArg(args->kernel, 2, sizeof(cl_uint), &val);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        cl_err = clEnqueueNDRangeKernel(args->cmd_queue, args->kernel, 1,
+            NULL, &work_items_to_use, NULL, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+
+        cl_err = clEnqueueReadBuffer(args->cmd_queue, buffer, CL_TRUE, 0,
+                args->buffer_size, host_copy, 0, NULL, NULL);
+        check_cl_error(__FILE__, __LINE__, cl_err);
+        for (cl_uint i = 0; i < len; i++)
+        {
+            if (host_copy[i] != val)
+            {
+                fprintf(stderr, "Entry %u is %u instead of %u at %s:%d\n", i,
+                        host_copy[i], val, __FILE__, __LINE__);
+                exit(-1);
+            }
+        }
+        clFinish(args->cmd_queue);
+        clReleaseMemObject(buffer);
+    }
+    free(host_copy);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t platform_to_use = 0;
+    uint32_t device_to_use = 0;
+    cl_device_type dev_type = CL_DEVICE_TYPE_DEFAULT;
+    uint64_t buffer_size = DEFAULT_BUFFER_SIZE / NUM_THREADS;
+
+    // Check input options.
+    check_opts(argc, argv, "Buffers created by many threads without Overflow",
+            &platform_to_use, &device_to_use, &dev_type);
+
+    // Set up the OpenCL environment.
+    cl_platform_id platform = setup_platform(platform_to_use);
+    cl_device_id device = setup_device(device_to_use, platform_to_use,
+            platform, dev_type);
+    cl_context context = setup_context(platform, device);
+
+    // Build the program. Each thread gets its own queue and kernel, since
+    // kernel arguments cannot be set from several threads at once.
+    cl_program program = setup_program(context, 1, &kernel_source, device);
+
+    // Run the actual test.
+    printf("\n\nRunning Good threaded_create Test...\n");
+    printf("    Using %d threads making %d buffers of size: %llu\n",
+            NUM_THREADS, BUFFERS_PER_THREAD, (long long unsigned)buffer_size);
+
+    pthread_t threads[NUM_THREADS];
+    thread_args args[NUM_THREADS];
+    for (cl_uint t = 0; t < NUM_THREADS; t++)
+    {
+        args[t].context = context;
+        args[t].cmd_queue = setup_cmd_queue(context, device);
+        args[t].kernel = setup_kernel(program, "test");
+        args[t].buffer_size = buffer_size;
+        args[t].thread_num = t;
+    }
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        if (pthread_create(&threads[t], NULL, create_and_fill, &args[t]))
+        {
+            fprintf(stderr, "pthread_create near %s:%d failed.\n", __FILE__,
+                    __LINE__);
+            exit(-1);
+        }
+    }
+    for (int t = 0; t < NUM_THREADS; t++)
+        pthread_join(threads[t], NULL);
+
+    printf("Done Running Good threaded_create Test.\n");
+    return 0;
+}